@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/utilite/UObjDeletionThread.h"
 #include "rtabmap/utilite/UFile.h"
 #include "rtabmap/utilite/UConversion.h"
+#include "rtabmap/utilite/UTrace.h"
 
 #include <vtkObject.h>
 
@@ -71,6 +72,7 @@ int main(int argc, char* argv[])
     app->installEventFilter(mainWindow); // to catch FileOpen events.
     
     std::string database;
+    std::string tracePath;
     for(int i=1; i<argc; ++i)
     {
         std::string value = uReplaceChar(argv[i], '~', UDirectory::homeDir());
@@ -79,6 +81,11 @@ int main(int argc, char* argv[])
         {
             database = value;
         }
+        else if((strcmp(argv[i], "--trace") == 0 || strcmp(argv[i], "-trace") == 0) && i+1<argc)
+        {
+            tracePath = uReplaceChar(argv[++i], '~', UDirectory::homeDir());
+            UTrace::setEnabled(true);
+        }
     }
 
 	printf("Program started...\n");
@@ -123,6 +130,12 @@ int main(int argc, char* argv[])
 	delete rtabmap;
 	delete mainWindow;
 	delete app;
+
+	if(!tracePath.empty())
+	{
+		UTrace::setEnabled(false);
+		printf("Saving trace \"%s\"... %s\n", tracePath.c_str(), UTrace::exportChromeTrace(tracePath)?"done!":"failed!");
+	}
 	printf("All done!\n");
 
     return 0;
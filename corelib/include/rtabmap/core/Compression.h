@@ -31,7 +31,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
 
 #include <rtabmap/utilite/UThread.h>
+#include <rtabmap/utilite/UMutex.h>
+#include <rtabmap/utilite/USemaphore.h>
 #include <opencv2/opencv.hpp>
+#include <memory>
+#include <list>
 
 namespace rtabmap {
 
@@ -70,6 +74,64 @@ private:
 	bool compressMode_;
 };
 
+/**
+ * Compression task done by a CompressionPool.
+ */
+class RTABMAP_EXP CompressionJob
+{
+public:
+	// format : ".png" ".jpg" "" (empty is general)
+	CompressionJob(const cv::Mat & mat, const std::string & format = "");
+	// Wait until the data is compressed. Should be called by only one thread.
+	const cv::Mat & getCompressedData();
+
+private:
+	friend class CompressionPool;
+	friend class CompressionWorker;
+	void process();
+
+private:
+	cv::Mat uncompressedData_;
+	cv::Mat compressedData_;
+	std::string format_;
+	USemaphore done_;
+	bool waited_;
+};
+
+/**
+ * Long-lived worker threads compressing data, to avoid
+ * creating a CompressionThread for each data to compress.
+ *
+ * Example:
+ *   CompressionPool pool(4);
+ *   std::shared_ptr<CompressionJob> job = pool.compress(image, ".jpg");
+ *   ... // do something else
+ *   cv::Mat bytes = job->getCompressedData();
+ */
+class RTABMAP_EXP CompressionPool
+{
+public:
+	// If more than maxQueueSize jobs are waiting (0=unlimited), new jobs are
+	// done directly in the caller's thread to limit the memory used.
+	CompressionPool(int threads = 4, int maxQueueSize = 16);
+	virtual ~CompressionPool();
+
+	// format : ".png" ".jpg" "" (empty is general)
+	std::shared_ptr<CompressionJob> compress(const cv::Mat & mat, const std::string & format = "");
+	int queueSize() const;
+
+private:
+	friend class CompressionWorker;
+	std::shared_ptr<CompressionJob> takeJob();
+
+private:
+	std::list<std::shared_ptr<CompressionJob> > queue_;
+	mutable UMutex queueMutex_;
+	USemaphore jobAdded_;
+	std::vector<UThread*> workers_;
+	int maxQueueSize_;
+};
+
 std::vector<unsigned char> RTABMAP_EXP compressImage(const cv::Mat & image, const std::string & format = ".png");
 cv::Mat RTABMAP_EXP compressImage2(const cv::Mat & image, const std::string & format = ".png");
 
@@ -49,6 +49,9 @@ public:
 	void setCacheSize(unsigned int cacheSize);
 	void setSynchronous(int synchronous);
 	void setTempStore(int tempStore);
+	void setIncrementalVacuum(int pages);
+	void setDataSharded(bool dataSharded);
+	void setReadConnections(int readConnections);
 
 protected:
 	virtual bool connectDatabaseQuery(const std::string & url, bool overwritten = false);
@@ -77,6 +80,9 @@ protected:
 	virtual std::map<int, std::vector<int> > getAllStatisticsWmStatesQuery() const;
 
 	virtual void executeNoResultQuery(const std::string & sql) const;
+	virtual void reclaimFreePagesQuery() const;
+	virtual bool acquireReadConnection() const;
+	virtual void releaseReadConnection() const;
 
 	virtual void getWeightQuery(int signatureId, int & weight) const;
 
@@ -132,11 +138,12 @@ protected:
 	// Load objects
 	virtual void loadQuery(VWDictionary * dictionary, bool lastStateOnly = true) const;
 	virtual void loadLastNodesQuery(std::list<Signature *> & signatures) const;
-	virtual void loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & signatures) const;
+	virtual void loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & signatures, bool featuresOnDemand = false) const;
 	virtual void loadWordsQuery(const std::set<int> & wordIds, std::list<VisualWord *> & vws) const;
 	virtual void loadLinksQuery(int signatureId, std::multimap<int, Link> & links, Link::Type type = Link::kUndef) const;
 
 	virtual void loadNodeDataQuery(std::list<Signature *> & signatures, bool images=true, bool scan=true, bool userData=true, bool occupancyGrid=true) const;
+	virtual void loadFeaturesQuery(std::list<Signature *> & signatures) const;
 	virtual bool getCalibrationQuery(int signatureId, std::vector<CameraModel> & models, StereoCameraModel & stereoModel) const;
 	virtual bool getLaserScanInfoQuery(int signatureId, LaserScan & info) const;
 	virtual bool getNodeInfoQuery(int signatureId, Transform & pose, int & mapId, int & weight, std::string & label, double & stamp, Transform & groundTruthPose, std::vector<float> & velocity, GPS & gps, EnvSensors & sensors) const;
@@ -150,6 +157,8 @@ protected:
 	virtual void getAllLabelsQuery(std::map<int, std::string> & labels) const;
 
 private:
+	void loadWordsAndFeaturesQuery(const std::list<Signature *> & nodes, bool wordIdsOnly, bool featuresOnly) const;
+
 	std::string queryStepNode() const;
 	std::string queryStepImage() const;
 	std::string queryStepDepth() const;
@@ -182,7 +191,12 @@ private:
 
 private:
 	void loadLinksQuery(std::list<Signature *> & signatures) const;
-	int loadOrSaveDb(sqlite3 *pInMemory, const std::string & fileName, int isSave) const;
+	int loadOrSaveDb(sqlite3 *pInMemory, const std::string & fileName, int isSave, const std::string & schema = "main") const;
+	bool hasMainTableQuery(const std::string & table) const;
+	void attachDataShardQuery(const std::string & path, bool create);
+	void openReadConnections(const std::string & url);
+	void closeReadConnections();
+	sqlite3 * readConnection() const; // read connection acquired by the calling thread, or _ppDb
 
 protected:
 	sqlite3 * _ppDb;
@@ -195,6 +209,16 @@ private:
 	int _journalMode;
 	int _synchronous;
 	int _tempStore;
+	int _incrementalVacuum;
+	bool _dataSharded;
+	bool _dataShardAttached;
+	int _readConnectionsMax;
+	std::list<sqlite3 *> _readConnections;
+	mutable std::list<sqlite3 *> _freeReadConnections;
+	mutable std::map<unsigned long, sqlite3 *> _acquiredReadConnections; // <thread id, connection>
+	mutable UMutex _readConnectionsMutex;
+	mutable bool _readConnectionsClosing;
+	mutable USemaphore _readConnectionsReleased;
 };
 
 }
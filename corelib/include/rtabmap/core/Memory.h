@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <list>
 #include <map>
 #include <set>
+#include <memory>
 #include "rtabmap/utilite/UStl.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
@@ -58,6 +59,8 @@ class RegistrationIcp;
 class Stereo;
 class OccupancyGrid;
 class MarkerDetector;
+class CompressionPool;
+class CompressionJob;
 
 class RTABMAP_EXP Memory
 {
@@ -142,6 +145,16 @@ public:
 	void saveLocationData(int locationId);
 	void removeLink(int idA, int idB);
 	void removeRawData(int id, bool image = true, bool scan = true, bool userData = true);
+	// Wait for the compressed data of a new node (see Mem/CompressionPending)
+	void completeCompression(int id) const;
+	// Load keypoints, 3D points and descriptors of a node retrieved without them (see Mem/FeaturesLoadedOnDemand)
+	void loadWordsFeatures(int id) const;
+	// Uncompressed laser scan of a node, cached if Mem/ScanCacheSize > 0. If
+	// data is set (already loaded with the scan), it is used on cache miss.
+	LaserScan getUncompressedLaserScan(int id, const SensorData * data = 0) const;
+	int getScanCacheHits() const {return _scanCacheHits;}
+	int getScanCacheMisses() const {return _scanCacheMisses;}
+	unsigned long getScanCacheMemoryUsed() const {return _scanCacheBytes;} //Bytes
 
 	//getters
 	const std::map<int, double> & getWorkingMem() const {return _workingMem;}
@@ -225,7 +238,7 @@ public:
 	virtual void dumpMemory(std::string directory) const;
 	virtual void dumpSignatures(const char * fileNameSign, bool words3D) const;
 	void dumpDictionary(const char * fileNameRef, const char * fileNameDesc) const;
-	unsigned long getMemoryUsed() const; //Bytes
+	unsigned long getMemoryUsed(unsigned long * signaturesMemoryUsed = 0) const; //Bytes
 
 	void generateGraph(const std::string & fileName, const std::set<int> & ids = std::set<int>());
 	int cleanupLocalGrids(
@@ -263,6 +276,13 @@ private:
 	void clear();
 	void loadDataFromDb(bool postInitClosingEvents);
 	void moveToTrash(Signature * s, bool keepLinkedToGraph = true, std::list<int> * deletedWords = 0);
+	void completeCompression(Signature & s) const;
+	void completeCompressions() const;
+	void loadWordsFeatures(Signature & s) const;
+	void checkpoint();
+	void markCheckpointedNodesSaved();
+	void removeFromScanCache(int id) const;
+	void updateTransferIndex(int id);
 
 	void moveSignatureToWMFromSTM(int id, int * reducedTo = 0);
 	void addSignatureToWmFromLTM(Signature * signature);
@@ -316,6 +336,14 @@ private:
 	unsigned int _imagePreDecimation;
 	unsigned int _imagePostDecimation;
 	bool _compressionParallelized;
+	bool _compressionPending;
+	float _scanCacheMaxSize; // MB
+	bool _wmCompacted;
+	mutable std::set<int> _wordsToCompact; // WM nodes expanded or read since last update
+	bool _featuresLoadedOnDemand;
+	int _checkpointPeriod;
+	int _updatesSinceCheckpoint;
+	std::set<int> _checkpointedIds; // copies queued in the trash, not committed yet
 	float _laserScanDownsampleStepSize;
 	float _laserScanVoxelSize;
 	int _laserScanNormalK;
@@ -355,6 +383,41 @@ private:
 	std::map<int, Transform> _groundTruths;
 	std::map<int, std::string> _labels;
 	std::map<int, std::set<int> > _landmarksIndex; // < -landmarkId, nodeIds >
+
+	// Nodes in WM sorted by transfer priority (see getRemovableSignatures())
+	class WeightAgeIdKey
+	{
+	public:
+		WeightAgeIdKey(int w, double a, int i) :
+			weight(w),
+			age(a),
+			id(i){}
+		bool operator<(const WeightAgeIdKey & k) const
+		{
+			if(weight < k.weight)
+			{
+				return true;
+			}
+			else if(weight == k.weight)
+			{
+				if(age < k.age)
+				{
+					return true;
+				}
+				else if(age == k.age)
+				{
+					if(id < k.id)
+					{
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+		int weight, age, id;
+	};
+	std::set<WeightAgeIdKey> _transferIndex;
+	std::map<int, WeightAgeIdKey> _transferIndexKeys; // id, key in _transferIndex
     std::map<int, float> _landmarksSize;           // +landmarkId
 
 	//Keypoint stuff
@@ -370,6 +433,23 @@ private:
 	OccupancyGrid * _occupancy;
 
 	MarkerDetector * _markerDetector;
+
+	CompressionPool * _compressionPool;
+	struct PendingCompression
+	{
+		std::shared_ptr<CompressionJob> image;
+		std::shared_ptr<CompressionJob> depth;
+		std::shared_ptr<CompressionJob> scan;
+		std::shared_ptr<CompressionJob> userData;
+	};
+	mutable std::map<int, PendingCompression> _pendingCompressions;
+
+	// uncompressed scans, most recently used first
+	mutable std::list<std::pair<int, LaserScan> > _scanCache;
+	mutable std::map<int, std::list<std::pair<int, LaserScan> >::iterator> _scanCacheIndex;
+	mutable unsigned long _scanCacheBytes;
+	mutable int _scanCacheHits;
+	mutable int _scanCacheMisses;
 };
 
 } // namespace rtabmap
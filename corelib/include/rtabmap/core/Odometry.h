@@ -79,16 +79,28 @@ public:
 	double previousStamp() const {return previousStamp_;}
 	unsigned int framesProcessed() const {return framesProcessed_;}
 	bool imagesAlreadyRectified() const {return _imagesAlreadyRectified;}
+	bool isPipelined() const {return _pipelined && this->canPreprocess();}
+
+	// Extract features of data before process() is called. This can be called
+	// from another thread than the one calling process(), so that the features
+	// of the next frame are extracted while the current frame is registered.
+	// Returns false if the features have not been extracted.
+	bool preprocess(SensorData & data);
 
 protected:
 	const std::map<double, Transform> & imus() const {return imus_;}
+	// Covariance (6x6, CV_64FC1) of the guess given to computeTransform(), empty if unknown.
+	const cv::Mat & guessCovariance() const {return guessCovariance_;}
 
 private:
 	virtual Transform computeTransform(SensorData & data, const Transform & guess = Transform(), OdometryInfo * info = 0) = 0;
+	virtual bool canPreprocess() const {return false;}
+	virtual bool preprocessImpl(SensorData &) {return false;}
 
 	void initKalmanFilter(const Transform & initialPose = Transform::getIdentity(), float vx=0.0f, float vy=0.0f, float vz=0.0f, float vroll=0.0f, float vpitch=0.0f, float vyaw=0.0f);
 	void predictKalmanFilter(float dt, float * vx=0, float * vy=0, float * vz=0, float * vroll=0, float * vpitch=0, float * vyaw=0);
 	void updateKalmanFilter(float & vx, float & vy, float & vz, float & vroll, float & vpitch, float & vyaw);
+	bool preintegrateIMU(double fromStamp, double toStamp, Transform & deltaRotation, Eigen::Vector3d & deltaVelocity, Eigen::Vector3d & deltaPosition, Eigen::Matrix<double, 9, 9> & covariance) const;
 
 private:
 	int _resetCountdown;
@@ -109,6 +121,10 @@ private:
 	bool _alignWithGround;
 	bool _publishRAMUsage;
 	bool _imagesAlreadyRectified;
+	bool _pipelined;
+	bool _guessIMUPreintegration;
+	float _guessIMUGyroNoise;
+	float _guessIMUAccNoise;
 	Transform _pose;
 	int _resetCurrentCount;
 	double previousStamp_;
@@ -124,6 +140,8 @@ private:
 	StereoCameraModel stereoModel_;
 	std::vector<CameraModel> models_;
 	std::map<double, Transform> imus_;
+	std::map<double, IMU> imuSamples_; // in base frame, used by IMU preintegration
+	cv::Mat guessCovariance_;
 
 protected:
 	Odometry(const rtabmap::ParametersMap & parameters);
@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace rtabmap {
 
 class Odometry;
+class OdometryPreprocessThread;
 
 class RTABMAP_EXP OdometryThread : public UThread, public UEventsHandler {
 public:
@@ -50,6 +51,7 @@ protected:
 private:
 	virtual void mainLoopBegin();
 	virtual void mainLoopKill();
+	virtual void mainLoopEnd();
 
 	//============================================================
 	// MAIN LOOP
@@ -57,12 +59,25 @@ private:
 	virtual void mainLoop();
 	void addData(const SensorData & data);
 	bool getData(SensorData & data);
+	void pushData(const SensorData & data);
+	void preprocessData();
+
+	friend class OdometryPreprocessThread;
 
 private:
 	USemaphore _dataAdded;
 	UMutex _dataMutex;
 	std::list<SensorData> _dataBuffer;
 	std::list<SensorData> _imuBuffer;
+
+	// Pipelined mode: features of the next frame are extracted in
+	// _preprocessThread while the current frame is processed.
+	OdometryPreprocessThread * _preprocessThread;
+	USemaphore _rawDataAdded;
+	UMutex _rawDataMutex;
+	std::list<SensorData> _rawDataBuffer; // frames and IMU in arrival order
+	int _rawDataGeneration; // incremented on reset, data preprocessed before is dropped
+
 	Odometry * _odometry;
 	unsigned int _dataBufferMaxSize;
 	bool _resetOdometry;
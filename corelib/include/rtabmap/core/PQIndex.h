@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CORELIB_SRC_PQINDEX_H_
+#define CORELIB_SRC_PQINDEX_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace rtabmap {
+
+/**
+ * Compact index for float descriptors: each feature is encoded
+ * with one byte per sub-quantizer (product quantization). Features
+ * are partitioned in cells by a coarse quantizer so that only
+ * a few cells are scanned on search. Distances are computed
+ * asymmetrically (exact query vs encoded features).
+ */
+class RTABMAP_EXP PQIndex
+{
+public:
+	PQIndex();
+	virtual ~PQIndex();
+
+	void release();
+	bool isTrained() const {return !codebooks_.empty();}
+	unsigned int indexedFeatures() const;
+	unsigned int removedFeatures() const {return removedCount_;}
+
+	// return Bytes
+	unsigned long memoryUsed() const;
+
+	// features should be CV_32F, subQuantizers <= features.cols,
+	// coarseCells=0 to scan all features on search.
+	void train(
+			const cv::Mat & features,
+			int subQuantizers,
+			int coarseCells = 0,
+			int iterations = 10);
+
+	int featuresType() const {return CV_32F;}
+	int featuresDim() const {return featuresDim_;}
+
+	std::vector<unsigned int> addPoints(const cv::Mat & features);
+
+	void removePoint(unsigned int index);
+
+	// Remove codes of removed features, return the new index of
+	// each old index (-1 if removed).
+	std::vector<int> compact();
+
+	// return approximated squared L2 distances (indices should be casted in size_t)
+	void knnSearch(
+			const cv::Mat & query,
+			cv::Mat & indices,
+			cv::Mat & dists,
+			int knn,
+			int probes = 8) const;
+
+private:
+	int featuresDim_;
+	std::vector<int> subspaces_; // subspace offsets (size = sub-quantizers+1)
+	std::vector<cv::Mat> codebooks_; // one codebook (centroids x subspace dim) per sub-quantizer
+	cv::Mat coarseCentroids_;
+	std::vector<std::vector<unsigned int> > cells_; // feature indices of each coarse cell
+	cv::Mat codes_; // features x sub-quantizers, CV_8U
+	std::vector<unsigned char> removed_;
+	unsigned int removedCount_;
+};
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_PQINDEX_H_ */
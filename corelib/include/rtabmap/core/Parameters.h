@@ -223,20 +223,29 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(Mem, ImagePreDecimation,          unsigned int, 1, uFormat("Decimation of the RGB image before visual feature detection. If depth size is larger than decimated RGB size, depth is decimated to be always at most equal to RGB size. If %s is true and if depth is smaller than decimated RGB, depth may be interpolated to match RGB size for feature detection.",kMemDepthAsMask().c_str()));
     RTABMAP_PARAM(Mem, ImagePostDecimation,         unsigned int, 1, uFormat("Decimation of the RGB image before saving it to database. If depth size is larger than decimated RGB size, depth is decimated to be always at most equal to RGB size. Decimation is done from the original image. If set to same value than %s, data already decimated is saved (no need to re-decimate the image).", kMemImagePreDecimation().c_str()));
     RTABMAP_PARAM(Mem, CompressionParallelized,     bool, true,     "Compression of sensor data is multi-threaded.");
+    RTABMAP_PARAM(Mem, CompressionPending,          bool, false,    uFormat("[%s=true] New nodes are added to short-term memory while their sensor data is still being compressed. Compression is completed before the nodes are saved to database or published in statistics.", kMemCompressionParallelized().c_str()));
+    RTABMAP_PARAM(Mem, WMCompacted,                 bool, false,    "Keep visual words of nodes in Working Memory (not in Short-Term Memory) in a compact form (sorted arrays instead of trees, keypoints and 3D points in a single block) to reduce RAM usage of large Working Memory. Reading words of a compacted node uses a temporary expanded copy, released on next update.");
+    RTABMAP_PARAM(Mem, FeaturesLoadedOnDemand,      bool, false,    "When nodes are retrieved from the database, only their visual word ids (used by loop closure detection) are loaded. Their keypoints, 3D points and descriptors are loaded from the database on first use (e.g., visual registration). Sensor data is always loaded on demand.");
+    RTABMAP_PARAM(Mem, CheckpointPeriod,            int, 0,         "Every X updates, nodes of Working Memory (not in Short-Term Memory) not saved yet or modified since last checkpoint are written to database in the background with the trash, so that less has to be saved when closing. 0 means disabled.");
     RTABMAP_PARAM(Mem, LaserScanDownsampleStepSize, int, 1,         "If > 1, downsample the laser scans when creating a signature.");
     RTABMAP_PARAM(Mem, LaserScanVoxelSize,          float, 0.0,     uFormat("If > 0 m, voxel filtering is done on laser scans when creating a signature. If the laser scan had normals, they will be removed. To recompute the normals, make sure to use \"%s\" or \"%s\" parameters.", kMemLaserScanNormalK().c_str(), kMemLaserScanNormalRadius().c_str()));
     RTABMAP_PARAM(Mem, LaserScanNormalK,            int, 0,         "If > 0 and laser scans don't have normals, normals will be computed with K search neighbors when creating a signature.");
     RTABMAP_PARAM(Mem, LaserScanNormalRadius,       float, 0.0,     "If > 0 m and laser scans don't have normals, normals will be computed with radius search neighbors when creating a signature.");
     RTABMAP_PARAM(Mem, UseOdomFeatures,             bool, true,     "Use odometry features instead of regenerating them.");
     RTABMAP_PARAM(Mem, UseOdomGravity,              bool, false,    uFormat("Use odometry instead of IMU orientation to add gravity links to new nodes created. We assume that odometry is already aligned with gravity (e.g., we are using a VIO approach). Gravity constraints are used by graph optimization only if \"%s\" is not zero.", kOptimizerGravitySigma().c_str()));
+    RTABMAP_PARAM(Mem, ScanCacheSize,               float, 0.0,     "Maximum memory (MB) used to keep uncompressed laser scans of nodes, so that they are not uncompressed each time they are used (e.g., by proximity detection). Least recently used scans are removed first. 0 means disabled.");
     RTABMAP_PARAM(Mem, CovOffDiagIgnored,           bool, true,     "Ignore off diagonal values of the covariance matrix.");
 
     // KeypointMemory (Keypoint-based)
-    RTABMAP_PARAM(Kp, NNStrategy,               int, 1,       "kNNFlannNaive=0, kNNFlannKdTree=1, kNNFlannLSH=2, kNNBruteForce=3, kNNBruteForceGPU=4");
+    RTABMAP_PARAM(Kp, NNStrategy,               int, 1,       "kNNFlannNaive=0, kNNFlannKdTree=1, kNNFlannLSH=2, kNNBruteForce=3, kNNBruteForceGPU=4, kNNProductQuantization=5");
     RTABMAP_PARAM(Kp, IncrementalDictionary,    bool, true,   "");
     RTABMAP_PARAM(Kp, IncrementalFlann,         bool, true,   uFormat("When using FLANN based strategy, add/remove points to its index without always rebuilding the index (the index is built only when the dictionary increases of the factor \"%s\" in size).", kKpFlannRebalancingFactor().c_str()));
     RTABMAP_PARAM(Kp, FlannRebalancingFactor,   float, 2.0,   uFormat("Factor used when rebuilding the incremental FLANN index (see \"%s\"). Set <=1 to disable.", kKpIncrementalFlann().c_str()));
     RTABMAP_PARAM(Kp, ByteToFloat,              bool, false,  uFormat("For %s=1, binary descriptors are converted to float by converting each byte to float instead of converting each bit to float. When converting bytes instead of bits, less memory is used and search is faster at the cost of slightly less accurate matching.", kKpNNStrategy().c_str()));
+    RTABMAP_PARAM(Kp, PQSubQuantizers,          int, 0,       uFormat("For %s=5, number of sub-quantizers, i.e., number of bytes used to encode each word (0 means descriptor size / 4). Only float descriptors are supported.", kKpNNStrategy().c_str()));
+    RTABMAP_PARAM(Kp, PQCoarseCells,            int, 256,     uFormat("For %s=5, number of cells of the coarse quantizer partitioning the words (0 means all words are scanned on search).", kKpNNStrategy().c_str()));
+    RTABMAP_PARAM(Kp, PQProbes,                 int, 8,       uFormat("For %s=5, number of closest coarse cells scanned on search.", kKpNNStrategy().c_str()));
+    RTABMAP_PARAM(Kp, PQTrainingSize,           int, 10000,   uFormat("For %s=5, number of words required in an incremental dictionary to train the quantizers, words are matched by brute force until then. A fixed dictionary is trained on load. Once trained, descriptors of words already saved in the database are released from RAM.", kKpNNStrategy().c_str()));
     RTABMAP_PARAM(Kp, MaxDepth,                 float, 0,     "Filter extracted keypoints by depth (0=inf).");
     RTABMAP_PARAM(Kp, MinDepth,                 float, 0,     "Filter extracted keypoints by depth.");
     RTABMAP_PARAM(Kp, MaxFeatures,              int, 500,     "Maximum features extracted from the images (0 means not bounded, <0 means no extraction).");
@@ -253,6 +262,7 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM_STR(Kp, RoiRatios,       "0.0 0.0 0.0 0.0", "Region of interest ratios [left, right, top, bottom].");
     RTABMAP_PARAM_STR(Kp, DictionaryPath,       "",           "Path of the pre-computed dictionary");
     RTABMAP_PARAM(Kp, NewWordsComparedTogether, bool, true,   "When adding new words to dictionary, they are compared also with each other (to detect same words in the same signature).");
+    RTABMAP_PARAM(Kp, QuantizationThreads,      int, 1,       "Number of threads used to quantize the descriptors of a new signature against the dictionary (0=all OpenMP threads). Ignored with brute force GPU strategy.");
     RTABMAP_PARAM(Kp, SubPixWinSize,            int, 3,       "See cv::cornerSubPix().");
     RTABMAP_PARAM(Kp, SubPixIterations,         int, 0,       "See cv::cornerSubPix(). 0 disables sub pixel refining.");
     RTABMAP_PARAM(Kp, SubPixEps,                double, 0.02, "See cv::cornerSubPix().");
@@ -262,9 +272,12 @@ class RTABMAP_EXP Parameters
     //Database
     RTABMAP_PARAM(DbSqlite3, InMemory,     bool, false,      "Using database in the memory instead of a file on the hard disk.");
     RTABMAP_PARAM(DbSqlite3, CacheSize, unsigned int, 10000, "Sqlite cache size (default is 2000).");
-    RTABMAP_PARAM(DbSqlite3, JournalMode,  int, 3,           "0=DELETE, 1=TRUNCATE, 2=PERSIST, 3=MEMORY, 4=OFF (see sqlite3 doc : \"PRAGMA journal_mode\")");
+    RTABMAP_PARAM(DbSqlite3, JournalMode,  int, 3,           "0=DELETE, 1=TRUNCATE, 2=PERSIST, 3=MEMORY, 4=OFF, 5=WAL (see sqlite3 doc : \"PRAGMA journal_mode\")");
     RTABMAP_PARAM(DbSqlite3, Synchronous,  int, 0,           "0=OFF, 1=NORMAL, 2=FULL (see sqlite3 doc : \"PRAGMA synchronous\")");
     RTABMAP_PARAM(DbSqlite3, TempStore,    int, 2,           "0=DEFAULT, 1=FILE, 2=MEMORY (see sqlite3 doc : \"PRAGMA temp_store\")");
+    RTABMAP_PARAM(DbSqlite3, DataSharded,  bool, false,      "Sensor data (images, depth, laser scans, occupancy grids) of new databases is saved in a separate file (database path + \".data\") attached to the main database. The main file then only contains metadata, graph and features, and each file is vacuumed independently. Sharded databases are detected on opening. Ignored for databases in memory. Note that in WAL journal mode, a commit is atomic in each file but not across both: after a crash, sensor data of the last saved nodes may be missing.");
+    RTABMAP_PARAM(DbSqlite3, ReadConnections, int, 0,        uFormat("[%s=5] Number of read-only connections opened on the database file. Node loading, node info, calibration, laser scan info and sensor data requests use a free one instead of waiting for the main connection, so they run in parallel with saving (see rtabmap-info --bench). 0 means disabled. Ignored for databases in memory.", kDbSqlite3JournalMode().c_str()));
+    RTABMAP_PARAM(DbSqlite3, IncrementalVacuum, int, 0,      "Maximum free pages reclaimed after each trash emptying (-1=all, 0=disabled). Incremental auto vacuum is enabled on databases created with this option, existing databases without it are not affected (see sqlite3 doc : \"PRAGMA incremental_vacuum\").");
     RTABMAP_PARAM_STR(Db, TargetVersion,   "",               "Target database version for backward compatibility purpose. Only Major and minor versions are used and should be set (e.g., 0.19 vs 0.20 or 1.0 vs 2.0). Patch version is ignored (e.g., 0.20.1 and 0.20.3 will generate a 0.20 database).");
 
     // Keypoints descriptors/detectors
@@ -452,6 +465,10 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(Odom, ScanKeyFrameThr,        float, 0.9,   "[Geometry] Create a new keyframe when the number of ICP inliers drops under this ratio of points in last frame's scan. Setting the value to 0 means that a keyframe is created for each processed frame.");
     RTABMAP_PARAM(Odom, ImageDecimation,     unsigned int, 1, uFormat("Decimation of the RGB image before registration. If depth size is larger than decimated RGB size, depth is decimated to be always at most equal to RGB size. If %s is true and if depth is smaller than decimated RGB, depth may be interpolated to match RGB size for feature detection.", kVisDepthAsMask().c_str()));
     RTABMAP_PARAM(Odom, AlignWithGround,        bool, false,  "Align odometry with the ground on initialization.");
+    RTABMAP_PARAM(Odom, Pipelined,              bool, false,  uFormat("[Visual] When odometry is running in its own thread, features of the next frame are extracted in a separate thread while the current frame is registered (F2M and F2F approaches only). Ignored if %s>1 or if images need to be rectified.", kOdomImageDecimation().c_str()));
+    RTABMAP_PARAM(Odom, GuessIMUPreintegration, bool, false,  uFormat("[Visual] Compute the motion guess by integrating IMU angular velocity and linear acceleration between frames. The translation is estimated using the last velocity (see %s) and the gravity from the current orientation. The resulting covariance is used to reduce %s.", kOdomGuessMotion().c_str(), kVisCorGuessWinSize().c_str()));
+    RTABMAP_PARAM(Odom, GuessIMUGyroNoise,      float, 0.005, uFormat("[%s=true] Gyroscope noise density (rad/s/sqrt(Hz)).", kOdomGuessIMUPreintegration().c_str()));
+    RTABMAP_PARAM(Odom, GuessIMUAccNoise,       float, 0.05,  uFormat("[%s=true] Accelerometer noise density (m/s^2/sqrt(Hz)).", kOdomGuessIMUPreintegration().c_str()));
 
     // Odometry Frame-to-Map
     RTABMAP_PARAM(OdomF2M, MaxSize,             int, 2000,    "[Visual] Local map size: If > 0 (example 5000), the odometry will maintain a local map of X maximum words.");
@@ -461,12 +478,14 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(OdomF2M, ScanSubtractAngle,   float, 45,    uFormat("[Geometry] Max angle (degrees) used to filter points of a new added scan to local map (when \"%s\">0). 0 means any angle.", kOdomF2MScanSubtractRadius().c_str()).c_str());
     RTABMAP_PARAM(OdomF2M, ScanRange,           float, 0,     "[Geometry] Distance Range used to filter points of local map (when > 0). 0 means local map is updated using time and not range.");
     RTABMAP_PARAM(OdomF2M, ValidDepthRatio,     float, 0.75,  "If a new frame has points without valid depth, they are added to local feature map only if points with valid depth on total points is over this ratio. Setting to 1 means no points without valid depth are added to local feature map.");
+    RTABMAP_PARAM(OdomF2M, IndexVoxelSize,      float, 0,     "[Visual] If > 0, words of the local feature map are indexed in voxels of this size (m). When a motion guess is available, only words in voxels inside the camera frustum at the predicted pose are matched, so that matching cost doesn't grow with the local map size. Not used with geometric registration.");
 #if defined(RTABMAP_G2O) || defined(RTABMAP_ORB_SLAM)
     RTABMAP_PARAM(OdomF2M, BundleAdjustment,          int, 1, "Local bundle adjustment: 0=disabled, 1=g2o, 2=cvsba, 3=Ceres.");
 #else
     RTABMAP_PARAM(OdomF2M, BundleAdjustment,          int, 0, "Local bundle adjustment: 0=disabled, 1=g2o, 2=cvsba, 3=Ceres.");
 #endif
     RTABMAP_PARAM(OdomF2M, BundleAdjustmentMaxFrames, int, 10, "Maximum frames used for bundle adjustment (0=inf or all current frames in the local map).");
+    RTABMAP_PARAM(OdomF2M, BundleAdjustmentAsync,  bool, false, "Do local bundle adjustment in a background thread. The pose of the current frame is not refined, the optimized 3D points of the local map and the key-frame pose are updated when the optimization is done (on a later frame). A new optimization is started only when the previous one is finished.");
 
     // Odometry Mono
     RTABMAP_PARAM(OdomMono, InitMinFlow,        float, 100,  "Minimum optical flow required for the initialization step.");
@@ -691,9 +710,13 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(Stereo, MaxDisparity,          float, 128.0,  "Maximum disparity.");
     RTABMAP_PARAM(Stereo, OpticalFlow,           bool, true,    "Use optical flow to find stereo correspondences, otherwise a simple block matching approach is used.");
     RTABMAP_PARAM(Stereo, SSD,                   bool, true,    uFormat("[%s=false] Use Sum of Squared Differences (SSD) window, otherwise Sum of Absolute Differences (SAD) window is used.", kStereoOpticalFlow().c_str()));
+    RTABMAP_PARAM(Stereo, FullRange,             bool, false,   uFormat("[%s=false] Evaluate the whole disparity range of each keypoint on the full resolution image in one vectorized pass, then refine it at subpixel level (%s and %s are ignored). Otherwise, disparity is searched coarse-to-fine in the image pyramid.", kStereoOpticalFlow().c_str(), kStereoMaxLevel().c_str(), kStereoIterations().c_str()));
     RTABMAP_PARAM(Stereo, Eps,                   double, 0.01,  uFormat("[%s=true] Epsilon stop criterion.", kStereoOpticalFlow().c_str()));
 
     RTABMAP_PARAM(Stereo, DenseStrategy,         int, 0,  "0=cv::StereoBM, 1=cv::StereoSGBM");
+    RTABMAP_PARAM(Stereo, DenseStrips,           int, 1,  "Number of horizontal strips (overlapping by the block size) on which dense disparity is computed in parallel. 0 means one strip per thread, 1 means the whole image at once.");
+    RTABMAP_PARAM_STR(Stereo, DenseRoiRatios,    "0.0 0.0 0.0 0.0", "Region of interest ratios [left, right, top, bottom] in which dense disparity is computed. Disparity is invalid outside.");
+    RTABMAP_PARAM(Stereo, DenseDownscale,        int, 0,  "0=Full resolution, 1=Half resolution, the disparity is upsampled to full resolution, 2=Coarse-to-fine: the half resolution disparity limits the disparity range searched in each full resolution strip.");
 
     RTABMAP_PARAM(StereoBM, BlockSize,           int, 15,       "See cv::StereoBM");
     RTABMAP_PARAM(StereoBM, MinDisparity,        int, 0,        "See cv::StereoBM");
@@ -60,6 +60,15 @@ public:
 
 	const Feature2D * getDetector() const {return _detectorFrom;}
 
+	// Detect keypoints, descriptors and 3D keypoints of data like it would be
+	// done for the target signature in computeTransformation(). Does nothing
+	// if data already has keypoints.
+	void extractFeatures(SensorData & data) const;
+
+	// Covariance (6x6, CV_64FC1) of the next guess. If set, the matching window
+	// around projected points is reduced to 3 sigmas, up to Vis/CorGuessWinSize.
+	void setGuessCovariance(const cv::Mat & covariance);
+
 protected:
 	virtual Transform computeTransformationImpl(
 			Signature & from,
@@ -94,6 +103,7 @@ private:
 	double _gmsThresholdFactor;
 	int _guessWinSize;
 	bool _guessMatchToProjection;
+	cv::Mat _guessCovariance;
 	int _bundleAdjustment;
 	bool _depthAsMask;
 	float _minInliersDistributionThr;
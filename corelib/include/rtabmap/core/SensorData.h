@@ -35,6 +35,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/Transform.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
+#include <memory>
+#include <map>
+#include <rtabmap/utilite/UMutex.h>
 #include <rtabmap/core/LaserScan.h>
 #include <rtabmap/core/IMU.h>
 #include <rtabmap/core/GPS.h>
@@ -147,7 +150,7 @@ public:
 			!_stereoCameraModel.isValidForProjection() &&
 			_userDataRaw.empty() &&
 			_userDataCompressed.empty() &&
-			_keypoints.size() == 0 &&
+			keypoints().size() == 0 &&
 			_descriptors.empty() &&
 			imu_.empty());
 	}
@@ -189,6 +192,18 @@ public:
 	cv::Mat depthRaw() const {return _depthOrRightRaw.type()!=CV_8UC1?_depthOrRightRaw:cv::Mat();}
 	cv::Mat rightRaw() const {return _depthOrRightRaw.type()==CV_8UC1?_depthOrRightRaw:cv::Mat();}
 
+	/**
+	 * Optical flow pyramid (see cv::buildOpticalFlowPyramid()) of the grayscale
+	 * raw left/rgb image (or right image if right=true). The pyramid is built on
+	 * first request and shared by all copies of this data made from the same raw
+	 * images: setting or clearing the raw images of a copy gives it a new empty
+	 * cache without touching the others. Stereo correspondences, odometry and loop
+	 * closure registration can then reuse it. The cache is not serialized.
+	 * @return empty vector if the requested raw image is not set.
+	 */
+	std::vector<cv::Mat> imagePyramid(bool right, const cv::Size & winSize, int maxLevel, bool withDerivatives) const;
+	void clearImagePyramids();
+
 	RTABMAP_DEPRECATED(void setImageRaw(const cv::Mat & image), "Use setRGBDImage() or setStereoImage() with clearNotUpdated=false or removeRawData() instead. To be backward compatible, this function doesn't clear compressed data.");
 	RTABMAP_DEPRECATED(void setDepthOrRightRaw(const cv::Mat & image), "Use setRGBDImage() or setStereoImage() with clearNotUpdated=false or removeRawData() instead. To be backward compatible, this function doesn't clear compressed data.");
 	RTABMAP_DEPRECATED(void setLaserScanRaw(const LaserScan & scan), "Use setLaserScan() with clearNotUpdated=false or removeRawData() instead. To be backward compatible, this function doesn't clear compressed data.");
@@ -246,8 +261,10 @@ public:
 	const cv::Point3f & gridViewPoint() const {return _viewPoint;}
 
 	void setFeatures(const std::vector<cv::KeyPoint> & keypoints, const std::vector<cv::Point3f> & keypoints3D, const cv::Mat & descriptors);
-	const std::vector<cv::KeyPoint> & keypoints() const {return _keypoints;}
-	const std::vector<cv::Point3f> & keypoints3D() const {return _keypoints3D;}
+	void setFeatures(std::vector<cv::KeyPoint> && keypoints, std::vector<cv::Point3f> && keypoints3D, const cv::Mat & descriptors);
+	void setFeatures(const SensorData & data); // share features of data without copying them
+	const std::vector<cv::KeyPoint> & keypoints() const;
+	const std::vector<cv::Point3f> & keypoints3D() const;
 	const cv::Mat & descriptors() const {return _descriptors;}
 
 	void addGlobalDescriptor(const GlobalDescriptor & descriptor) {_globalDescriptors.push_back(descriptor);}
@@ -325,8 +342,9 @@ private:
 	Landmarks _landmarks;
 
 	// features
-	std::vector<cv::KeyPoint> _keypoints;
-	std::vector<cv::Point3f> _keypoints3D;
+	// immutable and shared between copies (null if empty)
+	std::shared_ptr<const std::vector<cv::KeyPoint> > _keypoints;
+	std::shared_ptr<const std::vector<cv::Point3f> > _keypoints3D;
 	cv::Mat _descriptors;
 
 	// global descriptors
@@ -340,6 +358,16 @@ private:
 	GPS gps_;
 
 	IMU imu_;
+
+	// optical flow pyramids cache, shared between copies having the
+	// same raw images (replaced, never cleared, when they change)
+	struct ImagePyramids
+	{
+		UMutex mutex;
+		// <right, winWidth, winHeight, maxLevel, withDerivatives>
+		std::map<std::vector<int>, std::vector<cv::Mat> > pyramids;
+	};
+	std::shared_ptr<ImagePyramids> _imagePyramids = std::make_shared<ImagePyramids>();
 };
 
 }
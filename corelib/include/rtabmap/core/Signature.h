@@ -37,10 +37,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <list>
 #include <vector>
 #include <set>
+#include <memory>
 
 #include <rtabmap/core/Transform.h>
 #include <rtabmap/core/SensorData.h>
 #include <rtabmap/core/Link.h>
+#include <rtabmap/utilite/UMutex.h>
 
 namespace rtabmap
 {
@@ -108,13 +110,39 @@ public:
 	void setWords(const std::multimap<int, int> & words, const std::vector<cv::KeyPoint> & keypoints, const std::vector<cv::Point3f> & words3, const cv::Mat & descriptors);
 	bool isEnabled() const {return _enabled;}
 	void setEnabled(bool enabled) {_enabled = enabled;}
-	const std::multimap<int, int> & getWords() const {return _words;}
-	const std::vector<cv::KeyPoint> & getWordsKpts() const {return _wordsKpts;}
+	const std::multimap<int, int> & getWords() const {return _wordsCompacted?expandedWords().words:_words;}
+	const std::vector<cv::KeyPoint> & getWordsKpts() const {return _wordsCompacted?expandedWords().keypoints:_wordsKpts;}
 	int getInvalidWordsCount() const {return _invalidWordsCount;}
 	const std::map<int, int> & getWordsChanged() const {return _wordsChanged;}
 	const cv::Mat & getWordsDescriptors() const {return _wordsDescriptors;}
 	void setWordsDescriptors(const cv::Mat & descriptors);
 
+	/**
+	 * Move words, keypoints and 3D points in a compact form (sorted
+	 * word array and a single contiguous block for keypoints and
+	 * 3D points) to reduce memory used by nodes in Working Memory.
+	 * The node stays compacted when read: getWords(), getWordsKpts()
+	 * and getWords3() return a temporary expanded copy, shared by
+	 * copies of this signature and released on next compactWords().
+	 */
+	void compactWords();
+	/**
+	 * Move compacted words back in their normal form (done
+	 * before any modification of the words).
+	 */
+	void expandWords();
+	bool isWordsCompacted() const {return _wordsCompacted;}
+	int getWordsCount() const {return _wordsCompacted?(int)_wordsCompact.size():(int)_words.size();}
+
+	/**
+	 * Set only the word ids (keypoint index = order of the words),
+	 * used to load nodes without their keypoints, 3D points and
+	 * descriptors. They can be set afterwards with setWordsFeatures().
+	 */
+	void setWordsWithoutFeatures(const std::multimap<int, int> & words);
+	void setWordsFeatures(const std::vector<cv::KeyPoint> & keypoints, const std::vector<cv::Point3f> & points, const cv::Mat & descriptors);
+	bool isWordsFeaturesLoaded() const {return _wordsFeaturesLoaded;}
+
 	//metric stuff
 	void setPose(const Transform & pose) {_pose = pose;}
 	void setGroundTruthPose(const Transform & pose) {_groundTruthPose = pose;}
@@ -128,7 +156,7 @@ public:
 		_velocity[5]=vyaw;
 	}
 
-	const std::vector<cv::Point3f> & getWords3() const {return _words3;}
+	const std::vector<cv::Point3f> & getWords3() const {return _wordsCompacted?expandedWords().words3:_words3;}
 	const Transform & getPose() const {return _pose;}
 	cv::Mat getPoseCovariance() const;
 	const Transform & getGroundTruthPose() const {return _groundTruthPose;}
@@ -139,6 +167,16 @@ public:
 
 	unsigned long getMemoryUsed(bool withSensorData=true) const; // Return memory usage in Bytes
 
+private:
+	struct ExpandedWords
+	{
+		std::multimap<int, int> words;
+		std::vector<cv::KeyPoint> keypoints;
+		std::vector<cv::Point3f> words3;
+	};
+	const ExpandedWords & expandedWords() const;
+	void uncompactWords(ExpandedWords & expanded) const;
+
 private:
 	int _id;
 	int _mapId;
@@ -157,6 +195,20 @@ private:
 	std::multimap<int, int> _words; // word <id, keypoint index>
 	std::vector<cv::KeyPoint> _wordsKpts;
 	std::vector<cv::Point3f> _words3; // in base_link frame (localTransform applied))
+	bool _wordsCompacted;
+	std::vector<std::pair<int, int> > _wordsCompact; // word <id, keypoint index> sorted like _words
+	std::vector<unsigned char> _wordsCompactData; // keypoints followed by 3D points
+	int _wordsCompactKpts;
+	int _wordsCompact3;
+	// Expanded copy of compacted words built on read (see compactWords()),
+	// shared between copies and replaced, never modified, by non-const methods
+	struct ExpandedWordsCache
+	{
+		UMutex mutex;
+		std::unique_ptr<ExpandedWords> expanded;
+	};
+	std::shared_ptr<ExpandedWordsCache> _wordsExpanded;
+	bool _wordsFeaturesLoaded;
 	cv::Mat _wordsDescriptors;
 	std::map<int, int> _wordsChanged; // <oldId, newId>
 	bool _enabled;
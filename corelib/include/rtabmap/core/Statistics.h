@@ -154,7 +154,11 @@ class RTABMAP_EXP Statistics
 	RTABMAP_STATS(Memory, Distance_travelled, m);
 	RTABMAP_STATS(Memory, RAM_usage, MB);
 	RTABMAP_STATS(Memory, RAM_estimated, MB);
+	RTABMAP_STATS(Memory, RAM_estimated_per_node, KB);
 	RTABMAP_STATS(Memory, Triangulated_points, );
+	RTABMAP_STATS(Memory, Scan_cache_hits, );
+	RTABMAP_STATS(Memory, Scan_cache_misses, );
+	RTABMAP_STATS(Memory, Scan_cache_size, MB);
 
 	RTABMAP_STATS(Timing, Memory_update, ms);
 	RTABMAP_STATS(Timing, Neighbor_link_refining, ms);
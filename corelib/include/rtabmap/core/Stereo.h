@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
 
 #include <rtabmap/core/Parameters.h>
+#include <rtabmap/core/SensorData.h>
 #include <opencv2/core/core.hpp>
 
 namespace rtabmap {
@@ -49,6 +50,14 @@ public:
 			const cv::Mat & rightImage,
 			const std::vector<cv::Point2f> & leftCorners,
 			std::vector<unsigned char> & status) const;
+	/**
+	 * Same as above, but with the image pyramids cached in
+	 * the stereo sensor data (see SensorData::imagePyramid()).
+	 */
+	virtual std::vector<cv::Point2f> computeCorrespondences(
+			const SensorData & data,
+			const std::vector<cv::Point2f> & leftCorners,
+			std::vector<unsigned char> & status) const;
 
 	cv::Size winSize() const {return cv::Size(winWidth_, winHeight_);}
 	int iterations() const   {return iterations_;}
@@ -56,6 +65,7 @@ public:
 	float minDisparity() const {return minDisparity_;}
 	float maxDisparity() const {return maxDisparity_;}
 	bool winSSD() const      {return winSSD_;}
+	bool fullRange() const   {return fullRange_;}
 
 private:
 	int winWidth_;
@@ -65,6 +75,7 @@ private:
 	float minDisparity_;
 	float maxDisparity_;
 	bool winSSD_;
+	bool fullRange_;
 };
 
 class RTABMAP_EXP StereoOpticalFlow : public Stereo {
@@ -78,9 +89,20 @@ public:
 			const cv::Mat & rightImage,
 			const std::vector<cv::Point2f> & leftCorners,
 			std::vector<unsigned char> & status) const;
+	virtual std::vector<cv::Point2f> computeCorrespondences(
+			const SensorData & data,
+			const std::vector<cv::Point2f> & leftCorners,
+			std::vector<unsigned char> & status) const;
 
 	float epsilon() const {return epsilon_;}
 
+private:
+	std::vector<cv::Point2f> computeCorrespondencesImpl(
+			cv::InputArray left,
+			cv::InputArray right,
+			const std::vector<cv::Point2f> & leftCorners,
+			std::vector<unsigned char> & status) const;
+
 private:
 	float epsilon_;
 };
@@ -47,13 +47,44 @@ public:
 public:
 	virtual ~StereoDense() {}
 
-	virtual void parseParameters(const ParametersMap & parameters) {}
+	virtual void parseParameters(const ParametersMap & parameters);
 	virtual cv::Mat computeDisparity(
 			const cv::Mat & leftImage,
 			const cv::Mat & rightImage) const = 0;
 
 protected:
-	StereoDense(const ParametersMap & parameters = ParametersMap()) {}
+	StereoDense(const ParametersMap & parameters = ParametersMap());
+
+	// Compute the disparity (CV_16SC1) of the region of interest, by strips in
+	// parallel and optionally from a half resolution disparity (see
+	// Stereo/DenseStrips, Stereo/DenseRoiRatios and Stereo/DenseDownscale).
+	// computeDisparityImpl() is called on each strip.
+	cv::Mat computeDisparityByStrips(
+			const cv::Mat & leftMono,
+			const cv::Mat & rightMono,
+			int minDisparity,
+			int numDisparities,
+			int blockSize) const;
+	virtual cv::Mat computeDisparityImpl(
+			const cv::Mat & leftMono,
+			const cv::Mat & rightMono,
+			int minDisparity,
+			int numDisparities) const;
+
+private:
+	cv::Mat computeStrips(
+			const cv::Mat & leftMono,
+			const cv::Mat & rightMono,
+			const cv::Rect & roi,
+			int minDisparity,
+			int numDisparities,
+			int blockSize,
+			const cv::Mat & coarseDisparity) const;
+
+private:
+	int strips_;
+	std::string roiRatios_;
+	int downscale_;
 };
 
 } /* namespace rtabmap */
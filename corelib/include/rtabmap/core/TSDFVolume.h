@@ -0,0 +1,122 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_TSDFVOLUME_H_
+#define CORELIB_SRC_TSDFVOLUME_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+
+#include <pcl/PolygonMesh.h>
+#include <opencv2/core/core.hpp>
+#include <rtabmap/core/Transform.h>
+#include <rtabmap/core/CameraModel.h>
+#include <rtabmap/core/SensorData.h>
+#include <unordered_map>
+#include <vector>
+
+namespace rtabmap {
+
+/**
+ * Truncated Signed Distance Function (TSDF) volume with voxel hashing. Only
+ * blocks of 8x8x8 voxels near observed surfaces are allocated, so memory
+ * grows with the surface area, not with the map bounding box. Depth images
+ * are integrated in parallel (OpenMP) over the blocks seen by the camera.
+ * The mesh is extracted with marching cubes; only blocks changed since the
+ * last extraction are re-meshed.
+ *
+ * Example:
+ * @code
+ * TSDFVolume volume(0.01f);
+ * for(std::map<int, Transform>::iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+ * {
+ *    SensorData data = memory->getNodeData(iter->first, true);
+ *    data.uncompressData();
+ *    volume.integrate(data, iter->second);
+ * }
+ * pcl::PolygonMesh::Ptr mesh = volume.extractMesh();
+ * @endcode
+ */
+class RTABMAP_EXP TSDFVolume {
+public:
+	/**
+	 * @param voxelSize voxel size (m)
+	 * @param truncationDistance truncation distance (m), 0 means 4 x voxelSize
+	 * @param maxDepth depth values over this distance (m) are ignored, 0 means no limit
+	 * @param maxBlocks maximum blocks of voxels kept in RAM, 0 means no limit. When
+	 *        reached, blocks the farthest from the last camera are meshed and their
+	 *        voxels are released. These blocks are kept in the mesh but
+	 *        cannot be updated anymore.
+	 */
+	TSDFVolume(float voxelSize = 0.01f, float truncationDistance = 0.0f, float maxDepth = 0.0f, int maxBlocks = 0);
+	virtual ~TSDFVolume();
+
+	void clear();
+
+	/**
+	 * Integrate raw depth (or stereo) images of the sensor data.
+	 * @param data sensor data with uncompressed images (see SensorData::uncompressData())
+	 * @param pose pose of the base frame of the sensor data
+	 * @return false if the data doesn't contain depth or stereo images with valid calibration
+	 */
+	bool integrate(const SensorData & data, const Transform & pose);
+
+	/**
+	 * @param depth CV_16UC1 (mm) or CV_32FC1 (m)
+	 * @param rgb optional CV_8UC3 (BGR) or CV_8UC1 image, can have a different size than depth
+	 * @param model camera model of depth image (local transform is used)
+	 * @param pose pose of the base frame
+	 */
+	bool integrate(const cv::Mat & depth, const cv::Mat & rgb, const CameraModel & model, const Transform & pose);
+
+	/**
+	 * Extract the mesh (colored vertices with normals) of the whole volume.
+	 */
+	pcl::PolygonMesh::Ptr extractMesh();
+
+	float getVoxelSize() const {return voxelSize_;}
+	int getBlocks() const {return (int)blocks_.size();}
+	int getReleasedBlocks() const {return (int)blocks_.size() - liveBlocks_;}
+	unsigned long getMemoryUsed() const;
+
+private:
+	struct Block;
+	void integrateBlock(Block * block, const cv::Mat & depth, const cv::Mat & rgb, const CameraModel & model, const Transform & worldToCamera) const;
+	void extractBlock(Block * block) const;
+	void releaseFarthestBlocks(const Transform & cameraPose);
+
+private:
+	float voxelSize_;
+	float truncationDistance_;
+	float maxDepth_;
+	int maxBlocks_;
+	int liveBlocks_;
+	std::unordered_map<unsigned long long, Block*> blocks_;
+};
+
+}
+
+#endif /* CORELIB_SRC_TSDFVOLUME_H_ */
@@ -42,6 +42,8 @@ namespace rtabmap
 class DBDriver;
 class VisualWord;
 class FlannIndex;
+class PQIndex;
+class PQTrainingThread;
 
 class RTABMAP_EXP VWDictionary
 {
@@ -52,6 +54,7 @@ public:
 		kNNFlannLSH,
 		kNNBruteForce,
 		kNNBruteForceGPU,
+		kNNProductQuantization,
 		kNNUndef};
 	static const int ID_START;
 	static const int ID_INVALID;
@@ -68,6 +71,8 @@ public:
 			return "BRUTE FORCE";
 		case kNNBruteForceGPU:
 			return "BRUTE FORCE GPU";
+		case kNNProductQuantization:
+			return "PRODUCT QUANTIZATION";
 		default:
 			return "Unknown";
 		}
@@ -108,7 +113,12 @@ public:
 	void setIncrementalDictionary();
 	void setFixedDictionary(const std::string & dictionaryPath);
 
-	void exportDictionary(const char * fileNameReferences, const char * fileNameDescriptors) const;
+	// releasedDescriptors: descriptors (reloaded from the database) of the
+	// words released by product quantization
+	void exportDictionary(
+			const char * fileNameReferences,
+			const char * fileNameDescriptors,
+			const std::map<int, cv::Mat> & releasedDescriptors = std::map<int, cv::Mat>()) const;
 
 	void clear(bool printWarningsIfNotEmpty = true);
 	std::vector<VisualWord *> getUnusedWords() const;
@@ -124,6 +134,11 @@ public:
 protected:
 	int getNextId();
 
+private:
+	void trainPQIndex();
+	void encodePQIndex();
+	void releasePQIndex();
+
 protected:
 	std::map<int, VisualWord *> _visualWords; //<id,VisualWord*>
 	int _totalActiveReferences; // keep track of all references for updating the common signature
@@ -137,9 +152,16 @@ private:
 	std::string _dictionaryPath; // a pre-computed dictionary (.txt or .db)
 	std::string _newDictionaryPath; // a pre-computed dictionary (.txt or .db)
 	bool _newWordsComparedTogether;
+	int _quantizationThreads;
 	int _lastWordId;
 	bool useDistanceL1_;
 	FlannIndex * _flannIndex;
+	PQIndex * _pqIndex;
+	PQTrainingThread * _pqTrainingThread;
+	int _pqSubQuantizers;
+	int _pqCoarseCells;
+	int _pqProbes;
+	int _pqTrainingSize;
 	cv::Mat _dataTree;
 	NNStrategy _strategy;
 	std::map<int ,int> _mapIndexId;
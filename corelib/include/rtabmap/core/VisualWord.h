@@ -48,6 +48,7 @@ public:
 	int getTotalReferences() const {return _totalReferences;}
 	int id() const {return _id;}
 	const cv::Mat & getDescriptor() const {return _descriptor;}
+	void releaseDescriptor() {_descriptor = cv::Mat();} // should be already saved in database
 	const std::map<int, int> & getReferences() const {return _references;} // (signature id , occurrence in the signature)
 
 	bool isSaved() const {return _saved;}
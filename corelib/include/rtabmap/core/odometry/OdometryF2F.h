@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace rtabmap {
 
 class Registration;
+class RegistrationVis;
 
 class RTABMAP_EXP OdometryF2F : public Odometry
 {
@@ -49,6 +50,8 @@ public:
 
 private:
 	virtual Transform computeTransform(SensorData & image, const Transform & guess = Transform(), OdometryInfo * info = 0);
+	virtual bool canPreprocess() const {return canPreprocess_;}
+	virtual bool preprocessImpl(SensorData & data);
 
 private:
 	//Parameters:
@@ -57,6 +60,8 @@ private:
 	float scanKeyFrameThr_;
 
 	Registration * registrationPipeline_;
+	RegistrationVis * featureExtractor_; // used only by preprocess()
+	bool canPreprocess_;
 	Signature refFrame_;
 	Transform lastKeyFramePose_;
 	ParametersMap parameters_;
@@ -34,12 +34,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/point_types.h>
 #include <pcl/pcl_base.h>
 #include <rtabmap/core/Link.h>
+#include <unordered_map>
 
 namespace rtabmap {
 
 class Signature;
 class Registration;
+class RegistrationVis;
 class Optimizer;
+class LocalBundleAdjustmentThread;
 
 class RTABMAP_EXP OdometryF2M : public Odometry
 {
@@ -55,6 +58,15 @@ public:
 
 private:
 	virtual Transform computeTransform(SensorData & data, const Transform & guess = Transform(), OdometryInfo * info = 0);
+	virtual bool canPreprocess() const;
+	virtual bool preprocessImpl(SensorData & data);
+
+	void updateMapIndex();
+	void updateMapIndex(const std::vector<int> & removedWords, const std::vector<int> & updatedWords);
+	void indexMapWord(int wordId, const cv::Point3f & pt);
+	void unindexMapWord(int wordId);
+	void applyAsyncBundleAdjustment(float & bundleTime, int & bundleOutliers, OdometryInfo * info);
+	bool getVisibleMap(const Transform & framePose, const SensorData & data, Signature & visibleMap) const;
 
 private:
 	//Parameters
@@ -69,15 +81,21 @@ private:
 	float scanMapMaxRange_;
 	int bundleAdjustment_;
 	int bundleMaxFrames_;
+	bool bundleAsync_;
 	float validDepthRatio_;
 	int pointToPlaneK_;
 	float pointToPlaneRadius_;
+	float indexVoxelSize_;
+	int guessWinSize_;
 
 	Registration * regPipeline_;
+	RegistrationVis * featureExtractor_; // used only by preprocess()
 	Signature * map_;
 	Signature * lastFrame_;
 	int lastFrameOldestNewId_;
 	std::vector<std::pair<pcl::PointCloud<pcl::PointXYZINormal>::Ptr, pcl::IndicesPtr> > scansBuffer_;
+	std::unordered_map<unsigned long long, std::unordered_map<unsigned long long, std::vector<int> > > mapIndex_; // <block of voxels, <voxel, wordIds>>
+	std::unordered_map<int, unsigned long long> mapIndexVoxels_; // <wordId, voxel>
 
 	std::map<int, std::map<int, FeatureBA> > bundleWordReferences_; //<WordId, <FrameId, pt2D+depth>>
 	std::map<int, Transform> bundlePoses_;
@@ -87,6 +105,7 @@ private:
 	std::map<int, int> bundlePoseReferences_;
 	int bundleSeq_;
 	Optimizer * sba_;
+	LocalBundleAdjustmentThread * bundleThread_;
 	ParametersMap parameters_;
 };
 
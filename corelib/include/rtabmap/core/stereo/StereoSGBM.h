@@ -46,6 +46,13 @@ public:
 			const cv::Mat & leftImage,
 			const cv::Mat & rightImage) const;
 
+protected:
+	virtual cv::Mat computeDisparityImpl(
+			const cv::Mat & leftMono,
+			const cv::Mat & rightImage,
+			int minDisparity,
+			int numDisparities) const;
+
 private:
 	int blockSize_;         //15
 	int minDisparity_;      //0
@@ -57,6 +57,30 @@ std::vector<cv::Point2f> RTABMAP_EXP calcStereoCorrespondences(
 		float minDisparity = 0.0f,
 		float maxDisparity = 64.0f,
 		bool ssdApproach = true); // SSD by default, otherwise it is SAD
+// same as above but with pyramids already built (from cv::buildOpticalFlowPyramid() without derivatives)
+std::vector<cv::Point2f> RTABMAP_EXP calcStereoCorrespondences(
+		const std::vector<cv::Mat> & leftPyramid,
+		const std::vector<cv::Mat> & rightPyramid,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status,
+		cv::Size winSize = cv::Size(6,3),
+		int maxLevel = 3,
+		int iterations = 5,
+		float minDisparity = 0.0f,
+		float maxDisparity = 64.0f,
+		bool ssdApproach = true);
+// Block matching on the full resolution images only: the whole disparity range
+// of a corner is evaluated in one vectorized pass along the epipolar line, then
+// the best disparity is refined by interpolating the costs of its neighbors.
+std::vector<cv::Point2f> RTABMAP_EXP calcStereoCorrespondencesFullRange(
+		const cv::Mat & leftImage,
+		const cv::Mat & rightImage,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status,
+		cv::Size winSize = cv::Size(6,3),
+		float minDisparity = 0.0f,
+		float maxDisparity = 64.0f,
+		bool ssdApproach = true);
 
 // exactly as cv::calcOpticalFlowPyrLK but it should be called with pyramid (from cv::buildOpticalFlowPyramid()) and delta drops the y error.
 void RTABMAP_EXP calcOpticalFlowPyrLKStereo( cv::InputArray _prevImg, cv::InputArray _nextImg,
@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/clams/discrete_depth_distortion_model.h"
 #include <opencv2/stitching/detail/exposure_compensate.hpp>
 #include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UTrace.h>
 #include <rtabmap/utilite/ULogger.h>
 
 #include <pcl/io/io.h>
@@ -260,6 +261,7 @@ void CameraThread::mainLoopBegin()
 
 void CameraThread::mainLoop()
 {
+	UTRACE_SCOPE("CameraThread::mainLoop");
 	UTimer totalTime;
 	CameraInfo info;
 	SensorData data = _camera->takeImage(&info);
@@ -96,6 +96,143 @@ void CompressionThread::mainLoop()
 	this->kill();
 }
 
+CompressionJob::CompressionJob(const cv::Mat & mat, const std::string & format) :
+	uncompressedData_(mat),
+	format_(format),
+	waited_(false)
+{
+	UASSERT(format.empty() || format.compare(".png") == 0 || format.compare(".jpg") == 0);
+}
+
+const cv::Mat & CompressionJob::getCompressedData()
+{
+	if(!waited_)
+	{
+		done_.acquire();
+		waited_ = true;
+	}
+	return compressedData_;
+}
+
+void CompressionJob::process()
+{
+	try
+	{
+		if(!uncompressedData_.empty())
+		{
+			if(!format_.empty())
+			{
+				compressedData_ = compressImage2(uncompressedData_, format_);
+			}
+			else
+			{
+				compressedData_ = compressData2(uncompressedData_);
+			}
+		}
+	}
+	catch (cv::Exception & e) {
+		UERROR("Exception while compressing data: %s", e.what());
+		compressedData_ = cv::Mat();
+	}
+	uncompressedData_ = cv::Mat();
+	done_.release();
+}
+
+class CompressionWorker : public UThread
+{
+public:
+	CompressionWorker(CompressionPool * pool) : pool_(pool) {}
+	virtual ~CompressionWorker() {}
+protected:
+	virtual void mainLoop()
+	{
+		std::shared_ptr<CompressionJob> job = pool_->takeJob();
+		if(job.get())
+		{
+			job->process();
+		}
+	}
+private:
+	CompressionPool * pool_;
+};
+
+CompressionPool::CompressionPool(int threads, int maxQueueSize) :
+	maxQueueSize_(maxQueueSize)
+{
+	UASSERT(threads >= 1);
+	UASSERT(maxQueueSize >= 0);
+	for(int i=0; i<threads; ++i)
+	{
+		workers_.push_back(new CompressionWorker(this));
+		workers_.back()->start();
+	}
+}
+
+CompressionPool::~CompressionPool()
+{
+	// All workers should be killed before waking them up, so
+	// that a worker cannot take the wake up of another one.
+	for(unsigned int i=0; i<workers_.size(); ++i)
+	{
+		workers_[i]->kill();
+	}
+	jobAdded_.release((int)workers_.size());
+	for(unsigned int i=0; i<workers_.size(); ++i)
+	{
+		workers_[i]->join();
+		delete workers_[i];
+	}
+
+	// Don't let anybody wait for jobs not done
+	for(std::list<std::shared_ptr<CompressionJob> >::iterator iter=queue_.begin(); iter!=queue_.end(); ++iter)
+	{
+		(*iter)->process();
+	}
+}
+
+std::shared_ptr<CompressionJob> CompressionPool::compress(const cv::Mat & mat, const std::string & format)
+{
+	std::shared_ptr<CompressionJob> job(new CompressionJob(mat, format));
+	if(mat.empty())
+	{
+		job->process();
+		return job;
+	}
+
+	queueMutex_.lock();
+	if(maxQueueSize_ > 0 && (int)queue_.size() >= maxQueueSize_)
+	{
+		queueMutex_.unlock();
+		UDEBUG("Compression queue is full (%d), compressing in caller's thread.", maxQueueSize_);
+		job->process();
+		return job;
+	}
+	queue_.push_back(job);
+	queueMutex_.unlock();
+	jobAdded_.release();
+	return job;
+}
+
+int CompressionPool::queueSize() const
+{
+	UScopeMutex lock(queueMutex_);
+	return (int)queue_.size();
+}
+
+std::shared_ptr<CompressionJob> CompressionPool::takeJob()
+{
+	std::shared_ptr<CompressionJob> job;
+	jobAdded_.acquire();
+	queueMutex_.lock();
+	if(!queue_.empty())
+	{
+		job = queue_.front();
+		queue_.pop_front();
+	}
+	queueMutex_.unlock();
+	return job;
+}
+
 // ".png" or ".jpg"
 std::vector<unsigned char> compressImage(const cv::Mat & image, const std::string & format)
 {
@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/utilite/UMath.h"
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UTimer.h"
+#include "rtabmap/utilite/UTrace.h"
 #include "rtabmap/utilite/UStl.h"
 
 namespace rtabmap {
@@ -317,6 +318,7 @@ void DBDriver::emptyTrashes(bool async)
 		return;
 	}
 
+	UTRACE_SCOPE("DBDriver::emptyTrashes");
 	UTimer totalTime;
 	totalTime.start();
 
@@ -329,6 +331,7 @@ void DBDriver::emptyTrashes(bool async)
 		visualWords = _trashVisualWords;
 		_trashSignatures.clear();
 		_trashVisualWords.clear();
+		_savingSignatures = signatures;
 
 		_dbSafeAccessMutex.lock();
 	}
@@ -346,12 +349,6 @@ void DBDriver::emptyTrashes(bool async)
 				//Only one query to the database
 				this->saveOrUpdate(uValues(signatures));
 			}
-
-			for(std::map<int, Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
-			{
-				delete iter->second;
-			}
-			signatures.clear();
 			ULOGGER_DEBUG("Time emptying memory signatures trash = %f...", timer.ticks());
 		}
 		if(visualWords.size())
@@ -371,12 +368,43 @@ void DBDriver::emptyTrashes(bool async)
 		}
 
 		this->commit();
+
+		if(this->isConnectedQuery())
+		{
+			this->reclaimFreePagesQuery();
+		}
 	}
 
 	_emptyTrashesTime = totalTime.ticks();
 	ULOGGER_DEBUG("Total time emptying trashes = %fs...", _emptyTrashesTime);
 
 	_dbSafeAccessMutex.unlock();
+
+	// committed, read connections can now get them from the database
+	_trashesMutex.lock();
+	_savingSignatures.clear();
+	_trashesMutex.unlock();
+	for(std::map<int, Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		delete iter->second;
+	}
+	signatures.clear();
+}
+
+const Signature * DBDriver::getTrashSignature(int signatureId) const
+{
+	// _trashesMutex should be locked
+	std::map<int, Signature *>::const_iterator iter = _trashSignatures.find(signatureId);
+	if(iter != _trashSignatures.end())
+	{
+		return iter->second;
+	}
+	iter = _savingSignatures.find(signatureId);
+	if(iter != _savingSignatures.end())
+	{
+		return iter->second;
+	}
+	return 0;
 }
 
 void DBDriver::asyncSave(Signature * s)
@@ -406,6 +434,7 @@ void DBDriver::asyncSave(VisualWord * vw)
 
 void DBDriver::saveOrUpdate(const std::vector<Signature *> & signatures)
 {
+	UTRACE_SCOPE("DBDriver::saveOrUpdate");
 	ULOGGER_DEBUG("");
 	std::list<Signature *> toSave;
 	std::list<Signature *> toUpdate;
@@ -553,16 +582,22 @@ Signature * DBDriver::loadSignature(int id, bool * loadedFromTrash)
 }
 void DBDriver::loadSignatures(const std::list<int> & signIds,
 		std::list<Signature *> & signatures,
-		std::set<int> * loadedFromTrash)
+		std::set<int> * loadedFromTrash,
+		bool featuresOnDemand)
 {
 	UDEBUG("");
 	// look up in the trash before the database
 	std::list<int> ids = signIds;
 	bool valueFound = false;
+	bool saving = false;
 	_trashesMutex.lock();
 	{
 		for(std::list<int>::iterator iter = ids.begin(); iter != ids.end();)
 		{
+			if(_savingSignatures.find(*iter) != _savingSignatures.end())
+			{
+				saving = true;
+			}
 			valueFound = false;
 			for(std::map<int, Signature*>::iterator sIter = _trashSignatures.begin(); sIter!=_trashSignatures.end();)
 			{
@@ -597,9 +632,22 @@ void DBDriver::loadSignatures(const std::list<int> & signIds,
 	UDEBUG("");
 	if(ids.size())
 	{
-		_dbSafeAccessMutex.lock();
-		this->loadSignaturesQuery(ids, signatures);
-		_dbSafeAccessMutex.unlock();
+		// Nodes being saved are not visible to read connections until
+		// committed, wait for the trash thread in that case
+		bool readConnection = !saving && this->acquireReadConnection();
+		if(!readConnection)
+		{
+			_dbSafeAccessMutex.lock();
+		}
+		this->loadSignaturesQuery(ids, signatures, featuresOnDemand);
+		if(readConnection)
+		{
+			this->releaseReadConnection();
+		}
+		else
+		{
+			_dbSafeAccessMutex.unlock();
+		}
 	}
 }
 
@@ -656,6 +704,7 @@ void DBDriver::loadNodeData(std::list<Signature *> & signatures, bool images, bo
 {
 	// Don't look in the trash, we assume that if we want to load
 	// data of a signature, it is not in thrash! Print an error if so.
+	bool saving = false;
 	_trashesMutex.lock();
 	if(_trashSignatures.size())
 	{
@@ -665,10 +714,40 @@ void DBDriver::loadNodeData(std::list<Signature *> & signatures, bool images, bo
 			UASSERT_MSG(!uContains(_trashSignatures, (*iter)->id()), uFormat("Signature %d should not be used when transferred to trash!!!!", (*iter)->id()).c_str());
 		}
 	}
+	for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end() && !saving && _savingSignatures.size(); ++iter)
+	{
+		saving = uContains(_savingSignatures, (*iter)->id());
+	}
 	_trashesMutex.unlock();
 
-	_dbSafeAccessMutex.lock();
+	// See loadSignatures()
+	bool readConnection = !saving && this->acquireReadConnection();
+	if(!readConnection)
+	{
+		_dbSafeAccessMutex.lock();
+	}
 	this->loadNodeDataQuery(signatures, images, scan, userData, occupancyGrid);
+	if(readConnection)
+	{
+		this->releaseReadConnection();
+	}
+	else
+	{
+		_dbSafeAccessMutex.unlock();
+	}
+}
+
+void DBDriver::loadFeatures(Signature * signature) const
+{
+	std::list<Signature *> signatures;
+	signatures.push_back(signature);
+	this->loadFeatures(signatures);
+}
+
+void DBDriver::loadFeatures(std::list<Signature *> & signatures) const
+{
+	_dbSafeAccessMutex.lock();
+	this->loadFeaturesQuery(signatures);
 	_dbSafeAccessMutex.unlock();
 }
 
@@ -680,9 +759,9 @@ void DBDriver::getNodeData(
 	bool found = false;
 	// look in the trash
 	_trashesMutex.lock();
-	if(uContains(_trashSignatures, signatureId))
+	const Signature * s = this->getTrashSignature(signatureId);
+	if(s)
 	{
-		const Signature * s = _trashSignatures.at(signatureId);
 		if((!s->isSaved() ||
 			((!images || !s->sensorData().imageCompressed().empty()) &&
 			 (!scan || !s->sensorData().laserScanCompressed().isEmpty()) &&
@@ -713,13 +792,24 @@ void DBDriver::getNodeData(
 
 	if(!found)
 	{
-		_dbSafeAccessMutex.lock();
+		bool readConnection = this->acquireReadConnection();
+		if(!readConnection)
+		{
+			_dbSafeAccessMutex.lock();
+		}
 		std::list<Signature *> signatures;
 		Signature tmp(signatureId);
 		signatures.push_back(&tmp);
 		loadNodeDataQuery(signatures, images, scan, userData, occupancyGrid);
 		data = signatures.front()->sensorData();
-		_dbSafeAccessMutex.unlock();
+		if(readConnection)
+		{
+			this->releaseReadConnection();
+		}
+		else
+		{
+			_dbSafeAccessMutex.unlock();
+		}
 	}
 }
 
@@ -732,19 +822,28 @@ bool DBDriver::getCalibration(
 	bool found = false;
 	// look in the trash
 	_trashesMutex.lock();
-	if(uContains(_trashSignatures, signatureId))
+	const Signature * s = this->getTrashSignature(signatureId);
+	if(s)
 	{
-		models = _trashSignatures.at(signatureId)->sensorData().cameraModels();
-		stereoModel = _trashSignatures.at(signatureId)->sensorData().stereoCameraModel();
+		models = s->sensorData().cameraModels();
+		stereoModel = s->sensorData().stereoCameraModel();
 		found = true;
 	}
 	_trashesMutex.unlock();
 
 	if(!found)
 	{
-		_dbSafeAccessMutex.lock();
-		found = this->getCalibrationQuery(signatureId, models, stereoModel);
-		_dbSafeAccessMutex.unlock();
+		if(this->acquireReadConnection())
+		{
+			found = this->getCalibrationQuery(signatureId, models, stereoModel);
+			this->releaseReadConnection();
+		}
+		else
+		{
+			_dbSafeAccessMutex.lock();
+			found = this->getCalibrationQuery(signatureId, models, stereoModel);
+			_dbSafeAccessMutex.unlock();
+		}
 	}
 	return found;
 }
@@ -757,18 +856,27 @@ bool DBDriver::getLaserScanInfo(
 	bool found = false;
 	// look in the trash
 	_trashesMutex.lock();
-	if(uContains(_trashSignatures, signatureId))
+	const Signature * s = this->getTrashSignature(signatureId);
+	if(s)
 	{
-		info = _trashSignatures.at(signatureId)->sensorData().laserScanCompressed();
+		info = s->sensorData().laserScanCompressed();
 		found = true;
 	}
 	_trashesMutex.unlock();
 
 	if(!found)
 	{
-		_dbSafeAccessMutex.lock();
-		found = this->getLaserScanInfoQuery(signatureId, info);
-		_dbSafeAccessMutex.unlock();
+		if(this->acquireReadConnection())
+		{
+			found = this->getLaserScanInfoQuery(signatureId, info);
+			this->releaseReadConnection();
+		}
+		else
+		{
+			_dbSafeAccessMutex.lock();
+			found = this->getLaserScanInfoQuery(signatureId, info);
+			_dbSafeAccessMutex.unlock();
+		}
 	}
 	return found;
 }
@@ -788,26 +896,35 @@ bool DBDriver::getNodeInfo(
 	bool found = false;
 	// look in the trash
 	_trashesMutex.lock();
-	if(uContains(_trashSignatures, signatureId))
+	const Signature * s = this->getTrashSignature(signatureId);
+	if(s)
 	{
-		pose = _trashSignatures.at(signatureId)->getPose().clone();
-		mapId = _trashSignatures.at(signatureId)->mapId();
-		weight = _trashSignatures.at(signatureId)->getWeight();
-		label = std::string(_trashSignatures.at(signatureId)->getLabel());
-		stamp = _trashSignatures.at(signatureId)->getStamp();
-		groundTruthPose = _trashSignatures.at(signatureId)->getGroundTruthPose().clone();
-		velocity = std::vector<float>(_trashSignatures.at(signatureId)->getVelocity());
-		gps = GPS(_trashSignatures.at(signatureId)->sensorData().gps());
-		sensors = EnvSensors(_trashSignatures.at(signatureId)->sensorData().envSensors());
+		pose = s->getPose().clone();
+		mapId = s->mapId();
+		weight = s->getWeight();
+		label = std::string(s->getLabel());
+		stamp = s->getStamp();
+		groundTruthPose = s->getGroundTruthPose().clone();
+		velocity = std::vector<float>(s->getVelocity());
+		gps = GPS(s->sensorData().gps());
+		sensors = EnvSensors(s->sensorData().envSensors());
 		found = true;
 	}
 	_trashesMutex.unlock();
 
 	if(!found)
 	{
-		_dbSafeAccessMutex.lock();
-		found = this->getNodeInfoQuery(signatureId, pose, mapId, weight, label, stamp, groundTruthPose, velocity, gps, sensors);
-		_dbSafeAccessMutex.unlock();
+		if(this->acquireReadConnection())
+		{
+			found = this->getNodeInfoQuery(signatureId, pose, mapId, weight, label, stamp, groundTruthPose, velocity, gps, sensors);
+			this->releaseReadConnection();
+		}
+		else
+		{
+			_dbSafeAccessMutex.lock();
+			found = this->getNodeInfoQuery(signatureId, pose, mapId, weight, label, stamp, groundTruthPose, velocity, gps, sensors);
+			_dbSafeAccessMutex.unlock();
+		}
 	}
 	return found;
 }
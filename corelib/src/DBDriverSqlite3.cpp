@@ -57,7 +57,12 @@ DBDriverSqlite3::DBDriverSqlite3(const ParametersMap & parameters) :
 	_cacheSize(Parameters::defaultDbSqlite3CacheSize()),
 	_journalMode(Parameters::defaultDbSqlite3JournalMode()),
 	_synchronous(Parameters::defaultDbSqlite3Synchronous()),
-	_tempStore(Parameters::defaultDbSqlite3TempStore())
+	_tempStore(Parameters::defaultDbSqlite3TempStore()),
+	_incrementalVacuum(Parameters::defaultDbSqlite3IncrementalVacuum()),
+	_dataSharded(Parameters::defaultDbSqlite3DataSharded()),
+	_dataShardAttached(false),
+	_readConnectionsMax(Parameters::defaultDbSqlite3ReadConnections()),
+	_readConnectionsClosing(false)
 {
 	ULOGGER_DEBUG("treadSafe=%d", sqlite3_threadsafe());
 	this->parseParameters(parameters);
@@ -91,6 +96,18 @@ void DBDriverSqlite3::parseParameters(const ParametersMap & parameters)
 	{
 		this->setDbInMemory(uStr2Bool((*iter).second.c_str()));
 	}
+	if((iter=parameters.find(Parameters::kDbSqlite3IncrementalVacuum())) != parameters.end())
+	{
+		this->setIncrementalVacuum(std::atoi((*iter).second.c_str()));
+	}
+	if((iter=parameters.find(Parameters::kDbSqlite3DataSharded())) != parameters.end())
+	{
+		this->setDataSharded(uStr2Bool((*iter).second.c_str()));
+	}
+	if((iter=parameters.find(Parameters::kDbSqlite3ReadConnections())) != parameters.end())
+	{
+		this->setReadConnections(std::atoi((*iter).second.c_str()));
+	}
 	DBDriver::parseParameters(parameters);
 }
 
@@ -102,35 +119,48 @@ void DBDriverSqlite3::setCacheSize(unsigned int cacheSize)
 		std::string query = "PRAGMA cache_size = ";
 		query += uNumber2Str(_cacheSize) + ";";
 		this->executeNoResultQuery(query.c_str());
+		if(_dataShardAttached)
+		{
+			this->executeNoResultQuery(uFormat("PRAGMA data_shard.cache_size = %d;", (int)_cacheSize));
+		}
 	}
 }
 
 void DBDriverSqlite3::setJournalMode(int journalMode)
 {
-	if(journalMode >= 0 && journalMode < 5)
+	if(journalMode >= 0 && journalMode < 6)
 	{
 		_journalMode = journalMode;
 		if(this->isConnected())
 		{
+			std::string mode;
 			switch(_journalMode)
 			{
+			case 5:
+				mode = "WAL";
+				break;
 			case 4:
-				this->executeNoResultQuery("PRAGMA journal_mode = OFF;");
+				mode = "OFF";
 				break;
 			case 3:
-				this->executeNoResultQuery("PRAGMA journal_mode = MEMORY;");
+				mode = "MEMORY";
 				break;
 			case 2:
-				this->executeNoResultQuery("PRAGMA journal_mode = PERSIST;");
+				mode = "PERSIST";
 				break;
 			case 1:
-				this->executeNoResultQuery("PRAGMA journal_mode = TRUNCATE;");
+				mode = "TRUNCATE";
 				break;
 			case 0:
 			default:
-				this->executeNoResultQuery("PRAGMA journal_mode = DELETE;");
+				mode = "DELETE";
 				break;
 			}
+			this->executeNoResultQuery(uFormat("PRAGMA main.journal_mode = %s;", mode.c_str()));
+			if(_dataShardAttached)
+			{
+				this->executeNoResultQuery(uFormat("PRAGMA data_shard.journal_mode = %s;", mode.c_str()));
+			}
 		}
 	}
 	else
@@ -146,19 +176,25 @@ void DBDriverSqlite3::setSynchronous(int synchronous)
 		_synchronous = synchronous;
 		if(this->isConnected())
 		{
+			std::string mode;
 			switch(_synchronous)
 			{
 			case 0:
-				this->executeNoResultQuery("PRAGMA synchronous = OFF;");
+				mode = "OFF";
 				break;
 			case 1:
-				this->executeNoResultQuery("PRAGMA synchronous = NORMAL;");
+				mode = "NORMAL";
 				break;
 			case 2:
 			default:
-				this->executeNoResultQuery("PRAGMA synchronous = FULL;");
+				mode = "FULL";
 				break;
 			}
+			this->executeNoResultQuery(uFormat("PRAGMA main.synchronous = %s;", mode.c_str()));
+			if(_dataShardAttached)
+			{
+				this->executeNoResultQuery(uFormat("PRAGMA data_shard.synchronous = %s;", mode.c_str()));
+			}
 		}
 	}
 	else
@@ -195,6 +231,21 @@ void DBDriverSqlite3::setTempStore(int tempStore)
 	}
 }
 
+void DBDriverSqlite3::setIncrementalVacuum(int pages)
+{
+	_incrementalVacuum = pages;
+}
+
+void DBDriverSqlite3::setDataSharded(bool dataSharded)
+{
+	_dataSharded = dataSharded;
+}
+
+void DBDriverSqlite3::setReadConnections(int readConnections)
+{
+	_readConnectionsMax = readConnections;
+}
+
 void DBDriverSqlite3::setDbInMemory(bool dbInMemory)
 {
 	UDEBUG("dbInMemory=%d", dbInMemory?1:0);
@@ -233,7 +284,7 @@ void DBDriverSqlite3::setDbInMemory(bool dbInMemory)
 ** If the operation is successful, SQLITE_OK is returned. Otherwise, if
 ** an error occurs, an SQLite error code is returned.
 */
-int DBDriverSqlite3::loadOrSaveDb(sqlite3 *pInMemory, const std::string & fileName, int isSave) const
+int DBDriverSqlite3::loadOrSaveDb(sqlite3 *pInMemory, const std::string & fileName, int isSave, const std::string & schema) const
 {
   int rc;                   /* Function return code */
   sqlite3 *pFile = 0;           /* Database connection opened on zFilename */
@@ -255,7 +306,7 @@ int DBDriverSqlite3::loadOrSaveDb(sqlite3 *pInMemory, const std::string & fileNa
     pTo   = (isSave ? pFile     : pInMemory);
 
     /* Set up the backup procedure to copy from the "main" database of
-    ** connection pFile to the main database of connection pInMemory.
+    ** connection pFile to the "schema" database of connection pInMemory.
     ** If something goes wrong, pBackup will be set to NULL and an error
     ** code and  message left in connection pTo.
     **
@@ -266,7 +317,7 @@ int DBDriverSqlite3::loadOrSaveDb(sqlite3 *pInMemory, const std::string & fileNa
     ** connection pTo. If no error occurred, then the error code belonging
     ** to pTo is set to SQLITE_OK.
     */
-    pBackup = sqlite3_backup_init(pTo, "main", pFrom, "main");
+    pBackup = sqlite3_backup_init(pTo, isSave?"main":schema.c_str(), pFrom, isSave?schema.c_str():"main");
     if( pBackup ){
       (void)sqlite3_backup_step(pBackup, -1);
       (void)sqlite3_backup_finish(pBackup);
@@ -324,9 +375,11 @@ bool DBDriverSqlite3::connectDatabaseQuery(const std::string & url, bool overwri
 	// Open a database connection
 	_ppDb = 0;
 	_memoryUsedEstimate = 0;
+	_dataShardAttached = false;
 
 	int rc = SQLITE_OK;
 	bool dbFileExist = false;
+	std::string dataShardUrl = url.empty()?"":url + ".data";
 	if(!url.empty())
 	{
 		dbFileExist = UFile::exists(url.c_str());
@@ -339,6 +392,15 @@ bool DBDriverSqlite3::connectDatabaseQuery(const std::string & url, bool overwri
 		else if(dbFileExist)
 		{
 			_memoryUsedEstimate = UFile::length(this->getUrl());
+			if(UFile::exists(dataShardUrl))
+			{
+				_memoryUsedEstimate += UFile::length(dataShardUrl);
+			}
+		}
+		if(!dbFileExist && UFile::exists(dataShardUrl))
+		{
+			UINFO("Deleting database data shard %s...", dataShardUrl.c_str());
+			UASSERT(UFile::erase(dataShardUrl) == 0);
 		}
 	}
 
@@ -420,7 +482,53 @@ bool DBDriverSqlite3::connectDatabaseQuery(const std::string & url, bool overwri
 			}
 		}
 		schema = uHex2Str(schema);
+		if(_incrementalVacuum != 0)
+		{
+			// must be set before tables are created
+			this->executeNoResultQuery("PRAGMA auto_vacuum = INCREMENTAL;");
+		}
 		this->executeNoResultQuery(schema.c_str());
+
+		if(_dataSharded)
+		{
+			if(_dbInMemory || url.empty())
+			{
+				UWARN("Parameter %s is ignored for databases in memory.", Parameters::kDbSqlite3DataSharded().c_str());
+			}
+			else
+			{
+				attachDataShardQuery(dataShardUrl, true);
+			}
+		}
+	}
+	else if(!hasMainTableQuery("Data"))
+	{
+		if(!dataShardUrl.empty() && UFile::exists(dataShardUrl))
+		{
+			// loaded in memory too if the database is in memory
+			attachDataShardQuery(dataShardUrl, false);
+		}
+		else if(this->getDatabaseVersionQuery(_version) && uStrNumCmp(_version, "0.10.0") >= 0)
+		{
+			UERROR("Table \"Data\" is not in database \"%s\" and its data shard \"%s\" cannot be found, sensor data won't be available.", url.c_str(), dataShardUrl.c_str());
+		}
+		// else databases older than 0.10.0 have no Data table, they are not sharded
+	}
+
+	if(dbFileExist && _incrementalVacuum != 0)
+	{
+		sqlite3_stmt * ppStmt = 0;
+		int rc = sqlite3_prepare_v2(_ppDb, "PRAGMA auto_vacuum;", -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_step(ppStmt);
+		if(rc == SQLITE_ROW && sqlite3_column_int(ppStmt, 0) != 2)
+		{
+			UWARN("Parameter %s is set but database \"%s\" has not been created with "
+				  "incremental auto vacuum, free pages won't be reclaimed.",
+				  Parameters::kDbSqlite3IncrementalVacuum().c_str(), url.c_str());
+		}
+		rc = sqlite3_finalize(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 	}
 	UASSERT(this->getDatabaseVersionQuery(_version)); // must be true!
 	UINFO("Database version = %s", _version.c_str());
@@ -442,11 +550,29 @@ bool DBDriverSqlite3::connectDatabaseQuery(const std::string & url, bool overwri
 	this->setSynchronous(_synchronous); // this will call the SQL
 	this->setTempStore(_tempStore); // this will call the SQL
 
+	if(_readConnectionsMax > 0)
+	{
+		if(_dbInMemory || url.empty())
+		{
+			UWARN("Parameter %s is ignored for databases in memory.", Parameters::kDbSqlite3ReadConnections().c_str());
+		}
+		else if(_journalMode != 5)
+		{
+			UWARN("Parameter %s is ignored, %s should be 5 (WAL) so that reads don't block writes.",
+					Parameters::kDbSqlite3ReadConnections().c_str(), Parameters::kDbSqlite3JournalMode().c_str());
+		}
+		else
+		{
+			openReadConnections(url);
+		}
+	}
+
 	return true;
 }
 void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & outputUrl)
 {
 	UDEBUG("");
+	closeReadConnections();
 	if(_ppDb)
 	{
 		int rc = SQLITE_OK;
@@ -481,6 +607,11 @@ void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & out
 				rc = loadOrSaveDb(_ppDb, outputFile, 1); // Save memory to file
 				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s), could not save \"%s\": %s. Make sure that your user has write " 
 					"permission on the target directory (you may have to change the working directory). ", _version.c_str(), outputFile.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+				if(_dataShardAttached)
+				{
+					rc = loadOrSaveDb(_ppDb, outputFile+".data", 1, "data_shard"); // Save memory data shard to file
+					UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s), could not save \"%s\": %s.", _version.c_str(), (outputFile+".data").c_str(), sqlite3_errmsg(_ppDb)).c_str());
+				}
 				ULOGGER_DEBUG("Saving DB time = %fs", timer.ticks());
 			}
 		}
@@ -499,7 +630,12 @@ void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & out
 			{
 				UERROR("Failed to rename just closed db %s to %s", this->getUrl().c_str(), outputUrl.c_str());
 			}
+			else if(_dataShardAttached && UFile::rename(this->getUrl()+".data", outputUrl+".data") != 0)
+			{
+				UERROR("Failed to rename just closed db data shard %s to %s", (this->getUrl()+".data").c_str(), (outputUrl+".data").c_str());
+			}
 		}
+		_dataShardAttached = false;
 	}
 }
 
@@ -508,6 +644,210 @@ bool DBDriverSqlite3::isConnectedQuery() const
 	return _ppDb != 0;
 }
 
+void DBDriverSqlite3::reclaimFreePagesQuery() const
+{
+	if(_ppDb && _incrementalVacuum != 0)
+	{
+		UTimer timer;
+		this->executeNoResultQuery(uFormat("PRAGMA incremental_vacuum(%d);", _incrementalVacuum>0?_incrementalVacuum:0));
+		if(_dataShardAttached)
+		{
+			this->executeNoResultQuery(uFormat("PRAGMA data_shard.incremental_vacuum(%d);", _incrementalVacuum>0?_incrementalVacuum:0));
+		}
+		UDEBUG("Incremental vacuum (%d pages max): %fs", _incrementalVacuum, timer.ticks());
+	}
+}
+
+void DBDriverSqlite3::openReadConnections(const std::string & url)
+{
+	UScopeMutex lock(_readConnectionsMutex);
+	for(int i=0; i<_readConnectionsMax; ++i)
+	{
+		sqlite3 * db = 0;
+		int rc = sqlite3_open_v2(url.c_str(), &db, SQLITE_OPEN_READONLY, 0);
+		if(rc == SQLITE_OK && _dataShardAttached)
+		{
+			sqlite3_stmt * ppStmt = 0;
+			std::string dataShardUrl = url + ".data";
+			rc = sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS data_shard;", -1, &ppStmt, 0);
+			if(rc == SQLITE_OK)
+			{
+				sqlite3_bind_text(ppStmt, 1, dataShardUrl.c_str(), -1, SQLITE_STATIC);
+				rc = sqlite3_step(ppStmt)==SQLITE_DONE?SQLITE_OK:sqlite3_errcode(db);
+				sqlite3_finalize(ppStmt);
+			}
+		}
+		if(rc != SQLITE_OK)
+		{
+			UERROR("Failed opening read connection %d on \"%s\": %s", i, url.c_str(), sqlite3_errmsg(db));
+			sqlite3_close(db);
+			break;
+		}
+		// in case of a checkpoint
+		sqlite3_busy_timeout(db, 1000);
+		_readConnections.push_back(db);
+		_freeReadConnections.push_back(db);
+	}
+	UINFO("Opened %d read connections", (int)_readConnections.size());
+}
+
+void DBDriverSqlite3::closeReadConnections()
+{
+	// Refuse new acquisitions, then wait for the ones still used
+	_readConnectionsMutex.lock();
+	UASSERT_MSG(_acquiredReadConnections.find(UThread::currentThreadId()) == _acquiredReadConnections.end(),
+			"Read connections cannot be closed while this thread still uses one.");
+	_freeReadConnections.clear();
+	_readConnectionsClosing = true;
+	int used = (int)_acquiredReadConnections.size();
+	_readConnectionsMutex.unlock();
+	if(used)
+	{
+		UDEBUG("Waiting for %d read connections to be released...", used);
+		_readConnectionsReleased.acquire(used);
+	}
+
+	UScopeMutex lock(_readConnectionsMutex);
+	UASSERT(_acquiredReadConnections.empty());
+	_readConnectionsClosing = false;
+	for(std::list<sqlite3 *>::iterator iter=_readConnections.begin(); iter!=_readConnections.end(); ++iter)
+	{
+		sqlite3_close(*iter);
+	}
+	_readConnections.clear();
+	_freeReadConnections.clear();
+}
+
+bool DBDriverSqlite3::acquireReadConnection() const
+{
+	UScopeMutex lock(_readConnectionsMutex);
+	if(!_freeReadConnections.empty())
+	{
+		unsigned long threadId = UThread::currentThreadId();
+		UASSERT_MSG(_acquiredReadConnections.find(threadId) == _acquiredReadConnections.end(), "A read connection is already used by this thread.");
+		_acquiredReadConnections.insert(std::make_pair(threadId, _freeReadConnections.front()));
+		_freeReadConnections.pop_front();
+		return true;
+	}
+	return false;
+}
+
+void DBDriverSqlite3::releaseReadConnection() const
+{
+	UScopeMutex lock(_readConnectionsMutex);
+	std::map<unsigned long, sqlite3 *>::iterator iter = _acquiredReadConnections.find(UThread::currentThreadId());
+	UASSERT(iter != _acquiredReadConnections.end());
+	sqlite3 * db = iter->second;
+	_acquiredReadConnections.erase(iter);
+	if(_readConnectionsClosing)
+	{
+		// closeReadConnections() is waiting for it
+		_readConnectionsReleased.release();
+	}
+	else
+	{
+		_freeReadConnections.push_back(db);
+	}
+}
+
+sqlite3 * DBDriverSqlite3::readConnection() const
+{
+	UScopeMutex lock(_readConnectionsMutex);
+	std::map<unsigned long, sqlite3 *>::const_iterator iter = _acquiredReadConnections.find(UThread::currentThreadId());
+	if(iter != _acquiredReadConnections.end())
+	{
+		return iter->second;
+	}
+	return _ppDb;
+}
+
+bool DBDriverSqlite3::hasMainTableQuery(const std::string & table) const
+{
+	bool found = false;
+	if(_ppDb)
+	{
+		sqlite3_stmt * ppStmt = 0;
+		int rc = sqlite3_prepare_v2(_ppDb, "SELECT name FROM main.sqlite_master WHERE type='table' AND name=?;", -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_bind_text(ppStmt, 1, table.c_str(), -1, SQLITE_STATIC);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		found = sqlite3_step(ppStmt) == SQLITE_ROW;
+		rc = sqlite3_finalize(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	}
+	return found;
+}
+
+void DBDriverSqlite3::attachDataShardQuery(const std::string & path, bool create)
+{
+	UINFO("Attaching data shard \"%s\"...", path.c_str());
+	sqlite3_stmt * ppStmt = 0;
+	int rc = sqlite3_prepare_v2(_ppDb, "ATTACH DATABASE ? AS data_shard;", -1, &ppStmt, 0);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	// With a database in memory, the shard file is modified only when the database is saved
+	rc = sqlite3_bind_text(ppStmt, 1, _dbInMemory?":memory:":path.c_str(), -1, SQLITE_STATIC);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	rc = sqlite3_step(ppStmt);
+	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	rc = sqlite3_finalize(ppStmt);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	_dataShardAttached = true;
+
+	if(_dbInMemory && !create)
+	{
+		UTimer timer;
+		rc = loadOrSaveDb(_ppDb, path, 0, "data_shard"); // Load memory data shard from file
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s), could not load \"%s\": %s", _version.c_str(), path.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UINFO("Loading data shard time = %fs, (%s)", timer.ticks(), path.c_str());
+	}
+
+	if(create)
+	{
+		// Move the (empty) Data table of the new database to the shard, keeping
+		// the schema of the target version. Unqualified "Data" in queries then
+		// resolves to the shard.
+		rc = sqlite3_prepare_v2(_ppDb, "SELECT sql FROM main.sqlite_master WHERE type='table' AND name='Data';", -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		std::string sql;
+		if(sqlite3_step(ppStmt) == SQLITE_ROW)
+		{
+			sql = (const char *)sqlite3_column_text(ppStmt, 0);
+		}
+		rc = sqlite3_finalize(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+		const std::string prefix = "CREATE TABLE Data";
+		UASSERT_MSG(sql.compare(0, prefix.size(), prefix) == 0, uFormat("Unexpected Data table schema: \"%s\"", sql.c_str()).c_str());
+		sql.replace(0, prefix.size(), "CREATE TABLE data_shard.Data");
+
+		if(_incrementalVacuum != 0)
+		{
+			this->executeNoResultQuery("PRAGMA data_shard.auto_vacuum = INCREMENTAL;");
+		}
+		// persistent triggers cannot refer to tables of another database,
+		// it is replaced by the TEMP trigger below
+		this->executeNoResultQuery("DROP TRIGGER IF EXISTS insert_Data_timeEnter;");
+		this->executeNoResultQuery("DROP TABLE main.Data;");
+		this->executeNoResultQuery(sql);
+	}
+
+	// TEMP triggers are not saved in the database, it is recreated on each connection
+	this->executeNoResultQuery(
+			"CREATE TEMP TRIGGER IF NOT EXISTS insert_Data_timeEnter AFTER INSERT ON data_shard.Data "
+			"BEGIN "
+			"UPDATE Node SET time_enter = DATETIME('NOW') WHERE rowid = new.rowid; "
+			"END;");
+
+	// Cache size, journal mode and synchronous of the shard are set with the ones of the main database.
+	// In WAL mode, sqlite doesn't commit atomically across attached databases (no super-journal):
+	// a crash during a commit can leave the shard and the main file out of sync.
+	if(_journalMode == 5)
+	{
+		UINFO("Data shard is used with WAL journal mode (%s=5): commits are atomic in each file but not across both.",
+				Parameters::kDbSqlite3JournalMode().c_str());
+	}
+}
+
 // In bytes
 void DBDriverSqlite3::executeNoResultQuery(const std::string & sql) const
 {
@@ -1293,6 +1633,7 @@ std::map<int, std::vector<int> > DBDriverSqlite3::getAllStatisticsWmStatesQuery(
 
 void DBDriverSqlite3::loadNodeDataQuery(std::list<Signature *> & signatures, bool images, bool scan, bool userData, bool occupancyGrid) const
 {
+	sqlite3 * db = readConnection();
 	UDEBUG("load data for %d signatures images=%d scan=%d userData=%d, grid=%d",
 			(int)signatures.size(), images?1:0, scan?1:0, userData?1:0, occupancyGrid?1:0);
 
@@ -1302,7 +1643,7 @@ void DBDriverSqlite3::loadNodeDataQuery(std::list<Signature *> & signatures, boo
 		return;
 	}
 
-	if(_ppDb)
+	if(db)
 	{
 		UTimer timer;
 		timer.start();
@@ -1423,8 +1764,8 @@ void DBDriverSqlite3::loadNodeDataQuery(std::list<Signature *> & signatures, boo
 				  <<";";
 		}
 
-		rc = sqlite3_prepare_v2(_ppDb, query.str().c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_prepare_v2(db, query.str().c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		const void * data = 0;
 		int dataSize = 0;
@@ -1437,7 +1778,7 @@ void DBDriverSqlite3::loadNodeDataQuery(std::list<Signature *> & signatures, boo
 			ULOGGER_DEBUG("Loading data for %d...", (*iter)->id());
 			// bind id
 			rc = sqlite3_bind_int(ppStmt, 1, (*iter)->id());
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			// Process the result if one
 			rc = sqlite3_step(ppStmt);
@@ -1833,16 +2174,16 @@ void DBDriverSqlite3::loadNodeDataQuery(std::list<Signature *> & signatures, boo
 
 				rc = sqlite3_step(ppStmt); // next result...
 			}
-			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			//reset
 			rc = sqlite3_reset(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 		}
 
 		// Finalize (delete) the statement
 		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 		ULOGGER_DEBUG("Time=%fs", timer.ticks());
 	}
 }
@@ -1852,8 +2193,9 @@ bool DBDriverSqlite3::getCalibrationQuery(
 		std::vector<CameraModel> & models,
 		StereoCameraModel & stereoModel) const
 {
+	sqlite3 * db = readConnection();
 	bool found = false;
-	if(_ppDb && signatureId)
+	if(db && signatureId)
 	{
 		int rc = SQLITE_OK;
 		sqlite3_stmt * ppStmt = 0;
@@ -1881,8 +2223,8 @@ bool DBDriverSqlite3::getCalibrationQuery(
 				  <<";";
 		}
 
-		rc = sqlite3_prepare_v2(_ppDb, query.str().c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_prepare_v2(db, query.str().c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		const void * data = 0;
 		int dataSize = 0;
@@ -2074,11 +2416,11 @@ bool DBDriverSqlite3::getCalibrationQuery(
 
 			rc = sqlite3_step(ppStmt); // next result...
 		}
-		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		// Finalize (delete) the statement
 		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 	}
 	return found;
 }
@@ -2087,8 +2429,9 @@ bool DBDriverSqlite3::getLaserScanInfoQuery(
 		int signatureId,
 		LaserScan & info) const
 {
+	sqlite3 * db = readConnection();
 	bool found = false;
-	if(_ppDb && signatureId)
+	if(db && signatureId)
 	{
 		int rc = SQLITE_OK;
 		sqlite3_stmt * ppStmt = 0;
@@ -2106,8 +2449,8 @@ bool DBDriverSqlite3::getLaserScanInfoQuery(
 			return false;
 		}
 
-		rc = sqlite3_prepare_v2(_ppDb, query.str().c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_prepare_v2(db, query.str().c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		const void * data = 0;
 		int dataSize = 0;
@@ -2182,11 +2525,11 @@ bool DBDriverSqlite3::getLaserScanInfoQuery(
 
 			rc = sqlite3_step(ppStmt); // next result...
 		}
-		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		// Finalize (delete) the statement
 		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 	}
 	return found;
 }
@@ -2202,8 +2545,9 @@ bool DBDriverSqlite3::getNodeInfoQuery(int signatureId,
 		GPS & gps,
 		EnvSensors & sensors) const
 {
+	sqlite3 * db = readConnection();
 	bool found = false;
-	if(_ppDb && signatureId)
+	if(db && signatureId)
 	{
 		int rc = SQLITE_OK;
 		sqlite3_stmt * ppStmt = 0;
@@ -2252,8 +2596,8 @@ bool DBDriverSqlite3::getNodeInfoQuery(int signatureId,
 					 ";";
 		}
 
-		rc = sqlite3_prepare_v2(_ppDb, query.str().c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_prepare_v2(db, query.str().c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		const void * data = 0;
 		int dataSize = 0;
@@ -2343,11 +2687,11 @@ bool DBDriverSqlite3::getNodeInfoQuery(int signatureId,
 
 			rc = sqlite3_step(ppStmt); // next result...
 		}
-		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		// Finalize (delete) the statement
 		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 	}
 	return found;
 }
@@ -2875,10 +3219,11 @@ void DBDriverSqlite3::getWeightQuery(int nodeId, int & weight) const
 }
 
 //may be slower than the previous version but don't have a limit of words that can be loaded at the same time
-void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & nodes) const
+void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & nodes, bool featuresOnDemand) const
 {
+	sqlite3 * db = readConnection();
 	ULOGGER_DEBUG("count=%d", (int)ids.size());
-	if(_ppDb && ids.size())
+	if(db && ids.size())
 	{
 		std::string type;
 		UTimer timer;
@@ -2926,15 +3271,15 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 				  << "WHERE id=?;";
 		}
 
-		rc = sqlite3_prepare_v2(_ppDb, query.str().c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_prepare_v2(db, query.str().c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		for(std::list<int>::const_iterator iter=ids.begin(); iter!=ids.end(); ++iter)
 		{
 			//ULOGGER_DEBUG("Loading node %d...", *iter);
 			// bind id
 			rc = sqlite3_bind_int(ppStmt, 1, *iter);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			int id = 0;
 			int mapId = 0;
@@ -3034,7 +3379,7 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 
 				rc = sqlite3_step(ppStmt);
 			}
-			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			// create the node
 			if(id)
@@ -3068,181 +3413,16 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 
 			//reset
 			rc = sqlite3_reset(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 		}
 
 		// Finalize (delete) the statement
 		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		ULOGGER_DEBUG("Time=%fs", timer.ticks());
 
-		// Prepare the query... Get the map from signature and visual words
-		std::stringstream query2;
-		if(uStrNumCmp(_version, "0.13.0") >= 0)
-		{
-			query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor "
-					 "FROM Feature "
-					 "WHERE node_id = ? ";
-		}
-		else if(uStrNumCmp(_version, "0.12.0") >= 0)
-		{
-			query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor "
-					 "FROM Map_Node_Word "
-					 "WHERE node_id = ? ";
-		}
-		else if(uStrNumCmp(_version, "0.11.2") >= 0)
-		{
-			query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z, descriptor_size, descriptor "
-					 "FROM Map_Node_Word "
-					 "WHERE node_id = ? ";
-		}
-		else
-		{
-			query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z "
-					 "FROM Map_Node_Word "
-					 "WHERE node_id = ? ";
-		}
-
-		query2 << " ORDER BY word_id"; // Needed for fast insertion below
-		query2 << ";";
-
-		rc = sqlite3_prepare_v2(_ppDb, query2.str().c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-		float nanFloat = std::numeric_limits<float>::quiet_NaN ();
-
-		for(std::list<Signature*>::const_iterator iter=nodes.begin(); iter!=nodes.end(); ++iter)
-		{
-			//ULOGGER_DEBUG("Loading words of %d...", (*iter)->id());
-			// bind id
-			rc = sqlite3_bind_int(ppStmt, 1, (*iter)->id());
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-			int visualWordId = 0;
-			int descriptorSize = 0;
-			const void * descriptor = 0;
-			int dRealSize = 0;
-			cv::KeyPoint kpt;
-			std::multimap<int, int> visualWords;
-			std::vector<cv::KeyPoint> visualWordsKpts;
-			std::vector<cv::Point3f> visualWords3;
-			cv::Mat descriptors;
-			bool allWords3NaN = true;
-			cv::Point3f depth(0,0,0);
-
-			// Process the result if one
-			rc = sqlite3_step(ppStmt);
-			while(rc == SQLITE_ROW)
-			{
-				int index = 0;
-				visualWordId = sqlite3_column_int(ppStmt, index++);
-				kpt.pt.x = sqlite3_column_double(ppStmt, index++);
-				kpt.pt.y = sqlite3_column_double(ppStmt, index++);
-				kpt.size = sqlite3_column_int(ppStmt, index++);
-				kpt.angle = sqlite3_column_double(ppStmt, index++);
-				kpt.response = sqlite3_column_double(ppStmt, index++);
-				if(uStrNumCmp(_version, "0.12.0") >= 0)
-				{
-					kpt.octave = sqlite3_column_int(ppStmt, index++);
-				}
-
-				if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
-				{
-					depth.x = nanFloat;
-					++index;
-				}
-				else
-				{
-					depth.x = sqlite3_column_double(ppStmt, index++);
-				}
-
-				if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
-				{
-					depth.y = nanFloat;
-					++index;
-				}
-				else
-				{
-					depth.y = sqlite3_column_double(ppStmt, index++);
-				}
-
-				if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
-				{
-					depth.z = nanFloat;
-					++index;
-				}
-				else
-				{
-					depth.z = sqlite3_column_double(ppStmt, index++);
-				}
-
-				visualWordsKpts.push_back(kpt);
-				visualWords.insert(visualWords.end(), std::make_pair(visualWordId, visualWordsKpts.size()-1));
-				visualWords3.push_back(depth);
-
-				if(allWords3NaN && util3d::isFinite(depth))
-				{
-					allWords3NaN = false;
-				}
-
-				if(uStrNumCmp(_version, "0.11.2") >= 0)
-				{
-					descriptorSize = sqlite3_column_int(ppStmt, index++); // VisualWord descriptor size
-					descriptor = sqlite3_column_blob(ppStmt, index); 	// VisualWord descriptor array
-					dRealSize = sqlite3_column_bytes(ppStmt, index++);
-
-					if(descriptor && descriptorSize>0 && dRealSize>0)
-					{
-						cv::Mat d;
-						if(dRealSize == descriptorSize)
-						{
-							// CV_8U binary descriptors
-							d = cv::Mat(1, descriptorSize, CV_8U);
-						}
-						else if(dRealSize/int(sizeof(float)) == descriptorSize)
-						{
-							// CV_32F
-							d = cv::Mat(1, descriptorSize, CV_32F);
-						}
-						else
-						{
-							UFATAL("Saved buffer size (%d bytes) is not the same as descriptor size (%d)", dRealSize, descriptorSize);
-						}
-
-						memcpy(d.data, descriptor, dRealSize);
-
-						descriptors.push_back(d);
-					}
-				}
-
-				rc = sqlite3_step(ppStmt);
-			}
-			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-			if(visualWords.size()==0)
-			{
-				UDEBUG("Empty signature detected! (id=%d)", (*iter)->id());
-			}
-			else
-			{
-				if(allWords3NaN)
-				{
-					visualWords3.clear();
-				}
-				(*iter)->setWords(visualWords, visualWordsKpts, visualWords3, descriptors);
-				ULOGGER_DEBUG("Add %d keypoints, %d 3d points and %d descriptors to node %d", (int)visualWords.size(), allWords3NaN?0:(int)visualWords3.size(), (int)descriptors.rows, (*iter)->id());
-			}
-
-			//reset
-			rc = sqlite3_reset(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-		}
-
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
+		this->loadWordsAndFeaturesQuery(nodes, featuresOnDemand, false);
 		ULOGGER_DEBUG("Time=%fs", timer.ticks());
 
 		this->loadLinksQuery(nodes);
@@ -3261,14 +3441,14 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 					 "FROM Data "
 					 "WHERE id = ? ";
 
-			rc = sqlite3_prepare_v2(_ppDb, query3.str().c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			rc = sqlite3_prepare_v2(db, query3.str().c_str(), -1, &ppStmt, 0);
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			for(std::list<Signature*>::const_iterator iter=nodes.begin(); iter!=nodes.end(); ++iter)
 			{
 				// bind id
 				rc = sqlite3_bind_int(ppStmt, 1, (*iter)->id());
-				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 				rc = sqlite3_step(ppStmt);
 				if(rc == SQLITE_ROW)
@@ -3419,15 +3599,15 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 					}
 					rc = sqlite3_step(ppStmt);
 				}
-				UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+				UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 				//reset
 				rc = sqlite3_reset(ppStmt);
-				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 			}
 			// Finalize (delete) the statement
 			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			ULOGGER_DEBUG("Time load %d calibrations=%fs", (int)nodes.size(), timer.ticks());
 		}
@@ -3440,14 +3620,14 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 					 "FROM GlobalDescriptor "
 					 "WHERE node_id = ? ";
 
-			rc = sqlite3_prepare_v2(_ppDb, query3.str().c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			rc = sqlite3_prepare_v2(db, query3.str().c_str(), -1, &ppStmt, 0);
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			for(std::list<Signature*>::const_iterator iter=nodes.begin(); iter!=nodes.end(); ++iter)
 			{
 				// bind id
 				rc = sqlite3_bind_int(ppStmt, 1, (*iter)->id());
-				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 				std::vector<GlobalDescriptor> globalDescriptors;
 
@@ -3480,7 +3660,7 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 
 					rc = sqlite3_step(ppStmt);
 				}
-				UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+				UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 				if(!globalDescriptors.empty())
 				{
@@ -3490,11 +3670,11 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 
 				//reset
 				rc = sqlite3_reset(ppStmt);
-				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 			}
 			// Finalize (delete) the statement
 			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			ULOGGER_DEBUG("Time load %d global descriptors=%fs", (int)nodes.size(), timer.ticks());
 		}
@@ -3506,6 +3686,226 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 	}
 }
 
+void DBDriverSqlite3::loadFeaturesQuery(std::list<Signature *> & signatures) const
+{
+	ULOGGER_DEBUG("count=%d", (int)signatures.size());
+	if(_ppDb && signatures.size())
+	{
+		UTimer timer;
+		this->loadWordsAndFeaturesQuery(signatures, false, true);
+		ULOGGER_DEBUG("Time=%fs", timer.ticks());
+	}
+}
+
+void DBDriverSqlite3::loadWordsAndFeaturesQuery(const std::list<Signature *> & nodes, bool wordIdsOnly, bool featuresOnly) const
+{
+	sqlite3 * db = readConnection();
+	UASSERT(!(wordIdsOnly && featuresOnly));
+	int rc = SQLITE_OK;
+	sqlite3_stmt * ppStmt = 0;
+
+	// Prepare the query... Get the map from signature and visual words
+	std::stringstream query2;
+	if(wordIdsOnly)
+	{
+		query2 << "SELECT word_id "
+				 "FROM " << (uStrNumCmp(_version, "0.13.0") >= 0?"Feature":"Map_Node_Word") << " "
+				 "WHERE node_id = ? ";
+	}
+	else if(uStrNumCmp(_version, "0.13.0") >= 0)
+	{
+		query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor "
+				 "FROM Feature "
+				 "WHERE node_id = ? ";
+	}
+	else if(uStrNumCmp(_version, "0.12.0") >= 0)
+	{
+		query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor "
+				 "FROM Map_Node_Word "
+				 "WHERE node_id = ? ";
+	}
+	else if(uStrNumCmp(_version, "0.11.2") >= 0)
+	{
+		query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z, descriptor_size, descriptor "
+				 "FROM Map_Node_Word "
+				 "WHERE node_id = ? ";
+	}
+	else
+	{
+		query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z "
+				 "FROM Map_Node_Word "
+				 "WHERE node_id = ? ";
+	}
+
+	query2 << " ORDER BY word_id, rowid"; // Needed for fast insertion below, rowid to get the same order when features are loaded afterwards
+	query2 << ";";
+
+	rc = sqlite3_prepare_v2(db, query2.str().c_str(), -1, &ppStmt, 0);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
+
+	float nanFloat = std::numeric_limits<float>::quiet_NaN ();
+
+	for(std::list<Signature*>::const_iterator iter=nodes.begin(); iter!=nodes.end(); ++iter)
+	{
+		//ULOGGER_DEBUG("Loading words of %d...", (*iter)->id());
+		// bind id
+		rc = sqlite3_bind_int(ppStmt, 1, (*iter)->id());
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
+
+		int visualWordId = 0;
+		int descriptorSize = 0;
+		const void * descriptor = 0;
+		int dRealSize = 0;
+		cv::KeyPoint kpt;
+		std::multimap<int, int> visualWords;
+		std::vector<cv::KeyPoint> visualWordsKpts;
+		std::vector<cv::Point3f> visualWords3;
+		cv::Mat descriptors;
+		bool allWords3NaN = true;
+		cv::Point3f depth(0,0,0);
+
+		// Process the result if one
+		rc = sqlite3_step(ppStmt);
+		while(rc == SQLITE_ROW)
+		{
+			int index = 0;
+			visualWordId = sqlite3_column_int(ppStmt, index++);
+			if(wordIdsOnly)
+			{
+				visualWords.insert(visualWords.end(), std::make_pair(visualWordId, (int)visualWords.size()));
+				rc = sqlite3_step(ppStmt);
+				continue;
+			}
+			kpt.pt.x = sqlite3_column_double(ppStmt, index++);
+			kpt.pt.y = sqlite3_column_double(ppStmt, index++);
+			kpt.size = sqlite3_column_int(ppStmt, index++);
+			kpt.angle = sqlite3_column_double(ppStmt, index++);
+			kpt.response = sqlite3_column_double(ppStmt, index++);
+			if(uStrNumCmp(_version, "0.12.0") >= 0)
+			{
+				kpt.octave = sqlite3_column_int(ppStmt, index++);
+			}
+
+			if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
+			{
+				depth.x = nanFloat;
+				++index;
+			}
+			else
+			{
+				depth.x = sqlite3_column_double(ppStmt, index++);
+			}
+
+			if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
+			{
+				depth.y = nanFloat;
+				++index;
+			}
+			else
+			{
+				depth.y = sqlite3_column_double(ppStmt, index++);
+			}
+
+			if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
+			{
+				depth.z = nanFloat;
+				++index;
+			}
+			else
+			{
+				depth.z = sqlite3_column_double(ppStmt, index++);
+			}
+
+			visualWordsKpts.push_back(kpt);
+			visualWords.insert(visualWords.end(), std::make_pair(visualWordId, visualWordsKpts.size()-1));
+			visualWords3.push_back(depth);
+
+			if(allWords3NaN && util3d::isFinite(depth))
+			{
+				allWords3NaN = false;
+			}
+
+			if(uStrNumCmp(_version, "0.11.2") >= 0)
+			{
+				descriptorSize = sqlite3_column_int(ppStmt, index++); // VisualWord descriptor size
+				descriptor = sqlite3_column_blob(ppStmt, index); 	// VisualWord descriptor array
+				dRealSize = sqlite3_column_bytes(ppStmt, index++);
+
+				if(descriptor && descriptorSize>0 && dRealSize>0)
+				{
+					cv::Mat d;
+					if(dRealSize == descriptorSize)
+					{
+						// CV_8U binary descriptors
+						d = cv::Mat(1, descriptorSize, CV_8U);
+					}
+					else if(dRealSize/int(sizeof(float)) == descriptorSize)
+					{
+						// CV_32F
+						d = cv::Mat(1, descriptorSize, CV_32F);
+					}
+					else
+					{
+						UFATAL("Saved buffer size (%d bytes) is not the same as descriptor size (%d)", dRealSize, descriptorSize);
+					}
+
+					memcpy(d.data, descriptor, dRealSize);
+
+					descriptors.push_back(d);
+				}
+			}
+
+			rc = sqlite3_step(ppStmt);
+		}
+		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
+
+		if(featuresOnly)
+		{
+			if(allWords3NaN)
+			{
+				visualWords3.clear();
+			}
+			if((int)visualWordsKpts.size() != (*iter)->getWordsCount())
+			{
+				UERROR("Features of node %d in database (%d) don't match its words (%d)!", (*iter)->id(), (int)visualWordsKpts.size(), (*iter)->getWordsCount());
+				visualWordsKpts.clear();
+				visualWords3.clear();
+				descriptors = cv::Mat();
+			}
+			(*iter)->setWordsFeatures(visualWordsKpts, visualWords3, descriptors);
+			ULOGGER_DEBUG("Add %d keypoints, %d 3d points and %d descriptors to node %d", (int)visualWordsKpts.size(), (int)visualWords3.size(), (int)descriptors.rows, (*iter)->id());
+		}
+		else if(visualWords.size()==0)
+		{
+			UDEBUG("Empty signature detected! (id=%d)", (*iter)->id());
+		}
+		else if(wordIdsOnly)
+		{
+			(*iter)->setWordsWithoutFeatures(visualWords);
+			ULOGGER_DEBUG("Add %d words (features loaded on demand) to node %d", (int)visualWords.size(), (*iter)->id());
+		}
+		else
+		{
+			if(allWords3NaN)
+			{
+				visualWords3.clear();
+			}
+			(*iter)->setWords(visualWords, visualWordsKpts, visualWords3, descriptors);
+			ULOGGER_DEBUG("Add %d keypoints, %d 3d points and %d descriptors to node %d", (int)visualWords.size(), allWords3NaN?0:(int)visualWords3.size(), (int)descriptors.rows, (*iter)->id());
+		}
+
+		//reset
+		rc = sqlite3_reset(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
+	}
+
+	// Finalize (delete) the statement
+	rc = sqlite3_finalize(ppStmt);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
+}
+
+
+
 void DBDriverSqlite3::loadLastNodesQuery(std::list<Signature *> & nodes) const
 {
 	ULOGGER_DEBUG("");
@@ -3899,7 +4299,8 @@ void DBDriverSqlite3::loadLinksQuery(
 
 void DBDriverSqlite3::loadLinksQuery(std::list<Signature *> & signatures) const
 {
-	if(_ppDb)
+	sqlite3 * db = readConnection();
+	if(db)
 	{
 		UTimer timer;
 		timer.start();
@@ -3938,14 +4339,14 @@ void DBDriverSqlite3::loadLinksQuery(std::list<Signature *> & signatures) const
 				  << "ORDER BY to_id";
 		}
 
-		rc = sqlite3_prepare_v2(_ppDb, query.str().c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_prepare_v2(db, query.str().c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 		for(std::list<Signature*>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
 		{
 			// bind id
 			rc = sqlite3_bind_int(ppStmt, 1, (*iter)->id());
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			int toId = -1;
 			int linkType = -1;
@@ -4046,20 +4447,20 @@ void DBDriverSqlite3::loadLinksQuery(std::list<Signature *> & signatures) const
 
 				rc = sqlite3_step(ppStmt);
 			}
-			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 
 			// add links
 			(*iter)->addLinks(links);
 
 			//reset
 			rc = sqlite3_reset(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 			UDEBUG("time=%fs, node=%d, links.size=%d", timer.ticks(), (*iter)->id(), links.size());
 		}
 
 		// Finalize (delete) the statement
 		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(db)).c_str());
 	}
 }
 
@@ -795,25 +795,14 @@ std::vector<cv::Point3f> Feature2D::generateKeypoints3D(
 		if(!data.rightRaw().empty() && !data.imageRaw().empty() && data.stereoCameraModel().isValidForProjection())
 		{
 			//stereo
-			cv::Mat imageMono;
-			// convert to grayscale
-			if(data.imageRaw().channels() > 1)
-			{
-				cv::cvtColor(data.imageRaw(), imageMono, cv::COLOR_BGR2GRAY);
-			}
-			else
-			{
-				imageMono = data.imageRaw();
-			}
-
 			std::vector<cv::Point2f> leftCorners;
 			cv::KeyPoint::convert(keypoints, leftCorners);
 			std::vector<unsigned char> status;
 
+			// use the pyramids cached in the sensor data (grayscale conversion is done there)
 			std::vector<cv::Point2f> rightCorners;
 			rightCorners = _stereo->computeCorrespondences(
-					imageMono,
-					data.rightRaw(),
+					data,
 					leftCorners,
 					status);
 
@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UEventsManager.h>
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UTrace.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UProcessInfo.h>
 #include <rtabmap/utilite/UMath.h>
@@ -94,6 +95,12 @@ Memory::Memory(const ParametersMap & parameters) :
     _imagePreDecimation(Parameters::defaultMemImagePreDecimation()),
 	_imagePostDecimation(Parameters::defaultMemImagePostDecimation()),
 	_compressionParallelized(Parameters::defaultMemCompressionParallelized()),
+	_compressionPending(Parameters::defaultMemCompressionPending()),
+	_scanCacheMaxSize(Parameters::defaultMemScanCacheSize()),
+	_wmCompacted(Parameters::defaultMemWMCompacted()),
+	_featuresLoadedOnDemand(Parameters::defaultMemFeaturesLoadedOnDemand()),
+	_checkpointPeriod(Parameters::defaultMemCheckpointPeriod()),
+	_updatesSinceCheckpoint(0),
 	_laserScanDownsampleStepSize(Parameters::defaultMemLaserScanDownsampleStepSize()),
 	_laserScanVoxelSize(Parameters::defaultMemLaserScanVoxelSize()),
 	_laserScanNormalK(Parameters::defaultMemLaserScanNormalK()),
@@ -124,7 +131,11 @@ Memory::Memory(const ParametersMap & parameters) :
 
 	_badSignRatio(Parameters::defaultKpBadSignRatio()),
 	_tfIdfLikelihoodUsed(Parameters::defaultKpTfIdfLikelihoodUsed()),
-	_parallelized(Parameters::defaultKpParallelized())
+	_parallelized(Parameters::defaultKpParallelized()),
+	_compressionPool(0),
+	_scanCacheBytes(0),
+	_scanCacheHits(0),
+	_scanCacheMisses(0)
 {
 	_feature2D = Feature2D::create(parameters);
 	_vwd = new VWDictionary(parameters);
@@ -248,6 +259,7 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 				//       global loop closures.
 				_signatures.insert(std::pair<int, Signature *>((*iter)->id(), *iter));
 				_workingMem.insert(std::make_pair((*iter)->id(), UTimer::now()));
+				updateTransferIndex((*iter)->id());
 				if(!(*iter)->getGroundTruthPose().isNull()) {
 					_groundTruths.insert(std::make_pair((*iter)->id(), (*iter)->getGroundTruthPose()));
 				}
@@ -531,6 +543,7 @@ Memory::~Memory()
 	delete _registrationPipeline;
 	delete _registrationIcpMulti;
 	delete _occupancy;
+	delete _compressionPool;
 }
 
 void Memory::parseParameters(const ParametersMap & parameters)
@@ -554,13 +567,43 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(params, Parameters::kMemMapLabelsAdded(), _mapLabelsAdded);
 	Parameters::parse(params, Parameters::kMemRehearsalSimilarity(), _similarityThreshold);
 	Parameters::parse(params, Parameters::kMemRecentWmRatio(), _recentWmRatio);
+	bool transferSortingByWeightId = _transferSortingByWeightId;
 	Parameters::parse(params, Parameters::kMemTransferSortingByWeightId(), _transferSortingByWeightId);
+	if(transferSortingByWeightId != _transferSortingByWeightId)
+	{
+		for(std::map<int, double>::iterator iter=_workingMem.begin(); iter!=_workingMem.end(); ++iter)
+		{
+			updateTransferIndex(iter->first);
+		}
+	}
 	Parameters::parse(params, Parameters::kMemSTMSize(), _maxStMemSize);
 	Parameters::parse(params, Parameters::kMemDepthAsMask(), _depthAsMask);
 	Parameters::parse(params, Parameters::kMemStereoFromMotion(), _stereoFromMotion);
 	Parameters::parse(params, Parameters::kMemImagePreDecimation(), _imagePreDecimation);
 	Parameters::parse(params, Parameters::kMemImagePostDecimation(), _imagePostDecimation);
 	Parameters::parse(params, Parameters::kMemCompressionParallelized(), _compressionParallelized);
+	Parameters::parse(params, Parameters::kMemCompressionPending(), _compressionPending);
+	Parameters::parse(params, Parameters::kMemScanCacheSize(), _scanCacheMaxSize);
+	if(_scanCacheMaxSize <= 0.0f)
+	{
+		_scanCache.clear();
+		_scanCacheIndex.clear();
+		_scanCacheBytes = 0;
+	}
+	if(_compressionParallelized && _compressionPool == 0)
+	{
+		// one worker for each data type (image, depth, scan, user data)
+		_compressionPool = new CompressionPool(4, 16);
+	}
+	else if(!_compressionParallelized && _compressionPool)
+	{
+		completeCompressions();
+		delete _compressionPool;
+		_compressionPool = 0;
+	}
+	Parameters::parse(params, Parameters::kMemWMCompacted(), _wmCompacted);
+	Parameters::parse(params, Parameters::kMemFeaturesLoadedOnDemand(), _featuresLoadedOnDemand);
+	Parameters::parse(params, Parameters::kMemCheckpointPeriod(), _checkpointPeriod);
 	Parameters::parse(params, Parameters::kMemLaserScanDownsampleStepSize(), _laserScanDownsampleStepSize);
 	Parameters::parse(params, Parameters::kMemLaserScanVoxelSize(), _laserScanVoxelSize);
 	Parameters::parse(params, Parameters::kMemLaserScanNormalK(), _laserScanNormalK);
@@ -758,6 +801,19 @@ void Memory::preUpdate()
 		//When parallelized, it is done in CreateSignature
 		_vwd->update();
 	}
+	if(_wmCompacted)
+	{
+		// Compact words of nodes in WM that have been added or accessed since last update
+		for(std::set<int>::iterator iter=_wordsToCompact.begin(); iter!=_wordsToCompact.end(); ++iter)
+		{
+			Signature * s = uValue(_signatures, *iter, (Signature*)0);
+			if(s && _stMem.find(*iter) == _stMem.end())
+			{
+				s->compactWords();
+			}
+		}
+		_wordsToCompact.clear();
+	}
 }
 
 bool Memory::update(
@@ -775,11 +831,15 @@ bool Memory::update(
 		Statistics * stats)
 {
 	UDEBUG("");
+	UTRACE_SCOPE("Memory::update");
 	UTimer timer;
 	UTimer totalTimer;
 	timer.start();
 	float t;
 
+	_scanCacheHits = 0;
+	_scanCacheMisses = 0;
+
 	//============================================================
 	// Pre update...
 	//============================================================
@@ -1031,6 +1091,11 @@ void Memory::addSignatureToWmFromLTM(Signature * signature)
 		UDEBUG("Inserting node %d in WM...", signature->id());
 		_workingMem.insert(std::make_pair(signature->id(), UTimer::now()));
 		_signatures.insert(std::pair<int, Signature*>(signature->id(), signature));
+		updateTransferIndex(signature->id());
+		if(_wmCompacted)
+		{
+			_wordsToCompact.insert(signature->id());
+		}
 		if(!signature->getGroundTruthPose().isNull()) {
 			_groundTruths.insert(std::make_pair(signature->id(), signature->getGroundTruthPose()));
 		}
@@ -1049,6 +1114,14 @@ void Memory::moveSignatureToWMFromSTM(int id, int * reducedTo)
 	Signature * s = this->_getSignature(id);
 	UASSERT(s!=0);
 
+	// optical flow pyramids are only useful for recent nodes
+	s->sensorData().clearImagePyramids();
+
+	if(_wmCompacted)
+	{
+		_wordsToCompact.insert(id);
+	}
+
 	if(_reduceGraph)
 	{
 		bool merge = false;
@@ -1143,6 +1216,7 @@ void Memory::moveSignatureToWMFromSTM(int id, int * reducedTo)
 	if(s != 0)
 	{
 		_workingMem.insert(_workingMem.end(), std::make_pair(*_stMem.begin(), UTimer::now()));
+		updateTransferIndex(*_stMem.begin());
 		_stMem.erase(*_stMem.begin());
 	}
 	// else already removed from STM/WM in moveToTrash()
@@ -1155,7 +1229,13 @@ const Signature * Memory::getSignature(int id) const
 
 Signature * Memory::_getSignature(int id) const
 {
-	return uValue(_signatures, id, (Signature*)0);
+	Signature * s = uValue(_signatures, id, (Signature*)0);
+	if(s && s->isWordsCompacted())
+	{
+		// may be expanded or read, compact it again on next update
+		_wordsToCompact.insert(id);
+	}
+	return s;
 }
 
 const VWDictionary * Memory::getVWDictionary() const
@@ -1616,6 +1696,7 @@ void Memory::updateAge(int signatureId)
 	if(iter!=_workingMem.end())
 	{
 		iter->second = UTimer::now();
+		updateTransferIndex(signatureId);
 	}
 }
 
@@ -1673,6 +1754,11 @@ void Memory::clear()
 {
 	UDEBUG("");
 
+	completeCompressions();
+	_scanCache.clear();
+	_scanCacheIndex.clear();
+	_scanCacheBytes = 0;
+
 	// empty the STM
 	while(_stMem.size())
 	{
@@ -1745,6 +1831,10 @@ void Memory::clear()
 		ULOGGER_ERROR("_workingMem must be empty here, size=%d", _workingMem.size());
 	}
 	_workingMem.clear();
+	_transferIndex.clear();
+	_transferIndexKeys.clear();
+	_checkpointedIds.clear();
+	_wordsToCompact.clear();
 	if(_signatures.size()!=0)
 	{
 		ULOGGER_ERROR("_signatures must be empty here, size=%d", _signatures.size());
@@ -2144,56 +2234,106 @@ void Memory::emptyTrash()
 {
 	if(_dbDriver)
 	{
+		if(_checkpointPeriod > 0 && ++_updatesSinceCheckpoint >= _checkpointPeriod)
+		{
+			checkpoint();
+			_updatesSinceCheckpoint = 0;
+		}
 		_dbDriver->emptyTrashes(true);
 	}
 }
 
+void Memory::checkpoint()
+{
+	if(!_dbDriver || _dbDriver->isInMemory() || !_incrementalMemory)
+	{
+		return;
+	}
+	// previous checkpoint should be committed before queuing new copies
+	markCheckpointedNodesSaved();
+	UTimer timer;
+	int count = 0;
+	for(std::map<int, double>::const_iterator iter=_workingMem.begin(); iter!=_workingMem.end(); ++iter)
+	{
+		// STM nodes can still be merged or deleted
+		Signature * s = iter->first>0 && !isInSTM(iter->first)?this->_getSignature(iter->first):0;
+		if(s &&
+		   (!s->isSaved() || s->isModified()) &&
+		   !(!s->isSaved() && s->isBadSignature() && _badSignaturesIgnored))
+		{
+			completeCompression(*s);
+			Signature * cpy = new Signature();
+			*cpy = *s;
+			_dbDriver->asyncSave(cpy);
+			// The node is set saved only when the copy is committed (see
+			// markCheckpointedNodesSaved()), direct database updates done
+			// before would be overwritten by the copy.
+			s->setModified(false);
+			_checkpointedIds.insert(s->id());
+			++count;
+		}
+	}
+	UDEBUG("Checkpoint: %d nodes to save (%fs)", count, timer.ticks());
+}
+
+void Memory::markCheckpointedNodesSaved()
+{
+	if(_checkpointedIds.empty())
+	{
+		return;
+	}
+	if(_dbDriver)
+	{
+		// wait for the checkpoint copies to be committed
+		_dbDriver->join();
+	}
+	for(std::set<int>::iterator iter=_checkpointedIds.begin(); iter!=_checkpointedIds.end(); ++iter)
+	{
+		Signature * s = this->_getSignature(*iter);
+		if(s)
+		{
+			s->setSaved(true);
+		}
+	}
+	_checkpointedIds.clear();
+}
+
 void Memory::joinTrashThread()
 {
 	if(_dbDriver)
 	{
 		UDEBUG("");
 		_dbDriver->join();
+		markCheckpointedNodesSaved();
 		UDEBUG("");
 	}
 }
 
-class WeightAgeIdKey
+void Memory::updateTransferIndex(int id)
 {
-public:
-	WeightAgeIdKey(int w, double a, int i) :
-		weight(w),
-		age(a),
-		id(i){}
-	bool operator<(const WeightAgeIdKey & k) const
+	std::map<int, WeightAgeIdKey>::iterator iter = _transferIndexKeys.find(id);
+	if(iter != _transferIndexKeys.end())
 	{
-		if(weight < k.weight)
-		{
-			return true;
-		}
-		else if(weight == k.weight)
+		_transferIndex.erase(iter->second);
+		_transferIndexKeys.erase(iter);
+	}
+	std::map<int, double>::const_iterator memIter = _workingMem.find(id);
+	if(id > 0 && memIter != _workingMem.end())
+	{
+		const Signature * s = this->getSignature(id);
+		if(s)
 		{
-			if(age < k.age)
-			{
-				return true;
-			}
-			else if(age == k.age)
-			{
-				if(id < k.id)
-				{
-					return true;
-				}
-			}
+			WeightAgeIdKey key(s->getWeight(), _transferSortingByWeightId?0.0:memIter->second, id);
+			_transferIndex.insert(key);
+			_transferIndexKeys.insert(std::make_pair(id, key));
 		}
-		return false;
 	}
-	int weight, age, id;
-};
+}
+
 std::list<Signature *> Memory::getRemovableSignatures(int count, const std::set<int> & ignoredIds)
 {
 	//UDEBUG("");
 	std::list<Signature *> removableSignatures;
-	std::map<WeightAgeIdKey, Signature *> weightAgeIdMap;
 
 	// Find the last index to check...
 	UDEBUG("mem.size()=%d, ignoredIds.size()=%d", (int)_workingMem.size(), (int)ignoredIds.size());
@@ -2231,63 +2371,56 @@ std::list<Signature *> Memory::getRemovableSignatures(int count, const std::set<
 			lastInSTM = _signatures.at(*_stMem.begin());
 		}
 
-		for(std::map<int, double>::const_iterator memIter = _workingMem.begin(); memIter != _workingMem.end(); ++memIter)
+		// Immunization of recent WM is decided before looking at the candidates
+		bool recentWmImmunizedAtStart = recentWmImmunized;
+		int recentWmCount = 0;
+		// make the list of removable signatures
+		// Criteria : Weight -> ID
+		UDEBUG("transferIndex.size()=%d _lastGlobalLoopClosureId=%d currentRecentWmSize=%d recentWmMaxSize=%d",
+				(int)_transferIndex.size(), _lastGlobalLoopClosureId, currentRecentWmSize, recentWmMaxSize);
+		for(std::set<WeightAgeIdKey>::const_iterator iter=_transferIndex.begin();
+			iter!=_transferIndex.end() && removableSignatures.size() < (unsigned int)count;
+			++iter)
 		{
-			if( (recentWmImmunized && memIter->first > _lastGlobalLoopClosureId) ||
-				memIter->first == _lastGlobalLoopClosureId)
+			int id = iter->id;
+			if( (recentWmImmunizedAtStart && id > _lastGlobalLoopClosureId) ||
+				id == _lastGlobalLoopClosureId ||
+				ignoredIds.find(id) != ignoredIds.end() ||
+				(lastInSTM && lastInSTM->hasLink(id)))
 			{
 				// ignore recent memory
+				continue;
 			}
-			else if(memIter->first > 0 && ignoredIds.find(memIter->first) == ignoredIds.end() && (!lastInSTM || !lastInSTM->hasLink(memIter->first)))
+
+			Signature * s = this->_getSignature(id);
+			if(s == 0)
 			{
-				Signature * s = this->_getSignature(memIter->first);
-				if(s)
-				{
-					// Links must not be in STM to be removable, rehearsal issue
-					bool foundInSTM = false;
-					for(std::map<int, Link>::const_iterator iter = s->getLinks().begin(); iter!=s->getLinks().end(); ++iter)
-					{
-						if(_stMem.find(iter->first) != _stMem.end())
-						{
-							UDEBUG("Ignored %d because it has a link (%d) to STM", s->id(), iter->first);
-							foundInSTM = true;
-							break;
-						}
-					}
-					if(!foundInSTM)
-					{
-						// less weighted signature priority to be transferred
-						weightAgeIdMap.insert(std::make_pair(WeightAgeIdKey(s->getWeight(), _transferSortingByWeightId?0.0:memIter->second, s->id()), s));
-					}
-				}
-				else
+				ULOGGER_ERROR("Not supposed to occur!!!");
+				continue;
+			}
+
+			// Links must not be in STM to be removable, rehearsal issue
+			bool foundInSTM = false;
+			for(std::map<int, Link>::const_iterator jter = s->getLinks().begin(); jter!=s->getLinks().end(); ++jter)
+			{
+				if(_stMem.find(jter->first) != _stMem.end())
 				{
-					ULOGGER_ERROR("Not supposed to occur!!!");
+					UDEBUG("Ignored %d because it has a link (%d) to STM", s->id(), jter->first);
+					foundInSTM = true;
+					break;
 				}
 			}
-			else
+			if(foundInSTM)
 			{
-				//UDEBUG("Ignoring id %d", memIter->first);
+				continue;
 			}
-		}
 
-		int recentWmCount = 0;
-		// make the list of removable signatures
-		// Criteria : Weight -> ID
-		UDEBUG("signatureMap.size()=%d _lastGlobalLoopClosureId=%d currentRecentWmSize=%d recentWmMaxSize=%d",
-				(int)weightAgeIdMap.size(), _lastGlobalLoopClosureId, currentRecentWmSize, recentWmMaxSize);
-		for(std::map<WeightAgeIdKey, Signature*>::iterator iter=weightAgeIdMap.begin();
-			iter!=weightAgeIdMap.end();
-			++iter)
-		{
 			if(!recentWmImmunized)
 			{
-				UDEBUG("weight=%d, id=%d",
-						iter->second->getWeight(),
-						iter->second->id());
-				removableSignatures.push_back(iter->second);
+				UDEBUG("weight=%d, id=%d", s->getWeight(), s->id());
+				removableSignatures.push_back(s);
 
-				if(_lastGlobalLoopClosureId && iter->second->id() > _lastGlobalLoopClosureId)
+				if(_lastGlobalLoopClosureId && s->id() > _lastGlobalLoopClosureId)
 				{
 					++recentWmCount;
 					if(currentRecentWmSize - recentWmCount < recentWmMaxSize)
@@ -2297,16 +2430,10 @@ std::list<Signature *> Memory::getRemovableSignatures(int count, const std::set<
 					}
 				}
 			}
-			else if(_lastGlobalLoopClosureId == 0 || iter->second->id() < _lastGlobalLoopClosureId)
-			{
-				UDEBUG("weight=%d, id=%d",
-						iter->second->getWeight(),
-						iter->second->id());
-				removableSignatures.push_back(iter->second);
-			}
-			if(removableSignatures.size() >= (unsigned int)count)
+			else if(_lastGlobalLoopClosureId == 0 || s->id() < _lastGlobalLoopClosureId)
 			{
-				break;
+				UDEBUG("weight=%d, id=%d", s->getWeight(), s->id());
+				removableSignatures.push_back(s);
 			}
 		}
 	}
@@ -2325,6 +2452,13 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 	UDEBUG("id=%d", s?s->id():0);
 	if(s)
 	{
+		if(_checkpointedIds.find(s->id()) != _checkpointedIds.end())
+		{
+			// a copy is already queued in the trash, don't insert it twice
+			markCheckpointedNodesSaved();
+		}
+		removeFromScanCache(s->id());
+
 		// Cleanup landmark indexes
 		if(!s->getLandmarks().empty())
 		{
@@ -2378,6 +2512,7 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 					if(iter->second.type() == Link::kGlobalClosure && s->id() > sTo->id() && s->getWeight()>0)
 					{
 						sTo->setWeight(sTo->getWeight() + s->getWeight()); // copy weight
+						updateTransferIndex(sTo->id());
 					}
 
 					sTo->removeLink(s->id());
@@ -2420,6 +2555,7 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 		}
 
 		_workingMem.erase(s->id());
+		updateTransferIndex(s->id());
 		_stMem.erase(s->id());
 		_signatures.erase(s->id());
 		_groundTruths.erase(s->id());
@@ -2455,10 +2591,12 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 			{
 				_allNodesInWM = false;
 			}
+			completeCompression(*s);
 			_dbDriver->asyncSave(s);
 		}
 		else
 		{
+			_pendingCompressions.erase(s->id());
 			delete s;
 		}
 	}
@@ -2598,6 +2736,11 @@ void Memory::deleteLocation(int locationId, std::list<int> * deletedWords)
 void Memory::saveLocationData(int locationId)
 {
 	UDEBUG("Saving location data %d", locationId);
+	completeCompression(locationId);
+	if(_checkpointedIds.find(locationId) != _checkpointedIds.end())
+	{
+		markCheckpointedNodesSaved();
+	}
 	Signature * location = _getSignature(locationId);
 	if( location &&
 		_dbDriver &&
@@ -2631,6 +2774,8 @@ void Memory::removeLink(int oldId, int newId)
 				// adjust the weight
 				oldS->setWeight(oldS->getWeight()+1);
 				newS->setWeight(newS->getWeight()>0?newS->getWeight()-1:0);
+				updateTransferIndex(oldS->id());
+				updateTransferIndex(newS->id());
 			}
 
 
@@ -2677,12 +2822,162 @@ void Memory::removeLink(int oldId, int newId)
 	}
 }
 
+void Memory::completeCompression(int id) const
+{
+	if(!_pendingCompressions.empty())
+	{
+		Signature * s = this->_getSignature(id);
+		if(s)
+		{
+			completeCompression(*s);
+		}
+		else
+		{
+			_pendingCompressions.erase(id);
+		}
+	}
+}
+
+void Memory::completeCompression(Signature & s) const
+{
+	std::map<int, PendingCompression>::iterator iter = _pendingCompressions.find(s.id());
+	if(iter == _pendingCompressions.end())
+	{
+		return;
+	}
+
+	UTimer timer;
+	const PendingCompression & pending = iter->second;
+	if(pending.image.get() && pending.depth.get())
+	{
+		// keep raw data
+		if(s.sensorData().stereoCameraModel().isValidForProjection())
+		{
+			s.sensorData().setStereoImage(
+					pending.image->getCompressedData(),
+					pending.depth->getCompressedData(),
+					s.sensorData().stereoCameraModel(),
+					false);
+		}
+		else
+		{
+			s.sensorData().setRGBDImage(
+					pending.image->getCompressedData(),
+					pending.depth->getCompressedData(),
+					s.sensorData().cameraModels(),
+					false);
+		}
+	}
+	if(pending.scan.get() && !pending.scan->getCompressedData().empty())
+	{
+		const LaserScan & laserScan = s.sensorData().laserScanRaw();
+		s.sensorData().setLaserScan(
+				laserScan.angleIncrement() == 0.0f?
+					LaserScan(pending.scan->getCompressedData(),
+						laserScan.maxPoints(),
+						laserScan.rangeMax(),
+						laserScan.format(),
+						laserScan.localTransform()):
+					LaserScan(pending.scan->getCompressedData(),
+						laserScan.format(),
+						laserScan.rangeMin(),
+						laserScan.rangeMax(),
+						laserScan.angleMin(),
+						laserScan.angleMax(),
+						laserScan.angleIncrement(),
+						laserScan.localTransform()),
+				false);
+	}
+	if(pending.userData.get() && !pending.userData->getCompressedData().empty())
+	{
+		s.sensorData().setUserData(pending.userData->getCompressedData(), false);
+	}
+	_pendingCompressions.erase(iter);
+	UDEBUG("Compression of node %d completed (waited %fs)", s.id(), timer.ticks());
+}
+
+void Memory::loadWordsFeatures(int id) const
+{
+	Signature * s = this->_getSignature(id);
+	if(s)
+	{
+		loadWordsFeatures(*s);
+	}
+}
+
+void Memory::loadWordsFeatures(Signature & s) const
+{
+	if(!s.isWordsFeaturesLoaded() && _dbDriver)
+	{
+		UDEBUG("Loading features of node %d", s.id());
+		_dbDriver->loadFeatures(&s);
+	}
+}
+
+void Memory::completeCompressions() const
+{
+	while(!_pendingCompressions.empty())
+	{
+		completeCompression(_pendingCompressions.begin()->first);
+	}
+}
+
+LaserScan Memory::getUncompressedLaserScan(int id, const SensorData * dataIn) const
+{
+	std::map<int, std::list<std::pair<int, LaserScan> >::iterator>::iterator iter = _scanCacheIndex.find(id);
+	if(iter != _scanCacheIndex.end())
+	{
+		++_scanCacheHits;
+		// move to front
+		_scanCache.splice(_scanCache.begin(), _scanCache, iter->second);
+		return iter->second->second;
+	}
+
+	++_scanCacheMisses;
+	SensorData data = dataIn?*dataIn:getNodeData(id, false, true, false, false);
+	LaserScan scan;
+	data.uncompressDataConst(0, 0, &scan);
+	if(_scanCacheMaxSize > 0.0f && data.laserScanRaw().isEmpty() && !scan.isEmpty())
+	{
+		unsigned long bytes = scan.data().total()*scan.data().elemSize();
+		unsigned long maxBytes = (unsigned long)(_scanCacheMaxSize*1024.0f*1024.0f);
+		if(bytes <= maxBytes)
+		{
+			while(!_scanCache.empty() && _scanCacheBytes + bytes > maxBytes)
+			{
+				removeFromScanCache(_scanCache.back().first);
+			}
+			_scanCache.push_front(std::make_pair(id, scan));
+			_scanCacheIndex.insert(std::make_pair(id, _scanCache.begin()));
+			_scanCacheBytes += bytes;
+		}
+	}
+	return scan;
+}
+
+void Memory::removeFromScanCache(int id) const
+{
+	std::map<int, std::list<std::pair<int, LaserScan> >::iterator>::iterator iter = _scanCacheIndex.find(id);
+	if(iter != _scanCacheIndex.end())
+	{
+		const LaserScan & scan = iter->second->second;
+		_scanCacheBytes -= scan.data().total()*scan.data().elemSize();
+		_scanCache.erase(iter->second);
+		_scanCacheIndex.erase(iter);
+	}
+}
+
 void Memory::removeRawData(int id, bool image, bool scan, bool userData)
 {
 	UDEBUG("id=%d image=%d scan=%d userData=%d", id, image?1:0, scan?1:0, userData?1:0);
 	Signature * s = this->_getSignature(id);
 	if(s)
 	{
+		completeCompression(*s);
+		if(scan)
+		{
+			removeFromScanCache(id);
+		}
 		s->sensorData().clearRawData(
 				image && (!_reextractLoopClosureFeatures || !_registrationPipeline->isImageRequired()),
 				scan && !_registrationPipeline->isScanRequired(),
@@ -2730,6 +3025,11 @@ Transform Memory::computeTransform(
 	UDEBUG("");
 	Transform transform;
 
+	completeCompression(fromS);
+	completeCompression(toS);
+	loadWordsFeatures(fromS);
+	loadWordsFeatures(toS);
+
 	// make sure we have all data needed
 	// load binary data from database if not in RAM (if image is already here, scan and userData should be or they are null)
 	if(((_reextractLoopClosureFeatures && _registrationPipeline->isImageRequired()) && fromS.sensorData().imageCompressed().empty()) ||
@@ -2841,6 +3141,7 @@ Transform Memory::computeTransform(
 				int id = iter->first;
 				if(id != fromS.id() && iter->second.type() == Link::kNeighbor) // assemble only neighbors for the local feature map
 				{
+					loadWordsFeatures(id);
 					const Signature * s = this->getSignature(id);
 					if(s && !s->getWords3().empty())
 					{
@@ -2899,6 +3200,7 @@ Transform Memory::computeTransform(
 						}
 						else
 						{
+							loadWordsFeatures(id);
 							s = this->getSignature(id);
 						}
 						if(s)
@@ -3061,6 +3363,7 @@ Transform Memory::computeIcpTransformMulti(
 	{
 		Signature * s = _getSignature(iter->first);
 		UASSERT_MSG(s != 0, uFormat("id=%d", iter->first).c_str());
+		completeCompression(*s);
 		//if image is already here, scan should be or it is null
 		if(s->sensorData().imageCompressed().empty() &&
 		   s->sensorData().laserScanCompressed().isEmpty())
@@ -3077,9 +3380,7 @@ Transform Memory::computeIcpTransformMulti(
 	LaserScan fromScan;
 	fromS->sensorData().uncompressData(0, 0, &fromScan);
 
-	Signature * toS = _getSignature(toId);
-	LaserScan toScan;
-	toS->sensorData().uncompressData(0, 0, &toScan);
+	LaserScan toScan = getUncompressedLaserScan(toId);
 
 	Transform t;
 	if(!fromScan.isEmpty() && !toScan.isEmpty())
@@ -3112,8 +3413,7 @@ Transform Memory::computeIcpTransformMulti(
 				Signature * s = this->_getSignature(iter->first);
 				if(!s->sensorData().laserScanCompressed().isEmpty())
 				{
-					LaserScan scan;
-					s->sensorData().uncompressData(0, 0, &scan);
+					LaserScan scan = getUncompressedLaserScan(iter->first);
 					if(!scan.isEmpty() && scan.format() == toScan.format())
 					{
 						if(scan.hasIntensity())
@@ -3281,6 +3581,8 @@ bool Memory::addLink(const Link & link, bool addInDatabase)
 						toS->setWeight(toS->getWeight() + fromS->getWeight());
 						fromS->setWeight(0);
 					}
+					updateTransferIndex(fromS->id());
+					updateTransferIndex(toS->id());
 				}
 			}
 		}
@@ -3430,7 +3732,30 @@ void Memory::dumpDictionary(const char * fileNameRef, const char * fileNameDesc)
 {
 	if(_vwd)
 	{
-		_vwd->exportDictionary(fileNameRef, fileNameDesc);
+		// reload descriptors released by product quantization
+		std::map<int, cv::Mat> releasedDescriptors;
+		if(_dbDriver)
+		{
+			std::set<int> releasedIds;
+			for(std::map<int, VisualWord *>::const_iterator iter=_vwd->getVisualWords().begin(); iter!=_vwd->getVisualWords().end(); ++iter)
+			{
+				if(iter->second->getDescriptor().empty())
+				{
+					releasedIds.insert(iter->first);
+				}
+			}
+			if(!releasedIds.empty())
+			{
+				std::list<VisualWord *> words;
+				_dbDriver->loadWords(releasedIds, words);
+				for(std::list<VisualWord *>::iterator iter=words.begin(); iter!=words.end(); ++iter)
+				{
+					releasedDescriptors.insert(std::make_pair((*iter)->id(), (*iter)->getDescriptor()));
+					delete *iter;
+				}
+			}
+		}
+		_vwd->exportDictionary(fileNameRef, fileNameDesc, releasedDescriptors);
 	}
 }
 
@@ -3456,6 +3781,7 @@ void Memory::dumpSignatures(const char * fileNameSign, bool words3D) const
 			{
 				if(words3D)
 				{
+					loadWordsFeatures(iter->first);
 					if(!ss->getWords3().empty())
 					{
 						const std::multimap<int, int> & ref = ss->getWords();
@@ -3544,14 +3870,21 @@ void Memory::dumpMemoryTree(const char * fileNameTree) const
 
 }
 
-unsigned long Memory::getMemoryUsed() const
+unsigned long Memory::getMemoryUsed(unsigned long * signaturesMemoryUsed) const
 {
 	unsigned long memoryUsage = sizeof(Memory);
 	memoryUsage += _signatures.size() * (sizeof(int)+sizeof(std::map<int, Signature *>::iterator)) + sizeof(std::map<int, Signature *>);
+	unsigned long signaturesUsage = 0;
 	for(std::map<int, Signature*>::const_iterator iter=_signatures.begin(); iter!=_signatures.end(); ++iter)
 	{
-		memoryUsage += iter->second->getMemoryUsed(true);
+		signaturesUsage += iter->second->getMemoryUsed(true);
+	}
+	memoryUsage += signaturesUsage;
+	if(signaturesMemoryUsed)
+	{
+		*signaturesMemoryUsed = signaturesUsage;
 	}
+	UDEBUG("Signatures: %lu bytes (%d nodes, %lu bytes/node)", signaturesUsage, (int)_signatures.size(), _signatures.size()?signaturesUsage/(unsigned long)_signatures.size():0ul);
 	if(_vwd)
 	{
 		memoryUsage += _vwd->getMemoryUsed();
@@ -3574,6 +3907,7 @@ unsigned long Memory::getMemoryUsed() const
 	memoryUsage += sizeof(Registration);
 	memoryUsage += sizeof(RegistrationIcp);
 	memoryUsage += _occupancy->getMemoryUsed();
+	memoryUsage += _scanCacheBytes + _scanCache.size() * (sizeof(int)+sizeof(LaserScan)+sizeof(std::list<std::pair<int, LaserScan> >::iterator)*3);
 	memoryUsage += sizeof(MarkerDetector);
 	memoryUsage += sizeof(DBDriver);
 
@@ -3759,6 +4093,8 @@ bool Memory::rehearsalMerge(int oldId, int newId)
 				newS->setWeight(-9);
 			}
 			UDEBUG("New weights: %d->%d %d->%d", oldS->id(), oldS->getWeight(), newS->id(), oldS->getWeight());
+			updateTransferIndex(oldS->id());
+			updateTransferIndex(newS->id());
 
 			// remove location
 			moveToTrash(_idUpdatedToNewOneRehearsal?oldS:newS, _notLinkedNodesKeptInDb);
@@ -3786,6 +4122,8 @@ bool Memory::rehearsalMerge(int oldId, int newId)
 				oldS->setWeight(w + oldS->getWeight() + 1);
 				newS->setWeight(intermediateMerge?-1:0); // convert to intermediate node
 			}
+			updateTransferIndex(oldS->id());
+			updateTransferIndex(newS->id());
 		}
 	}
 	else
@@ -3925,6 +4263,7 @@ bool Memory::getNodeInfo(int signatureId,
 cv::Mat Memory::getImageCompressed(int signatureId) const
 {
 	cv::Mat image;
+	completeCompression(signatureId);
 	const Signature * s = this->getSignature(signatureId);
 	if(s)
 	{
@@ -3943,6 +4282,7 @@ SensorData Memory::getNodeData(int locationId, bool images, bool scan, bool user
 {
 	//UDEBUG("");
 	SensorData r;
+	completeCompression(locationId);
 	const Signature * s = this->getSignature(locationId);
 	if(s && (!s->isSaved() ||
 			((!images || !s->sensorData().imageCompressed().empty()) &&
@@ -3988,6 +4328,7 @@ void Memory::getNodeWordsAndGlobalDescriptors(int nodeId,
 	Signature * s = this->_getSignature(nodeId);
 	if(s)
 	{
+		loadWordsFeatures(*s);
 		words = s->getWords();
 		wordsKpts = s->getWordsKpts();
 		words3 = s->getWords3();
@@ -4097,8 +4438,8 @@ int Memory::cleanupLocalGrids(
 
 		// scan
 		SensorData data = this->getNodeData(iter->first, false, true, false, true);
-		LaserScan scan;
-		data.uncompressData(0,0,&scan,0,&gridGround,&gridObstacles,&gridEmpty);
+		LaserScan scan = getUncompressedLaserScan(iter->first, &data);
+		data.uncompressData(0,0,0,0,&gridGround,&gridObstacles,&gridEmpty);
 
 		if(!gridObstacles.empty())
 		{
@@ -4152,6 +4493,11 @@ int Memory::cleanupLocalGrids(
 				bool modifyDb = true;
 				if(s)
 				{
+					if(_checkpointedIds.find(s->id()) != _checkpointedIds.end())
+					{
+						// commit the checkpoint copy first, the update below would be overwritten
+						markCheckpointedNodesSaved();
+					}
 					s->sensorData().setOccupancyGrid(gridGround, newObstacles, gridEmpty, cellSize, data.gridViewPoint());
 					if(!s->isSaved())
 					{
@@ -4246,8 +4592,15 @@ int Memory::cleanupLocalGrids(
 				// update
 				Signature * s = this->_getSignature(iter->first);
 				bool modifyDb = true;
+				removeFromScanCache(iter->first);
 				if(s)
 				{
+					if(_checkpointedIds.find(s->id()) != _checkpointedIds.end())
+					{
+						// commit the checkpoint copy first, the update below would be overwritten
+						markCheckpointedNodesSaved();
+					}
+					completeCompression(*s);
 					s->sensorData().setLaserScan(scan, true);
 					if(!s->isSaved())
 					{
@@ -4289,12 +4642,14 @@ void Memory::copyData(const Signature * from, Signature * to)
 	if(from && to)
 	{
 		// words 2d
+		loadWordsFeatures(from->id());
 		this->disableWordsRef(to->id());
 		to->setWords(from->getWords(), from->getWordsKpts(), from->getWords3(), from->getWordsDescriptors());
 		std::list<int> id;
 		id.push_back(to->id());
 		this->enableWordsRef(id);
 
+		completeCompression(from->id());
 		if(from->isSaved() && _dbDriver)
 		{
 			_dbDriver->getNodeData(from->id(), to->sensorData());
@@ -5327,35 +5682,24 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		cv::Mat compressedUserData;
 		if(_compressionParallelized)
 		{
-			rtabmap::CompressionThread ctImage(image, _rgbCompressionFormat);
-			rtabmap::CompressionThread ctDepth(depthOrRightImage, depthOrRightImage.type() == CV_32FC1 || depthOrRightImage.type() == CV_16UC1?std::string(".png"):_rgbCompressionFormat);
-			rtabmap::CompressionThread ctLaserScan(laserScan.data());
-			rtabmap::CompressionThread ctUserData(data.userDataRaw());
-			if(!image.empty())
-			{
-				ctImage.start();
-			}
-			if(!depthOrRightImage.empty())
+			UASSERT(_compressionPool != 0);
+			PendingCompression pending;
+			pending.image = _compressionPool->compress(image, _rgbCompressionFormat);
+			pending.depth = _compressionPool->compress(depthOrRightImage, depthOrRightImage.type() == CV_32FC1 || depthOrRightImage.type() == CV_16UC1?std::string(".png"):_rgbCompressionFormat);
+			pending.scan = _compressionPool->compress(laserScan.data());
+			pending.userData = _compressionPool->compress(data.userDataRaw());
+			if(_compressionPending)
 			{
-				ctDepth.start();
+				// compressed data will be set in completeCompression()
+				_pendingCompressions.insert(std::make_pair(id, pending));
 			}
-			if(!laserScan.isEmpty())
-			{
-				ctLaserScan.start();
-			}
-			if(!data.userDataRaw().empty())
+			else
 			{
-				ctUserData.start();
+				compressedImage = pending.image->getCompressedData();
+				compressedDepth = pending.depth->getCompressedData();
+				compressedScan = pending.scan->getCompressedData();
+				compressedUserData = pending.userData->getCompressedData();
 			}
-			ctImage.join();
-			ctDepth.join();
-			ctLaserScan.join();
-			ctUserData.join();
-
-			compressedImage = ctImage.getCompressedData();
-			compressedDepth = ctDepth.getCompressedData();
-			compressedScan = ctLaserScan.getCompressedData();
-			compressedUserData = ctUserData.getCompressedData();
 		}
 		else
 		{
@@ -5427,21 +5771,20 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		cv::Mat compressedUserData;
 		if(_compressionParallelized)
 		{
-			rtabmap::CompressionThread ctUserData(data.userDataRaw());
-			rtabmap::CompressionThread ctLaserScan(laserScan.data());
-			if(!data.userDataRaw().empty() && !isIntermediateNode)
+			UASSERT(_compressionPool != 0);
+			PendingCompression pending;
+			pending.scan = _compressionPool->compress(isIntermediateNode?cv::Mat():laserScan.data());
+			pending.userData = _compressionPool->compress(isIntermediateNode?cv::Mat():data.userDataRaw());
+			if(_compressionPending)
 			{
-				ctUserData.start();
+				// compressed data will be set in completeCompression()
+				_pendingCompressions.insert(std::make_pair(id, pending));
 			}
-			if(!laserScan.isEmpty() && !isIntermediateNode)
+			else
 			{
-				ctLaserScan.start();
+				compressedScan = pending.scan->getCompressedData();
+				compressedUserData = pending.userData->getCompressedData();
 			}
-			ctUserData.join();
-			ctLaserScan.join();
-
-			compressedScan = ctLaserScan.getCompressedData();
-			compressedUserData = ctUserData.getCompressedData();
 		}
 		else
 		{
@@ -5857,7 +6200,7 @@ std::set<int> Memory::reactivateSignatures(const std::list<int> & ids, unsigned
 	std::list<Signature *> reactivatedSigns;
 	if(_dbDriver)
 	{
-		_dbDriver->loadSignatures(idsToLoad, reactivatedSigns);
+		_dbDriver->loadSignatures(idsToLoad, reactivatedSigns, 0, _featuresLoadedOnDemand);
 	}
 	timeDbAccess = timer.getElapsedTime();
 	std::list<int> idsLoaded;
@@ -44,6 +44,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/util3d_filtering.h"
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UTimer.h"
+#include "rtabmap/utilite/UTrace.h"
 #include "rtabmap/utilite/UConversion.h"
 #include "rtabmap/utilite/UProcessInfo.h"
 #include "rtabmap/core/ParticleFilter.h"
@@ -131,6 +132,10 @@ Odometry::Odometry(const rtabmap::ParametersMap & parameters) :
 		_alignWithGround(Parameters::defaultOdomAlignWithGround()),
 		_publishRAMUsage(Parameters::defaultRtabmapPublishRAMUsage()),
 		_imagesAlreadyRectified(Parameters::defaultRtabmapImagesAlreadyRectified()),
+		_pipelined(Parameters::defaultOdomPipelined()),
+		_guessIMUPreintegration(Parameters::defaultOdomGuessIMUPreintegration()),
+		_guessIMUGyroNoise(Parameters::defaultOdomGuessIMUGyroNoise()),
+		_guessIMUAccNoise(Parameters::defaultOdomGuessIMUAccNoise()),
 		_pose(Transform::getIdentity()),
 		_resetCurrentCount(0),
 		previousStamp_(0),
@@ -160,6 +165,12 @@ Odometry::Odometry(const rtabmap::ParametersMap & parameters) :
 	Parameters::parse(parameters, Parameters::kOdomAlignWithGround(), _alignWithGround);
 	Parameters::parse(parameters, Parameters::kRtabmapPublishRAMUsage(), _publishRAMUsage);
 	Parameters::parse(parameters, Parameters::kRtabmapImagesAlreadyRectified(), _imagesAlreadyRectified);
+	Parameters::parse(parameters, Parameters::kOdomPipelined(), _pipelined);
+	Parameters::parse(parameters, Parameters::kOdomGuessIMUPreintegration(), _guessIMUPreintegration);
+	Parameters::parse(parameters, Parameters::kOdomGuessIMUGyroNoise(), _guessIMUGyroNoise);
+	Parameters::parse(parameters, Parameters::kOdomGuessIMUAccNoise(), _guessIMUAccNoise);
+	UASSERT(_guessIMUGyroNoise >= 0.0f);
+	UASSERT(_guessIMUAccNoise >= 0.0f);
 
 	if(_imageDecimation == 0)
 	{
@@ -208,6 +219,8 @@ void Odometry::reset(const Transform & initialPose)
 	framesProcessed_ = 0;
 	imuLastTransform_.setNull();
 	imus_.clear();
+	imuSamples_.clear();
+	guessCovariance_ = cv::Mat();
 	if(_force3DoF || particleFilters_.size())
 	{
 		float x,y,z, roll,pitch,yaw;
@@ -283,6 +296,109 @@ Transform getMeanVelocity(const std::list<std::pair<std::vector<float>, double>
 	return Transform();
 }
 
+bool Odometry::preprocess(SensorData & data)
+{
+	if(!this->isPipelined() ||
+	   data.imageRaw().empty() ||
+	   _imageDecimation > 1 ||
+	   (!_imagesAlreadyRectified && !this->canProcessRawImages()))
+	{
+		// Features would have to be extracted on the decimated/rectified images created in process()
+		return false;
+	}
+	return preprocessImpl(data);
+}
+
+// On-manifold preintegration (without bias) of the IMU samples between two stamps. Deltas
+// are expressed in base frame at fromStamp, gravity is not included. Covariance order
+// is rotation, velocity, position.
+bool Odometry::preintegrateIMU(
+		double fromStamp,
+		double toStamp,
+		Transform & deltaRotation,
+		Eigen::Vector3d & deltaVelocity,
+		Eigen::Vector3d & deltaPosition,
+		Eigen::Matrix<double, 9, 9> & covariance) const
+{
+	UASSERT(toStamp > fromStamp);
+	if(imuSamples_.empty() ||
+	   imuSamples_.begin()->first > fromStamp ||
+	   imuSamples_.rbegin()->first < toStamp - (toStamp - fromStamp)*0.5)
+	{
+		UDEBUG("Not enough IMU samples between %f and %f", fromStamp, toStamp);
+		return false;
+	}
+
+	// start with the last sample before fromStamp (zero-order hold)
+	std::map<double, IMU>::const_iterator iter = imuSamples_.upper_bound(fromStamp);
+	--iter;
+
+	Eigen::Matrix3d dR = Eigen::Matrix3d::Identity();
+	Eigen::Vector3d dV(0,0,0);
+	Eigen::Vector3d dP(0,0,0);
+	covariance.setZero();
+	double gyroVariance = double(_guessIMUGyroNoise)*double(_guessIMUGyroNoise);
+	double accVariance = double(_guessIMUAccNoise)*double(_guessIMUAccNoise);
+	double t = fromStamp;
+	int samples = 0;
+	for(; iter!=imuSamples_.end() && t < toStamp; ++iter)
+	{
+		std::map<double, IMU>::const_iterator next = iter;
+		++next;
+		double end = next!=imuSamples_.end() && next->first < toStamp?next->first:toStamp;
+		double dt = end - t;
+		if(dt <= 0.0)
+		{
+			continue;
+		}
+		Eigen::Vector3d w(iter->second.angularVelocity()[0], iter->second.angularVelocity()[1], iter->second.angularVelocity()[2]);
+		Eigen::Vector3d a(iter->second.linearAcceleration()[0], iter->second.linearAcceleration()[1], iter->second.linearAcceleration()[2]);
+
+		Eigen::Matrix3d aSkew;
+		aSkew << 0, -a[2], a[1],
+				 a[2], 0, -a[0],
+				 -a[1], a[0], 0;
+		double angle = (w*dt).norm();
+		Eigen::Matrix3d incR = angle>1e-12?Eigen::AngleAxisd(angle, w*dt/angle).toRotationMatrix():Eigen::Matrix3d::Identity();
+
+		// covariance propagation
+		Eigen::Matrix<double, 9, 9> A = Eigen::Matrix<double, 9, 9>::Identity();
+		A.block<3,3>(0,0) = incR.transpose();
+		A.block<3,3>(3,0) = -dR*aSkew*dt;
+		A.block<3,3>(6,0) = -0.5*dR*aSkew*dt*dt;
+		A.block<3,3>(6,3) = Eigen::Matrix3d::Identity()*dt;
+		Eigen::Matrix<double, 9, 6> B = Eigen::Matrix<double, 9, 6>::Zero();
+		B.block<3,3>(0,0) = Eigen::Matrix3d::Identity()*dt;
+		B.block<3,3>(3,3) = dR*dt;
+		B.block<3,3>(6,3) = 0.5*dR*dt*dt;
+		Eigen::Matrix<double, 6, 6> Q = Eigen::Matrix<double, 6, 6>::Zero();
+		Q.block<3,3>(0,0) = Eigen::Matrix3d::Identity()*gyroVariance/dt;
+		Q.block<3,3>(3,3) = Eigen::Matrix3d::Identity()*accVariance/dt;
+		covariance = A*covariance*A.transpose() + B*Q*B.transpose();
+
+		// integration
+		dP += dV*dt + 0.5*dR*a*dt*dt;
+		dV += dR*a*dt;
+		dR = dR*incR;
+
+		t = end;
+		++samples;
+	}
+
+	if(samples == 0)
+	{
+		return false;
+	}
+
+	// make sure the rotation matrix stays orthonormal
+	Eigen::Quaterniond q(dR);
+	q.normalize();
+	deltaRotation = Transform(0,0,0, q.x(), q.y(), q.z(), q.w());
+	deltaVelocity = dV;
+	deltaPosition = dP;
+	return true;
+}
+
 Transform Odometry::process(SensorData & data, OdometryInfo * info)
 {
 	return process(data, Transform(), info);
@@ -290,6 +406,7 @@ Transform Odometry::process(SensorData & data, OdometryInfo * info)
 
 Transform Odometry::process(SensorData & data, const Transform & guessIn, OdometryInfo * info)
 {
+	UTRACE_SCOPE("Odometry::process");
 	UASSERT_MSG(data.id() >= 0, uFormat("Input data should have ID greater or equal than 0 (id=%d)!", data.id()).c_str());
 
 	// cache imu data
@@ -322,6 +439,19 @@ Transform Odometry::process(SensorData & data, const Transform & guessIn, Odomet
 				imus_.erase(imus_.begin());
 			}
 		}
+
+		if(_guessIMUPreintegration &&
+		   !(data.imu().angularVelocity()[0] == 0.0 && data.imu().angularVelocity()[1] == 0.0 && data.imu().angularVelocity()[2] == 0.0 &&
+			 data.imu().linearAcceleration()[0] == 0.0 && data.imu().linearAcceleration()[1] == 0.0 && data.imu().linearAcceleration()[2] == 0.0))
+		{
+			IMU imuBase = data.imu();
+			imuBase.convertToBaseFrame();
+			imuSamples_.insert(std::make_pair(data.stamp(), imuBase));
+			if(imuSamples_.size() > 1000)
+			{
+				imuSamples_.erase(imuSamples_.begin());
+			}
+		}
 	}
 
 
@@ -535,10 +665,67 @@ Transform Odometry::process(SensorData & data, const Transform & guessIn, Odomet
 	}
 
 	Transform imuCurrentTransform;
+	guessCovariance_ = cv::Mat();
+	Transform imuDeltaRotation;
+	Eigen::Vector3d imuDeltaVelocity;
+	Eigen::Vector3d imuDeltaPosition;
+	Eigen::Matrix<double, 9, 9> imuCovariance;
 	if(!guessIn.isNull())
 	{
 		guess = guessIn;
 	}
+	else if(_guessIMUPreintegration &&
+			dt > 0.0 &&
+			!imuSamples_.empty() &&
+			preintegrateIMU(previousStamp_, data.stamp(), imuDeltaRotation, imuDeltaVelocity, imuDeltaPosition, imuCovariance))
+	{
+		// Gravity in the previous frame, from IMU orientation if available, otherwise
+		// assuming that the odometry frame is aligned with gravity.
+		if(!imus_.empty())
+		{
+			imuCurrentTransform = Transform::getTransform(imus_, data.stamp());
+		}
+		Eigen::Matrix3d previousRotation = (!imuLastTransform_.isNull()?imuLastTransform_:_pose).toEigen3d().linear();
+		Eigen::Vector3d gravity = previousRotation.transpose() * Eigen::Vector3d(0, 0, -9.81);
+
+		// Velocity in the previous frame from the last motion estimated
+		Eigen::Vector3d velocity(0,0,0);
+		double velocityVariance = 0.0;
+		if(!velocityGuess_.isNull())
+		{
+			velocity = Eigen::Vector3d(velocityGuess_.x(), velocityGuess_.y(), velocityGuess_.z());
+			velocityVariance = 0.01; // (0.1 m/s)^2
+		}
+		else
+		{
+			velocityVariance = 1.0; // unknown velocity, assume robot is starting
+		}
+
+		Eigen::Vector3d t = velocity*dt + 0.5*gravity*dt*dt + imuDeltaPosition;
+		guess = Transform(
+				imuDeltaRotation.r11(), imuDeltaRotation.r12(), imuDeltaRotation.r13(), t[0],
+				imuDeltaRotation.r21(), imuDeltaRotation.r22(), imuDeltaRotation.r23(), t[1],
+				imuDeltaRotation.r31(), imuDeltaRotation.r32(), imuDeltaRotation.r33(), t[2]);
+		if(_force3DoF)
+		{
+			guess = guess.to3DoF();
+		}
+
+		// rtabmap covariance order: x,y,z,roll,pitch,yaw
+		guessCovariance_ = cv::Mat::zeros(6,6,CV_64FC1);
+		for(int i=0; i<3; ++i)
+		{
+			for(int j=0; j<3; ++j)
+			{
+				guessCovariance_.at<double>(i,j) = imuCovariance(6+i, 6+j);
+				guessCovariance_.at<double>(i,3+j) = imuCovariance(6+i, j);
+				guessCovariance_.at<double>(3+i,j) = imuCovariance(i, 6+j);
+				guessCovariance_.at<double>(3+i,3+j) = imuCovariance(i, j);
+			}
+			guessCovariance_.at<double>(i,i) += velocityVariance*dt*dt;
+		}
+		UDEBUG("IMU preintegration guess=%s (dt=%fs)", guess.prettyPrint().c_str(), dt);
+	}
 	else if(!imus_.empty())
 	{
 		// replace orientation guess with IMU (if available)
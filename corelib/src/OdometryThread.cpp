@@ -32,10 +32,44 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/CameraEvent.h"
 #include "rtabmap/core/OdometryEvent.h"
 #include "rtabmap/utilite/ULogger.h"
+#include "rtabmap/utilite/UTimer.h"
 
 namespace rtabmap {
 
+class OdometryPreprocessThread : public UThread
+{
+public:
+	OdometryPreprocessThread(OdometryThread * odomThread) :
+		odomThread_(odomThread)
+	{
+		UASSERT(odomThread_ != 0);
+	}
+	virtual ~OdometryPreprocessThread()
+	{
+		this->join(true);
+	}
+
+private:
+	virtual void mainLoopBegin()
+	{
+		ULogger::registerCurrentThread("OdomPreprocess");
+	}
+	virtual void mainLoopKill()
+	{
+		odomThread_->_rawDataAdded.release();
+	}
+	virtual void mainLoop()
+	{
+		odomThread_->preprocessData();
+	}
+
+private:
+	OdometryThread * odomThread_;
+};
+
 OdometryThread::OdometryThread(Odometry * odometry, unsigned int dataBufferMaxSize) :
+	_preprocessThread(0),
+	_rawDataGeneration(0),
 	_odometry(odometry),
 	_dataBufferMaxSize(dataBufferMaxSize),
 	_resetOdometry(false),
@@ -44,12 +78,18 @@ OdometryThread::OdometryThread(Odometry * odometry, unsigned int dataBufferMaxSi
 	_imuEstimatedDelay(0.0)
 {
 	UASSERT(_odometry != 0);
+	if(_odometry->isPipelined())
+	{
+		UINFO("Odometry is pipelined: features are extracted in a separate thread.");
+		_preprocessThread = new OdometryPreprocessThread(this);
+	}
 }
 
 OdometryThread::~OdometryThread()
 {
 	this->unregisterFromEventsManager();
 	this->join(true);
+	delete _preprocessThread;
 	delete _odometry;
 	UDEBUG("");
 }
@@ -91,13 +131,29 @@ bool OdometryThread::handleEvent(UEvent * event)
 void OdometryThread::mainLoopBegin()
 {
 	ULogger::registerCurrentThread("Odometry");
+	if(_preprocessThread)
+	{
+		_preprocessThread->start();
+	}
 }
 
 void OdometryThread::mainLoopKill()
 {
+	if(_preprocessThread)
+	{
+		_preprocessThread->kill();
+	}
 	_dataAdded.release();
 }
 
+void OdometryThread::mainLoopEnd()
+{
+	if(_preprocessThread)
+	{
+		_preprocessThread->join(true);
+	}
+}
+
 //============================================================
 // MAIN LOOP
 //============================================================
@@ -107,6 +163,12 @@ void OdometryThread::mainLoop()
 	{
 		_odometry->reset(_resetPose);
 		_resetOdometry = false;
+		if(_preprocessThread)
+		{
+			UScopeMutex lock(_rawDataMutex);
+			_rawDataBuffer.clear();
+			++_rawDataGeneration;
+		}
 		UScopeMutex lock(_dataMutex);
 		_dataBuffer.clear();
 		_imuBuffer.clear();
@@ -152,6 +214,95 @@ void OdometryThread::addData(const SensorData & data)
 		}
 	}
 
+	if(_preprocessThread)
+	{
+		// Features will be extracted in the preprocessing thread before
+		// the data is available to mainLoop(). IMU-only data goes through
+		// the same queue so that it is not reordered with the frames.
+		bool notify = true;
+		_rawDataMutex.lock();
+		{
+			_rawDataBuffer.push_back(data);
+			if(_dataBufferMaxSize > 0 && (!data.imageRaw().empty() || !data.laserScanRaw().isEmpty() || data.imu().empty()))
+			{
+				// only frames are counted
+				unsigned int frames = 0;
+				for(std::list<SensorData>::iterator iter=_rawDataBuffer.begin(); iter!=_rawDataBuffer.end(); ++iter)
+				{
+					if(!iter->imageRaw().empty() || !iter->laserScanRaw().isEmpty() || iter->imu().empty())
+					{
+						++frames;
+					}
+				}
+				for(std::list<SensorData>::iterator iter=_rawDataBuffer.begin(); frames > _dataBufferMaxSize && iter!=_rawDataBuffer.end();)
+				{
+					if(!iter->imageRaw().empty() || !iter->laserScanRaw().isEmpty() || iter->imu().empty())
+					{
+						UDEBUG("Raw data buffer is full, the oldest data is removed to add the new one.");
+						iter = _rawDataBuffer.erase(iter);
+						--frames;
+						notify = false;
+					}
+					else
+					{
+						++iter;
+					}
+				}
+			}
+		}
+		_rawDataMutex.unlock();
+
+		if(notify)
+		{
+			_rawDataAdded.release();
+		}
+		return;
+	}
+
+	pushData(data);
+}
+
+void OdometryThread::preprocessData()
+{
+	SensorData data;
+	bool dataFilled = false;
+	int generation = 0;
+	_rawDataAdded.acquire();
+	_rawDataMutex.lock();
+	{
+		if(!_rawDataBuffer.empty())
+		{
+			data = _rawDataBuffer.front();
+			_rawDataBuffer.pop_front();
+			generation = _rawDataGeneration;
+			dataFilled = true;
+		}
+	}
+	_rawDataMutex.unlock();
+
+	if(dataFilled)
+	{
+		UTimer timer;
+		if((!data.imageRaw().empty() || !data.laserScanRaw().isEmpty() || data.imu().empty()) &&
+		   _odometry->preprocess(data))
+		{
+			UDEBUG("Extracted %d features of data %d (%fs)", (int)data.keypoints().size(), data.id(), timer.ticks());
+		}
+
+		UScopeMutex lock(_rawDataMutex);
+		if(generation == _rawDataGeneration)
+		{
+			pushData(data);
+		}
+		else
+		{
+			UDEBUG("Odometry has been reset, data %d is dropped.", data.id());
+		}
+	}
+}
+
+void OdometryThread::pushData(const SensorData & data)
+{
 	bool notify = true;
 	_dataMutex.lock();
 	{
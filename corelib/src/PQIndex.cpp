@@ -0,0 +1,334 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <rtabmap/core/PQIndex.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UMath.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <algorithm>
+
+namespace rtabmap {
+
+static float squaredDistance(const float * a, const float * b, int dim)
+{
+	float d = 0.0f;
+	for(int i=0; i<dim; ++i)
+	{
+		float diff = a[i]-b[i];
+		d += diff*diff;
+	}
+	return d;
+}
+
+static int nearestCentroid(const cv::Mat & centroids, const float * feature)
+{
+	int best = 0;
+	float bestDist = squaredDistance(feature, centroids.ptr<float>(0), centroids.cols);
+	for(int i=1; i<centroids.rows; ++i)
+	{
+		float d = squaredDistance(feature, centroids.ptr<float>(i), centroids.cols);
+		if(d < bestDist)
+		{
+			bestDist = d;
+			best = i;
+		}
+	}
+	return best;
+}
+
+PQIndex::PQIndex():
+		featuresDim_(0),
+		removedCount_(0)
+{
+}
+PQIndex::~PQIndex()
+{
+	this->release();
+}
+
+void PQIndex::release()
+{
+	UDEBUG("");
+	featuresDim_ = 0;
+	subspaces_.clear();
+	codebooks_.clear();
+	coarseCentroids_ = cv::Mat();
+	cells_.clear();
+	codes_ = cv::Mat();
+	removed_.clear();
+	removedCount_ = 0;
+}
+
+unsigned int PQIndex::indexedFeatures() const
+{
+	return codes_.rows - removedCount_;
+}
+
+unsigned long PQIndex::memoryUsed() const
+{
+	unsigned long memoryUsage = sizeof(PQIndex);
+	for(size_t i=0; i<codebooks_.size(); ++i)
+	{
+		memoryUsage += codebooks_[i].total() * codebooks_[i].elemSize();
+	}
+	memoryUsage += coarseCentroids_.total() * coarseCentroids_.elemSize();
+	for(size_t i=0; i<cells_.size(); ++i)
+	{
+		memoryUsage += cells_[i].size() * sizeof(unsigned int) + sizeof(std::vector<unsigned int>);
+	}
+	memoryUsage += codes_.total() * codes_.elemSize();
+	memoryUsage += removed_.size();
+	return memoryUsage;
+}
+
+void PQIndex::train(
+		const cv::Mat & featuresIn,
+		int subQuantizers,
+		int coarseCells,
+		int iterations)
+{
+	UASSERT(featuresIn.type() == CV_32FC1 && featuresIn.rows > 0);
+	UASSERT_MSG(subQuantizers > 0 && subQuantizers <= featuresIn.cols, uFormat("subQuantizers=%d dim=%d", subQuantizers, featuresIn.cols).c_str());
+	this->release();
+
+	cv::Mat features = featuresIn.isContinuous()?featuresIn:featuresIn.clone();
+	featuresDim_ = features.cols;
+	cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, iterations, 0.0001);
+
+	// Split the descriptor in sub-vectors, each one quantized on a byte
+	int centroids = uMin(256, features.rows);
+	subspaces_.resize(subQuantizers+1);
+	for(int i=0; i<=subQuantizers; ++i)
+	{
+		subspaces_[i] = i*featuresDim_/subQuantizers;
+	}
+	codebooks_.resize(subQuantizers);
+	for(int i=0; i<subQuantizers; ++i)
+	{
+		cv::Mat samples = features.colRange(subspaces_[i], subspaces_[i+1]).clone();
+		cv::Mat labels;
+		cv::kmeans(samples, centroids, labels, criteria, 1, cv::KMEANS_PP_CENTERS, codebooks_[i]);
+		UASSERT(codebooks_[i].type() == CV_32FC1 && codebooks_[i].rows == centroids);
+	}
+
+	if(coarseCells > 1 && features.rows > coarseCells)
+	{
+		cv::Mat labels;
+		cv::kmeans(features, coarseCells, labels, criteria, 1, cv::KMEANS_PP_CENTERS, coarseCentroids_);
+		UASSERT(coarseCentroids_.type() == CV_32FC1 && coarseCentroids_.rows == coarseCells);
+		cells_.resize(coarseCells);
+	}
+	else
+	{
+		cells_.resize(1);
+	}
+	UDEBUG("Trained with %d features (dim=%d): sub-quantizers=%d centroids=%d cells=%d",
+			features.rows, featuresDim_, subQuantizers, centroids, (int)cells_.size());
+}
+
+std::vector<unsigned int> PQIndex::addPoints(const cv::Mat & features)
+{
+	UASSERT_MSG(this->isTrained(), "Index should be trained before adding points!");
+	UASSERT(features.type() == CV_32FC1 && features.cols == featuresDim_);
+
+	std::vector<unsigned int> indices(features.rows);
+	cv::Mat codes(features.rows, (int)codebooks_.size(), CV_8UC1);
+	for(int i=0; i<features.rows; ++i)
+	{
+		const float * feature = features.ptr<float>(i);
+		unsigned char * code = codes.ptr(i);
+		for(size_t s=0; s<codebooks_.size(); ++s)
+		{
+			code[s] = (unsigned char)nearestCentroid(codebooks_[s], feature + subspaces_[s]);
+		}
+		indices[i] = codes_.rows + i;
+		int cell = coarseCentroids_.empty()?0:nearestCentroid(coarseCentroids_, feature);
+		cells_[cell].push_back(indices[i]);
+	}
+	codes_.push_back(codes);
+	removed_.resize(codes_.rows, 0);
+	return indices;
+}
+
+void PQIndex::removePoint(unsigned int index)
+{
+	// Codes are only marked as removed, they are skipped on search
+	UASSERT(index < removed_.size());
+	if(!removed_[index])
+	{
+		removed_[index] = 1;
+		++removedCount_;
+	}
+}
+
+std::vector<int> PQIndex::compact()
+{
+	std::vector<int> newIndices(codes_.rows, -1);
+	if(removedCount_ == 0)
+	{
+		for(int i=0; i<codes_.rows; ++i)
+		{
+			newIndices[i] = i;
+		}
+		return newIndices;
+	}
+
+	UTimer timer;
+	cv::Mat codes(codes_.rows - removedCount_, codes_.cols, CV_8UC1);
+	int j = 0;
+	for(int i=0; i<codes_.rows; ++i)
+	{
+		if(!removed_[i])
+		{
+			codes_.row(i).copyTo(codes.row(j));
+			newIndices[i] = j++;
+		}
+	}
+	UASSERT(j == codes.rows);
+	for(size_t c=0; c<cells_.size(); ++c)
+	{
+		std::vector<unsigned int> cell;
+		cell.reserve(cells_[c].size());
+		for(size_t k=0; k<cells_[c].size(); ++k)
+		{
+			if(newIndices[cells_[c][k]] >= 0)
+			{
+				cell.push_back(newIndices[cells_[c][k]]);
+			}
+		}
+		cells_[c].swap(cell);
+	}
+	UDEBUG("Compacted %d -> %d codes (%fs)", codes_.rows, codes.rows, timer.ticks());
+	codes_ = codes;
+	removed_ = std::vector<unsigned char>(codes_.rows, 0);
+	removedCount_ = 0;
+	return newIndices;
+}
+
+void PQIndex::knnSearch(
+		const cv::Mat & query,
+		cv::Mat & indices,
+		cv::Mat & dists,
+		int knn,
+		int probes) const
+{
+	if(!this->isTrained())
+	{
+		UERROR("PQ index not yet trained!");
+		return;
+	}
+	UASSERT(query.type() == CV_32FC1 && query.cols == featuresDim_);
+	UASSERT(knn > 0);
+	indices.create(query.rows, knn, sizeof(size_t)==8?CV_64F:CV_32S);
+	dists.create(query.rows, knn, CV_32FC1);
+
+	int m = (int)codebooks_.size();
+	int centroids = codebooks_[0].rows;
+	int cellsToScan = uMax(1, uMin(probes, (int)cells_.size()));
+	std::vector<float> table(m*centroids);
+	std::vector<std::pair<float, int> > cellDists(cells_.size());
+	std::vector<std::pair<float, size_t> > best;
+	best.reserve(knn+1);
+	for(int i=0; i<query.rows; ++i)
+	{
+		const float * q = query.ptr<float>(i);
+
+		// Distances between the query sub-vectors and all centroids
+		for(int s=0; s<m; ++s)
+		{
+			int dim = subspaces_[s+1]-subspaces_[s];
+			for(int c=0; c<centroids; ++c)
+			{
+				table[s*centroids + c] = squaredDistance(q + subspaces_[s], codebooks_[s].ptr<float>(c), dim);
+			}
+		}
+
+		// Closest cells
+		if(cells_.size() > 1)
+		{
+			for(int c=0; c<coarseCentroids_.rows; ++c)
+			{
+				cellDists[c].first = squaredDistance(q, coarseCentroids_.ptr<float>(c), featuresDim_);
+				cellDists[c].second = c;
+			}
+			std::partial_sort(cellDists.begin(), cellDists.begin()+cellsToScan, cellDists.end());
+		}
+		else
+		{
+			cellDists[0].second = 0;
+		}
+
+		best.clear();
+		for(int c=0; c<cellsToScan; ++c)
+		{
+			const std::vector<unsigned int> & cell = cells_[cellDists[c].second];
+			for(size_t j=0; j<cell.size(); ++j)
+			{
+				unsigned int index = cell[j];
+				if(removed_[index])
+				{
+					continue;
+				}
+				const unsigned char * code = codes_.ptr(index);
+				float d = 0.0f;
+				for(int s=0; s<m; ++s)
+				{
+					d += table[s*centroids + code[s]];
+				}
+				if((int)best.size() < knn || d < best.back().first)
+				{
+					std::pair<float, size_t> candidate(d, index);
+					best.insert(std::upper_bound(best.begin(), best.end(), candidate), candidate);
+					if((int)best.size() > knn)
+					{
+						best.pop_back();
+					}
+				}
+			}
+		}
+
+		size_t * indicesPtr = (size_t*)indices.ptr(i);
+		float * distsPtr = dists.ptr<float>(i);
+		for(int j=0; j<knn; ++j)
+		{
+			if(j < (int)best.size())
+			{
+				indicesPtr[j] = best[j].second;
+				distsPtr[j] = best[j].first;
+			}
+			else
+			{
+				indicesPtr[j] = 0;
+				distsPtr[j] = -1.0f;
+			}
+		}
+	}
+}
+
+} /* namespace rtabmap */
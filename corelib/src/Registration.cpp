@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/RegistrationIcp.h>
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UTrace.h>
 
 namespace rtabmap {
 
@@ -192,6 +193,7 @@ Transform Registration::computeTransformationMod(
 		RegistrationInfo * infoOut) const
 {
 	UTimer time;
+	UTRACE_SCOPE("Registration::computeTransformation");
 	RegistrationInfo info;
 	if(infoOut)
 	{
@@ -204,7 +204,7 @@ void RegistrationVis::parseParameters(const ParametersMap & parameters)
 
 	if(uContains(parameters, Parameters::kVisCorNNType()))
 	{
-		if(_nnType<VWDictionary::kNNUndef)
+		if(_nnType<=VWDictionary::kNNBruteForceGPU)
 		{
 			uInsert(_featureParameters, ParametersPair(Parameters::kKpNNStrategy(), uNumber2Str(_nnType)));
 		}
@@ -273,6 +273,61 @@ RegistrationVis::~RegistrationVis()
 #endif
 }
 
+void RegistrationVis::setGuessCovariance(const cv::Mat & covariance)
+{
+	UASSERT(covariance.empty() || (covariance.cols == 6 && covariance.rows == 6 && covariance.type() == CV_64FC1));
+	_guessCovariance = covariance;
+}
+
+void RegistrationVis::extractFeatures(SensorData & data) const
+{
+	cv::Mat image = data.imageRaw();
+	if(image.empty() || !data.keypoints().empty())
+	{
+		return;
+	}
+	if(image.channels() > 1)
+	{
+		cv::Mat tmp;
+		cv::cvtColor(image, tmp, cv::COLOR_BGR2GRAY);
+		image = tmp;
+	}
+
+	cv::Mat depthMask;
+	if(!data.depthRaw().empty() && _depthAsMask)
+	{
+		if(image.rows % data.depthRaw().rows == 0 &&
+		   image.cols % data.depthRaw().cols == 0 &&
+		   image.rows/data.depthRaw().rows == image.cols/data.depthRaw().cols)
+		{
+			depthMask = util2d::interpolate(data.depthRaw(), image.rows/data.depthRaw().rows, 0.1f);
+		}
+		else
+		{
+			UWARN("%s is true, but RGB size (%dx%d) modulo depth size (%dx%d) is not 0. Ignoring depth mask for feature detection.",
+					Parameters::kVisDepthAsMask().c_str(),
+					data.imageRaw().rows, data.imageRaw().cols,
+					data.depthRaw().rows, data.depthRaw().cols);
+		}
+	}
+
+	std::vector<cv::KeyPoint> kpts = _detectorTo->generateKeypoints(image, depthMask);
+	cv::Mat descriptors;
+	if(kpts.size())
+	{
+		descriptors = _detectorTo->generateDescriptors(image, kpts);
+	}
+	std::vector<cv::Point3f> kpts3D = _detectorTo->generateKeypoints3D(data, kpts);
+	if(kpts3D.size() &&
+	   (_detectorTo->getMinDepth() > 0.0f || _detectorTo->getMaxDepth() > 0.0f) &&
+	   (!data.cameraModels().empty() || data.stereoCameraModel().isValidForProjection()))
+	{
+		_detectorTo->filterKeypointsByDepth(kpts, descriptors, kpts3D, _detectorTo->getMinDepth(), _detectorTo->getMaxDepth());
+	}
+	UDEBUG("Extracted %d features", (int)kpts.size());
+	data.setFeatures(std::move(kpts), std::move(kpts3D), descriptors);
+}
+
 Transform RegistrationVis::computeTransformationImpl(
 			Signature & fromSignature,
 			Signature & toSignature,
@@ -504,10 +559,16 @@ Transform RegistrationVis::computeTransformationImpl(
 				UDEBUG("guessSet = %d", guessSet?1:0);
 				std::vector<unsigned char> status;
 				std::vector<float> err;
+				// Pyramids are cached in the sensor data and shared by its copies, so
+				// that they are built only once per image (e.g., odometry's reference
+				// frame, or the new node registered with multiple loop closure/proximity
+				// candidates).
+				const std::vector<cv::Mat> & pyramidFrom = fromSignature.sensorData().imagePyramid(false, cv::Size(_flowWinSize, _flowWinSize), _flowMaxLevel, true);
+				const std::vector<cv::Mat> & pyramidTo = toSignature.sensorData().imagePyramid(false, cv::Size(_flowWinSize, _flowWinSize), _flowMaxLevel, true);
 				UDEBUG("cv::calcOpticalFlowPyrLK() begin");
 				cv::calcOpticalFlowPyrLK(
-						imageFrom,
-						imageTo,
+						pyramidFrom,
+						pyramidTo,
 						cornersFrom,
 						cornersTo,
 						status,
@@ -823,6 +884,18 @@ Transform RegistrationVis::computeTransformationImpl(
 					cv::Rodrigues(R, rvec);
 					cv::Mat tvec = (cv::Mat_<double>(1,3) << (double)guessCameraRef.x(), (double)guessCameraRef.y(), (double)guessCameraRef.z());
 					cv::Mat K = toSignature.sensorData().cameraModels().size()?toSignature.sensorData().cameraModels()[0].K():toSignature.sensorData().stereoCameraModel().left().K();
+
+					int guessWinSize = _guessWinSize;
+					if(!_guessCovariance.empty())
+					{
+						// 3 sigmas of the guess error in pixels, translation error is projected at 1 m
+						double fx = K.at<double>(0,0);
+						double sigmaT = sqrt(uMax3(_guessCovariance.at<double>(0,0), _guessCovariance.at<double>(1,1), _guessCovariance.at<double>(2,2)));
+						double sigmaR = sqrt(uMax3(_guessCovariance.at<double>(3,3), _guessCovariance.at<double>(4,4), _guessCovariance.at<double>(5,5)));
+						guessWinSize = uMax(3, uMin(_guessWinSize, (int)ceil(3.0*fx*(sigmaR + sigmaT))));
+						UDEBUG("Guess window size reduced to %d pixels from guess covariance (max=%d)", guessWinSize, _guessWinSize);
+					}
+
 					std::vector<cv::Point2f> projected;
 					cv::projectPoints(kptsFrom3D, rvec, tvec, K, cv::Mat(), projected);
 					UDEBUG("Projected points=%d", (int)projected.size());
@@ -861,7 +934,7 @@ Transform RegistrationVis::computeTransformationImpl(
 
 							std::vector< std::vector<size_t> > indices;
 							std::vector<std::vector<float> > dists;
-							float radius = (float)_guessWinSize; // pixels
+							float radius = (float)guessWinSize; // pixels
 							std::vector<cv::Point2f> pointsTo;
 							cv::KeyPoint::convert(kptsTo, pointsTo);
 							rtflann::Matrix<float> pointsToMat((float*)pointsTo.data(), pointsTo.size(), 2);
@@ -1004,7 +1077,7 @@ Transform RegistrationVis::computeTransformationImpl(
 
 							std::vector< std::vector<size_t> > indices;
 							std::vector<std::vector<float> > dists;
-							float radius = (float)_guessWinSize; // pixels
+							float radius = (float)guessWinSize; // pixels
 							rtflann::Matrix<float> cornersProjectedMat((float*)cornersProjected.data(), cornersProjected.size(), 2);
 							index.radiusSearch(cornersProjectedMat, indices, dists, radius*radius, rtflann::SearchParams());
 
@@ -49,6 +49,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UFile.h>
 #include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UTrace.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UMath.h>
 #include <rtabmap/utilite/UProcessInfo.h>
@@ -1068,6 +1069,7 @@ bool Rtabmap::process(
 		const std::map<std::string, float> & externalStats)
 {
 	UDEBUG("");
+	UTRACE_SCOPE("Rtabmap::process");
 
 	//============================================================
 	// Initialization
@@ -1889,6 +1891,10 @@ bool Rtabmap::process(
 				if(_highestHypothesis.second >= loopThr)
 				{
 					rejectedGlobalLoopClosure = true;
+					if(_verifyLoopClosureHypothesis)
+					{
+						_memory->loadWordsFeatures(_highestHypothesis.first);
+					}
 					if(posterior.size() <= 2 && loopThr>0.0f)
 					{
 						// Ignore loop closure if there is only one loop closure hypothesis
@@ -2552,6 +2558,11 @@ bool Rtabmap::process(
 				// 2) compare locally with nearest locations by scan matching
 				//
 				UDEBUG("Proximity detection (local loop closure in SPACE with scan matching)");
+				if(_proximityMaxNeighbors > 0)
+				{
+					// make sure the scan of the new node is compressed (see Mem/CompressionPending)
+					_memory->completeCompression(signature->id());
+				}
 				if( _proximityMaxNeighbors <= 0)
 				{
 					UDEBUG("Proximity by scan matching is disabled (%s=%d).", Parameters::kRGBDProximityPathMaxNeighbors().c_str(), _proximityMaxNeighbors);
@@ -3473,6 +3484,9 @@ bool Rtabmap::process(
 			statistics_.addStatistic(Statistics::kMemorySmall_movement(), smallDisplacement?1.0f:0);
 			statistics_.addStatistic(Statistics::kMemoryDistance_travelled(), _distanceTravelled);
 			statistics_.addStatistic(Statistics::kMemoryFast_movement(), tooFastMovement?1.0f:0);
+			statistics_.addStatistic(Statistics::kMemoryScan_cache_hits(), _memory->getScanCacheHits());
+			statistics_.addStatistic(Statistics::kMemoryScan_cache_misses(), _memory->getScanCacheMisses());
+			statistics_.addStatistic(Statistics::kMemoryScan_cache_size(), float(_memory->getScanCacheMemoryUsed())/(1024.0f*1024.0f)); //MB
 			if(_publishRAMUsage)
 			{
 				UTimer ramTimer;
@@ -3480,10 +3494,15 @@ bool Rtabmap::process(
 				long estimatedMemoryUsage = sizeof(Rtabmap);
 				estimatedMemoryUsage += _optimizedPoses.size() * (sizeof(int) + sizeof(Transform) + 12 * sizeof(float) + sizeof(std::map<int, Transform>::iterator)) + sizeof(std::map<int, Transform>);
 				estimatedMemoryUsage += _constraints.size() * (sizeof(int) + sizeof(Transform) + 12 * sizeof(float) + sizeof(cv::Mat) + 36 * sizeof(double) + sizeof(std::map<int, Link>::iterator)) + sizeof(std::map<int, Link>);
-				estimatedMemoryUsage += _memory->getMemoryUsed();
+				unsigned long signaturesMemoryUsage = 0;
+				estimatedMemoryUsage += _memory->getMemoryUsed(&signaturesMemoryUsage);
 				estimatedMemoryUsage += _bayesFilter->getMemoryUsed();
 				estimatedMemoryUsage += _parameters.size()*(sizeof(std::string)*2+sizeof(ParametersMap::iterator)) + sizeof(ParametersMap);
 				statistics_.addStatistic(Statistics::kMemoryRAM_estimated(), (float)(estimatedMemoryUsage/(1024*1024)));//MB
+				if(!_memory->getSignatures().empty())
+				{
+					statistics_.addStatistic(Statistics::kMemoryRAM_estimated_per_node(), (float)signaturesMemoryUsage/float(_memory->getSignatures().size())/1024.0f);//KB
+				}
 				statistics_.addStatistic(Statistics::kTimingRAM_estimation(), ramTimer.ticks()*1000);
 			}
 
@@ -3526,6 +3545,7 @@ bool Rtabmap::process(
 	}
 	if(_publishLastSignatureData)
 	{
+		_memory->completeCompression(signature->id());
 		lastSignatureData = *signature;
 	}
 	if(!_rawDataKept)
@@ -5123,6 +5143,7 @@ bool Rtabmap::globalBundleAdjustment(
 		{
 			if(_memory->getSignature(iter->first))
 			{
+				_memory->loadWordsFeatures(iter->first);
 				signatures.insert(std::make_pair(iter->first, *_memory->getSignature(iter->first)));
 			}
 		}
@@ -6086,30 +6107,25 @@ void Rtabmap::createGlobalScanMap()
 	std::map<int, Transform> scanViewpoints;
 	for(std::map<int, Transform>::iterator iter=_optimizedPoses.begin(); iter!=_optimizedPoses.end(); ++iter)
 	{
-		SensorData data = _memory->getNodeData(iter->first, false, true, false, false);
-		if(!data.laserScanCompressed().empty())
+		LaserScan scan = _memory->getUncompressedLaserScan(iter->first);
+		if(!scan.empty())
 		{
-			LaserScan scan;
-			data.uncompressDataConst(0, 0, &scan, 0, 0, 0, 0);
-			if(!scan.empty())
+			scan = util3d::transformLaserScan(scan, iter->second*scan.localTransform());
+			if(_globalScanMap.empty() || _globalScanMap.format() == scan.format())
 			{
-				scan = util3d::transformLaserScan(scan, iter->second*scan.localTransform());
-				if(_globalScanMap.empty() || _globalScanMap.format() == scan.format())
-				{
-					_globalScanMap += scan;
-					_globalScanMapPoses.insert(*iter);
-					scanViewpoints.insert(std::make_pair(iter->first, iter->second * scan.localTransform()));
-					scanIndices.resize(_globalScanMap.size(), iter->first);
-				}
-				else
-				{
-					UWARN("Incompatible scan formats (%s vs %s), cannot create global scan map.",
-							_globalScanMap.formatName().c_str(),
-							scan.formatName().c_str());
-					_globalScanMap.clear();
-					_globalScanMapPoses.clear();
-					break;
-				}
+				_globalScanMap += scan;
+				_globalScanMapPoses.insert(*iter);
+				scanViewpoints.insert(std::make_pair(iter->first, iter->second * scan.localTransform()));
+				scanIndices.resize(_globalScanMap.size(), iter->first);
+			}
+			else
+			{
+				UWARN("Incompatible scan formats (%s vs %s), cannot create global scan map.",
+						_globalScanMap.formatName().c_str(),
+						scan.formatName().c_str());
+				_globalScanMap.clear();
+				_globalScanMapPoses.clear();
+				break;
 			}
 		}
 	}
@@ -32,6 +32,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/utilite/ULogger.h"
 #include <rtabmap/utilite/UMath.h>
 #include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UMutex.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
 
 namespace rtabmap
 {
@@ -214,6 +217,7 @@ void SensorData::setRGBDImage(
 				"between raw and compressed data!");
 	}
 	bool clearData = clearPreviousData || _stereoCameraModel.isValidForProjection();
+	clearImagePyramids();
 
 	_stereoCameraModel = StereoCameraModel();
 	_cameraModels = models;
@@ -281,6 +285,7 @@ void SensorData::setStereoImage(
 				"between raw and compressed data!");
 	}
 	bool clearData = clearPreviousData || !_cameraModels.empty();
+	clearImagePyramids();
 
 	_cameraModels.clear();
 	_stereoCameraModel = stereoCameraModel;
@@ -358,11 +363,13 @@ void SensorData::setImageRaw(const cv::Mat & image)
 {
 	UASSERT(image.empty() || image.rows > 1);
 	_imageRaw = image;
+	clearImagePyramids();
 }
 void SensorData::setDepthOrRightRaw(const cv::Mat & image)
 {
 	UASSERT(image.empty() || image.rows > 1);
 	_depthOrRightRaw = image;
+	clearImagePyramids();
 }
 void SensorData::setLaserScanRaw(const LaserScan & scan)
 {
@@ -758,14 +765,96 @@ void SensorData::setFeatures(const std::vector<cv::KeyPoint> & keypoints, const
 {
 	UASSERT_MSG(keypoints3D.empty() || keypoints.size() == keypoints3D.size(), uFormat("keypoints=%d keypoints3D=%d", (int)keypoints.size(), (int)keypoints3D.size()).c_str());
 	UASSERT_MSG(descriptors.empty() || (int)keypoints.size() == descriptors.rows, uFormat("keypoints=%d descriptors=%d", (int)keypoints.size(), descriptors.rows).c_str());
-	_keypoints = keypoints;
-	_keypoints3D = keypoints3D;
+	_keypoints.reset(keypoints.empty()?0:new std::vector<cv::KeyPoint>(keypoints));
+	_keypoints3D.reset(keypoints3D.empty()?0:new std::vector<cv::Point3f>(keypoints3D));
 	_descriptors = descriptors;
 }
 
+void SensorData::setFeatures(std::vector<cv::KeyPoint> && keypoints, std::vector<cv::Point3f> && keypoints3D, const cv::Mat & descriptors)
+{
+	UASSERT_MSG(keypoints3D.empty() || keypoints.size() == keypoints3D.size(), uFormat("keypoints=%d keypoints3D=%d", (int)keypoints.size(), (int)keypoints3D.size()).c_str());
+	UASSERT_MSG(descriptors.empty() || (int)keypoints.size() == descriptors.rows, uFormat("keypoints=%d descriptors=%d", (int)keypoints.size(), descriptors.rows).c_str());
+	_keypoints.reset(keypoints.empty()?0:new std::vector<cv::KeyPoint>(std::move(keypoints)));
+	_keypoints3D.reset(keypoints3D.empty()?0:new std::vector<cv::Point3f>(std::move(keypoints3D)));
+	_descriptors = descriptors;
+}
+
+void SensorData::setFeatures(const SensorData & data)
+{
+	_keypoints = data._keypoints;
+	_keypoints3D = data._keypoints3D;
+	_descriptors = data._descriptors;
+}
+
+const std::vector<cv::KeyPoint> & SensorData::keypoints() const
+{
+	static const std::vector<cv::KeyPoint> empty;
+	return _keypoints.get()?*_keypoints:empty;
+}
+
+const std::vector<cv::Point3f> & SensorData::keypoints3D() const
+{
+	static const std::vector<cv::Point3f> empty;
+	return _keypoints3D.get()?*_keypoints3D:empty;
+}
+
+std::vector<cv::Mat> SensorData::imagePyramid(bool right, const cv::Size & winSize, int maxLevel, bool withDerivatives) const
+{
+	cv::Mat image = right?rightRaw():_imageRaw;
+	if(image.empty())
+	{
+		return std::vector<cv::Mat>();
+	}
+	std::vector<int> key(5);
+	key[0] = right?1:0;
+	key[1] = winSize.width;
+	key[2] = winSize.height;
+	key[3] = maxLevel;
+	key[4] = withDerivatives?1:0;
+
+	UScopeMutex lock(_imagePyramids->mutex);
+	std::map<std::vector<int>, std::vector<cv::Mat> >::iterator iter = _imagePyramids->pyramids.find(key);
+	if(iter != _imagePyramids->pyramids.end())
+	{
+		return iter->second;
+	}
+
+	if(image.channels() > 1)
+	{
+		cv::Mat tmp;
+		cv::cvtColor(image, tmp, cv::COLOR_BGR2GRAY);
+		image = tmp;
+	}
+	std::vector<cv::Mat> & pyramid = _imagePyramids->pyramids[key];
+	cv::buildOpticalFlowPyramid(image, pyramid, winSize, maxLevel, withDerivatives);
+	UDEBUG("Built %s pyramid of node %d (win=%dx%d maxLevel=%d derivatives=%d)",
+			right?"right":"left", _id, winSize.width, winSize.height, maxLevel, withDerivatives?1:0);
+	return pyramid;
+}
+
+void SensorData::clearImagePyramids()
+{
+	// don't clear the shared cache, other copies may still have the same images
+	_imagePyramids = std::make_shared<ImagePyramids>();
+}
+
 unsigned long SensorData::getMemoryUsed() const // Return memory usage in Bytes
 {
+	// the pyramids cache is shared between copies, count only its share
+	unsigned long pyramidsMemory = 0;
+	{
+		UScopeMutex lock(_imagePyramids->mutex);
+		for(std::map<std::vector<int>, std::vector<cv::Mat> >::const_iterator iter=_imagePyramids->pyramids.begin(); iter!=_imagePyramids->pyramids.end(); ++iter)
+		{
+			for(size_t i=0; i<iter->second.size(); ++i)
+			{
+				pyramidsMemory += iter->second[i].total()*iter->second[i].elemSize();
+			}
+		}
+		pyramidsMemory /= _imagePyramids.use_count();
+	}
 	return sizeof(SensorData) +
+			pyramidsMemory +
 			_imageCompressed.total()*_imageCompressed.elemSize() +
 			_imageRaw.total()*_imageRaw.elemSize() +
 			_depthOrRightCompressed.total()*_depthOrRightCompressed.elemSize() +
@@ -780,8 +869,8 @@ unsigned long SensorData::getMemoryUsed() const // Return memory usage in Bytes
 			_obstacleCellsRaw.total()*_obstacleCellsRaw.elemSize()+
 			_emptyCellsCompressed.total()*_emptyCellsCompressed.elemSize() +
 			_emptyCellsRaw.total()*_emptyCellsRaw.elemSize()+
-			_keypoints.size() * sizeof(cv::KeyPoint) +
-			_keypoints3D.size() * sizeof(cv::Point3f) +
+			keypoints().size() * sizeof(cv::KeyPoint) +
+			keypoints3D().size() * sizeof(cv::Point3f) +
 			_descriptors.total()*_descriptors.elemSize();
 }
 
@@ -807,6 +896,7 @@ void SensorData::clearRawData(bool images, bool scan, bool userData)
 	{
 		_imageRaw=cv::Mat();
 		_depthOrRightRaw=cv::Mat();
+		clearImagePyramids();
 	}
 	if(scan)
 	{
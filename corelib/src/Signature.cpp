@@ -44,6 +44,10 @@ Signature::Signature() :
 	_saved(false),
 	_modified(true),
 	_linksModified(true),
+	_wordsCompacted(false),
+	_wordsCompactKpts(0),
+	_wordsCompact3(0),
+	_wordsFeaturesLoaded(true),
 	_enabled(false),
 	_invalidWordsCount(0)
 {
@@ -66,6 +70,10 @@ Signature::Signature(
 	_saved(false),
 	_modified(true),
 	_linksModified(true),
+	_wordsCompacted(false),
+	_wordsCompactKpts(0),
+	_wordsCompact3(0),
+	_wordsFeaturesLoaded(true),
 	_enabled(false),
 	_invalidWordsCount(0),
 	_pose(pose),
@@ -88,6 +96,10 @@ Signature::Signature(const SensorData & data) :
 	_saved(false),
 	_modified(true),
 	_linksModified(true),
+	_wordsCompacted(false),
+	_wordsCompactKpts(0),
+	_wordsCompact3(0),
+	_wordsFeaturesLoaded(true),
 	_enabled(false),
 	_invalidWordsCount(0),
 	_pose(Transform::getIdentity()),
@@ -222,14 +234,15 @@ void Signature::removeVirtualLinks()
 float Signature::compareTo(const Signature & s) const
 {
 	float similarity = 0.0f;
-	const std::multimap<int, int> & words = s.getWords();
 
 	if(!s.isBadSignature() && !this->isBadSignature())
 	{
+		const std::multimap<int, int> & words = s.getWords();
+		const std::multimap<int, int> & thisWords = this->getWords();
 		std::list<std::pair<int, std::pair<int, int> > > pairs;
-		int totalWords = ((int)_words.size()-_invalidWordsCount)>((int)words.size()-s.getInvalidWordsCount())?((int)_words.size()-_invalidWordsCount):((int)words.size()-s.getInvalidWordsCount());
+		int totalWords = ((int)thisWords.size()-_invalidWordsCount)>((int)words.size()-s.getInvalidWordsCount())?((int)thisWords.size()-_invalidWordsCount):((int)words.size()-s.getInvalidWordsCount());
 		UASSERT(totalWords > 0);
-		EpipolarGeometry::findPairs(words, _words, pairs);
+		EpipolarGeometry::findPairs(words, thisWords, pairs);
 
 		similarity = float(pairs.size()) / float(totalWords);
 	}
@@ -238,6 +251,10 @@ float Signature::compareTo(const Signature & s) const
 
 void Signature::changeWordsRef(int oldWordId, int activeWordId)
 {
+	if(_wordsCompacted)
+	{
+		expandWords();
+	}
 	std::list<int> words = uValues(_words, oldWordId);
 	if(words.size())
 	{
@@ -269,6 +286,17 @@ void Signature::setWords(const std::multimap<int, int> & words,
 	UASSERT_MSG(keypoints.empty() || keypoints.size() == words.size(),  uFormat("words=%d, descriptors=%d", (int)words.size(), (int)keypoints.size()).c_str());
 	UASSERT(words.empty() || !keypoints.empty() || !points.empty() || !descriptors.empty());
 
+	// arguments may refer to our expanded words, keep them alive until copied
+	std::shared_ptr<ExpandedWordsCache> expanded = _wordsExpanded;
+	setWordsWithoutFeatures(words);
+	_wordsKpts = keypoints;
+	_words3 = points;
+	_wordsDescriptors = descriptors.clone();
+	_wordsFeaturesLoaded = true;
+}
+
+void Signature::setWordsWithoutFeatures(const std::multimap<int, int> & words)
+{
 	_invalidWordsCount = 0;
 	for(std::multimap<int, int>::const_iterator iter=words.begin(); iter!=words.end(); ++iter)
 	{
@@ -282,14 +310,42 @@ void Signature::setWords(const std::multimap<int, int> & words,
 
 	_enabled = false;
 	_words = words;
+	_wordsKpts.clear();
+	_words3.clear();
+	_wordsDescriptors = cv::Mat();
+	_wordsCompacted = false;
+	_wordsCompact.clear();
+	_wordsCompactData.clear();
+	_wordsCompactKpts = 0;
+	_wordsCompact3 = 0;
+	_wordsExpanded.reset();
+	_wordsFeaturesLoaded = words.empty();
+}
+
+void Signature::setWordsFeatures(const std::vector<cv::KeyPoint> & keypoints,
+		const std::vector<cv::Point3f> & points,
+		const cv::Mat & descriptors)
+{
+	int wordsCount = getWordsCount();
+	UASSERT_MSG(descriptors.empty() || descriptors.rows == wordsCount, uFormat("words=%d, descriptors=%d", wordsCount, descriptors.rows).c_str());
+	UASSERT_MSG(points.empty() || (int)points.size() == wordsCount,  uFormat("words=%d, points=%d", wordsCount, (int)points.size()).c_str());
+	UASSERT_MSG(keypoints.empty() || (int)keypoints.size() == wordsCount,  uFormat("words=%d, keypoints=%d", wordsCount, (int)keypoints.size()).c_str());
+
+	// arguments may refer to our expanded words, keep them alive until copied
+	std::shared_ptr<ExpandedWordsCache> expanded = _wordsExpanded;
+	if(_wordsCompacted)
+	{
+		expandWords();
+	}
 	_wordsKpts = keypoints;
 	_words3 = points;
 	_wordsDescriptors = descriptors.clone();
+	_wordsFeaturesLoaded = true;
 }
 
 bool Signature::isBadSignature() const
 {
-	return _words.size()-_invalidWordsCount <= 0;
+	return getWordsCount()-_invalidWordsCount <= 0;
 }
 
 void Signature::removeAllWords()
@@ -299,13 +355,114 @@ void Signature::removeAllWords()
 	_words3.clear();
 	_wordsDescriptors = cv::Mat();
 	_invalidWordsCount = 0;
+	_wordsFeaturesLoaded = true;
+	_wordsCompacted = false;
+	_wordsCompact.clear();
+	_wordsCompactData.clear();
+	_wordsCompactKpts = 0;
+	_wordsCompact3 = 0;
+	_wordsExpanded.reset();
+}
+
+void Signature::compactWords()
+{
+	if(_wordsCompacted)
+	{
+		// release the expanded copy built by readers, if any
+		_wordsExpanded = std::make_shared<ExpandedWordsCache>();
+		return;
+	}
+	if(_words.empty())
+	{
+		return;
+	}
+	UASSERT(_wordsKpts.empty() || _wordsKpts.size() == _words.size());
+	UASSERT(_words3.empty() || _words3.size() == _words.size());
+
+	std::vector<std::pair<int, int> >(_words.begin(), _words.end()).swap(_wordsCompact);
+
+	_wordsCompactKpts = (int)_wordsKpts.size();
+	_wordsCompact3 = (int)_words3.size();
+	size_t kptsBytes = _wordsKpts.size()*sizeof(cv::KeyPoint);
+	size_t pointsBytes = _words3.size()*sizeof(cv::Point3f);
+	std::vector<unsigned char>(kptsBytes + pointsBytes).swap(_wordsCompactData);
+	if(kptsBytes)
+	{
+		memcpy(_wordsCompactData.data(), _wordsKpts.data(), kptsBytes);
+	}
+	if(pointsBytes)
+	{
+		memcpy(_wordsCompactData.data()+kptsBytes, _words3.data(), pointsBytes);
+	}
+
+	// swap to release the memory
+	std::multimap<int, int>().swap(_words);
+	std::vector<cv::KeyPoint>().swap(_wordsKpts);
+	std::vector<cv::Point3f>().swap(_words3);
+	_wordsExpanded = std::make_shared<ExpandedWordsCache>();
+	_wordsCompacted = true;
+}
+
+void Signature::expandWords()
+{
+	if(!_wordsCompacted)
+	{
+		return;
+	}
+
+	ExpandedWords expanded;
+	uncompactWords(expanded);
+	_words.swap(expanded.words);
+	_wordsKpts.swap(expanded.keypoints);
+	_words3.swap(expanded.words3);
+
+	std::vector<std::pair<int, int> >().swap(_wordsCompact);
+	std::vector<unsigned char>().swap(_wordsCompactData);
+	_wordsCompactKpts = 0;
+	_wordsCompact3 = 0;
+	_wordsExpanded.reset();
+	_wordsCompacted = false;
+}
+
+const Signature::ExpandedWords & Signature::expandedWords() const
+{
+	UASSERT(_wordsCompacted && _wordsExpanded.get());
+	// readers may be in different threads
+	UScopeMutex lock(_wordsExpanded->mutex);
+	if(_wordsExpanded->expanded.get() == 0)
+	{
+		ExpandedWords * expanded = new ExpandedWords();
+		uncompactWords(*expanded);
+		_wordsExpanded->expanded.reset(expanded);
+	}
+	return *_wordsExpanded->expanded;
+}
+
+void Signature::uncompactWords(ExpandedWords & expanded) const
+{
+	// already sorted, hint at the end to insert in constant time
+	for(size_t i=0; i<_wordsCompact.size(); ++i)
+	{
+		expanded.words.insert(expanded.words.end(), _wordsCompact[i]);
+	}
+	expanded.keypoints.resize(_wordsCompactKpts);
+	expanded.words3.resize(_wordsCompact3);
+	size_t kptsBytes = expanded.keypoints.size()*sizeof(cv::KeyPoint);
+	if(kptsBytes)
+	{
+		memcpy(expanded.keypoints.data(), _wordsCompactData.data(), kptsBytes);
+	}
+	if(!expanded.words3.empty())
+	{
+		memcpy(expanded.words3.data(), _wordsCompactData.data()+kptsBytes, expanded.words3.size()*sizeof(cv::Point3f));
+	}
 }
 
 void Signature::setWordsDescriptors(const cv::Mat & descriptors)
 {
 	if(descriptors.empty())
 	{
-		if(_wordsKpts.empty() && _words3.empty())
+		if(_wordsCompacted?_wordsCompactKpts==0 && _wordsCompact3==0:_wordsKpts.empty() && _words3.empty())
 		{
 			removeAllWords();
 		}
@@ -316,7 +473,7 @@ void Signature::setWordsDescriptors(const cv::Mat & descriptors)
 	}
 	else
 	{
-		UASSERT(descriptors.rows == (int)_words.size());
+		UASSERT(descriptors.rows == getWordsCount());
 		_wordsDescriptors = descriptors.clone();
 	}
 }
@@ -348,6 +505,18 @@ unsigned long Signature::getMemoryUsed(bool withSensorData) const // Return memo
 	total += _words.size() * (sizeof(int)*2+sizeof(std::multimap<int, cv::KeyPoint>::iterator)) + sizeof(std::multimap<int, cv::KeyPoint>);
 	total += _wordsKpts.size() * sizeof(cv::KeyPoint) + sizeof(std::vector<cv::KeyPoint>);
 	total += _words3.size() * sizeof(cv::Point3f) + sizeof(std::vector<cv::Point3f>);
+	total += _wordsCompact.size() * sizeof(std::pair<int, int>) + sizeof(std::vector<std::pair<int, int> >);
+	total += _wordsCompactData.size() + sizeof(std::vector<unsigned char>);
+	if(_wordsExpanded.get())
+	{
+		UScopeMutex lock(_wordsExpanded->mutex);
+		if(_wordsExpanded->expanded.get())
+		{
+			total += _wordsExpanded->expanded->words.size() * (sizeof(int)*2+sizeof(std::multimap<int, cv::KeyPoint>::iterator));
+			total += _wordsExpanded->expanded->keypoints.size() * sizeof(cv::KeyPoint);
+			total += _wordsExpanded->expanded->words3.size() * sizeof(cv::Point3f);
+		}
+	}
 	total += _wordsDescriptors.total() * _wordsDescriptors.elemSize() + sizeof(cv::Mat);
 	total += _wordsChanged.size() * (sizeof(int)*2+sizeof(std::map<int, int>::iterator)) + sizeof(std::map<int, int>);
 	if(withSensorData)
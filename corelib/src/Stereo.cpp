@@ -53,7 +53,8 @@ Stereo::Stereo(const ParametersMap & parameters) :
 		maxLevel_(Parameters::defaultStereoMaxLevel()),
 		minDisparity_(Parameters::defaultStereoMinDisparity()),
 		maxDisparity_(Parameters::defaultStereoMaxDisparity()),
-		winSSD_(Parameters::defaultStereoSSD())
+		winSSD_(Parameters::defaultStereoSSD()),
+		fullRange_(Parameters::defaultStereoFullRange())
 {
 	this->parseParameters(parameters);
 }
@@ -67,6 +68,7 @@ void Stereo::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kStereoMinDisparity(), minDisparity_);
 	Parameters::parse(parameters, Parameters::kStereoMaxDisparity(), maxDisparity_);
 	Parameters::parse(parameters, Parameters::kStereoSSD(), winSSD_);
+	Parameters::parse(parameters, Parameters::kStereoFullRange(), fullRange_);
 }
 
 std::vector<cv::Point2f> Stereo::computeCorrespondences(
@@ -76,6 +78,21 @@ std::vector<cv::Point2f> Stereo::computeCorrespondences(
 		std::vector<unsigned char> & status) const
 {
 	std::vector<cv::Point2f> rightCorners;
+	if(fullRange_)
+	{
+		UDEBUG("util2d::calcStereoCorrespondencesFullRange() begin");
+		rightCorners = util2d::calcStereoCorrespondencesFullRange(
+						leftImage,
+						rightImage,
+						leftCorners,
+						status,
+						cv::Size(winWidth_, winHeight_),
+						minDisparity_,
+						maxDisparity_,
+						winSSD_);
+		UDEBUG("util2d::calcStereoCorrespondencesFullRange() end");
+		return rightCorners;
+	}
 	UDEBUG("util2d::calcStereoCorrespondences() begin");
 	rightCorners = util2d::calcStereoCorrespondences(
 					leftImage,
@@ -92,6 +109,48 @@ std::vector<cv::Point2f> Stereo::computeCorrespondences(
 	return rightCorners;
 }
 
+std::vector<cv::Point2f> Stereo::computeCorrespondences(
+		const SensorData & data,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status) const
+{
+	const std::vector<cv::Mat> & leftPyramid = data.imagePyramid(false, cv::Size(winWidth_, winHeight_), maxLevel_, false);
+	const std::vector<cv::Mat> & rightPyramid = data.imagePyramid(true, cv::Size(winWidth_, winHeight_), maxLevel_, false);
+	UASSERT(!leftPyramid.empty() && !rightPyramid.empty());
+
+	std::vector<cv::Point2f> rightCorners;
+	if(fullRange_)
+	{
+		// only the first level of the pyramids (the gray images) is used
+		UDEBUG("util2d::calcStereoCorrespondencesFullRange() begin");
+		rightCorners = util2d::calcStereoCorrespondencesFullRange(
+						leftPyramid[0],
+						rightPyramid[0],
+						leftCorners,
+						status,
+						cv::Size(winWidth_, winHeight_),
+						minDisparity_,
+						maxDisparity_,
+						winSSD_);
+		UDEBUG("util2d::calcStereoCorrespondencesFullRange() end");
+		return rightCorners;
+	}
+	UDEBUG("util2d::calcStereoCorrespondences() begin");
+	rightCorners = util2d::calcStereoCorrespondences(
+					leftPyramid,
+					rightPyramid,
+					leftCorners,
+					status,
+					cv::Size(winWidth_, winHeight_),
+					maxLevel_,
+					iterations_,
+					minDisparity_,
+					maxDisparity_,
+					winSSD_);
+	UDEBUG("util2d::calcStereoCorrespondences() end");
+	return rightCorners;
+}
+
 StereoOpticalFlow::StereoOpticalFlow(const ParametersMap & parameters) :
 		Stereo(parameters),
 		epsilon_(Parameters::defaultStereoEps())
@@ -111,13 +170,34 @@ std::vector<cv::Point2f> StereoOpticalFlow::computeCorrespondences(
 		const cv::Mat & rightImage,
 		const std::vector<cv::Point2f> & leftCorners,
 		std::vector<unsigned char> & status) const
+{
+	return computeCorrespondencesImpl(leftImage, rightImage, leftCorners, status);
+}
+
+std::vector<cv::Point2f> StereoOpticalFlow::computeCorrespondences(
+		const SensorData & data,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status) const
+{
+	// the left pyramid should include derivatives (see util2d::calcOpticalFlowPyrLKStereo())
+	const std::vector<cv::Mat> & leftPyramid = data.imagePyramid(false, this->winSize(), this->maxLevel(), true);
+	const std::vector<cv::Mat> & rightPyramid = data.imagePyramid(true, this->winSize(), this->maxLevel(), false);
+	UASSERT(!leftPyramid.empty() && !rightPyramid.empty());
+	return computeCorrespondencesImpl(leftPyramid, rightPyramid, leftCorners, status);
+}
+
+std::vector<cv::Point2f> StereoOpticalFlow::computeCorrespondencesImpl(
+		cv::InputArray left,
+		cv::InputArray right,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status) const
 {
 	std::vector<cv::Point2f> rightCorners;
 	UDEBUG("util2d::calcOpticalFlowPyrLKStereo() begin");
 	std::vector<float> err;
 	util2d::calcOpticalFlowPyrLKStereo(
-			leftImage,
-			rightImage,
+			left,
+			right,
 			leftCorners,
 			rightCorners,
 			status,
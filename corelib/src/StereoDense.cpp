@@ -27,6 +27,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rtabmap/core/stereo/StereoBM.h>
 #include <rtabmap/core/stereo/StereoSGBM.h>
+#include <rtabmap/core/util2d.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UMath.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <climits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace rtabmap {
 
@@ -54,4 +62,194 @@ StereoDense * StereoDense::create(StereoDense::Type type, const ParametersMap &
 	return stereo;
 }
 
+StereoDense::StereoDense(const ParametersMap & parameters) :
+		strips_(Parameters::defaultStereoDenseStrips()),
+		roiRatios_(Parameters::defaultStereoDenseRoiRatios()),
+		downscale_(Parameters::defaultStereoDenseDownscale())
+{
+	StereoDense::parseParameters(parameters);
+}
+
+void StereoDense::parseParameters(const ParametersMap & parameters)
+{
+	Parameters::parse(parameters, Parameters::kStereoDenseStrips(), strips_);
+	Parameters::parse(parameters, Parameters::kStereoDenseRoiRatios(), roiRatios_);
+	Parameters::parse(parameters, Parameters::kStereoDenseDownscale(), downscale_);
+	UASSERT(strips_ >= 0);
+	UASSERT(downscale_ >= 0 && downscale_ <= 2);
+}
+
+cv::Mat StereoDense::computeDisparityImpl(
+		const cv::Mat &,
+		const cv::Mat &,
+		int,
+		int) const
+{
+	UERROR("Disparity by strips is not implemented by this approach!");
+	return cv::Mat();
+}
+
+cv::Mat StereoDense::computeDisparityByStrips(
+		const cv::Mat & leftMono,
+		const cv::Mat & rightMono,
+		int minDisparity,
+		int numDisparities,
+		int blockSize) const
+{
+	UASSERT(leftMono.type() == CV_8UC1 && rightMono.type() == CV_8UC1);
+	UASSERT(leftMono.cols == rightMono.cols && leftMono.rows == rightMono.rows);
+
+	cv::Rect fullRoi(0, 0, leftMono.cols, leftMono.rows);
+	cv::Rect roi = util2d::computeRoi(leftMono, roiRatios_);
+	if(roi.width <= 0 || roi.height <= 0)
+	{
+		roi = fullRoi;
+	}
+
+	if(roi == fullRoi && strips_ == 1 && downscale_ == 0)
+	{
+		return computeDisparityImpl(leftMono, rightMono, minDisparity, numDisparities);
+	}
+
+	cv::Mat coarseDisparity;
+	if(downscale_ > 0)
+	{
+		cv::Mat leftHalf, rightHalf;
+		cv::resize(leftMono, leftHalf, cv::Size(leftMono.cols/2, leftMono.rows/2), 0, 0, cv::INTER_AREA);
+		cv::resize(rightMono, rightHalf, cv::Size(rightMono.cols/2, rightMono.rows/2), 0, 0, cv::INTER_AREA);
+		cv::Rect roiHalf(roi.x/2, roi.y/2, roi.width/2, roi.height/2);
+		int minDisparityHalf = minDisparity/2;
+		int numDisparitiesHalf = uMax(16, ((numDisparities/2 + 15)/16)*16); // multiple of 16
+		coarseDisparity = computeStrips(leftHalf, rightHalf, roiHalf, minDisparityHalf, numDisparitiesHalf, blockSize, cv::Mat());
+
+		if(downscale_ == 1)
+		{
+			// Upsample size and values of the disparity
+			short invalid = (short)((minDisparity-1)*16);
+			short minValid = (short)(minDisparityHalf*16);
+			cv::Mat disparity(leftMono.size(), CV_16SC1, cv::Scalar(invalid));
+			for(int y=roi.y; y<roi.y+roi.height; ++y)
+			{
+				const short * src = coarseDisparity.ptr<short>(uMin(y/2, coarseDisparity.rows-1));
+				short * dst = disparity.ptr<short>(y);
+				for(int x=roi.x; x<roi.x+roi.width; ++x)
+				{
+					short v = src[uMin(x/2, coarseDisparity.cols-1)];
+					dst[x] = v < minValid?invalid:v*2;
+				}
+			}
+			return disparity;
+		}
+	}
+
+	return computeStrips(leftMono, rightMono, roi, minDisparity, numDisparities, blockSize, coarseDisparity);
+}
+
+cv::Mat StereoDense::computeStrips(
+		const cv::Mat & leftMono,
+		const cv::Mat & rightMono,
+		const cv::Rect & roi,
+		int minDisparity,
+		int numDisparities,
+		int blockSize,
+		const cv::Mat & coarseDisparity) const
+{
+	short invalid = (short)((minDisparity-1)*16);
+	cv::Mat disparity(leftMono.size(), CV_16SC1, cv::Scalar(invalid));
+
+	int strips = strips_;
+	if(strips == 0)
+	{
+#ifdef _OPENMP
+		strips = omp_get_max_threads();
+#else
+		strips = 1;
+#endif
+	}
+	// Strips should not be smaller than the matching window
+	strips = uMax(1, uMin(strips, roi.height / uMax(1, 2*blockSize)));
+	int stripHeight = (roi.height + strips - 1) / strips;
+	// Rows added on each side of a strip so that the disparity near its borders
+	// is computed like on the full image
+	int overlap = blockSize + 8;
+
+	UDEBUG("roi=%d,%d,%d,%d strips=%d coarse=%d", roi.x, roi.y, roi.width, roi.height, strips, coarseDisparity.empty()?0:1);
+
+#pragma omp parallel for schedule(dynamic)
+	for(int i=0; i<strips; ++i)
+	{
+		int y0 = roi.y + i*stripHeight;
+		int y1 = uMin(roi.y+roi.height, y0+stripHeight);
+		if(y1 <= y0)
+		{
+			continue;
+		}
+
+		int stripMinDisparity = minDisparity;
+		int stripNumDisparities = numDisparities;
+		if(!coarseDisparity.empty())
+		{
+			// Limit the disparity range to the one found at half resolution
+			short coarseMinValid = (short)((minDisparity/2)*16);
+			short minV = SHRT_MAX;
+			short maxV = SHRT_MIN;
+			for(int y=y0/2; y<uMin((y1+1)/2, coarseDisparity.rows); ++y)
+			{
+				const short * row = coarseDisparity.ptr<short>(y);
+				for(int x=roi.x/2; x<uMin((roi.x+roi.width+1)/2, coarseDisparity.cols); ++x)
+				{
+					if(row[x] >= coarseMinValid)
+					{
+						minV = uMin(minV, row[x]);
+						maxV = uMax(maxV, row[x]);
+					}
+				}
+			}
+			if(maxV >= minV)
+			{
+				const int margin = 4; // pixels
+				int lo = uMax(minDisparity, int(floor(float(minV)*2.0f/16.0f)) - margin);
+				int hi = uMin(minDisparity+numDisparities-1, int(ceil(float(maxV)*2.0f/16.0f)) + margin);
+				if(hi > lo)
+				{
+					stripMinDisparity = lo;
+					stripNumDisparities = uMin(numDisparities, ((hi-lo+1 + 15)/16)*16);
+				}
+			}
+		}
+
+		// Right image should include the columns matching the left border of the ROI
+		int ex0 = uMax(0, roi.x - (stripMinDisparity + stripNumDisparities));
+		int ey0 = uMax(0, y0-overlap);
+		int ey1 = uMin(leftMono.rows, y1+overlap);
+		cv::Rect stripRoi(ex0, ey0, roi.x+roi.width-ex0, ey1-ey0);
+		if(stripRoi.width <= stripNumDisparities + blockSize)
+		{
+			UWARN("Strip %d (%dx%d) is too small for %d disparities, ignoring it.", i, stripRoi.width, stripRoi.height, stripNumDisparities);
+			continue;
+		}
+
+		cv::Mat stripDisparity = computeDisparityImpl(leftMono(stripRoi), rightMono(stripRoi), stripMinDisparity, stripNumDisparities);
+		if(stripDisparity.empty())
+		{
+			continue;
+		}
+		UASSERT(stripDisparity.type() == CV_16SC1 && stripDisparity.size() == stripRoi.size());
+
+		short stripMinValid = (short)(stripMinDisparity*16);
+		for(int y=y0; y<y1; ++y)
+		{
+			const short * src = stripDisparity.ptr<short>(y-ey0);
+			short * dst = disparity.ptr<short>(y);
+			for(int x=roi.x; x<roi.x+roi.width; ++x)
+			{
+				short v = src[x-ex0];
+				dst[x] = v < stripMinValid?invalid:v;
+			}
+		}
+	}
+
+	return disparity;
+}
+
 } /* namespace rtabmap */
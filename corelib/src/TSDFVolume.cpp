@@ -0,0 +1,641 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap/core/TSDFVolume.h"
+#include "rtabmap/core/util2d.h"
+#include "rtabmap/utilite/ULogger.h"
+#include "rtabmap/utilite/UMath.h"
+#include "rtabmap/utilite/UTimer.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <pcl/surface/marching_cubes.h> // edgeTable and triTable
+#include <pcl/conversions.h>
+#include <pcl/point_types.h>
+#include <unordered_set>
+#include <algorithm>
+
+namespace rtabmap {
+
+#define TSDF_BLOCK_SIZE 8
+#define TSDF_BLOCK_VOXELS (TSDF_BLOCK_SIZE*TSDF_BLOCK_SIZE*TSDF_BLOCK_SIZE)
+#define TSDF_MAX_WEIGHT 128.0f
+
+struct TSDFVoxel
+{
+	float tsdf;
+	float weight;
+	unsigned char rgb[4];
+};
+
+struct TSDFVolume::Block
+{
+	Block(int x, int y, int z) :
+		x(x), y(y), z(z),
+		voxels(new TSDFVoxel[TSDF_BLOCK_VOXELS]),
+		updated(false),
+		meshDirty(false)
+	{
+		for(int i=0; i<TSDF_BLOCK_VOXELS; ++i)
+		{
+			voxels[i].tsdf = 1.0f;
+			voxels[i].weight = 0.0f;
+			voxels[i].rgb[0] = voxels[i].rgb[1] = voxels[i].rgb[2] = voxels[i].rgb[3] = 0;
+		}
+	}
+	~Block()
+	{
+		delete [] voxels;
+	}
+	void release()
+	{
+		delete [] voxels;
+		voxels = 0;
+	}
+	int x,y,z;
+	TSDFVoxel * voxels; // null when released
+	bool updated;
+	bool meshDirty;
+
+	// mesh cache
+	std::vector<pcl::PointXYZRGB> vertices;
+	std::vector<unsigned long long> verticesKey;
+	std::vector<int> triangles; // indices in vertices
+};
+
+namespace {
+
+// floor division (works with negative values)
+inline int floorDiv(int a, int b)
+{
+	return a>=0?a/b:(a-b+1)/b;
+}
+
+inline unsigned long long blockKey(int x, int y, int z)
+{
+	// 21 bits per axis
+	return ((unsigned long long)((x + (1<<20)) & 0x1FFFFF) << 42) |
+		   ((unsigned long long)((y + (1<<20)) & 0x1FFFFF) << 21) |
+		   ((unsigned long long)((z + (1<<20)) & 0x1FFFFF));
+}
+
+inline unsigned long long edgeKey(int x, int y, int z, int axis)
+{
+	// 20 bits per axis + 2 bits for the edge axis
+	return ((unsigned long long)((x + (1<<19)) & 0xFFFFF) << 42) |
+		   ((unsigned long long)((y + (1<<19)) & 0xFFFFF) << 22) |
+		   ((unsigned long long)((z + (1<<19)) & 0xFFFFF) << 2) |
+		   (unsigned long long)axis;
+}
+
+// Corner offsets and edges in the same order than pcl::MarchingCubes
+const int cornerOffsets[8][3] = {{0,0,0}, {1,0,0}, {1,0,1}, {0,0,1}, {0,1,0}, {1,1,0}, {1,1,1}, {0,1,1}};
+// edges are always interpolated from their corner with the lowest coordinates
+const int edgeLower[12] = {0,1,3,0,4,5,7,4,0,1,2,3};
+const int edgeUpper[12] = {1,2,2,3,5,6,6,7,4,5,6,7};
+const int edgeAxis[12] =  {0,2,0,2,0,2,0,2,1,1,1,1};
+
+}
+
+TSDFVolume::TSDFVolume(float voxelSize, float truncationDistance, float maxDepth, int maxBlocks) :
+		voxelSize_(voxelSize),
+		truncationDistance_(truncationDistance>0.0f?truncationDistance:voxelSize*4.0f),
+		maxDepth_(maxDepth),
+		maxBlocks_(maxBlocks),
+		liveBlocks_(0)
+{
+	UASSERT(voxelSize_ > 0.0f);
+	UASSERT(maxDepth_ >= 0.0f);
+	UASSERT(maxBlocks_ >= 0);
+}
+
+TSDFVolume::~TSDFVolume()
+{
+	clear();
+}
+
+void TSDFVolume::clear()
+{
+	for(std::unordered_map<unsigned long long, Block*>::iterator iter=blocks_.begin(); iter!=blocks_.end(); ++iter)
+	{
+		delete iter->second;
+	}
+	blocks_.clear();
+	liveBlocks_ = 0;
+}
+
+bool TSDFVolume::integrate(const SensorData & data, const Transform & pose)
+{
+	UASSERT(!pose.isNull());
+	cv::Mat depth = data.depthRaw();
+	const cv::Mat & rgb = data.imageRaw();
+	std::vector<CameraModel> models = data.cameraModels();
+	if(depth.empty() && !data.rightRaw().empty() && !rgb.empty() && data.stereoCameraModel().isValidForProjection())
+	{
+		cv::Mat leftMono;
+		if(rgb.channels() == 3)
+		{
+			cv::cvtColor(rgb, leftMono, cv::COLOR_BGR2GRAY);
+		}
+		else
+		{
+			leftMono = rgb;
+		}
+		depth = util2d::depthFromDisparity(
+				util2d::disparityFromStereoImages(leftMono, data.rightRaw()),
+				data.stereoCameraModel().left().fx(),
+				data.stereoCameraModel().baseline());
+		models.clear();
+		models.push_back(data.stereoCameraModel().left());
+	}
+	if(depth.empty() || models.empty())
+	{
+		UWARN("Sensor data %d doesn't have raw depth or stereo images with calibration, it cannot be integrated (did you uncompress the data?).", data.id());
+		return false;
+	}
+
+	// multi-cameras: images are side by side
+	int depthWidth = depth.cols/(int)models.size();
+	int rgbWidth = rgb.cols/(int)models.size();
+	bool integrated = false;
+	for(size_t i=0; i<models.size(); ++i)
+	{
+		cv::Mat subDepth = depth(cv::Rect(depthWidth*int(i), 0, depthWidth, depth.rows));
+		cv::Mat subRgb = rgb.empty()?cv::Mat():rgb(cv::Rect(rgbWidth*int(i), 0, rgbWidth, rgb.rows));
+		integrated = integrate(subDepth, subRgb, models[i], pose) || integrated;
+	}
+	return integrated;
+}
+
+bool TSDFVolume::integrate(const cv::Mat & depth, const cv::Mat & rgb, const CameraModel & modelIn, const Transform & pose)
+{
+	UASSERT(!depth.empty() && (depth.type() == CV_16UC1 || depth.type() == CV_32FC1));
+	UASSERT(rgb.empty() || rgb.type() == CV_8UC3 || rgb.type() == CV_8UC1);
+	UASSERT(!pose.isNull());
+	if(!modelIn.isValidForProjection())
+	{
+		UWARN("Camera model is not valid for projection, the depth image cannot be integrated.");
+		return false;
+	}
+
+	UTimer timer;
+	CameraModel model = modelIn;
+	if(model.imageWidth() > 0 && model.imageWidth() != depth.cols)
+	{
+		model = model.scaled(double(depth.cols)/double(model.imageWidth()));
+	}
+	Transform cameraPose = pose * model.localTransform();
+	Eigen::Affine3f cameraToWorld = cameraPose.toEigen3f();
+
+	//============================================================
+	// Allocate blocks near observed surfaces
+	//============================================================
+	float blockWidth = voxelSize_*TSDF_BLOCK_SIZE;
+	float fx = model.fx();
+	float fy = model.fy();
+	float cx = model.cx();
+	float cy = model.cy();
+	// A block projects on at least "step*2" pixels up to max depth
+	int step = std::max(1, int(blockWidth * fx / (2.0f*(maxDepth_>0.0f?maxDepth_:10.0f))));
+	float stepZ = std::min(truncationDistance_, blockWidth/2.0f);
+	std::unordered_set<unsigned long long> keys;
+	for(int v=0; v<depth.rows; v+=step)
+	{
+		for(int u=0; u<depth.cols; u+=step)
+		{
+			float d = depth.type() == CV_16UC1?float(depth.at<unsigned short>(v,u))*0.001f:depth.at<float>(v,u);
+			if(!(d > 0.0f && uIsFinite(d)) || (maxDepth_>0.0f && d > maxDepth_))
+			{
+				continue;
+			}
+			Eigen::Vector3f ray((float(u)-cx)/fx, (float(v)-cy)/fy, 1.0f);
+			for(float z=d-truncationDistance_; z<=d+truncationDistance_+stepZ/2.0f; z+=stepZ)
+			{
+				if(z <= 0.0f)
+				{
+					continue;
+				}
+				Eigen::Vector3f p = cameraToWorld * (ray*z);
+				int gx = (int)std::floor(p[0]/voxelSize_+0.5f);
+				int gy = (int)std::floor(p[1]/voxelSize_+0.5f);
+				int gz = (int)std::floor(p[2]/voxelSize_+0.5f);
+				keys.insert(blockKey(floorDiv(gx, TSDF_BLOCK_SIZE), floorDiv(gy, TSDF_BLOCK_SIZE), floorDiv(gz, TSDF_BLOCK_SIZE)));
+			}
+		}
+	}
+
+	std::vector<Block*> visibleBlocks;
+	visibleBlocks.reserve(keys.size());
+	for(std::unordered_set<unsigned long long>::iterator iter=keys.begin(); iter!=keys.end(); ++iter)
+	{
+		std::unordered_map<unsigned long long, Block*>::iterator jter = blocks_.find(*iter);
+		if(jter == blocks_.end())
+		{
+			int x = int((*iter >> 42) & 0x1FFFFF) - (1<<20);
+			int y = int((*iter >> 21) & 0x1FFFFF) - (1<<20);
+			int z = int(*iter & 0x1FFFFF) - (1<<20);
+			jter = blocks_.insert(std::make_pair(*iter, new Block(x, y, z))).first;
+			++liveBlocks_;
+		}
+		if(jter->second->voxels)
+		{
+			visibleBlocks.push_back(jter->second);
+		}
+	}
+	double allocationTime = timer.ticks();
+
+	//============================================================
+	// Integrate (blocks are independent)
+	//============================================================
+	Transform worldToCamera = cameraPose.inverse();
+	#pragma omp parallel for schedule(dynamic, 16)
+	for(int i=0; i<(int)visibleBlocks.size(); ++i)
+	{
+		integrateBlock(visibleBlocks[i], depth, rgb, model, worldToCamera);
+	}
+
+	// Marching cubes of a block uses voxels of its upper neighbors
+	for(size_t i=0; i<visibleBlocks.size(); ++i)
+	{
+		Block * block = visibleBlocks[i];
+		if(block->updated)
+		{
+			block->updated = false;
+			block->meshDirty = true;
+			for(int n=1; n<8; ++n)
+			{
+				std::unordered_map<unsigned long long, Block*>::iterator jter = blocks_.find(blockKey(block->x-(n&1), block->y-((n>>1)&1), block->z-((n>>2)&1)));
+				if(jter != blocks_.end() && jter->second->voxels)
+				{
+					jter->second->meshDirty = true;
+				}
+			}
+		}
+	}
+
+	if(maxBlocks_ > 0 && liveBlocks_ > maxBlocks_)
+	{
+		releaseFarthestBlocks(cameraPose);
+	}
+
+	UDEBUG("Integrated %d blocks (allocation=%fs, integration=%fs, blocks=%d, live=%d)",
+			(int)visibleBlocks.size(), allocationTime, timer.ticks(), (int)blocks_.size(), liveBlocks_);
+	return true;
+}
+
+void TSDFVolume::integrateBlock(Block * block, const cv::Mat & depth, const cv::Mat & rgb, const CameraModel & model, const Transform & worldToCamera) const
+{
+	float fx = model.fx();
+	float fy = model.fy();
+	float cx = model.cx();
+	float cy = model.cy();
+	float rgbScale = rgb.empty()?0.0f:float(rgb.cols)/float(depth.cols);
+	Eigen::Affine3f t = worldToCamera.toEigen3f();
+	int index = 0;
+	for(int k=0; k<TSDF_BLOCK_SIZE; ++k)
+	{
+		for(int j=0; j<TSDF_BLOCK_SIZE; ++j)
+		{
+			for(int i=0; i<TSDF_BLOCK_SIZE; ++i, ++index)
+			{
+				Eigen::Vector3f p = t * Eigen::Vector3f(
+						float(block->x*TSDF_BLOCK_SIZE+i)*voxelSize_,
+						float(block->y*TSDF_BLOCK_SIZE+j)*voxelSize_,
+						float(block->z*TSDF_BLOCK_SIZE+k)*voxelSize_);
+				if(p[2] <= 0.0f)
+				{
+					continue;
+				}
+				int u = int(fx*p[0]/p[2] + cx + 0.5f);
+				int v = int(fy*p[1]/p[2] + cy + 0.5f);
+				if(u < 0 || u >= depth.cols || v < 0 || v >= depth.rows)
+				{
+					continue;
+				}
+				float d = depth.type() == CV_16UC1?float(depth.at<unsigned short>(v,u))*0.001f:depth.at<float>(v,u);
+				if(!(d > 0.0f && uIsFinite(d)) || (maxDepth_>0.0f && d > maxDepth_))
+				{
+					continue;
+				}
+				float sdf = d - p[2];
+				if(sdf < -truncationDistance_)
+				{
+					continue;
+				}
+				float tsdf = std::min(1.0f, sdf/truncationDistance_);
+				TSDFVoxel & voxel = block->voxels[index];
+				float w = voxel.weight;
+				voxel.tsdf = (voxel.tsdf*w + tsdf)/(w+1.0f);
+				voxel.weight = std::min(w+1.0f, TSDF_MAX_WEIGHT);
+				if(rgbScale > 0.0f && sdf < truncationDistance_)
+				{
+					int ur = std::min(int(float(u)*rgbScale), rgb.cols-1);
+					int vr = std::min(int(float(v)*rgbScale), rgb.rows-1);
+					const unsigned char * c = rgb.ptr<unsigned char>(vr, ur);
+					for(int n=0; n<3; ++n)
+					{
+						voxel.rgb[n] = (unsigned char)((float(voxel.rgb[n])*w + float(rgb.channels()==3?c[2-n]:c[0]))/(w+1.0f));
+					}
+				}
+				block->updated = true;
+			}
+		}
+	}
+}
+
+void TSDFVolume::extractBlock(Block * block) const
+{
+	block->vertices.clear();
+	block->verticesKey.clear();
+	block->triangles.clear();
+	block->meshDirty = false;
+	if(block->voxels == 0)
+	{
+		return;
+	}
+
+	// neighbors: index = dx | dy<<1 | dz<<2
+	const TSDFVoxel * neighbors[8];
+	neighbors[0] = block->voxels;
+	for(int n=1; n<8; ++n)
+	{
+		std::unordered_map<unsigned long long, Block*>::const_iterator iter = blocks_.find(blockKey(block->x+(n&1), block->y+((n>>1)&1), block->z+((n>>2)&1)));
+		neighbors[n] = iter!=blocks_.end()?iter->second->voxels:0;
+	}
+
+	std::unordered_map<unsigned long long, int> localIndices;
+	const TSDFVoxel * corners[8];
+	for(int k=0; k<TSDF_BLOCK_SIZE; ++k)
+	{
+		for(int j=0; j<TSDF_BLOCK_SIZE; ++j)
+		{
+			for(int i=0; i<TSDF_BLOCK_SIZE; ++i)
+			{
+				bool valid = true;
+				int cubeIndex = 0;
+				for(int c=0; c<8 && valid; ++c)
+				{
+					int ci = i+cornerOffsets[c][0];
+					int cj = j+cornerOffsets[c][1];
+					int ck = k+cornerOffsets[c][2];
+					const TSDFVoxel * voxels = neighbors[(ci>=TSDF_BLOCK_SIZE?1:0) | (cj>=TSDF_BLOCK_SIZE?2:0) | (ck>=TSDF_BLOCK_SIZE?4:0)];
+					if(voxels == 0)
+					{
+						valid = false;
+						break;
+					}
+					corners[c] = &voxels[(ck%TSDF_BLOCK_SIZE)*TSDF_BLOCK_SIZE*TSDF_BLOCK_SIZE + (cj%TSDF_BLOCK_SIZE)*TSDF_BLOCK_SIZE + ci%TSDF_BLOCK_SIZE];
+					valid = corners[c]->weight > 0.0f;
+					if(corners[c]->tsdf < 0.0f)
+					{
+						cubeIndex |= 1<<c;
+					}
+				}
+				if(!valid || pcl::edgeTable[cubeIndex] == 0)
+				{
+					continue;
+				}
+
+				int gx = block->x*TSDF_BLOCK_SIZE+i;
+				int gy = block->y*TSDF_BLOCK_SIZE+j;
+				int gz = block->z*TSDF_BLOCK_SIZE+k;
+				int edgeVertices[12];
+				for(int e=0; e<12; ++e)
+				{
+					if((pcl::edgeTable[cubeIndex] & (1<<e)) == 0)
+					{
+						continue;
+					}
+					const int * lower = cornerOffsets[edgeLower[e]];
+					unsigned long long key = edgeKey(gx+lower[0], gy+lower[1], gz+lower[2], edgeAxis[e]);
+					std::unordered_map<unsigned long long, int>::iterator iter = localIndices.find(key);
+					if(iter != localIndices.end())
+					{
+						edgeVertices[e] = iter->second;
+						continue;
+					}
+					const TSDFVoxel & a = *corners[edgeLower[e]];
+					const TSDFVoxel & b = *corners[edgeUpper[e]];
+					float t = fabs(a.tsdf-b.tsdf) > 1e-6f?a.tsdf/(a.tsdf-b.tsdf):0.5f;
+					pcl::PointXYZRGB pt;
+					pt.x = float(gx+lower[0])*voxelSize_;
+					pt.y = float(gy+lower[1])*voxelSize_;
+					pt.z = float(gz+lower[2])*voxelSize_;
+					pt.data[edgeAxis[e]] += t*voxelSize_;
+					pt.r = (unsigned char)(float(a.rgb[0])*(1.0f-t) + float(b.rgb[0])*t);
+					pt.g = (unsigned char)(float(a.rgb[1])*(1.0f-t) + float(b.rgb[1])*t);
+					pt.b = (unsigned char)(float(a.rgb[2])*(1.0f-t) + float(b.rgb[2])*t);
+					edgeVertices[e] = (int)block->vertices.size();
+					localIndices.insert(std::make_pair(key, edgeVertices[e]));
+					block->vertices.push_back(pt);
+					block->verticesKey.push_back(key);
+				}
+
+				// TSDF gradient in the cell (toward free space), used to orient the triangles
+				Eigen::Vector3f gradient(0,0,0);
+				for(int c=0; c<8; ++c)
+				{
+					for(int n=0; n<3; ++n)
+					{
+						gradient[n] += cornerOffsets[c][n]?corners[c]->tsdf:-corners[c]->tsdf;
+					}
+				}
+
+				for(int n=0; pcl::triTable[cubeIndex][n] != -1; n+=3)
+				{
+					int a = edgeVertices[pcl::triTable[cubeIndex][n]];
+					int b = edgeVertices[pcl::triTable[cubeIndex][n+1]];
+					int c = edgeVertices[pcl::triTable[cubeIndex][n+2]];
+					if(a == b || b == c || a == c)
+					{
+						continue;
+					}
+					Eigen::Vector3f pa = block->vertices[a].getVector3fMap();
+					Eigen::Vector3f normal = (block->vertices[b].getVector3fMap()-pa).cross(block->vertices[c].getVector3fMap()-pa);
+					if(normal.dot(gradient) < 0.0f)
+					{
+						std::swap(b, c);
+					}
+					block->triangles.push_back(a);
+					block->triangles.push_back(b);
+					block->triangles.push_back(c);
+				}
+			}
+		}
+	}
+}
+
+void TSDFVolume::releaseFarthestBlocks(const Transform & cameraPose)
+{
+	UTimer timer;
+	std::vector<std::pair<float, Block*> > liveBlocks;
+	liveBlocks.reserve(liveBlocks_);
+	float blockWidth = voxelSize_*TSDF_BLOCK_SIZE;
+	for(std::unordered_map<unsigned long long, Block*>::iterator iter=blocks_.begin(); iter!=blocks_.end(); ++iter)
+	{
+		if(iter->second->voxels)
+		{
+			float dx = (float(iter->second->x)+0.5f)*blockWidth - cameraPose.x();
+			float dy = (float(iter->second->y)+0.5f)*blockWidth - cameraPose.y();
+			float dz = (float(iter->second->z)+0.5f)*blockWidth - cameraPose.z();
+			liveBlocks.push_back(std::make_pair(-(dx*dx+dy*dy+dz*dz), iter->second));
+		}
+	}
+
+	// Release down to 90% of the limit, so that it is not done on every integration
+	int toRelease = (int)liveBlocks.size() - maxBlocks_*9/10;
+	if(toRelease <= 0)
+	{
+		return;
+	}
+	std::nth_element(liveBlocks.begin(), liveBlocks.begin()+toRelease, liveBlocks.end());
+	liveBlocks.resize(toRelease);
+
+	// Mesh released blocks and their lower neighbors (which need their voxels) before releasing them
+	std::vector<Block*> toExtract;
+	for(size_t i=0; i<liveBlocks.size(); ++i)
+	{
+		Block * block = liveBlocks[i].second;
+		if(block->meshDirty)
+		{
+			block->meshDirty = false; // avoid adding it twice
+			toExtract.push_back(block);
+		}
+		for(int n=1; n<8; ++n)
+		{
+			std::unordered_map<unsigned long long, Block*>::iterator iter = blocks_.find(blockKey(block->x-(n&1), block->y-((n>>1)&1), block->z-((n>>2)&1)));
+			if(iter != blocks_.end() && iter->second->voxels && iter->second->meshDirty)
+			{
+				iter->second->meshDirty = false; // avoid adding it twice
+				toExtract.push_back(iter->second);
+			}
+		}
+	}
+	#pragma omp parallel for
+	for(int i=0; i<(int)toExtract.size(); ++i)
+	{
+		extractBlock(toExtract[i]);
+	}
+	for(size_t i=0; i<liveBlocks.size(); ++i)
+	{
+		liveBlocks[i].second->release();
+	}
+	liveBlocks_ -= toRelease;
+	UDEBUG("Released %d blocks (meshed=%d, live=%d, time=%fs)", toRelease, (int)toExtract.size(), liveBlocks_, timer.ticks());
+}
+
+pcl::PolygonMesh::Ptr TSDFVolume::extractMesh()
+{
+	UTimer timer;
+	std::vector<Block*> blocks;
+	std::vector<Block*> dirtyBlocks;
+	blocks.reserve(blocks_.size());
+	for(std::unordered_map<unsigned long long, Block*>::iterator iter=blocks_.begin(); iter!=blocks_.end(); ++iter)
+	{
+		blocks.push_back(iter->second);
+		if(iter->second->meshDirty)
+		{
+			dirtyBlocks.push_back(iter->second);
+		}
+	}
+	#pragma omp parallel for schedule(dynamic, 16)
+	for(int i=0; i<(int)dirtyBlocks.size(); ++i)
+	{
+		extractBlock(dirtyBlocks[i]);
+	}
+	double extractionTime = timer.ticks();
+
+	// Merge vertices shared between blocks
+	pcl::PointCloud<pcl::PointXYZRGBNormal> cloud;
+	std::vector<pcl::Vertices> polygons;
+	std::unordered_map<unsigned long long, int> indices;
+	std::vector<int> blockToGlobal;
+	for(size_t i=0; i<blocks.size(); ++i)
+	{
+		const Block * block = blocks[i];
+		blockToGlobal.resize(block->vertices.size());
+		for(size_t j=0; j<block->vertices.size(); ++j)
+		{
+			std::pair<std::unordered_map<unsigned long long, int>::iterator, bool> inserted = indices.insert(std::make_pair(block->verticesKey[j], (int)cloud.size()));
+			if(inserted.second)
+			{
+				pcl::PointXYZRGBNormal pt;
+				pt.x = block->vertices[j].x;
+				pt.y = block->vertices[j].y;
+				pt.z = block->vertices[j].z;
+				pt.r = block->vertices[j].r;
+				pt.g = block->vertices[j].g;
+				pt.b = block->vertices[j].b;
+				pt.normal_x = pt.normal_y = pt.normal_z = 0.0f;
+				cloud.push_back(pt);
+			}
+			blockToGlobal[j] = inserted.first->second;
+		}
+		for(size_t j=0; j<block->triangles.size(); j+=3)
+		{
+			pcl::Vertices polygon;
+			polygon.vertices.resize(3);
+			for(int n=0; n<3; ++n)
+			{
+				polygon.vertices[n] = blockToGlobal[block->triangles[j+n]];
+			}
+			// accumulate area-weighted face normals
+			Eigen::Vector3f pa = cloud[polygon.vertices[0]].getVector3fMap();
+			Eigen::Vector3f normal = (cloud[polygon.vertices[1]].getVector3fMap()-pa).cross(cloud[polygon.vertices[2]].getVector3fMap()-pa);
+			for(int n=0; n<3; ++n)
+			{
+				cloud[polygon.vertices[n]].getNormalVector3fMap() += normal;
+			}
+			polygons.push_back(polygon);
+		}
+	}
+	for(size_t i=0; i<cloud.size(); ++i)
+	{
+		cloud[i].getNormalVector3fMap().normalize();
+	}
+
+	pcl::PolygonMesh::Ptr mesh(new pcl::PolygonMesh);
+	pcl::toPCLPointCloud2(cloud, mesh->cloud);
+	mesh->polygons = polygons;
+	UDEBUG("Extracted mesh: %d vertices, %d polygons (re-meshed blocks=%d/%d, extraction=%fs, merge=%fs)",
+			(int)cloud.size(), (int)polygons.size(), (int)dirtyBlocks.size(), (int)blocks.size(), extractionTime, timer.ticks());
+	return mesh;
+}
+
+unsigned long TSDFVolume::getMemoryUsed() const
+{
+	unsigned long memoryUsage = sizeof(TSDFVolume);
+	memoryUsage += blocks_.size() * (sizeof(unsigned long long) + sizeof(Block*) + sizeof(Block) + sizeof(void*)*2);
+	memoryUsage += liveBlocks_ * TSDF_BLOCK_VOXELS * sizeof(TSDFVoxel);
+	for(std::unordered_map<unsigned long long, Block*>::const_iterator iter=blocks_.begin(); iter!=blocks_.end(); ++iter)
+	{
+		memoryUsage += iter->second->vertices.capacity() * sizeof(pcl::PointXYZRGB);
+		memoryUsage += iter->second->verticesKey.capacity() * sizeof(unsigned long long);
+		memoryUsage += iter->second->triangles.capacity() * sizeof(int);
+	}
+	return memoryUsage;
+}
+
+}
@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/DBDriver.h"
 #include "rtabmap/core/Parameters.h"
 #include "rtabmap/core/FlannIndex.h"
+#include "rtabmap/core/PQIndex.h"
 
 #include "rtabmap/utilite/UtiLite.h"
 
@@ -51,6 +52,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fstream>
 #include <string>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #define KDTREE_SIZE 4
 #define KNN_CHECKS 32
 
@@ -60,6 +65,48 @@ namespace rtabmap
 const int VWDictionary::ID_START = 1;
 const int VWDictionary::ID_INVALID = 0;
 
+// Trains the quantizers of a product quantization index in background,
+// the dictionary is searched by brute force in the meantime.
+class PQTrainingThread : public UThread
+{
+public:
+	PQTrainingThread(const cv::Mat & samples, int subQuantizers, int coarseCells) :
+		samples_(samples),
+		subQuantizers_(subQuantizers),
+		coarseCells_(coarseCells),
+		index_(new PQIndex())
+	{
+	}
+	virtual ~PQTrainingThread()
+	{
+		this->join();
+		delete index_;
+	}
+	// caller takes ownership
+	PQIndex * takeIndex()
+	{
+		PQIndex * index = index_;
+		index_ = 0;
+		return index;
+	}
+
+protected:
+	virtual void mainLoop()
+	{
+		UTimer timer;
+		index_->train(samples_, subQuantizers_, coarseCells_);
+		UINFO("Product quantization quantizers trained in background with %d words (%fs)", samples_.rows, timer.ticks());
+		samples_ = cv::Mat();
+		this->kill();
+	}
+
+private:
+	cv::Mat samples_;
+	int subQuantizers_;
+	int coarseCells_;
+	PQIndex * index_;
+};
+
 VWDictionary::VWDictionary(const ParametersMap & parameters) :
 	_totalActiveReferences(0),
 	_incrementalDictionary(Parameters::defaultKpIncrementalDictionary()),
@@ -69,9 +116,16 @@ VWDictionary::VWDictionary(const ParametersMap & parameters) :
 	_nndrRatio(Parameters::defaultKpNndrRatio()),
 	_newDictionaryPath(Parameters::defaultKpDictionaryPath()),
 	_newWordsComparedTogether(Parameters::defaultKpNewWordsComparedTogether()),
+	_quantizationThreads(Parameters::defaultKpQuantizationThreads()),
 	_lastWordId(0),
 	useDistanceL1_(false),
 	_flannIndex(new FlannIndex()),
+	_pqIndex(new PQIndex()),
+	_pqTrainingThread(0),
+	_pqSubQuantizers(Parameters::defaultKpPQSubQuantizers()),
+	_pqCoarseCells(Parameters::defaultKpPQCoarseCells()),
+	_pqProbes(Parameters::defaultKpPQProbes()),
+	_pqTrainingSize(Parameters::defaultKpPQTrainingSize()),
 	_strategy(kNNBruteForce)
 {
 	this->setNNStrategy((NNStrategy)Parameters::defaultKpNNStrategy());
@@ -82,6 +136,7 @@ VWDictionary::~VWDictionary()
 {
 	this->clear();
 	delete _flannIndex;
+	delete _pqIndex;
 }
 
 void VWDictionary::parseParameters(const ParametersMap & parameters)
@@ -89,8 +144,25 @@ void VWDictionary::parseParameters(const ParametersMap & parameters)
 	ParametersMap::const_iterator iter;
 	Parameters::parse(parameters, Parameters::kKpNndrRatio(), _nndrRatio);
 	Parameters::parse(parameters, Parameters::kKpNewWordsComparedTogether(), _newWordsComparedTogether);
+	Parameters::parse(parameters, Parameters::kKpQuantizationThreads(), _quantizationThreads);
 	Parameters::parse(parameters, Parameters::kKpIncrementalFlann(), _incrementalFlann);
 	Parameters::parse(parameters, Parameters::kKpFlannRebalancingFactor(), _rebalancingFactor);
+	int pqSubQuantizers = _pqSubQuantizers;
+	int pqCoarseCells = _pqCoarseCells;
+	int pqTrainingSize = _pqTrainingSize;
+	Parameters::parse(parameters, Parameters::kKpPQSubQuantizers(), _pqSubQuantizers);
+	Parameters::parse(parameters, Parameters::kKpPQCoarseCells(), _pqCoarseCells);
+	Parameters::parse(parameters, Parameters::kKpPQProbes(), _pqProbes);
+	Parameters::parse(parameters, Parameters::kKpPQTrainingSize(), _pqTrainingSize);
+	if((_pqIndex->isTrained() || _pqTrainingThread) &&
+	   (pqSubQuantizers != _pqSubQuantizers || pqCoarseCells != _pqCoarseCells || pqTrainingSize != _pqTrainingSize))
+	{
+		UWARN("Parameters %s, %s and %s changed but the product quantization index is already trained, "
+				"they will be used only when the dictionary is re-initialized.",
+				Parameters::kKpPQSubQuantizers().c_str(),
+				Parameters::kKpPQCoarseCells().c_str(),
+				Parameters::kKpPQTrainingSize().c_str());
+	}
 	bool byteToFloat = _byteToFloat;
 	Parameters::parse(parameters, Parameters::kKpByteToFloat(), _byteToFloat);
 
@@ -327,6 +399,19 @@ bool VWDictionary::setNNStrategy(NNStrategy strategy)
 		strategy = kNNBruteForce;
 	}
 
+	if(_strategy == kNNProductQuantization && strategy != _strategy && _pqIndex->isTrained())
+	{
+		for(std::map<int, VisualWord *>::iterator iter=_visualWords.begin(); iter!=_visualWords.end(); ++iter)
+		{
+			if(iter->second->getDescriptor().empty())
+			{
+				UERROR("Cannot change nearest neighbor strategy: descriptors of the words already saved "
+						"in the database have been released by product quantization, the dictionary should be reloaded.");
+				return false;
+			}
+		}
+	}
+
 	bool update = _strategy != strategy;
 	_strategy = strategy;
 	if(update)
@@ -336,6 +421,7 @@ bool VWDictionary::setNNStrategy(NNStrategy strategy)
 			UINFO("Nearest neighbor strategy has changed, re-initialize search tree.");
 		}
 		_dataTree = cv::Mat();
+		this->releasePQIndex();
 		_notIndexedWords = uKeysSet(_visualWords);
 		_removedIndexedWords.clear();
 		this->update();
@@ -358,12 +444,12 @@ int VWDictionary::getLastIndexedWordId() const
 
 unsigned int VWDictionary::getIndexedWordsCount() const
 {
-	return _flannIndex->indexedFeatures();
+	return _pqIndex->isTrained()?_pqIndex->indexedFeatures():_flannIndex->indexedFeatures();
 }
 
 unsigned int VWDictionary::getIndexMemoryUsed() const
 {
-	return _flannIndex->memoryUsed();
+	return _pqIndex->isTrained()?_pqIndex->memoryUsed():_flannIndex->memoryUsed();
 }
 
 unsigned long VWDictionary::getMemoryUsed() const
@@ -484,7 +570,52 @@ void VWDictionary::update()
 
 	if(_notIndexedWords.size() || _visualWords.size() == 0 || _removedIndexedWords.size())
 	{
-		if(_incrementalFlann &&
+		if(_strategy == kNNProductQuantization && _pqIndex->isTrained())
+		{
+			ULOGGER_DEBUG("PQ: Removing %d words...", (int)_removedIndexedWords.size());
+			for(std::set<int>::iterator iter=_removedIndexedWords.begin(); iter!=_removedIndexedWords.end(); ++iter)
+			{
+				UASSERT(uContains(_mapIdIndex, *iter));
+				UASSERT(uContains(_mapIndexId, _mapIdIndex.at(*iter)));
+				_pqIndex->removePoint(_mapIdIndex.at(*iter));
+				_mapIndexId.erase(_mapIdIndex.at(*iter));
+				_mapIdIndex.erase(*iter);
+			}
+			if(_pqIndex->removedFeatures() > _pqIndex->indexedFeatures())
+			{
+				// Removed codes are only flagged, drop them when they
+				// are more than the words still indexed
+				std::vector<int> newIndices = _pqIndex->compact();
+				std::map<int, int> mapIndexId;
+				for(std::map<int, int>::iterator iter=_mapIndexId.begin(); iter!=_mapIndexId.end(); ++iter)
+				{
+					UASSERT(iter->first < (int)newIndices.size() && newIndices[iter->first] >= 0);
+					mapIndexId.insert(mapIndexId.end(), std::pair<int, int>(newIndices[iter->first], iter->second));
+					_mapIdIndex.at(iter->second) = newIndices[iter->first];
+				}
+				_mapIndexId.swap(mapIndexId);
+			}
+
+			ULOGGER_DEBUG("PQ: Inserting %d words...", (int)_notIndexedWords.size());
+			for(std::set<int>::iterator iter=_notIndexedWords.begin(); iter!=_notIndexedWords.end(); ++iter)
+			{
+				VisualWord* w = uValue(_visualWords, *iter, (VisualWord*)0);
+				UASSERT(w);
+				UASSERT_MSG(w->getDescriptor().type() == CV_32F, "To use Product Quantization dictionary, float descriptors are required!");
+				int index = _pqIndex->addPoints(w->getDescriptor()).front();
+				std::pair<std::map<int, int>::iterator, bool> inserted;
+				inserted = _mapIndexId.insert(std::pair<int, int>(index, w->id()));
+				UASSERT(inserted.second);
+				inserted = _mapIdIndex.insert(std::pair<int, int>(w->id(), index));
+				UASSERT(inserted.second);
+				if(w->isSaved())
+				{
+					// Full descriptor can be reloaded from the database
+					w->releaseDescriptor();
+				}
+			}
+		}
+		else if(_incrementalFlann &&
 		   _strategy < kNNBruteForce &&
 		   _visualWords.size())
 		{
@@ -677,6 +808,27 @@ void VWDictionary::update()
 				ULOGGER_DEBUG("Time to create kd tree = %f s", timer.ticks());
 			}
 		}
+
+		if(_strategy == kNNProductQuantization && !_pqIndex->isTrained())
+		{
+			if(_pqTrainingThread)
+			{
+				if(!_pqTrainingThread->isRunning())
+				{
+					// Quantizers trained in background, encode the
+					// words of the brute force data matrix
+					delete _pqIndex;
+					_pqIndex = _pqTrainingThread->takeIndex();
+					delete _pqTrainingThread;
+					_pqTrainingThread = 0;
+					this->encodePQIndex();
+				}
+			}
+			else if(_dataTree.rows >= (_incrementalDictionary?uMax(2, _pqTrainingSize):2))
+			{
+				this->trainPQIndex();
+			}
+		}
 		UDEBUG("Dictionary updated! (size=%d added=%d removed=%d)",
 				_dataTree.rows, _notIndexedWords.size(), _removedIndexedWords.size());
 	}
@@ -717,6 +869,7 @@ void VWDictionary::clear(bool printWarningsIfNotEmpty)
 	_mapIdIndex.clear();
 	_unusedWords.clear();
 	_flannIndex->release();
+	this->releasePQIndex();
 	useDistanceL1_ = false;
 }
 
@@ -725,6 +878,79 @@ int VWDictionary::getNextId()
 	return ++_lastWordId;
 }
 
+void VWDictionary::trainPQIndex()
+{
+	UASSERT_MSG(_dataTree.type() == CV_32F, "To use Product Quantization dictionary, float descriptors are required!");
+	UASSERT(_dataTree.rows == (int)_mapIndexId.size());
+	UTimer timer;
+
+	// Train on words uniformly sampled in the dictionary
+	cv::Mat samples = _dataTree;
+	if(_pqTrainingSize > 0 && _dataTree.rows > _pqTrainingSize)
+	{
+		samples = cv::Mat(_pqTrainingSize, _dataTree.cols, _dataTree.type());
+		for(int i=0; i<samples.rows; ++i)
+		{
+			_dataTree.row((int)((long)i*_dataTree.rows/samples.rows)).copyTo(samples.row(i));
+		}
+	}
+	int subQuantizers = _pqSubQuantizers>0?uMin(_pqSubQuantizers, _dataTree.cols):uMax(1, _dataTree.cols/4);
+	if(_incrementalDictionary)
+	{
+		// k-means can take a while, don't block the update: words
+		// are matched by brute force until the training is done
+		UASSERT(_pqTrainingThread == 0);
+		_pqTrainingThread = new PQTrainingThread(samples.clone(), subQuantizers, _pqCoarseCells);
+		_pqTrainingThread->start();
+		UINFO("Product quantization training started in background with %d words (sub-quantizers=%d, cells=%d)",
+				samples.rows, subQuantizers, _pqCoarseCells);
+		return;
+	}
+	_pqIndex->train(samples, subQuantizers, _pqCoarseCells);
+	UINFO("Product quantization index trained with %d words (sub-quantizers=%d, cells=%d) in %f s",
+			samples.rows, subQuantizers, _pqCoarseCells, timer.ticks());
+	this->encodePQIndex();
+}
+
+void VWDictionary::encodePQIndex()
+{
+	UASSERT(_pqIndex->isTrained());
+	UASSERT(_dataTree.rows == (int)_mapIndexId.size());
+	UTimer timer;
+
+	// Rows of the brute force data matrix are the indexes of the words
+	if(!_dataTree.empty())
+	{
+		std::vector<unsigned int> indices = _pqIndex->addPoints(_dataTree);
+		UASSERT(indices.size() == _mapIndexId.size() && indices.front() == 0);
+	}
+	int released = 0;
+	for(std::map<int, int>::iterator iter=_mapIndexId.begin(); iter!=_mapIndexId.end(); ++iter)
+	{
+		VisualWord * w = uValue(_visualWords, iter->second, (VisualWord*)0);
+		UASSERT(w);
+		if(w->isSaved())
+		{
+			w->releaseDescriptor();
+			++released;
+		}
+	}
+	_dataTree = cv::Mat();
+	UINFO("Product quantization index encoded %d words (released descriptors=%d, %f KB) in %f s",
+			(int)_mapIndexId.size(), released, _pqIndex->memoryUsed()/1024.0f, timer.ticks());
+}
+
+void VWDictionary::releasePQIndex()
+{
+	if(_pqTrainingThread)
+	{
+		// wait for the k-means to finish
+		delete _pqTrainingThread;
+		_pqTrainingThread = 0;
+	}
+	_pqIndex->release();
+}
+
 void VWDictionary::addWordRef(int wordId, int signatureId)
 {
 	VisualWord * vw = 0;
@@ -778,7 +1004,13 @@ std::list<int> VWDictionary::addNewWords(
 	// verify we have the same features
 	int dim = 0;
 	int type = -1;
-	if(_visualWords.size())
+	if(_pqIndex->isTrained())
+	{
+		// descriptors of saved words may have been released
+		dim = _pqIndex->featuresDim();
+		type = _pqIndex->featuresType();
+	}
+	else if(_visualWords.size())
 	{
 		dim = _visualWords.begin()->second->getDescriptor().cols;
 		type = _visualWords.begin()->second->getDescriptor().type();
@@ -815,7 +1047,12 @@ std::list<int> VWDictionary::addNewWords(
 	}
 	dim = 0;
 	type = -1;
-	if(_dataTree.rows || _flannIndex->isBuilt())
+	if(_pqIndex->isTrained())
+	{
+		dim = _pqIndex->featuresDim();
+		type = _pqIndex->featuresType();
+	}
+	else if(_dataTree.rows || _flannIndex->isBuilt())
 	{
 		dim = _flannIndex->isBuilt()?_flannIndex->featuresDim():_dataTree.cols;
 		type = _flannIndex->isBuilt()?_flannIndex->featuresType():_dataTree.type();
@@ -851,20 +1088,96 @@ std::list<int> VWDictionary::addNewWords(
 	UTimer timerLocal;
 	timerLocal.start();
 
-	if(_flannIndex->isBuilt() || (!_dataTree.empty() && _dataTree.rows >= (int)k))
+	int threads = _quantizationThreads;
+	if(threads <= 0)
+	{
+#ifdef _OPENMP
+		threads = omp_get_max_threads();
+#else
+		threads = 1;
+#endif
+	}
+	// Don't split in chunks too small to be worth it
+	threads = uMax(1, uMin(threads, descriptors.rows/32));
+	if(threads > 1 && !descriptors.isContinuous())
+	{
+		descriptors = descriptors.clone();
+	}
+
+	if(_flannIndex->isBuilt() ||
+	   (_pqIndex->isTrained() && _pqIndex->indexedFeatures() >= k) ||
+	   (!_dataTree.empty() && _dataTree.rows >= (int)k))
 	{
 		//Find nearest neighbors
-		UDEBUG("newPts.total()=%d ", descriptors.rows);
+		UDEBUG("newPts.total()=%d threads=%d", descriptors.rows, threads);
 
-		if(_strategy == kNNFlannNaive || _strategy == kNNFlannKdTree || _strategy == kNNFlannLSH)
+		if(_strategy == kNNFlannNaive || _strategy == kNNFlannKdTree || _strategy == kNNFlannLSH || _pqIndex->isTrained())
 		{
-			_flannIndex->knnSearch(descriptors, results, dists, k, KNN_CHECKS);
+			if(threads > 1)
+			{
+				// The index is read-only here, search chunks of queries in parallel
+				results.create(descriptors.rows, k, sizeof(size_t)==8?CV_64F:CV_32S);
+				dists.create(descriptors.rows, k, !_pqIndex->isTrained() && _flannIndex->featuresType() == CV_8UC1?CV_32S:CV_32F);
+				int chunkSize = (descriptors.rows + threads - 1) / threads;
+#pragma omp parallel for num_threads(threads)
+				for(int t=0; t<threads; ++t)
+				{
+					int start = t*chunkSize;
+					int end = uMin(descriptors.rows, start+chunkSize);
+					if(start < end)
+					{
+						cv::Mat resultsChunk = results.rowRange(start, end);
+						cv::Mat distsChunk = dists.rowRange(start, end);
+						if(_pqIndex->isTrained())
+						{
+							_pqIndex->knnSearch(descriptors.rowRange(start, end), resultsChunk, distsChunk, k, _pqProbes);
+						}
+						else
+						{
+							_flannIndex->knnSearch(descriptors.rowRange(start, end), resultsChunk, distsChunk, k, KNN_CHECKS);
+						}
+					}
+				}
+			}
+			else if(_pqIndex->isTrained())
+			{
+				_pqIndex->knnSearch(descriptors, results, dists, k, _pqProbes);
+			}
+			else
+			{
+				_flannIndex->knnSearch(descriptors, results, dists, k, KNN_CHECKS);
+			}
 		}
-		else if(_strategy == kNNBruteForce)
+		else if(_strategy == kNNBruteForce || _strategy == kNNProductQuantization)
 		{
 			bruteForce = true;
-			cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-			matcher.knnMatch(descriptors, _dataTree, matches, k);
+			if(threads > 1)
+			{
+				matches.resize(descriptors.rows);
+				int chunkSize = (descriptors.rows + threads - 1) / threads;
+#pragma omp parallel for num_threads(threads)
+				for(int t=0; t<threads; ++t)
+				{
+					int start = t*chunkSize;
+					int end = uMin(descriptors.rows, start+chunkSize);
+					if(start < end)
+					{
+						std::vector<std::vector<cv::DMatch> > matchesChunk;
+						cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
+						matcher.knnMatch(descriptors.rowRange(start, end), _dataTree, matchesChunk, k);
+						UASSERT((int)matchesChunk.size() == end-start);
+						for(int i=start; i<end; ++i)
+						{
+							matches[i].swap(matchesChunk[i-start]);
+						}
+					}
+				}
+			}
+			else
+			{
+				cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
+				matcher.knnMatch(descriptors, _dataTree, matches, k);
+			}
 		}
 		else if(_strategy == kNNBruteForceGPU)
 		{
@@ -976,6 +1289,7 @@ std::list<int> VWDictionary::addNewWords(
 		}
 
 		// Check if this descriptor matches with a word from the last signature (a word not already added to the tree)
+		// Done sequentially whatever the number of threads, so that resulting words are the same
 		if(_newWordsComparedTogether && newWords.rows)
 		{
 			std::vector<std::vector<cv::DMatch> > matchesNewWords;
@@ -1076,14 +1390,22 @@ std::vector<int> VWDictionary::findNN(const std::list<VisualWord *> & vws) const
 	{
 		int type = (*vws.begin())->getDescriptor().type();
 		int dim = (*vws.begin())->getDescriptor().cols;
+		int dictDim = _visualWords.begin()->second->getDescriptor().cols;
+		int dictType = _visualWords.begin()->second->getDescriptor().type();
+		if(_pqIndex->isTrained())
+		{
+			// descriptors of saved words may have been released
+			dictDim = _pqIndex->featuresDim();
+			dictType = _pqIndex->featuresType();
+		}
 
-		if(dim != _visualWords.begin()->second->getDescriptor().cols)
+		if(dim != dictDim)
 		{
 			UERROR("Descriptors (size=%d) are not the same size as already added words in dictionary(size=%d)", (*vws.begin())->getDescriptor().cols, dim);
 			return std::vector<int>(vws.size(), 0);
 		}
 
-		if(type != _visualWords.begin()->second->getDescriptor().type())
+		if(type != dictType)
 		{
 			UERROR("Descriptors (type=%d) are not the same type as already added words in dictionary(type=%d)", (*vws.begin())->getDescriptor().type(), type);
 			return std::vector<int>(vws.size(), 0);
@@ -1121,6 +1443,12 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 		// verify we have the same features
 		int dim = _visualWords.begin()->second->getDescriptor().cols;
 		int type = _visualWords.begin()->second->getDescriptor().type();
+		if(_pqIndex->isTrained())
+		{
+			// descriptors of saved words may have been released
+			dim = _pqIndex->featuresDim();
+			type = _pqIndex->featuresType();
+		}
 		UASSERT(type == CV_32F || type == CV_8U);
 
 		if(dim != queryIn.cols)
@@ -1153,7 +1481,12 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 		}
 		dim = 0;
 		type = -1;
-		if(_dataTree.rows || _flannIndex->isBuilt())
+		if(_pqIndex->isTrained())
+		{
+			dim = _pqIndex->featuresDim();
+			type = _pqIndex->featuresType();
+		}
+		else if(_dataTree.rows || _flannIndex->isBuilt())
 		{
 			dim = _flannIndex->isBuilt()?_flannIndex->featuresDim():_dataTree.cols;
 			type = _flannIndex->isBuilt()?_flannIndex->featuresType():_dataTree.type();
@@ -1178,16 +1511,22 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 		cv::Mat results;
 		cv::Mat dists;
 
-		if(_flannIndex->isBuilt() || (!_dataTree.empty() && _dataTree.rows >= (int)k))
+		if(_flannIndex->isBuilt() ||
+		   (_pqIndex->isTrained() && _pqIndex->indexedFeatures() >= k) ||
+		   (!_dataTree.empty() && _dataTree.rows >= (int)k))
 		{
 			//Find nearest neighbors
 			UDEBUG("query.rows=%d ", query.rows);
 
-			if(_strategy == kNNFlannNaive || _strategy == kNNFlannKdTree || _strategy == kNNFlannLSH)
+			if(_pqIndex->isTrained())
+			{
+				_pqIndex->knnSearch(query, results, dists, k, _pqProbes);
+			}
+			else if(_strategy == kNNFlannNaive || _strategy == kNNFlannKdTree || _strategy == kNNFlannLSH)
 			{
 				_flannIndex->knnSearch(query, results, dists, k, KNN_CHECKS);
 			}
-			else if(_strategy == kNNBruteForce)
+			else if(_strategy == kNNBruteForce || _strategy == kNNProductQuantization)
 			{
 				bruteForce = true;
 				cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
@@ -1455,7 +1794,10 @@ void VWDictionary::deleteUnusedWords()
 	}
 }
 
-void VWDictionary::exportDictionary(const char * fileNameReferences, const char * fileNameDescriptors) const
+void VWDictionary::exportDictionary(
+		const char * fileNameReferences,
+		const char * fileNameDescriptors,
+		const std::map<int, cv::Mat> & releasedDescriptors) const
 {
 	UDEBUG("");
 	if(_visualWords.empty())
@@ -1463,7 +1805,19 @@ void VWDictionary::exportDictionary(const char * fileNameReferences, const char
 		UWARN("Dictionary is empty, cannot export it!");
 		return;
 	}
-	if(_visualWords.begin()->second->getDescriptor().type() != CV_32FC1)
+	// Descriptors of saved words may have been released by product quantization
+	cv::Mat firstDescriptor = _visualWords.begin()->second->getDescriptor();
+	if(firstDescriptor.empty())
+	{
+		firstDescriptor = uValue(releasedDescriptors, _visualWords.begin()->first, cv::Mat());
+	}
+	if(firstDescriptor.empty())
+	{
+		UERROR("Descriptor of word %d is not available (released by product quantization), "
+				"cannot export the dictionary!", _visualWords.begin()->first);
+		return;
+	}
+	if(firstDescriptor.type() != CV_32FC1)
 	{
 		UERROR("Exporting binary descriptors is not implemented!");
 		return;
@@ -1491,11 +1845,12 @@ void VWDictionary::exportDictionary(const char * fileNameReferences, const char
 		else
 		{
 			UDEBUG("");
-			fprintf(foutDesc, "WordID Descriptors...%d\n", (*_visualWords.begin()).second->getDescriptor().cols);
+			fprintf(foutDesc, "WordID Descriptors...%d\n", firstDescriptor.cols);
 		}
 	}
 
 	UDEBUG("Export %d words...", _visualWords.size());
+	int missingDescriptors = 0;
     for(std::map<int, VisualWord *>::const_iterator iter=_visualWords.begin(); iter!=_visualWords.end(); ++iter)
     {
     	// References
@@ -1516,9 +1871,19 @@ void VWDictionary::exportDictionary(const char * fileNameReferences, const char
     	//Descriptors
     	if(foutDesc)
     	{
+			cv::Mat descriptor = (*iter).second->getDescriptor();
+			if(descriptor.empty())
+			{
+				descriptor = uValue(releasedDescriptors, (*iter).first, cv::Mat());
+				if(descriptor.empty())
+				{
+					++missingDescriptors;
+					continue;
+				}
+			}
 			fprintf(foutDesc, "%d ", (*iter).first);
-			const float * desc = (const float *)(*iter).second->getDescriptor().data;
-			int dim = (*iter).second->getDescriptor().cols;
+			const float * desc = (const float *)descriptor.data;
+			int dim = descriptor.cols;
 
 			for(int i=0; i<dim; i++)
 			{
@@ -1528,6 +1893,11 @@ void VWDictionary::exportDictionary(const char * fileNameReferences, const char
     	}
     }
 
+	if(missingDescriptors)
+	{
+		UWARN("%d words exported without descriptor (released by product quantization)", missingDescriptors);
+	}
+
 	if(foutRef)
 		fclose(foutRef);
 	if(foutDesc)
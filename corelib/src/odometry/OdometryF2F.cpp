@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/odometry/OdometryF2F.h"
 #include "rtabmap/core/OdometryInfo.h"
 #include "rtabmap/core/Registration.h"
+#include "rtabmap/core/RegistrationVis.h"
 #include "rtabmap/core/EpipolarGeometry.h"
 #include "rtabmap/core/util3d_transforms.h"
 #include "rtabmap/utilite/ULogger.h"
@@ -40,7 +41,9 @@ OdometryF2F::OdometryF2F(const ParametersMap & parameters) :
 	Odometry(parameters),
 	keyFrameThr_(Parameters::defaultOdomKeyFrameThr()),
 	visKeyFrameThr_(Parameters::defaultOdomVisKeyFrameThr()),
-	scanKeyFrameThr_(Parameters::defaultOdomScanKeyFrameThr())
+	scanKeyFrameThr_(Parameters::defaultOdomScanKeyFrameThr()),
+	featureExtractor_(0),
+	canPreprocess_(false)
 {
 	registrationPipeline_ = Registration::create(parameters);
 	Parameters::parse(parameters, Parameters::kOdomKeyFrameThr(), keyFrameThr_);
@@ -50,12 +53,29 @@ OdometryF2F::OdometryF2F(const ParametersMap & parameters) :
 	UASSERT(visKeyFrameThr_>=0);
 	UASSERT(scanKeyFrameThr_>=0.0f && scanKeyFrameThr_<=1.0f);
 
+	// Optical flow needs the reference frame to find the new features
+	int corType = Parameters::defaultVisCorType();
+	Parameters::parse(parameters, Parameters::kVisCorType(), corType);
+	canPreprocess_ = registrationPipeline_->isImageRequired() && corType == 0;
+
 	parameters_ = parameters;
 }
 
 OdometryF2F::~OdometryF2F()
 {
 	delete registrationPipeline_;
+	delete featureExtractor_;
+}
+
+bool OdometryF2F::preprocessImpl(SensorData & data)
+{
+	if(featureExtractor_ == 0)
+	{
+		// Own detector, so that it can be used in parallel with registrationPipeline_
+		featureExtractor_ = new RegistrationVis(parameters_);
+	}
+	featureExtractor_->extractFeatures(data);
+	return true;
 }
 
 void OdometryF2F::reset(const Transform & initialPose)
@@ -116,6 +136,12 @@ Transform OdometryF2F::computeTransform(
 			registrationPipeline_->parseParameters(params);
 		}
 
+		RegistrationVis * registrationVis = dynamic_cast<RegistrationVis*>(registrationPipeline_);
+		if(registrationVis)
+		{
+			registrationVis->setGuessCovariance(guess.isNull()?cv::Mat():this->guessCovariance());
+		}
+
 		Signature tmpRefFrame = refFrame_;
 		output = registrationPipeline_->computeTransformationMod(
 				tmpRefFrame,
@@ -298,7 +324,7 @@ Transform OdometryF2F::computeTransform(
 		UWARN("Registration failed: \"%s\"", regInfo.rejectedMsg.c_str());
 	}
 
-	data.setFeatures(newFrame.sensorData().keypoints(), newFrame.sensorData().keypoints3D(), newFrame.sensorData().descriptors());
+	data.setFeatures(newFrame.sensorData());
 	data.setLaserScan(newFrame.sensorData().laserScanRaw());
 
 	if(info)
@@ -42,9 +42,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/utilite/UTimer.h"
 #include "rtabmap/utilite/UMath.h"
 #include "rtabmap/utilite/UConversion.h"
+#include "rtabmap/utilite/UThread.h"
+#include "rtabmap/utilite/UMutex.h"
+#include "rtabmap/utilite/USemaphore.h"
 #include <opencv2/calib3d/calib3d.hpp>
 #include <rtabmap/core/odometry/OdometryF2M.h>
 #include <pcl/common/io.h>
+#include <algorithm>
 
 #if _MSC_VER
 	#define ISFINITE(value) _finite(value)
@@ -54,6 +58,163 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace rtabmap {
 
+// Runs local bundle adjustment of OdometryF2M in background, one
+// optimization at a time.
+class LocalBundleAdjustmentThread : public UThread
+{
+public:
+	LocalBundleAdjustmentThread(Optimizer * sba) :
+		sba_(sba),
+		generation_(0),
+		busy_(false),
+		done_(false),
+		rootId_(0),
+		jobGeneration_(0),
+		time_(0.0f)
+	{
+		UASSERT(sba_ != 0);
+	}
+	virtual ~LocalBundleAdjustmentThread()
+	{
+		this->join(true);
+	}
+
+	// Returns false if an optimization is already running.
+	bool post(
+			int rootId,
+			const std::map<int, Transform> & poses,
+			const std::multimap<int, Link> & links,
+			const std::map<int, CameraModel> & models,
+			const std::map<int, cv::Point3f> & points3DMap,
+			const std::map<int, std::map<int, FeatureBA> > & wordReferences)
+	{
+		UScopeMutex lock(mutex_);
+		if(busy_)
+		{
+			return false;
+		}
+		rootId_ = rootId;
+		poses_ = poses;
+		links_ = links;
+		models_ = models;
+		points3DMap_ = points3DMap;
+		wordReferences_ = wordReferences;
+		outliers_.clear();
+		jobGeneration_ = generation_;
+		busy_ = true;
+		done_ = false;
+		jobAdded_.release();
+		return true;
+	}
+
+	// Returns true if an optimization is done since the last call.
+	bool take(
+			int & rootId,
+			std::map<int, Transform> & poses,
+			std::map<int, cv::Point3f> & points3DMap,
+			std::set<int> & outliers,
+			float & time)
+	{
+		UScopeMutex lock(mutex_);
+		if(!done_)
+		{
+			return false;
+		}
+		rootId = rootId_;
+		poses = poses_;
+		points3DMap = points3DMap_;
+		outliers = outliers_;
+		time = time_;
+		done_ = false;
+		return true;
+	}
+
+	// Discard the result of the optimization currently running (if any).
+	void clear()
+	{
+		UScopeMutex lock(mutex_);
+		++generation_;
+		done_ = false;
+	}
+
+private:
+	virtual void mainLoopBegin()
+	{
+		ULogger::registerCurrentThread("OdomBA");
+	}
+	virtual void mainLoopKill()
+	{
+		jobAdded_.release();
+	}
+	virtual void mainLoop()
+	{
+		jobAdded_.acquire();
+		if(!this->isRunning())
+		{
+			return;
+		}
+
+		int rootId;
+		std::map<int, Transform> poses;
+		std::multimap<int, Link> links;
+		std::map<int, CameraModel> models;
+		std::map<int, cv::Point3f> points3DMap;
+		std::map<int, std::map<int, FeatureBA> > wordReferences;
+		int generation;
+		{
+			UScopeMutex lock(mutex_);
+			if(!busy_)
+			{
+				return;
+			}
+			rootId = rootId_;
+			poses.swap(poses_);
+			links.swap(links_);
+			models.swap(models_);
+			points3DMap.swap(points3DMap_);
+			wordReferences.swap(wordReferences_);
+			generation = jobGeneration_;
+		}
+
+		UTimer timer;
+		std::set<int> outliers;
+		// set root negative to fix all other poses
+		poses = sba_->optimizeBA(-rootId, poses, links, models, points3DMap, wordReferences, &outliers);
+		float time = timer.ticks();
+		UDEBUG("Async bundle adjustment of frame %d: %fs (poses=%d points=%d outliers=%d)",
+				rootId, time, (int)poses.size(), (int)points3DMap.size(), (int)outliers.size());
+
+		UScopeMutex lock(mutex_);
+		if(generation == generation_)
+		{
+			poses_ = poses;
+			points3DMap_ = points3DMap;
+			outliers_ = outliers;
+			time_ = time;
+			done_ = true;
+		}
+		busy_ = false;
+	}
+
+private:
+	Optimizer * sba_;
+	UMutex mutex_;
+	USemaphore jobAdded_;
+	int generation_;
+	bool busy_;
+	bool done_;
+
+	int rootId_;
+	int jobGeneration_;
+	std::map<int, Transform> poses_;
+	std::multimap<int, Link> links_;
+	std::map<int, CameraModel> models_;
+	std::map<int, cv::Point3f> points3DMap_;
+	std::map<int, std::map<int, FeatureBA> > wordReferences_;
+	std::set<int> outliers_;
+	float time_;
+};
+
 OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 	Odometry(parameters),
 	maximumMapSize_(Parameters::defaultOdomF2MMaxSize()),
@@ -67,14 +228,20 @@ OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 	scanMapMaxRange_(Parameters::defaultOdomF2MScanRange()),
 	bundleAdjustment_(Parameters::defaultOdomF2MBundleAdjustment()),
 	bundleMaxFrames_(Parameters::defaultOdomF2MBundleAdjustmentMaxFrames()),
+	bundleAsync_(Parameters::defaultOdomF2MBundleAdjustmentAsync()),
 	validDepthRatio_(Parameters::defaultOdomF2MValidDepthRatio()),
 	pointToPlaneK_(Parameters::defaultIcpPointToPlaneK()),
 	pointToPlaneRadius_(Parameters::defaultIcpPointToPlaneRadius()),
+	indexVoxelSize_(Parameters::defaultOdomF2MIndexVoxelSize()),
+	guessWinSize_(Parameters::defaultVisCorGuessWinSize()),
+	regPipeline_(0),
+	featureExtractor_(0),
 	map_(new Signature(-1)),
 	lastFrame_(new Signature(1)),
 	lastFrameOldestNewId_(0),
 	bundleSeq_(0),
-	sba_(0)
+	sba_(0),
+	bundleThread_(0)
 {
 	UDEBUG("");
 	Parameters::parse(parameters, Parameters::kOdomF2MMaxSize(), maximumMapSize_);
@@ -91,7 +258,10 @@ OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 	Parameters::parse(parameters, Parameters::kOdomF2MScanRange(), scanMapMaxRange_);
 	Parameters::parse(parameters, Parameters::kOdomF2MBundleAdjustment(), bundleAdjustment_);
 	Parameters::parse(parameters, Parameters::kOdomF2MBundleAdjustmentMaxFrames(), bundleMaxFrames_);
+	Parameters::parse(parameters, Parameters::kOdomF2MBundleAdjustmentAsync(), bundleAsync_);
 	Parameters::parse(parameters, Parameters::kOdomF2MValidDepthRatio(), validDepthRatio_);
+	Parameters::parse(parameters, Parameters::kOdomF2MIndexVoxelSize(), indexVoxelSize_);
+	Parameters::parse(parameters, Parameters::kVisCorGuessWinSize(), guessWinSize_);
 
 	Parameters::parse(parameters, Parameters::kIcpPointToPlaneK(), pointToPlaneK_);
 	Parameters::parse(parameters, Parameters::kIcpPointToPlaneRadius(), pointToPlaneRadius_);
@@ -107,6 +277,11 @@ OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 			// disable bundle in RegistrationVis as we do it already here
 			uInsert(bundleParameters, ParametersPair(Parameters::kVisBundleAdjustment(), "0"));
 			sba_ = Optimizer::create(bundleAdjustment_==3?Optimizer::kTypeCeres:bundleAdjustment_==2?Optimizer::kTypeCVSBA:Optimizer::kTypeG2O, bundleParameters);
+			if(bundleAsync_)
+			{
+				bundleThread_ = new LocalBundleAdjustmentThread(sba_);
+				bundleThread_->start();
+			}
 		}
 		else
 		{
@@ -120,6 +295,7 @@ OdometryF2M::OdometryF2M(const ParametersMap & parameters) :
 	UASSERT(visKeyFrameThr_>=0);
 	UASSERT(scanKeyFrameThr_ >= 0.0f && scanKeyFrameThr_<=1.0f);
 	UASSERT(maxNewFeatures_ >= 0);
+	UASSERT(indexVoxelSize_ >= 0.0f);
 
 	int corType = Parameters::defaultVisCorType();
 	Parameters::parse(parameters, Parameters::kVisCorType(), corType);
@@ -171,11 +347,340 @@ OdometryF2M::~OdometryF2M()
 {
 	delete map_;
 	delete lastFrame_;
+	delete bundleThread_;
 	delete sba_;
 	delete regPipeline_;
+	delete featureExtractor_;
 	UDEBUG("");
 }
 
+bool OdometryF2M::canPreprocess() const
+{
+	return regPipeline_->isImageRequired();
+}
+
+bool OdometryF2M::preprocessImpl(SensorData & data)
+{
+	if(featureExtractor_ == 0)
+	{
+		// Own detector, so that it can be used in parallel with regPipeline_
+		featureExtractor_ = new RegistrationVis(parameters_);
+	}
+	featureExtractor_->extractFeatures(data);
+	return true;
+}
+
+// Update the local map with the last optimization done in background
+void OdometryF2M::applyAsyncBundleAdjustment(float & bundleTime, int & bundleOutliers, OdometryInfo * info)
+{
+	int rootId = 0;
+	std::map<int, Transform> poses;
+	std::map<int, cv::Point3f> points3DMap;
+	std::set<int> outliers;
+	if(!bundleThread_->take(rootId, poses, points3DMap, outliers, bundleTime))
+	{
+		return;
+	}
+	bundleOutliers = (int)outliers.size();
+
+	// Only the root frame is optimized, update it if it is still a key-frame of the local map
+	std::map<int, Transform>::iterator iterRoot = poses.find(rootId);
+	std::map<int, Transform>::iterator iterPose = bundlePoses_.find(rootId);
+	if(iterRoot != poses.end() && !iterRoot->second.isNull() && iterPose != bundlePoses_.end())
+	{
+		iterPose->second = iterRoot->second;
+		for(std::multimap<int, Link>::iterator iter=bundleLinks_.begin(); iter!=bundleLinks_.end(); ++iter)
+		{
+			if(iter->second.to() == rootId && iter->second.from() != rootId && bundlePoses_.find(iter->second.from()) != bundlePoses_.end())
+			{
+				iter->second.setTransform(bundlePoses_.at(iter->second.from()).inverse()*iterPose->second);
+			}
+		}
+	}
+
+	// Update 3D points still in the local map, outliers are not moved
+	int updated = 0;
+	if(!points3DMap.empty() && !map_->getWords().empty())
+	{
+		std::vector<cv::Point3f> words3 = map_->getWords3();
+		std::vector<int> updatedWords;
+		for(std::map<int, cv::Point3f>::iterator iter=points3DMap.begin(); iter!=points3DMap.end(); ++iter)
+		{
+			if(outliers.find(iter->first) == outliers.end())
+			{
+				std::multimap<int, int>::const_iterator jter = map_->getWords().find(iter->first);
+				if(jter != map_->getWords().end())
+				{
+					words3[jter->second] = iter->second;
+					updatedWords.push_back(iter->first);
+					++updated;
+				}
+			}
+		}
+		if(updated)
+		{
+			map_->setWords(map_->getWords(), map_->getWordsKpts(), words3, map_->getWordsDescriptors());
+			updateMapIndex(std::vector<int>(), updatedWords);
+		}
+	}
+
+	if(info)
+	{
+		info->localBundlePoses = poses;
+		info->localBundleModels = bundleModels_;
+	}
+	UDEBUG("Applied async bundle adjustment of frame %d (points updated=%d/%d, outliers=%d)",
+			rootId, updated, (int)points3DMap.size(), (int)outliers.size());
+}
+
+inline unsigned long long mapVoxelKey(int x, int y, int z)
+{
+	// 21 bits per axis
+	return ((unsigned long long)((x + (1<<20)) & 0x1FFFFF) << 42) |
+		   ((unsigned long long)((y + (1<<20)) & 0x1FFFFF) << 21) |
+		   ((unsigned long long)((z + (1<<20)) & 0x1FFFFF));
+}
+
+inline void mapVoxelCoordinates(unsigned long long key, int & x, int & y, int & z)
+{
+	x = int((key >> 42) & 0x1FFFFF) - (1<<20);
+	y = int((key >> 21) & 0x1FFFFF) - (1<<20);
+	z = int(key & 0x1FFFFF) - (1<<20);
+}
+
+// voxels are grouped in blocks of 8x8x8 voxels, so that
+// invisible regions of the map are rejected block by block
+inline unsigned long long mapBlockKey(unsigned long long voxelKey)
+{
+	int x,y,z;
+	mapVoxelCoordinates(voxelKey, x, y, z);
+	return mapVoxelKey(x>>3, y>>3, z>>3);
+}
+
+void OdometryF2M::updateMapIndex()
+{
+	mapIndex_.clear();
+	mapIndexVoxels_.clear();
+	if(indexVoxelSize_ <= 0.0f)
+	{
+		return;
+	}
+	UASSERT(map_->getWords().size() == map_->getWords3().size());
+	for(std::multimap<int, int>::const_iterator iter=map_->getWords().begin(); iter!=map_->getWords().end(); ++iter)
+	{
+		indexMapWord(iter->first, map_->getWords3()[iter->second]);
+	}
+	UDEBUG("Indexed %d words in %d voxels", (int)map_->getWords().size(), (int)mapIndexVoxels_.size());
+}
+
+// Update only words removed from or added/moved in map_
+void OdometryF2M::updateMapIndex(const std::vector<int> & removedWords, const std::vector<int> & updatedWords)
+{
+	if(indexVoxelSize_ <= 0.0f)
+	{
+		return;
+	}
+	for(size_t i=0; i<removedWords.size(); ++i)
+	{
+		unindexMapWord(removedWords[i]);
+	}
+	for(size_t i=0; i<updatedWords.size(); ++i)
+	{
+		std::multimap<int, int>::const_iterator iter = map_->getWords().find(updatedWords[i]);
+		if(iter != map_->getWords().end())
+		{
+			indexMapWord(iter->first, map_->getWords3()[iter->second]);
+		}
+	}
+	UDEBUG("Index updated (removed=%d updated=%d, words=%d)", (int)removedWords.size(), (int)updatedWords.size(), (int)mapIndexVoxels_.size());
+}
+
+void OdometryF2M::indexMapWord(int wordId, const cv::Point3f & pt)
+{
+	// Points without depth are added to map as far rays, so all points should be finite
+	if(!util3d::isFinite(pt))
+	{
+		unindexMapWord(wordId);
+		return;
+	}
+	unsigned long long key = mapVoxelKey(
+			int(std::floor(pt.x/indexVoxelSize_)),
+			int(std::floor(pt.y/indexVoxelSize_)),
+			int(std::floor(pt.z/indexVoxelSize_)));
+	std::unordered_map<int, unsigned long long>::iterator iter = mapIndexVoxels_.find(wordId);
+	if(iter != mapIndexVoxels_.end())
+	{
+		if(iter->second == key)
+		{
+			return;
+		}
+		unindexMapWord(wordId);
+	}
+	mapIndex_[mapBlockKey(key)][key].push_back(wordId);
+	mapIndexVoxels_.insert(std::make_pair(wordId, key));
+}
+
+void OdometryF2M::unindexMapWord(int wordId)
+{
+	std::unordered_map<int, unsigned long long>::iterator iter = mapIndexVoxels_.find(wordId);
+	if(iter == mapIndexVoxels_.end())
+	{
+		return;
+	}
+	std::unordered_map<unsigned long long, std::unordered_map<unsigned long long, std::vector<int> > >::iterator block = mapIndex_.find(mapBlockKey(iter->second));
+	UASSERT(block != mapIndex_.end());
+	std::unordered_map<unsigned long long, std::vector<int> >::iterator voxel = block->second.find(iter->second);
+	UASSERT(voxel != block->second.end());
+	std::vector<int>::iterator word = std::find(voxel->second.begin(), voxel->second.end(), wordId);
+	UASSERT(word != voxel->second.end());
+	*word = voxel->second.back();
+	voxel->second.pop_back();
+	if(voxel->second.empty())
+	{
+		block->second.erase(voxel);
+		if(block->second.empty())
+		{
+			mapIndex_.erase(block);
+		}
+	}
+	mapIndexVoxels_.erase(iter);
+}
+
+// Conservative test: does the sphere intersect the frustum (padded by margin pixels)?
+inline bool isSphereInFrustum(
+		const Eigen::Vector3f & center, float radius,
+		float fx, float fy, float cx, float cy,
+		const cv::Size & imageSize, float margin)
+{
+	if(center[2] + radius <= 0.0f)
+	{
+		return false; // behind the camera
+	}
+	if(center[2] <= radius)
+	{
+		return true; // around the camera
+	}
+	float u = fx*center[0]/center[2] + cx;
+	float v = fy*center[1]/center[2] + cy;
+	float m = fx*radius/(center[2] - radius) + margin;
+	return u > -m && u < float(imageSize.width) + m &&
+		   v > -m && v < float(imageSize.height) + m;
+}
+
+// Fill visibleMap with the words of the local map that may be seen by
+// the camera at framePose. Returns false if the whole map should be used.
+bool OdometryF2M::getVisibleMap(const Transform & framePose, const SensorData & data, Signature & visibleMap) const
+{
+	if(mapIndex_.empty() || framePose.isNull())
+	{
+		return false;
+	}
+
+	CameraModel model;
+	if(data.cameraModels().size() == 1 && data.cameraModels()[0].isValidForProjection())
+	{
+		model = data.cameraModels()[0];
+	}
+	else if(data.stereoCameraModel().isValidForProjection())
+	{
+		model = data.stereoCameraModel().left();
+	}
+	else
+	{
+		// multi-cameras not supported
+		return false;
+	}
+	cv::Size imageSize = model.imageSize();
+	if(imageSize.width == 0 || imageSize.height == 0)
+	{
+		imageSize = data.imageRaw().size();
+		if(data.imageRaw().empty())
+		{
+			return false;
+		}
+	}
+
+	Eigen::Affine3f worldToCamera = (framePose * model.localTransform()).inverse().toEigen3f();
+	float radius = indexVoxelSize_ * 0.8660254f; // half diagonal of a voxel
+	float fx = model.fx();
+	float fy = model.fy();
+	float cx = model.cx();
+	float cy = model.cy();
+
+	std::vector<std::pair<int, int> > visibleWords;
+	int visibleVoxels = 0;
+	int x,y,z;
+	for(std::unordered_map<unsigned long long, std::unordered_map<unsigned long long, std::vector<int> > >::const_iterator block=mapIndex_.begin(); block!=mapIndex_.end(); ++block)
+	{
+		mapVoxelCoordinates(block->first, x, y, z);
+		Eigen::Vector3f center = worldToCamera * Eigen::Vector3f(
+				(float(x)+0.5f)*8.0f*indexVoxelSize_,
+				(float(y)+0.5f)*8.0f*indexVoxelSize_,
+				(float(z)+0.5f)*8.0f*indexVoxelSize_);
+		if(!isSphereInFrustum(center, radius*8.0f, fx, fy, cx, cy, imageSize, float(guessWinSize_)))
+		{
+			continue;
+		}
+
+		for(std::unordered_map<unsigned long long, std::vector<int> >::const_iterator iter=block->second.begin(); iter!=block->second.end(); ++iter)
+		{
+			mapVoxelCoordinates(iter->first, x, y, z);
+			center = worldToCamera * Eigen::Vector3f(
+					(float(x)+0.5f)*indexVoxelSize_,
+					(float(y)+0.5f)*indexVoxelSize_,
+					(float(z)+0.5f)*indexVoxelSize_);
+
+			if(isSphereInFrustum(center, radius, fx, fy, cx, cy, imageSize, float(guessWinSize_)))
+			{
+				for(size_t i=0; i<iter->second.size(); ++i)
+				{
+					std::multimap<int, int>::const_iterator jter = map_->getWords().find(iter->second[i]);
+					UASSERT(jter != map_->getWords().end());
+					visibleWords.push_back(*jter);
+				}
+				++visibleVoxels;
+			}
+		}
+	}
+
+	if((int)visibleWords.size() < regPipeline_->getMinVisualCorrespondences() ||
+	   visibleWords.size() == map_->getWords().size())
+	{
+		return false;
+	}
+
+	// Keep the most recent word so that new words of the frame get IDs
+	// over all IDs of the local map (see RegistrationVis).
+	visibleWords.push_back(*map_->getWords().rbegin());
+	std::sort(visibleWords.begin(), visibleWords.end());
+	visibleWords.erase(std::unique(visibleWords.begin(), visibleWords.end()), visibleWords.end());
+
+	std::multimap<int, int> words;
+	std::vector<cv::KeyPoint> wordsKpts;
+	std::vector<cv::Point3f> words3(visibleWords.size());
+	cv::Mat descriptors(visibleWords.size(), map_->getWordsDescriptors().cols, map_->getWordsDescriptors().type());
+	if(!map_->getWordsKpts().empty())
+	{
+		wordsKpts.resize(visibleWords.size());
+	}
+	for(size_t i=0; i<visibleWords.size(); ++i)
+	{
+		int index = visibleWords[i].second;
+		words.insert(words.end(), std::make_pair(visibleWords[i].first, (int)i));
+		if(!wordsKpts.empty())
+		{
+			wordsKpts[i] = map_->getWordsKpts()[index];
+		}
+		words3[i] = map_->getWords3()[index];
+		map_->getWordsDescriptors().row(index).copyTo(descriptors.row(i));
+	}
+	visibleMap = Signature(map_->id());
+	visibleMap.setWords(words, wordsKpts, words3, descriptors);
+
+	UDEBUG("Visible words=%d/%d (voxels=%d)", (int)visibleWords.size(), (int)map_->getWords().size(), visibleVoxels);
+	return true;
+}
+
 
 void OdometryF2M::reset(const Transform & initialPose)
 {
@@ -185,6 +690,8 @@ void OdometryF2M::reset(const Transform & initialPose)
 	Odometry::reset(initialPose);
 	*lastFrame_ = Signature(1);
 	*map_ = Signature(-1);
+	mapIndex_.clear();
+	mapIndexVoxels_.clear();
 	scansBuffer_.clear();
 	bundleWordReferences_.clear();
 	bundlePoses_.clear();
@@ -193,6 +700,10 @@ void OdometryF2M::reset(const Transform & initialPose)
 	bundlePoseReferences_.clear();
 	bundleSeq_ = 0;
 	lastFrameOldestNewId_ = 0;
+	if(bundleThread_)
+	{
+		bundleThread_->clear();
+	}
 }
 
 // return not null transform if odometry is correctly computed
@@ -235,6 +746,10 @@ Transform OdometryF2M::computeTransform(
 	int totalBundleWordReferencesUsed = 0;
 	int totalBundleOutliers = 0;
 	float bundleTime = 0.0f;
+	if(bundleThread_ && bundleAdjustment_ > 0)
+	{
+		applyAsyncBundleAdjustment(bundleTime, totalBundleOutliers, info);
+	}
 	bool visDepthAsMask = Parameters::defaultVisDepthAsMask();
 	Parameters::parse(parameters_, Parameters::kVisDepthAsMask(), visDepthAsMask);
 
@@ -253,6 +768,15 @@ Transform OdometryF2M::computeTransform(
 			std::map<int, Transform> bundlePoses;
 			std::multimap<int, Link> bundleLinks;
 			std::map<int, CameraModel> bundleModels;
+			// async bundle adjustment, posted only if the frame becomes a key-frame
+			std::map<int, cv::Point3f> asyncPoints3DMap;
+			std::map<int, std::map<int, FeatureBA> > asyncWordReferences;
+
+			RegistrationVis * regVis = dynamic_cast<RegistrationVis*>(regPipeline_);
+			if(regVis)
+			{
+				regVis->setGuessCovariance(guess.isNull()?cv::Mat():this->guessCovariance());
+			}
 
 			for(int guessIteration=0;
 					guessIteration<(!guess.isNull()&&regPipeline_->isImageRequired()?2:1) && transform.isNull();
@@ -262,10 +786,26 @@ Transform OdometryF2M::computeTransform(
 				// reset matches, but keep already extracted features in lastFrame_->sensorData()
 				lastFrame_->removeAllWords();
 
+				// With the spatial index, match only words that can be seen from the guess
+				Signature visibleMap;
+				Signature * regMap = &tmpMap;
+				if(guessIteration==0 &&
+				   !guess.isNull() &&
+				   !regPipeline_->isScanRequired() &&
+				   getVisibleMap(this->getPose()*guess, lastFrame_->sensorData(), visibleMap))
+				{
+					regMap = &visibleMap;
+				}
+				int regMapSize = (int)regMap->getWords().size();
+				int regMapFirstId = regMapSize?regMap->getWords().begin()->first:0;
+				int regMapLastId = regMapSize?regMap->getWords().rbegin()->first:0;
+
 				points3DMap.clear();
 				bundlePoses.clear();
 				bundleLinks.clear();
 				bundleModels.clear();
+				asyncPoints3DMap.clear();
+				asyncWordReferences.clear();
 
 				float maxCorrespondenceDistance = 0.0f;
 				float outlierRatio = 0.0f;
@@ -291,7 +831,7 @@ Transform OdometryF2M::computeTransform(
 				}
 
 				transform = regPipeline_->computeTransformationMod(
-						tmpMap,
+						*regMap,
 						*lastFrame_,
 						// special case for ICP-only odom, set guess to identity if we just started or reset
 						guessIteration==0 && !guess.isNull()?this->getPose()*guess:!regPipeline_->isImageRequired()&&this->framesProcessed()<2?this->getPose():Transform(),
@@ -306,7 +846,7 @@ Transform OdometryF2M::computeTransform(
 					regPipeline_->parseParameters(params);
 				}
 
-				data.setFeatures(lastFrame_->sensorData().keypoints(), lastFrame_->sensorData().keypoints3D(), lastFrame_->sensorData().descriptors());
+				data.setFeatures(lastFrame_->sensorData());
 				data.setLaserScan(lastFrame_->sensorData().laserScanRaw());
 
 				UDEBUG("Registration time = %fs", regInfo.totalTime);
@@ -321,10 +861,10 @@ Transform OdometryF2M::computeTransform(
 						UDEBUG("Local Bundle Adjustment");
 
 						// make sure the IDs of words in the map are not modified (Optical Flow Registration issue)
-						UASSERT(map_->getWords().size() && tmpMap.getWords().size());
-						if(map_->getWords().size() != tmpMap.getWords().size() ||
-						   map_->getWords().begin()->first != tmpMap.getWords().begin()->first ||
-						   map_->getWords().rbegin()->first != tmpMap.getWords().rbegin()->first)
+						UASSERT(regMapSize && regMap->getWords().size());
+						if(regMapSize != (int)regMap->getWords().size() ||
+						   regMapFirstId != regMap->getWords().begin()->first ||
+						   regMapLastId != regMap->getWords().rbegin()->first)
 						{
 							UERROR("Bundle Adjustment cannot be used with a registration approach recomputing features from the \"from\" signature (e.g., Optical Flow).");
 							bundleAdjustment_ = 0;
@@ -435,72 +975,83 @@ Transform OdometryF2M::computeTransform(
 								//}
 							}
 
-							UDEBUG("sba...start");
-							// set root negative to fix all other poses
-							std::set<int> sbaOutliers;
-							UTimer bundleTimer;
-							bundlePoses = sba_->optimizeBA(-lastFrame_->id(), bundlePoses, bundleLinks, bundleModels, points3DMap, wordReferences, &sbaOutliers);
-							bundleTime = bundleTimer.ticks();
-							UDEBUG("sba...end");
-							totalBundleOutliers = (int)sbaOutliers.size();
-
-							UDEBUG("bundleTime=%fs (poses=%d wordRef=%d outliers=%d)", bundleTime, (int)bundlePoses.size(), (int)bundleWordReferences_.size(), (int)sbaOutliers.size());
-							if(info)
+							if(bundleThread_)
 							{
-								info->localBundlePoses = bundlePoses;
-								info->localBundleModels = bundleModels;
+								// The current frame is not refined. If it is added as key-frame,
+								// the local map will be corrected on a later frame when the
+								// optimization is done.
+								asyncPoints3DMap.swap(points3DMap);
+								asyncWordReferences.swap(wordReferences);
 							}
-
-							UDEBUG("Local Bundle Adjustment Before: %s", transform.prettyPrint().c_str());
-							if(bundlePoses.size() == bundlePoses_.size()+1)
+							else
 							{
-								if(!bundlePoses.rbegin()->second.isNull())
+								UDEBUG("sba...start");
+								// set root negative to fix all other poses
+								std::set<int> sbaOutliers;
+								UTimer bundleTimer;
+								bundlePoses = sba_->optimizeBA(-lastFrame_->id(), bundlePoses, bundleLinks, bundleModels, points3DMap, wordReferences, &sbaOutliers);
+								bundleTime = bundleTimer.ticks();
+								UDEBUG("sba...end");
+								totalBundleOutliers = (int)sbaOutliers.size();
+
+								UDEBUG("bundleTime=%fs (poses=%d wordRef=%d outliers=%d)", bundleTime, (int)bundlePoses.size(), (int)bundleWordReferences_.size(), (int)sbaOutliers.size());
+								if(info)
 								{
-									if(sbaOutliers.size())
+									info->localBundlePoses = bundlePoses;
+									info->localBundleModels = bundleModels;
+								}
+
+								UDEBUG("Local Bundle Adjustment Before: %s", transform.prettyPrint().c_str());
+								if(bundlePoses.size() == bundlePoses_.size()+1)
+								{
+									if(!bundlePoses.rbegin()->second.isNull())
 									{
-										std::vector<int> newInliers(regInfo.inliersIDs.size());
-										int oi=0;
-										for(unsigned int i=0; i<regInfo.inliersIDs.size(); ++i)
+										if(sbaOutliers.size())
 										{
-											if(sbaOutliers.find(regInfo.inliersIDs[i]) == sbaOutliers.end())
+											std::vector<int> newInliers(regInfo.inliersIDs.size());
+											int oi=0;
+											for(unsigned int i=0; i<regInfo.inliersIDs.size(); ++i)
 											{
-												newInliers[oi++] = regInfo.inliersIDs[i];
+												if(sbaOutliers.find(regInfo.inliersIDs[i]) == sbaOutliers.end())
+												{
+													newInliers[oi++] = regInfo.inliersIDs[i];
+												}
 											}
+											newInliers.resize(oi);
+											UDEBUG("BA outliers ratio %f", float(sbaOutliers.size())/float(regInfo.inliersIDs.size()));
+											regInfo.inliers = (int)newInliers.size();
+											regInfo.inliersIDs = newInliers;
 										}
-										newInliers.resize(oi);
-										UDEBUG("BA outliers ratio %f", float(sbaOutliers.size())/float(regInfo.inliersIDs.size()));
-										regInfo.inliers = (int)newInliers.size();
-										regInfo.inliersIDs = newInliers;
-									}
-									if(regInfo.inliers < regPipeline_->getMinVisualCorrespondences())
-									{
-										regInfo.rejectedMsg = uFormat("Too low inliers after bundle adjustment: %d<%d", regInfo.inliers, regPipeline_->getMinVisualCorrespondences());
-										transform.setNull();
-									}
-									else
-									{
-										transform = bundlePoses.rbegin()->second;
-										std::multimap<int, Link>::iterator iter = graph::findLink(bundleLinks, bundlePoses_.rbegin()->first, lastFrame_->id(), false);
-										UASSERT(iter != bundleLinks.end());
-										iter->second.setTransform(bundlePoses_.rbegin()->second.inverse()*transform);
-
-										iter = graph::findLink(bundleLinks, lastFrame_->id(), lastFrame_->id(), false);
-										if(info && iter!=bundleLinks.end() && iter->second.type() == Link::kGravity)
+										if(regInfo.inliers < regPipeline_->getMinVisualCorrespondences())
+										{
+											regInfo.rejectedMsg = uFormat("Too low inliers after bundle adjustment: %d<%d", regInfo.inliers, regPipeline_->getMinVisualCorrespondences());
+											transform.setNull();
+										}
+										else
 										{
-											float rollImu,pitchImu,yaw;
-											iter->second.transform().getEulerAngles(rollImu, pitchImu, yaw);
-											float roll,pitch;
-											transform.getEulerAngles(roll, pitch, yaw);
-											info->gravityRollError = fabs(rollImu - roll);
-											info->gravityPitchError = fabs(pitchImu - pitch);
+											transform = bundlePoses.rbegin()->second;
+											std::multimap<int, Link>::iterator iter = graph::findLink(bundleLinks, bundlePoses_.rbegin()->first, lastFrame_->id(), false);
+											UASSERT(iter != bundleLinks.end());
+											iter->second.setTransform(bundlePoses_.rbegin()->second.inverse()*transform);
+
+											iter = graph::findLink(bundleLinks, lastFrame_->id(), lastFrame_->id(), false);
+											if(info && iter!=bundleLinks.end() && iter->second.type() == Link::kGravity)
+											{
+												float rollImu,pitchImu,yaw;
+												iter->second.transform().getEulerAngles(rollImu, pitchImu, yaw);
+												float roll,pitch;
+												transform.getEulerAngles(roll, pitch, yaw);
+												info->gravityRollError = fabs(rollImu - roll);
+												info->gravityPitchError = fabs(pitchImu - pitch);
+											}
 										}
 									}
+									UDEBUG("Local Bundle Adjustment After : %s", transform.prettyPrint().c_str());
+								}
+								else
+								{
+									UWARN("Local bundle adjustment failed! transform is not refined.");
 								}
-								UDEBUG("Local Bundle Adjustment After : %s", transform.prettyPrint().c_str());
-							}
-							else
-							{
-								UWARN("Local bundle adjustment failed! transform is not refined.");
 							}
 						}
 					}
@@ -546,6 +1097,8 @@ Transform OdometryF2M::computeTransform(
 
 				bool modified = false;
 				Transform newFramePose = this->getPose()*output;
+				std::vector<int> removedWords; // to update the map index
+				std::vector<int> updatedWords;
 
 				// fields to update
 				LaserScan mapScan = tmpMap.sensorData().laserScanRaw();
@@ -599,12 +1152,19 @@ Transform OdometryF2M::computeTransform(
 						bundleModels_.insert(*bundleModels.find(lastFrame_->id()));
 						iterBundlePosesRef = bundlePoseReferences_.find(lastFrame_->id());
 
+						if(bundleThread_ && !asyncWordReferences.empty() &&
+						   bundleThread_->post(lastFrame_->id(), bundlePoses, bundleLinks, bundleModels, asyncPoints3DMap, asyncWordReferences))
+						{
+							UDEBUG("Async bundle adjustment started for key-frame %d", lastFrame_->id());
+						}
+
 						// update local map 3D points (if bundle adjustment was done)
 						for(std::map<int, cv::Point3f>::iterator iter=points3DMap.begin(); iter!=points3DMap.end(); ++iter)
 						{
 							UASSERT(mapWords.count(iter->first) == 1);
 							//UDEBUG("Updated %d (%f,%f,%f) -> (%f,%f,%f)", iter->first, mapPoints[mapWords.find(iter->first)->second].x, mapPoints[mapWords.find(iter->first)->second].y, mapPoints[mapWords.find(iter->first)->second].z, iter->second.x, iter->second.y, iter->second.z);
 							mapPoints[mapWords.find(iter->first)->second] = iter->second;
+							updatedWords.push_back(iter->first);
 						}
 					}
 
@@ -687,16 +1247,7 @@ Transform OdometryF2M::computeTransform(
 								{
 									depth = util3d::transformPoint(pt, invLocalTransform).z;
 								}
-								if(bundleWordReferences_.find(iter->first) == bundleWordReferences_.end())
-								{
-									std::map<int, FeatureBA> framePt;
-									framePt.insert(std::make_pair(lastFrame_->id(), FeatureBA(kpt, depth)));
-									bundleWordReferences_.insert(std::make_pair(iter->first, framePt));
-								}
-								else
-								{
-									bundleWordReferences_.find(iter->first)->second.insert(std::make_pair(lastFrame_->id(), FeatureBA(kpt, depth)));
-								}
+								bundleWordReferences_[iter->first].insert(std::make_pair(lastFrame_->id(), FeatureBA(kpt, depth)));
 							}
 						}
 					}
@@ -723,20 +1274,12 @@ Transform OdometryF2M::computeTransform(
 									{
 										depth = util3d::transformPoint(iter->second.second.second.first, invLocalTransform).z;
 									}
-									if(bundleWordReferences_.find(iter->second.first) == bundleWordReferences_.end())
-									{
-										std::map<int, FeatureBA> framePt;
-										framePt.insert(std::make_pair(lastFrame_->id(), FeatureBA(iter->second.second.first, depth)));
-										bundleWordReferences_.insert(std::make_pair(iter->second.first, framePt));
-									}
-									else
-									{
-										bundleWordReferences_.find(iter->second.first)->second.insert(std::make_pair(lastFrame_->id(), FeatureBA(iter->second.second.first, depth)));
-									}
+									bundleWordReferences_[iter->second.first].insert(std::make_pair(lastFrame_->id(), FeatureBA(iter->second.second.first, depth)));
 								}
 							}
 
 							mapWords.insert(mapWords.end(), std::make_pair(iter->second.first, mapWords.size()));
+							updatedWords.push_back(iter->second.first);
 							mapWordsKpts.push_back(iter->second.second.first);
 							cv::Point3f pt = iter->second.second.second.first;
 							if(!util3d::isFinite(pt))
@@ -788,6 +1331,7 @@ Transform OdometryF2M::computeTransform(
 					{
 						// remove oldest outliers first
 						std::set<int> inliers(regInfo.inliersIDs.begin(), regInfo.inliersIDs.end());
+						bool unreferencedPoses = false; // some bundle poses don't see any word of the map anymore
 						std::vector<int> ids = regInfo.matchesIDs;
 						if(regInfo.projectedIDs.size())
 						{
@@ -813,15 +1357,19 @@ Transform OdometryF2M::computeTransform(
 								{
 									for(std::map<int, FeatureBA>::iterator iterFrame = iterRef->second.begin(); iterFrame != iterRef->second.end(); ++iterFrame)
 									{
-										if(bundlePoseReferences_.find(iterFrame->first) != bundlePoseReferences_.end())
+										std::map<int, int>::iterator iterPoseRef = bundlePoseReferences_.find(iterFrame->first);
+										if(iterPoseRef != bundlePoseReferences_.end() && --iterPoseRef->second <= 0)
 										{
-											bundlePoseReferences_.at(iterFrame->first) -= 1;
+											unreferencedPoses = true;
 										}
 									}
 									bundleWordReferences_.erase(iterRef);
 								}
 
-								mapWords.erase(id);
+								if(mapWords.erase(id))
+								{
+									removedWords.push_back(id);
+								}
 								++removed;
 							}
 						}
@@ -837,14 +1385,16 @@ Transform OdometryF2M::computeTransform(
 								{
 									for(std::map<int, FeatureBA>::iterator iterFrame = iterRef->second.begin(); iterFrame != iterRef->second.end(); ++iterFrame)
 									{
-										if(bundlePoseReferences_.find(iterFrame->first) != bundlePoseReferences_.end())
+										std::map<int, int>::iterator iterPoseRef = bundlePoseReferences_.find(iterFrame->first);
+										if(iterPoseRef != bundlePoseReferences_.end() && --iterPoseRef->second <= 0)
 										{
-											bundlePoseReferences_.at(iterFrame->first) -= 1;
+											unreferencedPoses = true;
 										}
 									}
 									bundleWordReferences_.erase(iterRef);
 								}
 
+								removedWords.push_back(iter->first);
 								mapWords.erase(iter++);
 								++removed;
 							}
@@ -876,7 +1426,7 @@ Transform OdometryF2M::computeTransform(
 						}
 
 						Link * previousLink = 0;
-						for(std::map<int, int>::iterator iter=bundlePoseReferences_.begin(); iter!=bundlePoseReferences_.end();)
+						for(std::map<int, int>::iterator iter=bundlePoseReferences_.begin(); unreferencedPoses && iter!=bundlePoseReferences_.end();)
 						{
 							if(iter->second <= 0)
 							{
@@ -1101,6 +1651,7 @@ Transform OdometryF2M::computeTransform(
 					}
 
 					map_->setWords(mapWords, mapWordsKpts, mapPoints, mapDescriptors);
+					updateMapIndex(removedWords, updatedWords);
 				}
 			}
 
@@ -1135,7 +1686,7 @@ Transform OdometryF2M::computeTransform(
 					dummy);
 			lastFrame_->sensorData().setLaserScan(dummy.sensorData().laserScanRaw());
 
-			data.setFeatures(lastFrame_->sensorData().keypoints(), lastFrame_->sensorData().keypoints3D(), lastFrame_->sensorData().descriptors());
+			data.setFeatures(lastFrame_->sensorData());
 			data.setLaserScan(lastFrame_->sensorData().laserScanRaw());
 
 			// a very high variance tells that the new pose is not linked with the previous one
@@ -1263,6 +1814,7 @@ Transform OdometryF2M::computeTransform(
 					}
 
 					map_->setWords(words, wordsKpts, transformedPoints, descriptors);
+					updateMapIndex();
 					addKeyFrame = true;
 				}
 				else
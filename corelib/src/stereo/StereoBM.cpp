@@ -64,6 +64,7 @@ StereoBM::StereoBM(const ParametersMap & parameters) :
 
 void StereoBM::parseParameters(const ParametersMap & parameters)
 {
+	StereoDense::parseParameters(parameters);
 	Parameters::parse(parameters, Parameters::kStereoBMBlockSize(), blockSize_);
 	Parameters::parse(parameters, Parameters::kStereoBMMinDisparity(), minDisparity_);
 	Parameters::parse(parameters, Parameters::kStereoBMNumDisparities(), numDisparities_);
@@ -94,12 +95,21 @@ cv::Mat StereoBM::computeDisparity(
 		leftMono = leftImage;
 	}
 
+	return computeDisparityByStrips(leftMono, rightImage, minDisparity_, numDisparities_, blockSize_);
+}
+
+cv::Mat StereoBM::computeDisparityImpl(
+		const cv::Mat & leftMono,
+		const cv::Mat & rightImage,
+		int minDisparity,
+		int numDisparities) const
+{
 	cv::Mat disparity;
 #if CV_MAJOR_VERSION < 3
 	cv::StereoBM stereo(cv::StereoBM::BASIC_PRESET);
 	stereo.state->SADWindowSize = blockSize_;
-	stereo.state->minDisparity = minDisparity_;
-	stereo.state->numberOfDisparities = numDisparities_;
+	stereo.state->minDisparity = minDisparity;
+	stereo.state->numberOfDisparities = numDisparities;
 	stereo.state->preFilterSize = preFilterSize_;
 	stereo.state->preFilterCap = preFilterCap_;
 	stereo.state->uniquenessRatio = uniquenessRatio_;
@@ -110,8 +120,8 @@ cv::Mat StereoBM::computeDisparity(
 #else
 	cv::Ptr<cv::StereoBM> stereo = cv::StereoBM::create();
 	stereo->setBlockSize(blockSize_);
-	stereo->setMinDisparity(minDisparity_);
-	stereo->setNumDisparities(numDisparities_);
+	stereo->setMinDisparity(minDisparity);
+	stereo->setNumDisparities(numDisparities);
 	stereo->setPreFilterSize(preFilterSize_);
 	stereo->setPreFilterCap(preFilterCap_);
 	stereo->setUniquenessRatio(uniquenessRatio_);
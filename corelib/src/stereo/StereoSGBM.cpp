@@ -52,6 +52,7 @@ StereoSGBM::StereoSGBM(const ParametersMap & parameters) :
 
 void StereoSGBM::parseParameters(const ParametersMap & parameters)
 {
+	StereoDense::parseParameters(parameters);
 	Parameters::parse(parameters, Parameters::kStereoSGBMBlockSize(), blockSize_);
 	Parameters::parse(parameters, Parameters::kStereoSGBMMinDisparity(), minDisparity_);
 	Parameters::parse(parameters, Parameters::kStereoSGBMNumDisparities(), numDisparities_);
@@ -83,11 +84,20 @@ cv::Mat StereoSGBM::computeDisparity(
 		leftMono = leftImage;
 	}
 
+	return computeDisparityByStrips(leftMono, rightImage, minDisparity_, numDisparities_, blockSize_);
+}
+
+cv::Mat StereoSGBM::computeDisparityImpl(
+		const cv::Mat & leftMono,
+		const cv::Mat & rightImage,
+		int minDisparity,
+		int numDisparities) const
+{
 	cv::Mat disparity;
 #if CV_MAJOR_VERSION < 3
 	cv::StereoSGBM stereo(
-			minDisparity_,
-			numDisparities_,
+			minDisparity,
+			numDisparities,
 			blockSize_,
             P1_,
 			P2_,
@@ -100,8 +110,8 @@ cv::Mat StereoSGBM::computeDisparity(
 	stereo(leftMono, rightImage, disparity);
 #else
 	cv::Ptr<cv::StereoSGBM> stereo = cv::StereoSGBM::create(
-			minDisparity_,
-			numDisparities_,
+			minDisparity,
+			numDisparities,
 			blockSize_,
             P1_,
 			P2_,
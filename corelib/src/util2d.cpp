@@ -45,6 +45,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #if CV_MAJOR_VERSION >= 3
 #include <opencv2/photo/photo.hpp>
 #endif
+#if CV_MAJOR_VERSION > 3 || (CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 3)
+#include <opencv2/core/hal/intrin.hpp>
+#endif
 
 namespace rtabmap
 {
@@ -119,6 +122,14 @@ float sad(const cv::Mat & windowLeft, const cv::Mat & windowRight)
 	return score;
 }
 
+// Block matching windows should be odd to be centered on the corners
+static cv::Size oddWindowSize(const cv::Size & winSize)
+{
+	return cv::Size(
+			winSize.width%2 == 0?winSize.width+1:winSize.width,
+			winSize.height%2 == 0?winSize.height+1:winSize.height);
+}
+
 std::vector<cv::Point2f> calcStereoCorrespondences(
 		const cv::Mat & leftImage,
 		const cv::Mat & rightImage,
@@ -131,6 +142,40 @@ std::vector<cv::Point2f> calcStereoCorrespondences(
 		float maxDisparityF,
 		bool ssdApproach)
 {
+	winSize = oddWindowSize(winSize);
+
+	UTimer timer;
+	std::vector<cv::Mat> leftPyramid, rightPyramid;
+	maxLevel =  cv::buildOpticalFlowPyramid( leftImage, leftPyramid, winSize, maxLevel, false);
+	maxLevel =  cv::buildOpticalFlowPyramid( rightImage, rightPyramid, winSize, maxLevel, false);
+	UDEBUG("pyramid time=%fs", timer.ticks());
+	return calcStereoCorrespondences(
+			leftPyramid,
+			rightPyramid,
+			leftCorners,
+			status,
+			winSize,
+			maxLevel,
+			iterations,
+			minDisparityF,
+			maxDisparityF,
+			ssdApproach);
+}
+
+std::vector<cv::Point2f> calcStereoCorrespondences(
+		const std::vector<cv::Mat> & leftPyramid,
+		const std::vector<cv::Mat> & rightPyramid,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status,
+		cv::Size winSize,
+		int maxLevel,
+		int iterations,
+		float minDisparityF,
+		float maxDisparityF,
+		bool ssdApproach)
+{
+	UASSERT(!leftPyramid.empty() && leftPyramid.size() == rightPyramid.size());
+	maxLevel = std::min(maxLevel, (int)leftPyramid.size()-1);
 	UDEBUG("winSize=(%d,%d)", winSize.width, winSize.height);
 	UDEBUG("maxLevel=%d", maxLevel);
 	UDEBUG("minDisparity=%f", minDisparityF);
@@ -139,28 +184,15 @@ std::vector<cv::Point2f> calcStereoCorrespondences(
 	UDEBUG("ssdApproach=%d", ssdApproach?1:0);
 	UASSERT(minDisparityF >= 0.0f && minDisparityF <= maxDisparityF);
 
-	// window should be odd
-	if(winSize.width%2 == 0)
-	{
-		winSize.width+=1;
-	}
-	if(winSize.height%2 == 0)
-	{
-		winSize.height+=1;
-	}
+	winSize = oddWindowSize(winSize);
 
 	cv::Size halfWin((winSize.width-1)/2, (winSize.height-1)/2);
 
 	UTimer timer;
-	double pyramidTime = 0.0;
 	double disparityTime = 0.0;
 	double subpixelTime = 0.0;
 
 	std::vector<cv::Point2f> rightCorners(leftCorners.size());
-	std::vector<cv::Mat> leftPyramid, rightPyramid;
-	maxLevel =  cv::buildOpticalFlowPyramid( leftImage, leftPyramid, winSize, maxLevel, false);
-	maxLevel =  cv::buildOpticalFlowPyramid( rightImage, rightPyramid, winSize, maxLevel, false);
-	pyramidTime = timer.ticks();
 
 	status = std::vector<unsigned char>(leftCorners.size(), 0);
 	int totalIterations = 0;
@@ -346,13 +378,167 @@ std::vector<cv::Point2f> calcStereoCorrespondences(
 	}
 	UDEBUG("SubPixel=%d/%d added (total=%d)", noSubPixel, added, (int)status.size());
 	UDEBUG("totalIterations=%d", totalIterations);
-	UDEBUG("Time pyramid = %f s", pyramidTime);
 	UDEBUG("Time disparity = %f s", disparityTime);
 	UDEBUG("Time sub-pixel = %f s", subpixelTime);
 
 	return rightCorners;
 }
 
+// Add the costs of one window row for all disparities of the range:
+// costs[k] += |left[u] - right[u+k]| (squared for SSD), u in [0,width), k in [0,n)
+static void accumulateRowCosts(
+		const unsigned char * left,
+		const unsigned char * right,
+		int width,
+		int n,
+		unsigned int * costs,
+		bool ssdApproach)
+{
+	for(int u=0; u<width; ++u)
+	{
+		const unsigned char * r = right+u;
+		int k=0;
+#if defined(CV_SIMD128) && CV_SIMD128
+		cv::v_uint16x8 l = cv::v_setall_u16(left[u]);
+		for(; k<=n-8; k+=8)
+		{
+			cv::v_uint16x8 diff = cv::v_absdiff(l, cv::v_load_expand(r+k));
+			cv::v_uint32x4 c0, c1;
+			if(ssdApproach)
+			{
+				cv::v_mul_expand(diff, diff, c0, c1);
+			}
+			else
+			{
+				cv::v_expand(diff, c0, c1);
+			}
+			cv::v_store(costs+k, cv::v_load(costs+k) + c0);
+			cv::v_store(costs+k+4, cv::v_load(costs+k+4) + c1);
+		}
+#endif
+		for(; k<n; ++k)
+		{
+			int diff = int(left[u]) - int(r[k]);
+			costs[k] += ssdApproach?(unsigned int)(diff*diff):(unsigned int)abs(diff);
+		}
+	}
+}
+
+std::vector<cv::Point2f> calcStereoCorrespondencesFullRange(
+		const cv::Mat & leftImage,
+		const cv::Mat & rightImage,
+		const std::vector<cv::Point2f> & leftCorners,
+		std::vector<unsigned char> & status,
+		cv::Size winSize,
+		float minDisparityF,
+		float maxDisparityF,
+		bool ssdApproach)
+{
+	UASSERT(leftImage.type() == CV_8UC1 && rightImage.type() == CV_8UC1);
+	UASSERT(leftImage.size() == rightImage.size());
+	UASSERT(minDisparityF >= 0.0f && minDisparityF <= maxDisparityF);
+	UDEBUG("winSize=(%d,%d)", winSize.width, winSize.height);
+	UDEBUG("minDisparity=%f", minDisparityF);
+	UDEBUG("maxDisparity=%f", maxDisparityF);
+	UDEBUG("ssdApproach=%d", ssdApproach?1:0);
+
+	winSize = oddWindowSize(winSize);
+	cv::Size halfWin((winSize.width-1)/2, (winSize.height-1)/2);
+
+	UTimer timer;
+	std::vector<cv::Point2f> rightCorners(leftCorners.size());
+	status = std::vector<unsigned char>(leftCorners.size(), 0);
+
+	int minDisparity = std::floor(minDisparityF);
+	int maxDisparity = std::floor(maxDisparityF);
+	std::vector<unsigned int> costs(maxDisparity-minDisparity+1);
+	int added = 0;
+	int rejectedAmbiguous = 0;
+	for(unsigned int i=0; i<leftCorners.size(); ++i)
+	{
+		int cx = cvRound(leftCorners[i].x);
+		int cy = cvRound(leftCorners[i].y);
+		if(cx-halfWin.width < 0 || cx+halfWin.width >= leftImage.cols ||
+		   cy-halfWin.height < 0 || cy+halfWin.height >= leftImage.rows)
+		{
+			continue;
+		}
+
+		// the right window should stay in the image
+		int localMaxDisparity = std::min(maxDisparity, cx-halfWin.width);
+		int n = localMaxDisparity-minDisparity+1;
+		if(n < 3)
+		{
+			continue;
+		}
+
+		// Cost k is for disparity localMaxDisparity-k, so that the right pixels
+		// of all disparities are contiguous in memory.
+		memset(costs.data(), 0, n*sizeof(unsigned int));
+		for(int v=-halfWin.height; v<=halfWin.height; ++v)
+		{
+			accumulateRowCosts(
+					leftImage.ptr<unsigned char>(cy+v) + cx-halfWin.width,
+					rightImage.ptr<unsigned char>(cy+v) + cx-halfWin.width-localMaxDisparity,
+					winSize.width,
+					n,
+					costs.data(),
+					ssdApproach);
+		}
+
+		int best = 0;
+		double sum = 0.0;
+		for(int k=0; k<n; ++k)
+		{
+			if(costs[k] < costs[best])
+			{
+				best = k;
+			}
+			sum += costs[k];
+		}
+		// Same ambiguity criterion than calcStereoCorrespondences()
+		double mean = sum/double(n);
+		double variance = 0.0;
+		for(int k=0; k<n; ++k)
+		{
+			variance += (double(costs[k])-mean)*(double(costs[k])-mean);
+		}
+		if(double(costs[best]) > sqrt(variance/double(n)) || best == 0 || best == n-1)
+		{
+			++rejectedAmbiguous;
+			continue;
+		}
+
+		// subpixel refining: parabola for SSD, equiangular lines for SAD
+		float c0 = costs[best-1];
+		float c1 = costs[best];
+		float c2 = costs[best+1];
+		float offset = 0.0f;
+		if(ssdApproach)
+		{
+			float denom = c0 - 2.0f*c1 + c2;
+			offset = denom>0.0f?0.5f*(c0-c2)/denom:0.0f;
+		}
+		else
+		{
+			float denom = 2.0f*std::max(c0-c1, c2-c1);
+			offset = denom>0.0f?(c0-c2)/denom:0.0f;
+		}
+		float disparity = float(localMaxDisparity) - (float(best)+offset);
+		if(disparity <= minDisparityF || disparity > maxDisparityF)
+		{
+			continue;
+		}
+		rightCorners[i] = cv::Point2f(leftCorners[i].x - disparity, leftCorners[i].y);
+		status[i] = 1;
+		++added;
+	}
+	UDEBUG("added=%d/%d (ambiguous=%d)", added, (int)status.size(), rejectedAmbiguous);
+	UDEBUG("Time disparity = %f s", timer.ticks());
+
+	return rightCorners;
+}
+
 typedef float acctype;
 typedef float itemtype;
 #define  CV_DESCALE(x,n)     (((x) + (1 << ((n)-1))) >> (n))
@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UMath.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UFile.h>
+#include <rtabmap/utilite/UTimer.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/io/ply_io.h>
 #include <pcl/common/transforms.h>
@@ -42,6 +43,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/imgproc/types_c.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace rtabmap
 {
 
@@ -2830,6 +2835,69 @@ struct ProjectionInfo {
 	float distance;
 };
 
+struct ProjectionCamera {
+	int nodeID;
+	int cameraIndex;
+	Eigen::Affine3f t; // world to camera
+	float fx;
+	float fy;
+	float cx;
+	float cy;
+	cv::Size imageSize;
+	cv::Rect roi;
+};
+
+struct ProjectionCell {
+	Eigen::Vector3f min;
+	Eigen::Vector3f max;
+	std::vector<int> indices;
+};
+
+/**
+ * Conservative test: returns false only if no point of the cell
+ * can be projected in the camera's roi closer than maxDistance.
+ */
+bool isCellInFrustum(const ProjectionCell & cell, const ProjectionCamera & camera, float maxDistance)
+{
+	float minZ = std::numeric_limits<float>::max();
+	float maxZ = -std::numeric_limits<float>::max();
+	bool allInFront = true;
+	int left=0, right=0, top=0, bottom=0;
+	for(int k=0; k<8; ++k)
+	{
+		Eigen::Vector3f corner(
+				k&1?cell.max[0]:cell.min[0],
+				k&2?cell.max[1]:cell.min[1],
+				k&4?cell.max[2]:cell.min[2]);
+		corner = camera.t * corner;
+		minZ = std::min(minZ, corner[2]);
+		maxZ = std::max(maxZ, corner[2]);
+		if(corner[2] <= 0.0f)
+		{
+			allInFront = false;
+		}
+		else
+		{
+			// one pixel margin for the rounding done when rasterizing
+			float u = (camera.fx*corner[0])/corner[2] + camera.cx;
+			float v = (camera.fy*corner[1])/corner[2] + camera.cy;
+			left += u < float(camera.roi.x-1)?1:0;
+			right += u > float(camera.roi.x+camera.roi.width+1)?1:0;
+			top += v < float(camera.roi.y-1)?1:0;
+			bottom += v > float(camera.roi.y+camera.roi.height+1)?1:0;
+		}
+	}
+	if(maxZ <= 0.0f)
+	{
+		return false; // behind the camera
+	}
+	if(maxDistance > 0.0f && minZ > maxDistance + 0.001f)
+	{
+		return false; // too far (distances are rounded to mm)
+	}
+	return !allInFront || (left<8 && right<8 && top<8 && bottom<8);
+}
+
 /**
  * For each point, return pixel of the best camera (NodeID->CameraIndex)
  * looking at it based on the policy and parameters
@@ -2859,8 +2927,10 @@ std::vector<std::pair< std::pair<int, int>, pcl::PointXY> > projectCloudToCamera
 		return pointToPixel;
 	}
 
-	std::vector<std::vector<ProjectionInfo> > invertedIndex(cloud.size()); // For each point: list of cameras
-	int cameraProcessed = 0;
+	UTimer timer;
+
+	// Flatten the cameras, the rasterization below is done per camera in parallel
+	std::vector<ProjectionCamera, Eigen::aligned_allocator<ProjectionCamera> > cameras;
 	for(std::map<int, Transform>::const_iterator pter = cameraPoses.lower_bound(0); pter!=cameraPoses.end(); ++pter)
 	{
 		std::map<int, std::vector<CameraModel> >::const_iterator iter=cameraModels.find(pter->first);
@@ -2872,38 +2942,126 @@ std::vector<std::pair< std::pair<int, int>, pcl::PointXY> > projectCloudToCamera
 				UASSERT(!cameraTransform.isNull());
 				cv::Mat cameraMatrixK = iter->second[i].K();
 				UASSERT(cameraMatrixK.type() == CV_64FC1 && cameraMatrixK.cols == 3 && cameraMatrixK.cols == 3);
-				const cv::Size & imageSize = iter->second[i].imageSize();
-
-				float fx = cameraMatrixK.at<double>(0,0);
-				float fy = cameraMatrixK.at<double>(1,1);
-				float cx = cameraMatrixK.at<double>(0,2);
-				float cy = cameraMatrixK.at<double>(1,2);
 
-				// depth: 2 channels UINT: [depthMM, indexPt]
-				cv::Mat registered = cv::Mat::zeros(imageSize, CV_32SC2);
-				Transform t = cameraTransform.inverse();
-
-				cv::Rect roi(0,0,imageSize.width, imageSize.height);
+				ProjectionCamera camera;
+				camera.nodeID = pter->first;
+				camera.cameraIndex = i;
+				camera.t = cameraTransform.inverse().toEigen3f();
+				camera.fx = cameraMatrixK.at<double>(0,0);
+				camera.fy = cameraMatrixK.at<double>(1,1);
+				camera.cx = cameraMatrixK.at<double>(0,2);
+				camera.cy = cameraMatrixK.at<double>(1,2);
+				camera.imageSize = iter->second[i].imageSize();
+				camera.roi = cv::Rect(0,0,camera.imageSize.width, camera.imageSize.height);
 				if(roiRatios.size()==4)
 				{
-					roi = util2d::computeRoi(imageSize, roiRatios);
+					camera.roi = util2d::computeRoi(camera.imageSize, roiRatios);
 				}
+				cameras.push_back(camera);
+			}
+		}
+	}
 
-				int count = 0;
-				for(size_t i=0; i<cloud.size(); ++i)
+	// Bucket the points in a coarse grid, so that each camera only
+	// rasterizes the cells intersecting its frustum.
+	std::vector<ProjectionCell> cells;
+	{
+		Eigen::Vector3f minPt = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+		Eigen::Vector3f maxPt = Eigen::Vector3f::Constant(-std::numeric_limits<float>::max());
+		int validPoints = 0;
+		for(size_t i=0; i<cloud.size(); ++i)
+		{
+			const PointT & pt = cloud.at(i);
+			if(pcl::isFinite(pt))
+			{
+				minPt = minPt.cwiseMin(pt.getVector3fMap());
+				maxPt = maxPt.cwiseMax(pt.getVector3fMap());
+				++validPoints;
+			}
+		}
+		if(validPoints)
+		{
+			// ~256 points per cell, at most 64 cells on the largest axis
+			int maxCells = std::max(1, std::min(64, (int)std::cbrt(float(validPoints)/256.0f)));
+			Eigen::Vector3f extent = maxPt - minPt;
+			float cellSize = std::max(extent.maxCoeff()/float(maxCells), 0.0001f);
+			int nx = int(extent[0]/cellSize)+1;
+			int ny = int(extent[1]/cellSize)+1;
+			int nz = int(extent[2]/cellSize)+1;
+			std::vector<int> cellIndices(nx*ny*nz, -1);
+			for(size_t i=0; i<cloud.size(); ++i)
+			{
+				const PointT & pt = cloud.at(i);
+				if(pcl::isFinite(pt))
 				{
-					// Get 3D from laser scan
-					PointT ptScan = cloud.at(i);
-					ptScan = util3d::transformPoint(ptScan, t);
+					int x = std::min(nx-1, int((pt.x-minPt[0])/cellSize));
+					int y = std::min(ny-1, int((pt.y-minPt[1])/cellSize));
+					int z = std::min(nz-1, int((pt.z-minPt[2])/cellSize));
+					int & cellIndex = cellIndices[(z*ny + y)*nx + x];
+					if(cellIndex < 0)
+					{
+						cellIndex = cells.size();
+						cells.push_back(ProjectionCell());
+						cells.back().min = pt.getVector3fMap();
+						cells.back().max = pt.getVector3fMap();
+					}
+					ProjectionCell & cell = cells[cellIndex];
+					cell.min = cell.min.cwiseMin(pt.getVector3fMap());
+					cell.max = cell.max.cwiseMax(pt.getVector3fMap());
+					cell.indices.push_back(i);
+				}
+			}
+		}
+	}
+	UDEBUG("Indexed %d points in %d cells (%fs)", (int)cloud.size(), (int)cells.size(), timer.ticks());
+
+	std::vector<std::vector<ProjectionInfo> > invertedIndex(cloud.size()); // For each point: list of cameras
+
+	// Cameras are processed in batches to bound the memory used by the
+	// per-camera results before they are merged (in camera order, so
+	// that the result is the same than a serial projection).
+#ifdef _OPENMP
+	int batchSize = 4*omp_get_max_threads();
+#else
+	int batchSize = 1;
+#endif
+	int culledCells = 0;
+	for(int batchStart=0; batchStart<(int)cameras.size(); batchStart+=batchSize)
+	{
+		int batchEnd = std::min(batchStart+batchSize, (int)cameras.size());
+		std::vector<std::vector<std::pair<int, ProjectionInfo> > > projections(batchEnd-batchStart);
+
+		#pragma omp parallel for schedule(dynamic) reduction(+:culledCells)
+		for(int c=batchStart; c<batchEnd; ++c)
+		{
+			const ProjectionCamera & camera = cameras[c];
+			const cv::Rect & roi = camera.roi;
+
+			// depth: 2 channels UINT: [depthMM, indexPt]
+			cv::Mat registered = cv::Mat::zeros(camera.imageSize, CV_32SC2);
+
+			int count = 0;
+			for(size_t k=0; k<cells.size(); ++k)
+			{
+				if(!isCellInFrustum(cells[k], camera, maxDistance))
+				{
+					++culledCells;
+					continue;
+				}
+				const std::vector<int> & indices = cells[k].indices;
+				for(size_t j=0; j<indices.size(); ++j)
+				{
+					int i = indices[j];
+					Eigen::Vector3f ptScan = camera.t * cloud.at(i).getVector3fMap();
 
 					// re-project in camera frame
-					float z = ptScan.z;
+					float z = ptScan[2];
 					bool set = false;
 					if(z > 0.0f)
 					{
 						float invZ = 1.0f/z;
-						float dx = (fx*ptScan.x)*invZ + cx;
-						float dy = (fy*ptScan.y)*invZ + cy;
+						float dx = (camera.fx*ptScan[0])*invZ + camera.cx;
+						float dy = (camera.fy*ptScan[1])*invZ + camera.cy;
 						int dx_low = dx;
 						int dy_low = dy;
 						int dx_high = dx + 0.5f;
@@ -2936,36 +3094,43 @@ std::vector<std::pair< std::pair<int, int>, pcl::PointXY> > projectCloudToCamera
 						count++;
 					}
 				}
-				if(count == 0)
-				{
-					registered = cv::Mat();
-					UINFO("No points projected in camera %d/%d", pter->first, i);
-				}
-				else
-				{
-					UDEBUG("%d points projected in camera %d/%d", count, pter->first, i);
-				}
-				for(int u=0; u<registered.cols; ++u)
+			}
+			if(count == 0)
+			{
+				UINFO("No points projected in camera %d/%d", camera.nodeID, camera.cameraIndex);
+				continue;
+			}
+			UDEBUG("%d points projected in camera %d/%d", count, camera.nodeID, camera.cameraIndex);
+
+			std::vector<std::pair<int, ProjectionInfo> > & cameraProjections = projections[c-batchStart];
+			for(int u=0; u<registered.cols; ++u)
+			{
+				for(int v=0; v<registered.rows; ++v)
 				{
-					for(int v=0; v<registered.rows; ++v)
+					cv::Vec2i &zReg = registered.at<cv::Vec2i>(v, u);
+					if(zReg[0] > 0)
 					{
-						cv::Vec2i &zReg = registered.at<cv::Vec2i>(v, u);
-						if(zReg[0] > 0)
-						{
-							ProjectionInfo info;
-							info.nodeID = pter->first;
-							info.cameraIndex = i;
-							info.uv.x = float(u)/float(imageSize.width);
-							info.uv.y = float(v)/float(imageSize.height);
-							info.distance = zReg[0]/1000.0f;
-							invertedIndex[zReg[1]].push_back(info);
-						}
+						ProjectionInfo info;
+						info.nodeID = camera.nodeID;
+						info.cameraIndex = camera.cameraIndex;
+						info.uv.x = float(u)/float(camera.imageSize.width);
+						info.uv.y = float(v)/float(camera.imageSize.height);
+						info.distance = zReg[0]/1000.0f;
+						cameraProjections.push_back(std::make_pair(zReg[1], info));
 					}
 				}
 			}
 		}
 
-		msg = uFormat("Processed camera %d/%d", (int)cameraProcessed+1, (int)cameraPoses.size());
+		for(size_t c=0; c<projections.size(); ++c)
+		{
+			for(size_t j=0; j<projections[c].size(); ++j)
+			{
+				invertedIndex[projections[c][j].first].push_back(projections[c][j].second);
+			}
+		}
+
+		msg = uFormat("Processed camera %d/%d", batchEnd, (int)cameras.size());
 		UINFO(msg.c_str());
 		if(state && !state->callback(msg))
 		{
@@ -2973,8 +3138,9 @@ std::vector<std::pair< std::pair<int, int>, pcl::PointXY> > projectCloudToCamera
 			UWARN("Projecting to cameras cancelled!");
 			return pointToPixel;
 		}
-		++cameraProcessed;
 	}
+	UINFO("Rasterized %d cameras (%d/%d cells culled) (%fs)",
+			(int)cameras.size(), culledCells, (int)(cells.size()*cameras.size()), timer.ticks());
 
 	msg = uFormat("Select best camera for %d points...", (int)cloud.size());
 	UINFO(msg.c_str());
@@ -2989,64 +3155,68 @@ std::vector<std::pair< std::pair<int, int>, pcl::PointXY> > projectCloudToCamera
 	int colorized = 0;
 
 	// For each point
-	for(size_t i=0; i<invertedIndex.size(); ++i)
-	{
-		if((i+1)%10000 == 0)
-		{
-			UDEBUG("Point %d/%d", i+1, (int)cloud.size());
-			if(state && !state->callback(uFormat("%d/%d points projected to cameras (out of %d points)", colorized, i+1, (int)cloud.size())))
-			{
-				//cancelled!
-				UWARN("Projecting to camera cancelled!");
-				pointToPixel.clear();
-				return pointToPixel;
+	const int chunkSize = 10000;
+	for(int start=0; start<(int)invertedIndex.size(); start+=chunkSize)
+	{
+		int end = std::min(start+chunkSize, (int)invertedIndex.size());
+
+		#pragma omp parallel for reduction(+:colorized)
+		for(int i=start; i<end; ++i)
+		{
+			const PointT & pt = cloud.at(i);
+			int nodeID = -1;
+			int cameraIndex = -1;
+			float smallestWeight = std::numeric_limits<float>::max();
+			pcl::PointXY uv_coords;
+			for (size_t j = 0; j<invertedIndex[i].size(); ++j)
+			{
+				const Transform & cam = cameraPoses.at(invertedIndex[i][j].nodeID);
+				Eigen::Vector4f camDir(cam.x()-pt.x, cam.y()-pt.y, cam.z()-pt.z, 0);
+				Eigen::Vector4f normal(pt.normal_x, pt.normal_y, pt.normal_z, 0);
+				float angleToCam = maxAngle<=0?0:pcl::getAngle3D(normal, camDir);
+				float distanceToCam = invertedIndex[i][j].distance;
+				if( (maxAngle<=0 || (camDir.dot(normal) > 0 && angleToCam < maxAngle)) && // is facing camera? is point normal perpendicular to camera?
+					(maxDistance<=0 || distanceToCam<maxDistance)) // is point not too far from camera?
+				{
+					float vx = invertedIndex[i][j].uv.x-0.5f;
+					float vy = invertedIndex[i][j].uv.y-0.5f;
+
+					float distanceToCenter = vx*vx+vy*vy;
+					float distance = distanceToCenter;
+					if(distanceToCamPolicy)
+					{
+						distance = distanceToCam;
+					}
+					if(distance <= smallestWeight)
+					{
+						nodeID = invertedIndex[i][j].nodeID;
+						cameraIndex = invertedIndex[i][j].cameraIndex;
+						smallestWeight = distance;
+						uv_coords = invertedIndex[i][j].uv;
+					}
+				}
 			}
-		}
 
-		const PointT & pt = cloud.at(i);
-		int nodeID = -1;
-		int cameraIndex = -1;
-		float smallestWeight = std::numeric_limits<float>::max();
-		pcl::PointXY uv_coords;
-		for (size_t j = 0; j<invertedIndex[i].size(); ++j)
-		{
-			const Transform & cam = cameraPoses.at(invertedIndex[i][j].nodeID);
-			Eigen::Vector4f camDir(cam.x()-pt.x, cam.y()-pt.y, cam.z()-pt.z, 0);
-			Eigen::Vector4f normal(pt.normal_x, pt.normal_y, pt.normal_z, 0);
-			float angleToCam = maxAngle<=0?0:pcl::getAngle3D(normal, camDir);
-			float distanceToCam = invertedIndex[i][j].distance;
-			if( (maxAngle<=0 || (camDir.dot(normal) > 0 && angleToCam < maxAngle)) && // is facing camera? is point normal perpendicular to camera?
-				(maxDistance<=0 || distanceToCam<maxDistance)) // is point not too far from camera?
+			if(nodeID>-1 && cameraIndex> -1)
 			{
-				float vx = invertedIndex[i][j].uv.x-0.5f;
-				float vy = invertedIndex[i][j].uv.y-0.5f;
-
-				float distanceToCenter = vx*vx+vy*vy;
-				float distance = distanceToCenter;
-				if(distanceToCamPolicy)
-				{
-					distance = distanceToCam;
-				}
-				if(distance <= smallestWeight)
-				{
-					nodeID = invertedIndex[i][j].nodeID;
-					cameraIndex = invertedIndex[i][j].cameraIndex;
-					smallestWeight = distance;
-					uv_coords = invertedIndex[i][j].uv;
-				}
+				pointToPixel[i].first.first = nodeID;
+				pointToPixel[i].first.second = cameraIndex;
+				pointToPixel[i].second = uv_coords;
+				++colorized;
 			}
 		}
 
-		if(nodeID>-1 && cameraIndex> -1)
+		UDEBUG("Point %d/%d", end, (int)cloud.size());
+		if(state && !state->callback(uFormat("%d/%d points projected to cameras (out of %d points)", colorized, end, (int)cloud.size())))
 		{
-			pointToPixel[i].first.first = nodeID;
-			pointToPixel[i].first.second = cameraIndex;
-			pointToPixel[i].second = uv_coords;
-			++colorized;
+			//cancelled!
+			UWARN("Projecting to camera cancelled!");
+			pointToPixel.clear();
+			return pointToPixel;
 		}
 	}
 
-	UINFO("Process %d points...done! (%d [%d%%] projected in cameras)", (int)cloud.size(), colorized, colorized*100/cloud.size());
+	UINFO("Process %d points...done! (%d [%d%%] projected in cameras) (%fs)", (int)cloud.size(), colorized, colorized*100/cloud.size(), timer.ticks());
 
 	return pointToPixel;
 }
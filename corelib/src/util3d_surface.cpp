@@ -48,6 +48,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl18/surface/texture_mapping.h>
 #include <pcl/features/integral_image_normal.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifdef RTABMAP_ALICE_VISION
 #include <aliceVision/sfmData/SfMData.hpp>
 #include <aliceVision/sfmDataIO/sfmDataIO.hpp>
@@ -1435,6 +1439,52 @@ double sqr(uchar v)
 	return double(v)*double(v);
 }
 
+/**
+ * Small LRU cache of decoded images used by mergeTextures().
+ */
+class TextureImageCache
+{
+public:
+	struct Entry
+	{
+		cv::Mat image;
+		std::vector<CameraModel> models;
+		SensorData data; // compressed data, only set before decoding
+	};
+
+public:
+	TextureImageCache(int maxSize) : maxSize_(maxSize) {UASSERT(maxSize_>0);}
+
+	bool get(int id, Entry & entry)
+	{
+		std::map<int, std::pair<Entry, std::list<int>::iterator> >::iterator iter = entries_.find(id);
+		if(iter == entries_.end())
+		{
+			return false;
+		}
+		order_.splice(order_.begin(), order_, iter->second.second);
+		entry = iter->second.first;
+		return true;
+	}
+
+	void add(int id, const Entry & entry)
+	{
+		UASSERT(entries_.find(id) == entries_.end());
+		order_.push_front(id);
+		entries_.insert(std::make_pair(id, std::make_pair(entry, order_.begin())));
+		while((int)order_.size() > maxSize_)
+		{
+			entries_.erase(order_.back());
+			order_.pop_back();
+		}
+	}
+
+private:
+	int maxSize_;
+	std::list<int> order_; // most recently used first
+	std::map<int, std::pair<Entry, std::list<int>::iterator> > entries_;
+};
+
 cv::Mat mergeTextures(
 		pcl::TextureMesh & mesh,
 		const std::map<int, cv::Mat> & images,
@@ -1644,12 +1694,12 @@ cv::Mat mergeTextures(
 				int rows = float(textureSize)/(scale*imageSize.height);
 
 				globalTextures = cv::Mat(textureSize, materials*textureSize, imageType, cv::Scalar::all(blankValue));
-				cv::Mat globalTextureMasks = cv::Mat(textureSize, materials*textureSize, CV_8UC1, cv::Scalar::all(0));
-
-				// used for multi camera texturing, to avoid reloading same texture for sub cameras
-				cv::Mat previousImage;
-				int previousTextureId = 0;
-				std::vector<CameraModel> previousCameraModels;
+				cv::Mat globalTextureMasks;
+				if(brightnessContrastRatioLow > 0 || brightnessContrastRatioHigh > 0)
+				{
+					// only needed for brightness/contrast adjustment
+					globalTextureMasks = cv::Mat(textureSize, materials*textureSize, CV_8UC1, cv::Scalar::all(0));
+				}
 
 				// make a blank texture
 				cv::Mat emptyImage(int(imageSize.height*scale), int(imageSize.width*scale), imageType, cv::Scalar::all(blankValue));
@@ -1657,6 +1707,7 @@ cv::Mat mergeTextures(
 				int oi=0;
 				std::vector<cv::Point2i> imageOrigin(textures.size());
 				std::vector<int> newCamIndex(textures.size(), -1);
+				std::vector<int> texturesToLoad;
 				for(int t=0; t<(int)textures.size(); ++t)
 				{
 					if(materialsKept.at(t))
@@ -1673,74 +1724,129 @@ cv::Mat mergeTextures(
 						imageOrigin[t].y = v;
 						if(textures[t].first>=0)
 						{
-							cv::Mat image;
-							std::vector<CameraModel> models;
+							texturesToLoad.push_back(t);
+						}
+						else
+						{
+							emptyImage.copyTo(globalTextures(cv::Rect(u+indexMaterial*globalTextures.rows, v, emptyImage.cols, emptyImage.rows)));
+						}
+						++oi;
+					}
+				}
+
+				// Source images are decoded on demand by batches: compressed data
+				// is fetched serially (Memory and DBDriver are not reentrant), then
+				// decoded and resized in parallel. Decoded images are kept in a small
+				// LRU cache so that sub-cameras of the same node are decoded once.
+#ifdef _OPENMP
+				const int batchSize = 2*omp_get_max_threads();
+#else
+				const int batchSize = 1;
+#endif
+				TextureImageCache cache(batchSize);
+				for(int batchStart=0; batchStart<(int)texturesToLoad.size(); batchStart+=batchSize)
+				{
+					int batchEnd = std::min(batchStart+batchSize, (int)texturesToLoad.size());
 
-							if(textures[t].first == previousTextureId)
+					std::map<int, TextureImageCache::Entry> batchImages;
+					std::vector<int> idsToDecode;
+					std::vector<TextureImageCache::Entry> entriesToDecode;
+					for(int k=batchStart; k<batchEnd; ++k)
+					{
+						int id = textures[texturesToLoad[k]].first;
+						if(batchImages.find(id) != batchImages.end())
+						{
+							continue;
+						}
+						TextureImageCache::Entry entry;
+						if(cache.get(id, entry))
+						{
+							batchImages.insert(std::make_pair(id, entry));
+						}
+						else if(std::find(idsToDecode.begin(), idsToDecode.end(), id) == idsToDecode.end())
+						{
+							if(images.find(id) != images.end() &&
+								!images.find(id)->second.empty() &&
+								calibrations.find(id) != calibrations.end())
 							{
-								image = previousImage;
-								models = previousCameraModels;
+								entry.image = images.find(id)->second;
+								entry.models = calibrations.find(id)->second;
 							}
-							else
+							else if(memory)
 							{
-								if(images.find(textures[t].first) != images.end() &&
-									!images.find(textures[t].first)->second.empty() &&
-									calibrations.find(textures[t].first) != calibrations.end())
-								{
-									image = images.find(textures[t].first)->second;
-									if(image.rows == 1 && image.type() == CV_8UC1)
-									{
-										image = uncompressImage(image);
-									}
-									models = calibrations.find(textures[t].first)->second;
-								}
-								else if(memory)
-								{
-									SensorData data = memory->getNodeData(textures[t].first, true, false, false, false);
-									models = data.cameraModels();
-									data.uncompressDataConst(&image, 0);
-								}
-								else if(dbDriver)
-								{
-									SensorData data;
-									dbDriver->getNodeData(textures[t].first, data, true, false, false, false);
-									data.uncompressDataConst(&image, 0);
-									StereoCameraModel stereoModel;
-									dbDriver->getCalibration(textures[t].first, models, stereoModel);
-								}
-
-								previousImage = image;
-								previousCameraModels = models;
-								previousTextureId = textures[t].first;
+								entry.data = memory->getNodeData(id, true, false, false, false);
+								entry.models = entry.data.cameraModels();
 							}
-
-							UASSERT(!image.empty());
-
-							if(textures[t].second>=0)
+							else if(dbDriver)
 							{
-								UASSERT(textures[t].second < (int)models.size());
-								int width = image.cols/models.size();
-								image = image.colRange(width*textures[t].second, width*(textures[t].second+1));
+								dbDriver->getNodeData(id, entry.data, true, false, false, false);
+								StereoCameraModel stereoModel;
+								dbDriver->getCalibration(id, entry.models, stereoModel);
 							}
+							idsToDecode.push_back(id);
+							entriesToDecode.push_back(entry);
+						}
+					}
 
-							cv::Mat resizedImage;
-							cv::resize(image, resizedImage, emptyImage.size(), 0.0f, 0.0f, cv::INTER_AREA);
-							UASSERT(resizedImage.type() == CV_8UC1 || resizedImage.type() == CV_8UC3);
-							if(resizedImage.type() == CV_8UC1)
-							{
-								cv::Mat resizedImageColor;
-								cv::cvtColor(resizedImage, resizedImageColor, CV_GRAY2BGR);
-								resizedImage = resizedImageColor;
-							}
-							UASSERT(resizedImage.type() == globalTextures.type());
-							resizedImage.copyTo(globalTextures(cv::Rect(u+indexMaterial*globalTextures.rows, v, resizedImage.cols, resizedImage.rows)));
-							emptyImageMask.copyTo(globalTextureMasks(cv::Rect(u+indexMaterial*globalTextureMasks.rows, v, resizedImage.cols, resizedImage.rows)));
+					#pragma omp parallel for schedule(dynamic)
+					for(int k=0; k<(int)entriesToDecode.size(); ++k)
+					{
+						TextureImageCache::Entry & entry = entriesToDecode[k];
+						if(entry.image.empty())
+						{
+							entry.data.uncompressDataConst(&entry.image, 0);
 						}
-						else
+						else if(entry.image.rows == 1 && entry.image.type() == CV_8UC1)
 						{
-							emptyImage.copyTo(globalTextures(cv::Rect(u+indexMaterial*globalTextures.rows, v, emptyImage.cols, emptyImage.rows)));
+							entry.image = uncompressImage(entry.image);
+						}
+						entry.data = SensorData(); // free compressed data
+					}
+					for(size_t k=0; k<idsToDecode.size(); ++k)
+					{
+						UASSERT_MSG(!entriesToDecode[k].image.empty(), uFormat("Image of node %d cannot be loaded", idsToDecode[k]).c_str());
+						cache.add(idsToDecode[k], entriesToDecode[k]);
+						batchImages.insert(std::make_pair(idsToDecode[k], entriesToDecode[k]));
+					}
+
+					for(int k=batchStart; k<batchEnd; ++k)
+					{
+						int t = texturesToLoad[k];
+						UASSERT(textures[t].second < (int)batchImages.at(textures[t].first).models.size());
+					}
+
+					#pragma omp parallel for schedule(dynamic)
+					for(int k=batchStart; k<batchEnd; ++k)
+					{
+						int t = texturesToLoad[k];
+						int indexMaterial = newCamIndex[t] / (cols*rows);
+						int u = imageOrigin[t].x;
+						int v = imageOrigin[t].y;
+						const TextureImageCache::Entry & entry = batchImages.at(textures[t].first);
+						cv::Mat image = entry.image;
+						const std::vector<CameraModel> & models = entry.models;
+
+						if(textures[t].second>=0)
+						{
+							int width = image.cols/models.size();
+							image = image.colRange(width*textures[t].second, width*(textures[t].second+1));
+						}
+
+						cv::Mat resizedImage;
+						cv::resize(image, resizedImage, emptyImage.size(), 0.0f, 0.0f, cv::INTER_AREA);
+						UASSERT(resizedImage.type() == CV_8UC1 || resizedImage.type() == CV_8UC3);
+						if(resizedImage.type() == CV_8UC1)
+						{
+							cv::Mat resizedImageColor;
+							cv::cvtColor(resizedImage, resizedImageColor, CV_GRAY2BGR);
+							resizedImage = resizedImageColor;
+						}
+						UASSERT(resizedImage.type() == globalTextures.type());
+						resizedImage.copyTo(globalTextures(cv::Rect(u+indexMaterial*globalTextures.rows, v, resizedImage.cols, resizedImage.rows)));
+						if(!globalTextureMasks.empty())
+						{
+							emptyImageMask.copyTo(globalTextureMasks(cv::Rect(u+indexMaterial*globalTextureMasks.rows, v, resizedImage.cols, resizedImage.rows)));
 						}
-						++oi;
 					}
 
 					if(state)
@@ -1749,7 +1855,7 @@ cv::Mat mergeTextures(
 						{
 							return cv::Mat();
 						}
-						state->callback(uFormat("Assembled texture %d/%d.", t+1, (int)textures.size()));
+						state->callback(uFormat("Assembled texture %d/%d.", texturesToLoad[batchEnd-1]+1, (int)textures.size()));
 					}
 				}
 
@@ -1878,11 +1984,17 @@ cv::Mat mergeTextures(
 						}
 
 						cv::Mat_<double> gainsGray, gainsR, gainsG, gainsB;
-						cv::solve(A, b, gainsGray);
-
-						cv::solve(AR, b, gainsR);
-						cv::solve(AG, b, gainsG);
-						cv::solve(AB, b, gainsB);
+						#pragma omp parallel sections
+						{
+							#pragma omp section
+							cv::solve(A, b, gainsGray);
+							#pragma omp section
+							cv::solve(AR, b, gainsR);
+							#pragma omp section
+							cv::solve(AG, b, gainsG);
+							#pragma omp section
+							cv::solve(AB, b, gainsB);
+						}
 
 						cv::Mat_<double> gains(gainsGray.rows, 4);
 						gainsGray.copyTo(gains.col(0));
@@ -1890,9 +2002,10 @@ cv::Mat mergeTextures(
 						gainsG.copyTo(gains.col(2));
 						gainsB.copyTo(gains.col(3));
 
+						// each texture has its own area in the atlas
+						#pragma omp parallel for schedule(dynamic)
 						for(int t=0; t<(int)textures.size(); ++t)
 						{
-							//break;
 							if(materialsKept.at(t))
 							{
 								int u = imageOrigin[t].x;
@@ -1912,7 +2025,13 @@ cv::Mat mergeTextures(
 								cv::multiply(channels[2], gains(newCamIndex[t], gainRGB?1:0), channels[2]);
 
 								cv::merge(channels, roi);
-
+							}
+						}
+						for(int t=0; t<(int)textures.size(); ++t)
+						{
+							//break;
+							if(materialsKept.at(t))
+							{
 								if(gainsOut)
 								{
 									cv::Vec4d g(
@@ -2091,35 +2210,32 @@ cv::Mat mergeTextures(
 							}
 						}
 
+						// Apply the blending gains by strips of rows, in parallel across
+						// pages, so that full resolution gains of a page are never allocated.
+						// A margin of two decimated rows is kept around each strip so that the
+						// bilinear interpolation is the same than when resizing the whole page.
 						for(int i=0; i<materials; ++i)
 						{
-							/*std::vector<cv::Mat> channels;
-							cv::split(blendGains, channels);
-							cv::Mat img;
-							channels[0].convertTo(img,CV_8U,128.0,0);
-							cv::imwrite("blendSmallB.png", img);
-							channels[1].convertTo(img,CV_8U,128.0,0);
-							cv::imwrite("blendSmallG.png", img);
-							channels[2].convertTo(img,CV_8U,128.0,0);
-							cv::imwrite("blendSmallR.png", img);*/
-
-							cv::Mat globalTexturesROI = globalTextures(cv::Range::all(), cv::Range(i*globalTextures.rows, (i+1)*globalTextures.rows));
 							cv::Mat dst;
 							cv::blur(blendGains[i], dst, cv::Size(3,3));
-							cv::resize(dst, blendGains[i], globalTexturesROI.size(), 0, 0, cv::INTER_LINEAR);
-
-							/*cv::split(blendGains, channels);
-							channels[0].convertTo(img,CV_8U,128.0,0);
-							cv::imwrite("blendFullB.png", img);
-							channels[1].convertTo(img,CV_8U,128.0,0);
-							cv::imwrite("blendFullG.png", img);
-							channels[2].convertTo(img,CV_8U,128.0,0);
-							cv::imwrite("blendFullR.png", img);*/
+							blendGains[i] = dst;
+						}
+						const int stripRows = decimation * std::max(1, 256/decimation);
+						const int stripsPerPage = (globalTextures.rows + stripRows - 1) / stripRows;
+						#pragma omp parallel for schedule(dynamic)
+						for(int s=0; s<materials*stripsPerPage; ++s)
+						{
+							int i = s / stripsPerPage;
+							int rowStart = (s % stripsPerPage) * stripRows;
+							int rowEnd = std::min(rowStart + stripRows, globalTextures.rows);
+							int gainStart = std::max(0, rowStart/decimation - 2);
+							int gainEnd = std::min(blendGains[i].rows, rowEnd/decimation + 2);
 
-							cv::multiply(globalTexturesROI, blendGains[i], globalTexturesROI, 1.0, CV_8UC3);
+							cv::Mat stripGains;
+							cv::resize(blendGains[i].rowRange(gainStart, gainEnd), stripGains, cv::Size(globalTextures.rows, (gainEnd-gainStart)*decimation), 0, 0, cv::INTER_LINEAR);
 
-							//UWARN("Saving blending.png", globalTexture);
-							//cv::imwrite("blending.png", globalTexture);
+							cv::Mat globalTexturesROI = globalTextures(cv::Range(rowStart, rowEnd), cv::Range(i*globalTextures.rows, (i+1)*globalTextures.rows));
+							cv::multiply(globalTexturesROI, stripGains.rowRange(rowStart-gainStart*decimation, rowEnd-gainStart*decimation), globalTexturesROI, 1.0, CV_8UC3);
 						}
 
 						if(state) state->callback(uFormat("Blending (decimation=%d) %fs", decimation, timer.ticks()));
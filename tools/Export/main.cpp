@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/util3d_transforms.h>
 #include <rtabmap/core/util3d_surface.h>
 #include <rtabmap/core/util2d.h>
+#include <rtabmap/core/TSDFVolume.h>
 #include <rtabmap/core/optimizer/OptimizerG2O.h>
 #include <rtabmap/core/Graph.h>
 #include <rtabmap/utilite/UMath.h>
@@ -41,9 +42,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/filters/filter.h>
 #include <pcl/io/ply_io.h>
 #include <pcl/io/obj_io.h>
+#include <pcl/io/pcd_io.h>
 #include <pcl/common/common.h>
 #include <pcl/surface/poisson.h>
 #include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef RTABMAP_PDAL
 #include <rtabmap/core/PDALWriter.h>
@@ -60,6 +68,12 @@ void showUsage()
 			"    --output_dir \"\"       Output directory (default: same directory than the database).\n"
 			"    --bin                 Export PLY in binary format.\n"
 			"    --las                 Export cloud in LAS instead of PLY (PDAL dependency required).\n"
+			"    --pcd                 Export cloud in PCD instead of PLY.\n"
+			"    --stream              Streaming cloud export: nodes are loaded and processed in parallel by batches,\n"
+			"                            points are accumulated in a global voxel grid (--voxel) and written by chunks.\n"
+			"                            Memory stays bounded by the map volume instead of the number of nodes.\n"
+			"                            Not compatible with --mesh (unless --tsdf is used), --texture, --cam_projection and --save_in_db.\n"
+			"    --stream_batch  #     Number of nodes loaded and processed in parallel per batch with --stream (default 32).\n"
 			"    --mesh                Create a mesh.\n"
 			"    --texture             Create a mesh with texture.\n"
 			"    --texture_size  #     Texture size 1024, 2048, 4096, 8192, 16384 (default 8192).\n"
@@ -69,6 +83,8 @@ void showUsage()
 			"    --texture_d2c         Distance to camera policy.\n"
 			"    --cam_projection      Camera projection on assembled cloud and export node ID on each point (in PointSourceId field).\n"
 			"    --cam_projection_keep_all  Keep not colored points from cameras (node ID will be 0 and color will be red).\n"
+			"    --bench         #     Time the camera projection (--cam_projection is implied) over # runs with all\n"
+			"                            threads and with a single thread (serial path) on the same cloud, then export normally.\n"
 			"    --poses               Export optimized poses of the robot frame (e.g., base_link).\n"
 			"    --poses_camera        Export optimized poses of the camera frame (e.g., optical frame).\n"
 			"    --poses_scan          Export optimized poses of the scan frame.\n"
@@ -101,6 +117,12 @@ void showUsage()
 			"    --poisson_depth #     Set Poisson depth for mesh reconstruction.\n"
 			"    --poisson_size  #     Set target polygon size when computing Poisson's depth for mesh reconstruction (default 0.03 m).\n"
 			"    --max_polygons  #     Maximum polygons when creating a mesh (default 300000, set 0 for no limit).\n"
+			"    --tsdf                Create the mesh by TSDF integration of the depth images instead of Poisson reconstruction\n"
+			"                            (single mesh without duplicated surfaces, the depth images are not decimated).\n"
+			"    --tsdf_voxel    #     TSDF voxel size (default 0.01 m).\n"
+			"    --tsdf_trunc    #     TSDF truncation distance (default 0 m: 4 x tsdf_voxel).\n"
+			"    --tsdf_max_blocks #   Maximum TSDF blocks (8x8x8 voxels) kept in RAM, the farthest ones are meshed\n"
+			"                            and released (default 0=no limit).\n"
 			"    --max_range     #     Maximum range of the created clouds (default 4 m, 0 m with --scan).\n"
 			"    --decimation    #     Depth image decimation before creating the clouds (default 4, 1 with --scan).\n"
 			"    --voxel         #     Voxel size of the created clouds (default 0.01 m, 0 m with --scan).\n"
@@ -120,6 +142,572 @@ void showUsage()
 	exit(1);
 }
 
+template<typename PointT>
+void benchmarkCameraProjection(
+		const pcl::PointCloud<PointT> & cloud,
+		const std::map<int, Transform> & poses,
+		const std::map<int, std::vector<CameraModel> > & cameraModels,
+		float textureRange,
+		bool distanceToCamPolicy,
+		int iterations,
+		const std::vector<std::pair< std::pair<int, int>, pcl::PointXY> > & reference)
+{
+	UASSERT(iterations > 0);
+#ifdef _OPENMP
+	int threads = omp_get_max_threads();
+#else
+	int threads = 1;
+#endif
+	// 0=all threads, 1=serial
+	double times[2] = {0.0, 0.0};
+	bool identical[2] = {true, true};
+	for(int mode=0; mode<2; ++mode)
+	{
+#ifdef _OPENMP
+		omp_set_num_threads(mode==0?threads:1);
+#endif
+		for(int n=0; n<iterations; ++n)
+		{
+			UTimer timer;
+			std::vector<std::pair< std::pair<int, int>, pcl::PointXY> > pointToPixel = util3d::projectCloudToCameras(
+					cloud,
+					poses,
+					cameraModels,
+					textureRange,
+					0,
+					std::vector<float>(),
+					distanceToCamPolicy);
+			times[mode] += timer.ticks();
+			if(pointToPixel.size() != reference.size())
+			{
+				identical[mode] = false;
+			}
+			for(size_t i=0; identical[mode] && i<pointToPixel.size(); ++i)
+			{
+				identical[mode] = pointToPixel[i].first == reference[i].first &&
+						pointToPixel[i].second.x == reference[i].second.x &&
+						pointToPixel[i].second.y == reference[i].second.y;
+			}
+		}
+	}
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#endif
+	printf("Camera projection benchmark (%d points, %d poses, %d runs):\n", (int)cloud.size(), (int)poses.size(), iterations);
+	printf("   %d thread(s): %fs/run (result %s)\n", threads, times[0]/iterations, identical[0]?"identical":"DIFFERENT");
+	printf("   serial:       %fs/run (result %s)\n", times[1]/iterations, identical[1]?"identical":"DIFFERENT");
+	printf("   speedup:      %.2fx\n", times[0]>0.0?times[1]/times[0]:0.0);
+}
+
+void createNodeCloud(
+		SensorData & data,
+		const Transform & pose,
+		bool cloudFromScan,
+		bool uncompressScanImage,
+		bool uncompressScanDepth,
+		int decimation,
+		float maxRange,
+		float voxelSize,
+		float noiseRadius,
+		int noiseMinNeighbors,
+		cv::Mat & rgb,
+		cv::Mat & depth,
+		pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr & cloudWithNormals,
+		pcl::PointCloud<pcl::PointXYZINormal>::Ptr & cloudIWithNormals)
+{
+	pcl::IndicesPtr indices(new std::vector<int>);
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+	pcl::PointCloud<pcl::PointXYZI>::Ptr cloudI;
+	if(cloudFromScan)
+	{
+		cv::Mat tmpDepth;
+		LaserScan scan;
+		data.uncompressData(uncompressScanImage?&rgb:0, uncompressScanDepth&&!data.depthOrRightCompressed().empty()?&tmpDepth:0, &scan);
+		if(decimation>1 || maxRange)
+		{
+			scan = util3d::commonFiltering(scan, decimation, 0, maxRange);
+		}
+		if(scan.hasRGB())
+		{
+			cloud = util3d::laserScanToPointCloudRGB(scan, scan.localTransform());
+			if(noiseRadius>0.0f && noiseMinNeighbors>0)
+			{
+				indices = util3d::radiusFiltering(cloud, noiseRadius, noiseMinNeighbors);
+			}
+		}
+		else
+		{
+			cloudI = util3d::laserScanToPointCloudI(scan, scan.localTransform());
+			if(noiseRadius>0.0f && noiseMinNeighbors>0)
+			{
+				indices = util3d::radiusFiltering(cloudI, noiseRadius, noiseMinNeighbors);
+			}
+		}
+	}
+	else
+	{
+		data.uncompressData(&rgb, &depth);
+		cloud = util3d::cloudRGBFromSensorData(
+				data,
+				decimation,      // image decimation before creating the clouds
+				maxRange,        // maximum depth of the cloud
+				0.0f,
+				indices.get());
+		if(noiseRadius>0.0f && noiseMinNeighbors>0)
+		{
+			indices = util3d::radiusFiltering(cloud, indices, noiseRadius, noiseMinNeighbors);
+		}
+	}
+
+	if(voxelSize>0.0f)
+	{
+		if(cloud.get() && !cloud->empty())
+			cloud = rtabmap::util3d::voxelize(cloud, indices, voxelSize);
+		else if(cloudI.get() && !cloudI->empty())
+			cloudI = rtabmap::util3d::voxelize(cloudI, indices, voxelSize);
+	}
+	if(cloud.get() && !cloud->empty())
+		cloud = rtabmap::util3d::transformPointCloud(cloud, pose);
+	else if(cloudI.get() && !cloudI->empty())
+		cloudI = rtabmap::util3d::transformPointCloud(cloudI, pose);
+
+	Eigen::Vector3f viewpoint(pose.x(), pose.y(), pose.z());
+	if(cloud.get() && !cloud->empty())
+	{
+		pcl::PointCloud<pcl::Normal>::Ptr normals = rtabmap::util3d::computeNormals(cloud, 20, 0.0f, viewpoint);
+		cloudWithNormals.reset(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+		pcl::concatenateFields(*cloud, *normals, *cloudWithNormals);
+	}
+	else if(cloudI.get() && !cloudI->empty())
+	{
+		pcl::PointCloud<pcl::Normal>::Ptr normals = rtabmap::util3d::computeNormals(cloudI, 20, 0.0f, viewpoint);
+		cloudIWithNormals.reset(new pcl::PointCloud<pcl::PointXYZINormal>);
+		pcl::concatenateFields(*cloudI, *normals, *cloudIWithNormals);
+	}
+}
+
+bool exportNodeImages(
+		const std::string & outputDirectory,
+		const std::string & baseName,
+		const std::string & name,
+		const cv::Mat & rgb,
+		const cv::Mat & depth,
+		const std::vector<CameraModel> & models,
+		const StereoCameraModel & stereoModel)
+{
+	if(rgb.empty())
+	{
+		return false;
+	}
+	std::string dirSuffix = (depth.type() != CV_16UC1 && depth.type() != CV_32FC1 && !depth.empty())?"left":"rgb";
+	std::string dir = outputDirectory+"/"+baseName+"_"+dirSuffix;
+	if(!UDirectory::exists(dir)) {
+		UDirectory::makeDir(dir);
+	}
+	std::string outputPath=dir+"/"+name+".jpg";
+	cv::imwrite(outputPath, rgb);
+	if(!depth.empty())
+	{
+		std::string ext;
+		cv::Mat depthExported = depth;
+		if(depth.type() != CV_16UC1 && depth.type() != CV_32FC1)
+		{
+			ext = ".jpg";
+			dir = outputDirectory+"/"+baseName+"_right";
+		}
+		else
+		{
+			ext = ".png";
+			dir = outputDirectory+"/"+baseName+"_depth";
+			if(depth.type() == CV_32FC1)
+			{
+				depthExported = rtabmap::util2d::cvtDepthFromFloat(depth);
+			}
+		}
+		if(!UDirectory::exists(dir)) {
+			UDirectory::makeDir(dir);
+		}
+
+		outputPath=dir+"/"+name+ext;
+		cv::imwrite(outputPath, depthExported);
+	}
+
+	// save calibration per image (calibration can change over time, e.g. camera has auto focus)
+	for(size_t i=0; i<models.size(); ++i)
+	{
+		CameraModel model = models[i];
+		std::string modelName = name;
+		if(models.size() > 1) {
+			modelName += "_" + uNumber2Str((int)i);
+		}
+		model.setName(modelName);
+		std::string dir = outputDirectory+"/"+baseName+"_calib";
+		if(!UDirectory::exists(dir)) {
+			UDirectory::makeDir(dir);
+		}
+		model.save(dir);
+	}
+	if(stereoModel.isValidForProjection())
+	{
+		StereoCameraModel model = stereoModel;
+		model.setName(name, "left", "right");
+		std::string dir = outputDirectory+"/"+baseName+"_calib";
+		if(!UDirectory::exists(dir)) {
+			UDirectory::makeDir(dir);
+		}
+		model.save(dir);
+	}
+	return true;
+}
+
+void exportPosesFiles(
+		const std::string & outputDirectory,
+		const std::string & baseName,
+		int exportPosesFormat,
+		bool exportPoses,
+		bool exportPosesCamera,
+		bool exportPosesScan,
+		const std::map<int, Transform> & robotPoses,
+		const std::vector<std::map<int, Transform> > & cameraPoses,
+		const std::map<int, Transform> & scanPoses,
+		const std::multimap<int, Link> & links,
+		const std::map<int, double> & cameraStamps)
+{
+	std::string posesExt = (exportPosesFormat==3?"toro":exportPosesFormat==4?"g2o":"txt");
+	if(exportPoses)
+	{
+		std::string outputPath=outputDirectory+"/"+baseName+"_poses." + posesExt;
+		rtabmap::graph::exportPoses(outputPath, exportPosesFormat, robotPoses, links, cameraStamps);
+		printf("Poses exported to \"%s\".\n", outputPath.c_str());
+	}
+	if(exportPosesCamera)
+	{
+		for(size_t i=0; i<cameraPoses.size(); ++i)
+		{
+			std::string outputPath;
+			if(cameraPoses.size()==1)
+				outputPath = outputDirectory+"/"+baseName+"_camera_poses." + posesExt;
+			else
+				outputPath = outputDirectory+"/"+baseName+"_camera_poses_"+uNumber2Str((int)i)+"." + posesExt;
+			rtabmap::graph::exportPoses(outputPath, exportPosesFormat, cameraPoses[i], std::multimap<int, Link>(), cameraStamps);
+			printf("Camera poses exported to \"%s\".\n", outputPath.c_str());
+		}
+	}
+	if(exportPosesScan)
+	{
+		std::string outputPath=outputDirectory+"/"+baseName+"_scan_poses." + posesExt;
+		rtabmap::graph::exportPoses(outputPath, exportPosesFormat, scanPoses, std::multimap<int, Link>(), cameraStamps);
+		printf("Scan poses exported to \"%s\".\n", outputPath.c_str());
+	}
+}
+
+/**
+ * Point written by the streaming export (--stream). Color
+ * is used for RGB clouds, intensity for laser scans without color.
+ */
+struct StreamPoint
+{
+	float x, y, z;
+	float nx, ny, nz;
+	float intensity;
+	unsigned char r, g, b;
+};
+
+/**
+ * Writes a PLY or PCD file without keeping the points in memory. The
+ * points are appended by chunks to a temporary body file, then the
+ * header (which needs the final point count) is written on close().
+ */
+class StreamCloudWriter
+{
+public:
+	StreamCloudWriter(const std::string & path, bool pcd, bool binary, bool withIntensity) :
+		path_(path),
+		bodyPath_(path+".body"),
+		pcd_(pcd),
+		binary_(binary),
+		withIntensity_(withIntensity),
+		body_(0),
+		count_(0)
+	{
+		body_ = fopen(bodyPath_.c_str(), binary_?"wb":"w");
+		if(body_ == 0)
+		{
+			UERROR("Cannot open temporary file \"%s\"!", bodyPath_.c_str());
+		}
+	}
+	~StreamCloudWriter()
+	{
+		if(body_)
+		{
+			fclose(body_);
+			UFile::erase(bodyPath_);
+		}
+	}
+	bool isOpen() const {return body_ != 0;}
+	long count() const {return count_;}
+
+	void write(const std::vector<StreamPoint> & chunk)
+	{
+		UASSERT(body_ != 0);
+		for(size_t i=0; i<chunk.size(); ++i)
+		{
+			const StreamPoint & pt = chunk[i];
+			if(binary_)
+			{
+				float xyz[3] = {pt.x, pt.y, pt.z};
+				float n[3] = {pt.nx, pt.ny, pt.nz};
+				if(pcd_)
+				{
+					// FIELDS x y z (rgb|intensity) normal_x normal_y normal_z
+					fwrite(xyz, sizeof(float), 3, body_);
+					writeColorOrIntensity(pt);
+					fwrite(n, sizeof(float), 3, body_);
+				}
+				else
+				{
+					// PLY: x y z nx ny nz (red green blue|intensity)
+					fwrite(xyz, sizeof(float), 3, body_);
+					fwrite(n, sizeof(float), 3, body_);
+					writeColorOrIntensity(pt);
+				}
+			}
+			else if(pcd_)
+			{
+				if(withIntensity_)
+					fprintf(body_, "%f %f %f %f %f %f %f\n", pt.x, pt.y, pt.z, pt.intensity, pt.nx, pt.ny, pt.nz);
+				else
+					fprintf(body_, "%f %f %f %.9g %f %f %f\n", pt.x, pt.y, pt.z, packRGB(pt), pt.nx, pt.ny, pt.nz);
+			}
+			else
+			{
+				if(withIntensity_)
+					fprintf(body_, "%f %f %f %f %f %f %f\n", pt.x, pt.y, pt.z, pt.nx, pt.ny, pt.nz, pt.intensity);
+				else
+					fprintf(body_, "%f %f %f %f %f %f %d %d %d\n", pt.x, pt.y, pt.z, pt.nx, pt.ny, pt.nz, (int)pt.r, (int)pt.g, (int)pt.b);
+			}
+		}
+		count_ += chunk.size();
+	}
+
+	// Return false on failure
+	bool close()
+	{
+		UASSERT(body_ != 0);
+		fclose(body_);
+		body_ = 0;
+
+		FILE * out = fopen(path_.c_str(), "wb");
+		if(out == 0)
+		{
+			UERROR("Cannot open \"%s\"!", path_.c_str());
+			UFile::erase(bodyPath_);
+			return false;
+		}
+		if(pcd_)
+		{
+			fprintf(out, "# .PCD v0.7 - Point Cloud Data file format\n"
+					"VERSION 0.7\n"
+					"FIELDS x y z %s normal_x normal_y normal_z\n"
+					"SIZE 4 4 4 4 4 4 4\n"
+					"TYPE F F F F F F F\n"
+					"COUNT 1 1 1 1 1 1 1\n"
+					"WIDTH %ld\n"
+					"HEIGHT 1\n"
+					"VIEWPOINT 0 0 0 1 0 0 0\n"
+					"POINTS %ld\n"
+					"DATA %s\n",
+					withIntensity_?"intensity":"rgb",
+					count_,
+					count_,
+					binary_?"binary":"ascii");
+		}
+		else
+		{
+			fprintf(out, "ply\n"
+					"format %s 1.0\n"
+					"comment Exported by rtabmap-export (streaming)\n"
+					"element vertex %ld\n"
+					"property float x\n"
+					"property float y\n"
+					"property float z\n"
+					"property float nx\n"
+					"property float ny\n"
+					"property float nz\n",
+					binary_?"binary_little_endian":"ascii",
+					count_);
+			if(withIntensity_)
+			{
+				fprintf(out, "property float intensity\n");
+			}
+			else
+			{
+				fprintf(out, "property uchar red\n"
+						"property uchar green\n"
+						"property uchar blue\n");
+			}
+			fprintf(out, "end_header\n");
+		}
+
+		bool success = true;
+		FILE * body = fopen(bodyPath_.c_str(), "rb");
+		if(body)
+		{
+			std::vector<char> buffer(1<<20);
+			size_t read;
+			while((read = fread(buffer.data(), 1, buffer.size(), body)) > 0)
+			{
+				if(fwrite(buffer.data(), 1, read, out) != read)
+				{
+					UERROR("Failed writing \"%s\"!", path_.c_str());
+					success = false;
+					break;
+				}
+			}
+			fclose(body);
+		}
+		else
+		{
+			UERROR("Cannot read temporary file \"%s\"!", bodyPath_.c_str());
+			success = false;
+		}
+		fclose(out);
+		UFile::erase(bodyPath_);
+		return success;
+	}
+
+private:
+	// Like PCL, the PCD rgb field is a float holding the packed color bits
+	static float packRGB(const StreamPoint & pt)
+	{
+		unsigned int rgb = pt.r<<16 | pt.g<<8 | pt.b;
+		float rgbf;
+		memcpy(&rgbf, &rgb, sizeof(float));
+		return rgbf;
+	}
+
+	void writeColorOrIntensity(const StreamPoint & pt)
+	{
+		if(withIntensity_)
+		{
+			fwrite(&pt.intensity, sizeof(float), 1, body_);
+		}
+		else if(pcd_)
+		{
+			float rgb = packRGB(pt);
+			fwrite(&rgb, sizeof(float), 1, body_);
+		}
+		else
+		{
+			unsigned char rgb[3] = {pt.r, pt.g, pt.b};
+			fwrite(rgb, 1, 3, body_);
+		}
+	}
+
+private:
+	std::string path_;
+	std::string bodyPath_;
+	bool pcd_;
+	bool binary_;
+	bool withIntensity_;
+	FILE * body_;
+	long count_;
+};
+
+/**
+ * Global voxel grid of the streaming export. Only one averaged
+ * point per occupied voxel is kept, so memory depends on the
+ * volume covered by the map and not on the number of nodes.
+ */
+class StreamVoxelMap
+{
+public:
+	StreamVoxelMap(float voxelSize) :
+		voxelSize_(voxelSize),
+		outOfBounds_(0)
+	{
+		UASSERT(voxelSize_ > 0.0f);
+	}
+
+	void add(const StreamPoint & pt)
+	{
+		// 21 bits per axis
+		static const long long offset = 1<<20;
+		long long ix = (long long)std::floor(pt.x/voxelSize_) + offset;
+		long long iy = (long long)std::floor(pt.y/voxelSize_) + offset;
+		long long iz = (long long)std::floor(pt.z/voxelSize_) + offset;
+		if(ix < 0 || iy < 0 || iz < 0 || ix >= 2*offset || iy >= 2*offset || iz >= 2*offset)
+		{
+			++outOfBounds_;
+			return;
+		}
+		unsigned long long key = (unsigned long long)ix<<42 | (unsigned long long)iy<<21 | (unsigned long long)iz;
+		Cell & cell = cells_[key];
+		cell.x += pt.x;
+		cell.y += pt.y;
+		cell.z += pt.z;
+		cell.nx += pt.nx;
+		cell.ny += pt.ny;
+		cell.nz += pt.nz;
+		cell.intensity += pt.intensity;
+		cell.r += pt.r;
+		cell.g += pt.g;
+		cell.b += pt.b;
+		++cell.count;
+	}
+
+	size_t size() const {return cells_.size();}
+	long outOfBounds() const {return outOfBounds_;}
+
+	// Write all voxels by chunks and clear the map.
+	void flush(StreamCloudWriter & writer, size_t chunkSize)
+	{
+		std::vector<StreamPoint> chunk;
+		chunk.reserve(chunkSize);
+		for(std::unordered_map<unsigned long long, Cell>::iterator iter=cells_.begin(); iter!=cells_.end(); iter=cells_.erase(iter))
+		{
+			const Cell & cell = iter->second;
+			StreamPoint pt;
+			float n = float(cell.count);
+			pt.x = cell.x/n;
+			pt.y = cell.y/n;
+			pt.z = cell.z/n;
+			float norm = std::sqrt(cell.nx*cell.nx + cell.ny*cell.ny + cell.nz*cell.nz);
+			pt.nx = norm>0.0f?cell.nx/norm:0.0f;
+			pt.ny = norm>0.0f?cell.ny/norm:0.0f;
+			pt.nz = norm>0.0f?cell.nz/norm:0.0f;
+			pt.intensity = cell.intensity/n;
+			pt.r = (unsigned char)(cell.r/n);
+			pt.g = (unsigned char)(cell.g/n);
+			pt.b = (unsigned char)(cell.b/n);
+			chunk.push_back(pt);
+			if(chunk.size() >= chunkSize)
+			{
+				writer.write(chunk);
+				chunk.clear();
+			}
+		}
+		if(!chunk.empty())
+		{
+			writer.write(chunk);
+		}
+	}
+
+private:
+	struct Cell
+	{
+		Cell() : x(0), y(0), z(0), nx(0), ny(0), nz(0), intensity(0), r(0), g(0), b(0), count(0) {}
+		float x, y, z;
+		float nx, ny, nz;
+		float intensity;
+		float r, g, b;
+		int count;
+	};
+	float voxelSize_;
+	long outOfBounds_;
+	std::unordered_map<unsigned long long, Cell> cells_;
+};
+
 int main(int argc, char * argv[])
 {
 	ULogger::setType(ULogger::kTypeConsole);
@@ -132,6 +720,9 @@ int main(int argc, char * argv[])
 
 	bool binary = false;
 	bool las = false;
+	bool pcd = false;
+	bool stream = false;
+	int streamBatch = 32;
 	bool mesh = false;
 	bool texture = false;
 	bool ba = false;
@@ -142,6 +733,10 @@ int main(int argc, char * argv[])
 	int poissonDepth = 0;
 	float poissonSize = 0.03;
 	int maxPolygons = 300000;
+	bool tsdf = false;
+	float tsdfVoxel = 0.01f;
+	float tsdfTrunc = 0.0f;
+	int tsdfMaxBlocks = 0;
 	int decimation = -1;
 	float maxRange = -1.0f;
 	float voxelSize = -1.0f;
@@ -168,6 +763,7 @@ int main(int argc, char * argv[])
 	int highBrightnessGain = 10;
 	bool camProjection = false;
 	bool camProjectionKeepAll = false;
+	int camProjectionBench = 0;
 	bool exportPoses = false;
 	bool exportPosesCamera = false;
 	bool exportPosesScan = false;
@@ -220,6 +816,27 @@ int main(int argc, char * argv[])
 #endif
 
 		}
+		else if(std::strcmp(argv[i], "--pcd") == 0)
+		{
+			pcd = true;
+		}
+		else if(std::strcmp(argv[i], "--stream") == 0)
+		{
+			stream = true;
+		}
+		else if(std::strcmp(argv[i], "--stream_batch") == 0)
+		{
+			++i;
+			if(i<argc-1)
+			{
+				streamBatch = uStr2Int(argv[i]);
+				UASSERT(streamBatch>0);
+			}
+			else
+			{
+				showUsage();
+			}
+		}
 		else if(std::strcmp(argv[i], "--mesh") == 0)
 		{
 			mesh = true;
@@ -289,6 +906,20 @@ int main(int argc, char * argv[])
 		{
 			camProjectionKeepAll = true;
 		}
+		else if(std::strcmp(argv[i], "--bench") == 0)
+		{
+			++i;
+			if(i<argc-1)
+			{
+				camProjectionBench = uStr2Int(argv[i]);
+				UASSERT(camProjectionBench>=0);
+				camProjection = true;
+			}
+			else
+			{
+				showUsage();
+			}
+		}
 		else if(std::strcmp(argv[i], "--poses") == 0)
 		{
 			exportPoses = true;
@@ -444,6 +1075,46 @@ int main(int argc, char * argv[])
 				showUsage();
 			}
 		}
+		else if(std::strcmp(argv[i], "--tsdf") == 0)
+		{
+			tsdf = true;
+		}
+		else if(std::strcmp(argv[i], "--tsdf_voxel") == 0)
+		{
+			++i;
+			if(i<argc-1)
+			{
+				tsdfVoxel = uStr2Float(argv[i]);
+			}
+			else
+			{
+				showUsage();
+			}
+		}
+		else if(std::strcmp(argv[i], "--tsdf_trunc") == 0)
+		{
+			++i;
+			if(i<argc-1)
+			{
+				tsdfTrunc = uStr2Float(argv[i]);
+			}
+			else
+			{
+				showUsage();
+			}
+		}
+		else if(std::strcmp(argv[i], "--tsdf_max_blocks") == 0)
+		{
+			++i;
+			if(i<argc-1)
+			{
+				tsdfMaxBlocks = uStr2Int(argv[i]);
+			}
+			else
+			{
+				showUsage();
+			}
+		}
 		else if(std::strcmp(argv[i], "--poisson_depth") == 0)
 		{
 			++i;
@@ -689,6 +1360,23 @@ int main(int argc, char * argv[])
 		}
 	}
 
+	if(tsdf && cloudFromScan)
+	{
+		printf("Option --tsdf requires depth images and is not supported with --scan option, disabling TSDF...\n");
+		tsdf = false;
+	}
+	if(tsdf && tsdfVoxel <= 0.0f)
+	{
+		printf("Option --tsdf_voxel should be > 0, using 0.01 m...\n");
+		tsdfVoxel = 0.01f;
+	}
+
+	if(stream && ((mesh && !tsdf) || texture || camProjection || saveInDb))
+	{
+		printf("Options --mesh (without --tsdf), --texture, --cam_projection and --save_in_db are not supported with --stream option, disabling streaming...\n");
+		stream = false;
+	}
+
 	ParametersMap params = Parameters::parseArguments(argc, argv, false);
 
 	std::string dbPath = argv[argc-1];
@@ -733,7 +1421,8 @@ int main(int argc, char * argv[])
 	std::map<int, Transform> optimizedPoses;
 	std::multimap<int, Link> links;
 	printf("Optimizing the map...\n");
-	rtabmap.getGraph(optimizedPoses, links, true, true, &nodes, true, true, true, true);
+	// With --stream, sensor data is loaded only when the node is processed
+	rtabmap.getGraph(optimizedPoses, links, true, true, &nodes, !stream, !stream, !stream, !stream, !stream || ba, !stream);
 	printf("Optimizing the map... done (%fs, poses=%d).\n", timer.ticks(), (int)optimizedPoses.size());
 
 	if(optimizedPoses.empty())
@@ -794,158 +1483,356 @@ int main(int argc, char * argv[])
 		printf("Global bundle adjustment... done (%fs).\n", timer.ticks());
 	}
 
-	// Construct the cloud
-	printf("Create and assemble the clouds...\n");
-	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr mergedClouds(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-	pcl::PointCloud<pcl::PointXYZINormal>::Ptr mergedCloudsI(new pcl::PointCloud<pcl::PointXYZINormal>);
-	std::map<int, rtabmap::Transform> robotPoses;
-	std::vector<std::map<int, rtabmap::Transform> > cameraPoses;
-	std::map<int, rtabmap::Transform> scanPoses;
-	std::map<int, double> cameraStamps;
-	std::map<int, std::vector<rtabmap::CameraModel> > cameraModels;
-	std::map<int, cv::Mat> cameraDepths;
-	int imagesExported = 0;
-	for(std::map<int, Transform>::iterator iter=optimizedPoses.lower_bound(1); iter!=optimizedPoses.end(); ++iter)
+	if(stream)
 	{
-		Signature node = nodes.find(iter->first)->second;
+		// Streaming export: nodes are loaded by batches, their clouds are
+		// created in parallel, then merged in a global voxel grid.
+		std::string ext = las?"las":pcd?"pcd":"ply";
+		std::string outputPath=outputDirectory+"/"+baseName+"_cloud."+ext;
+		if(las && voxelSize<=0.0f)
+		{
+			printf("Option --las requires --voxel > 0 with --stream option, exporting in PLY...\n");
+			las = false;
+			outputPath=outputDirectory+"/"+baseName+"_cloud.ply";
+		}
+		std::string tmpPath = las?outputDirectory+"/"+baseName+"_cloud_tmp.ply":outputPath;
+		printf("Streaming export to \"%s\" (batch=%d, voxel=%f)...\n", outputPath.c_str(), streamBatch, voxelSize);
 
-		// uncompress data
-		std::vector<CameraModel> models = node.sensorData().cameraModels();
-		cv::Mat rgb;
-		cv::Mat depth;
+		std::map<int, rtabmap::Transform> robotPoses;
+		std::vector<std::map<int, rtabmap::Transform> > cameraPoses;
+		std::map<int, rtabmap::Transform> scanPoses;
+		std::map<int, double> cameraStamps;
+		int imagesExported = 0;
+		bool loadImages = !cloudFromScan || exportImages || exportPosesCamera;
 
-		pcl::IndicesPtr indices(new std::vector<int>);
-		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
-		pcl::PointCloud<pcl::PointXYZI>::Ptr cloudI;
-		if(cloudFromScan)
+		StreamVoxelMap * voxelMap = voxelSize>0.0f?new StreamVoxelMap(voxelSize):0;
+		StreamCloudWriter * writer = 0;
+		bool withIntensity = false;
+		int mixedNodes = 0; // nodes with a cloud of the other type than the written one
+		const size_t chunkSize = 100000;
+		std::vector<StreamPoint> chunk;
+		TSDFVolume * tsdfVolume = mesh && tsdf?new TSDFVolume(tsdfVoxel, tsdfTrunc, maxRange, tsdfMaxBlocks):0;
+
+		std::vector<int> ids;
+		for(std::map<int, Transform>::iterator iter=optimizedPoses.lower_bound(1); iter!=optimizedPoses.end(); ++iter)
+		{
+			ids.push_back(iter->first);
+		}
+		for(size_t b=0; b<ids.size(); b+=streamBatch)
 		{
-			cv::Mat tmpDepth;
-			LaserScan scan;
-			node.sensorData().uncompressData(exportImages?&rgb:0, (texture||exportImages)&&!node.sensorData().depthOrRightCompressed().empty()?&tmpDepth:0, &scan);
-			if(decimation>1 || maxRange)
+			int batchSize = (int)std::min(ids.size()-b, (size_t)streamBatch);
+			std::vector<SensorData> batchData(batchSize);
+			for(int i=0; i<batchSize; ++i)
 			{
-				scan = util3d::commonFiltering(scan, decimation, 0, maxRange);
+				// database access is serialized
+				batchData[i] = rtabmap.getMemory()->getNodeData(ids[b+i], loadImages, cloudFromScan || exportPosesScan, false, false);
 			}
-			if(scan.hasRGB())
-			{
-				cloud = util3d::laserScanToPointCloudRGB(scan, scan.localTransform());
-				if(noiseRadius>0.0f && noiseMinNeighbors>0)
+
+			std::vector<cv::Mat> batchRgb(batchSize);
+			std::vector<cv::Mat> batchDepth(batchSize);
+			std::vector<pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr> batchClouds(batchSize);
+			std::vector<pcl::PointCloud<pcl::PointXYZINormal>::Ptr> batchCloudsI(batchSize);
+			#pragma omp parallel for
+			for(int i=0; i<batchSize; ++i)
+			{
+				createNodeCloud(
+						batchData[i],
+						optimizedPoses.at(ids[b+i]),
+						cloudFromScan,
+						exportImages,
+						exportImages,
+						decimation,
+						maxRange,
+						voxelSize,
+						noiseRadius,
+						noiseMinNeighbors,
+						batchRgb[i],
+						batchDepth[i],
+						batchClouds[i],
+						batchCloudsI[i]);
+			}
+
+			for(int i=0; i<batchSize; ++i)
+			{
+				int id = ids[b+i];
+				const Transform & pose = optimizedPoses.at(id);
+				const Signature & node = nodes.at(id);
+				std::vector<CameraModel> models = batchData[i].cameraModels();
+				if(exportImages && exportNodeImages(
+						outputDirectory,
+						baseName,
+						exportImagesId?uNumber2Str(id):uFormat("%f",node.getStamp()),
+						batchRgb[i],
+						batchDepth[i],
+						models,
+						batchData[i].stereoCameraModel()))
 				{
-					indices = util3d::radiusFiltering(cloud, noiseRadius, noiseMinNeighbors);
+					++imagesExported;
 				}
-			}
-			else
-			{
-				cloudI = util3d::laserScanToPointCloudI(scan, scan.localTransform());
-				if(noiseRadius>0.0f && noiseMinNeighbors>0)
+
+				if(tsdfVolume)
+				{
+					// parallelized over the voxel blocks
+					tsdfVolume->integrate(batchData[i], pose);
+				}
+
+				if(writer == 0 && ((batchClouds[i].get() && !batchClouds[i]->empty()) || (batchCloudsI[i].get() && !batchCloudsI[i]->empty())))
+				{
+					withIntensity = !batchClouds[i].get() || batchClouds[i]->empty();
+					writer = new StreamCloudWriter(tmpPath, !las && pcd, las || binary, withIntensity);
+					if(!writer->isOpen())
+					{
+						delete writer;
+						delete voxelMap;
+						delete tsdfVolume;
+						return -1;
+					}
+				}
+				// The file has either color or intensity, clouds of the other
+				// type are written with zero intensity or black color
+				if(batchClouds[i].get() && !batchClouds[i]->empty())
+				{
+					if(withIntensity)
+					{
+						++mixedNodes;
+					}
+					for(size_t j=0; j<batchClouds[i]->size(); ++j)
+					{
+						const pcl::PointXYZRGBNormal & p = batchClouds[i]->at(j);
+						StreamPoint pt = {p.x, p.y, p.z, p.normal_x, p.normal_y, p.normal_z, 0.0f, p.r, p.g, p.b};
+						if(voxelMap)
+							voxelMap->add(pt);
+						else
+							chunk.push_back(pt);
+					}
+				}
+				else if(batchCloudsI[i].get() && !batchCloudsI[i]->empty())
 				{
-					indices = util3d::radiusFiltering(cloudI, noiseRadius, noiseMinNeighbors);
+					if(!withIntensity)
+					{
+						++mixedNodes;
+					}
+					for(size_t j=0; j<batchCloudsI[i]->size(); ++j)
+					{
+						const pcl::PointXYZINormal & p = batchCloudsI[i]->at(j);
+						StreamPoint pt = {p.x, p.y, p.z, p.normal_x, p.normal_y, p.normal_z, p.intensity, 0, 0, 0};
+						if(voxelMap)
+							voxelMap->add(pt);
+						else
+							chunk.push_back(pt);
+					}
+				}
+				if(writer && chunk.size() >= chunkSize)
+				{
+					writer->write(chunk);
+					chunk.clear();
+				}
+
+				if(models.empty() && batchData[i].stereoCameraModel().isValidForProjection())
+				{
+					models.push_back(batchData[i].stereoCameraModel().left());
+				}
+				robotPoses.insert(std::make_pair(id, pose));
+				cameraStamps.insert(std::make_pair(id, node.getStamp()));
+				if(exportPosesCamera && !models.empty())
+				{
+					if(cameraPoses.empty())
+					{
+						cameraPoses.resize(models.size());
+					}
+					UASSERT_MSG(models.size() == cameraPoses.size(), "Not all nodes have same number of cameras to export camera poses.");
+					for(size_t j=0; j<models.size(); ++j)
+					{
+						cameraPoses[j].insert(std::make_pair(id, pose*models[j].localTransform()));
+					}
+				}
+				if(exportPosesScan && !batchData[i].laserScanCompressed().empty())
+				{
+					scanPoses.insert(std::make_pair(id, pose*batchData[i].laserScanCompressed().localTransform()));
 				}
 			}
+			printf("Processed %d/%d nodes (%s=%d)\n",
+					int(b+batchSize),
+					(int)ids.size(),
+					voxelMap?"voxels":"points",
+					voxelMap?(int)voxelMap->size():int(writer?writer->count()+chunk.size():0));
 		}
-		else
+		printf("Create and assemble the clouds... done (%fs).\n", timer.ticks());
+		if(mixedNodes>0)
 		{
-			node.sensorData().uncompressData(&rgb, &depth);
-			cloud = util3d::cloudRGBFromSensorData(
-					node.sensorData(),
-					decimation,      // image decimation before creating the clouds
-					maxRange,        // maximum depth of the cloud
-					0.0f,
-					indices.get());
-			if(noiseRadius>0.0f && noiseMinNeighbors>0)
-			{
-				indices = util3d::radiusFiltering(cloud, indices, noiseRadius, noiseMinNeighbors);
-			}
+			printf("Warning: %d nodes have %s clouds while the exported cloud has %s, their points are exported with %s.\n",
+					mixedNodes,
+					withIntensity?"RGB":"intensity",
+					withIntensity?"intensity":"RGB",
+					withIntensity?"zero intensity":"black color");
 		}
 
-		if(exportImages && !rgb.empty())
+		if(imagesExported>0)
+			printf("%d images exported!\n", imagesExported);
+
+		int status = 0;
+		if(writer)
 		{
-			std::string dirSuffix = (depth.type() != CV_16UC1 && depth.type() != CV_32FC1 && !depth.empty())?"left":"rgb";
-			std::string dir = outputDirectory+"/"+baseName+"_"+dirSuffix;
-			if(!UDirectory::exists(dir)) {
-				UDirectory::makeDir(dir);
-			}
-			std::string outputPath=dir+"/"+(exportImagesId?uNumber2Str(iter->first):uFormat("%f",node.getStamp()))+".jpg";
-			cv::imwrite(outputPath, rgb);
-			++imagesExported;
-			if(!depth.empty())
+			if(voxelMap)
 			{
-				std::string ext;
-				cv::Mat depthExported = depth;
-				if(depth.type() != CV_16UC1 && depth.type() != CV_32FC1)
+				if(voxelMap->outOfBounds())
 				{
-					ext = ".jpg";
-					dir = outputDirectory+"/"+baseName+"_right";
+					printf("%ld points ignored (outside voxel grid bounds).\n", voxelMap->outOfBounds());
 				}
-				else
+				voxelMap->flush(*writer, chunkSize);
+			}
+			else if(!chunk.empty())
+			{
+				writer->write(chunk);
+				chunk.clear();
+			}
+			long count = writer->count();
+			if(writer->close())
+			{
+#ifdef RTABMAP_PDAL
+				if(las)
 				{
-					ext = ".png";
-					dir = outputDirectory+"/"+baseName+"_depth";
-					if(depth.type() == CV_32FC1)
+					// PDAL needs the full cloud, the voxel grid bounds its size
+					if(withIntensity)
 					{
-						depthExported = rtabmap::util2d::cvtDepthFromFloat(depth);
+						pcl::PointCloud<pcl::PointXYZINormal> cloud;
+						pcl::io::loadPLYFile(tmpPath, cloud);
+						savePDALFile(outputPath, cloud, std::vector<int>(), binary);
 					}
+					else
+					{
+						pcl::PointCloud<pcl::PointXYZRGBNormal> cloud;
+						pcl::io::loadPLYFile(tmpPath, cloud);
+						savePDALFile(outputPath, cloud, std::vector<int>(), binary);
+					}
+					UFile::erase(tmpPath);
 				}
-				if(!UDirectory::exists(dir)) {
-					UDirectory::makeDir(dir);
-				}
-
-				outputPath=dir+"/"+(exportImagesId?uNumber2Str(iter->first):uFormat("%f",node.getStamp()))+ext;
-				cv::imwrite(outputPath, depthExported);
+#endif
+				printf("Saving %s... done! (%ld points, %fs)\n", outputPath.c_str(), count, timer.ticks());
 			}
-
-			// save calibration per image (calibration can change over time, e.g. camera has auto focus)
-			for(size_t i=0; i<models.size(); ++i)
+			else
 			{
-				CameraModel model = models[i];
-				std::string modelName = (exportImagesId?uNumber2Str(iter->first):uFormat("%f",node.getStamp()));
-				if(models.size() > 1) {
-					modelName += "_" + uNumber2Str((int)i);
-				}
-				model.setName(modelName);
-				std::string dir = outputDirectory+"/"+baseName+"_calib";
-				if(!UDirectory::exists(dir)) {
-					UDirectory::makeDir(dir);
+				status = -1;
+			}
+			delete writer;
+		}
+		else
+		{
+			printf("Export failed! The cloud is empty.\n");
+		}
+		delete voxelMap;
+
+		if(tsdfVolume)
+		{
+			printf("TSDF mesh extraction... (blocks=%d, released=%d, %lu MB)\n",
+					tsdfVolume->getBlocks(),
+					tsdfVolume->getReleasedBlocks(),
+					tsdfVolume->getMemoryUsed()/(1024*1024));
+			pcl::PolygonMesh::Ptr tsdfMesh = tsdfVolume->extractMesh();
+			delete tsdfVolume;
+			printf("TSDF mesh extraction... done (%fs, %d polygons).\n", timer.ticks(), (int)tsdfMesh->polygons.size());
+			if(tsdfMesh->polygons.size())
+			{
+				if(maxPolygons > 0 && (int)tsdfMesh->polygons.size() > maxPolygons)
+				{
+					rtabmap::util3d::denseMeshPostProcessing<pcl::PointXYZRGBNormal>(
+							tsdfMesh,
+							0.0f,
+							maxPolygons,
+							pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr(),
+							-1.0f,
+							true,
+							false,
+							0);
 				}
-				model.save(dir);
+				std::string meshPath=outputDirectory+"/"+baseName+"_mesh.ply";
+				printf("Saving %s...\n", meshPath.c_str());
+				if(binary)
+					pcl::io::savePLYFileBinary(meshPath, *tsdfMesh);
+				else
+					pcl::io::savePLYFile(meshPath, *tsdfMesh);
+				printf("Saving %s... done!\n", meshPath.c_str());
 			}
-			if(node.sensorData().stereoCameraModel().isValidForProjection())
+			else
 			{
-				StereoCameraModel model = node.sensorData().stereoCameraModel();
-				std::string modelName = (exportImagesId?uNumber2Str(iter->first):uFormat("%f",node.getStamp()));
-				model.setName(modelName, "left", "right");
-				std::string dir = outputDirectory+"/"+baseName+"_calib";
-				if(!UDirectory::exists(dir)) {
-					UDirectory::makeDir(dir);
-				}
-				node.sensorData().stereoCameraModel().save(dir);
+				printf("Export failed! The mesh is empty.\n");
+				status = -1;
 			}
 		}
 
-		if(voxelSize>0.0f)
+		exportPosesFiles(
+				outputDirectory,
+				baseName,
+				exportPosesFormat,
+				exportPoses,
+				exportPosesCamera,
+				exportPosesScan,
+				robotPoses,
+				cameraPoses,
+				scanPoses,
+				links,
+				cameraStamps);
+
+		return status;
+	}
+
+	// Construct the cloud
+	printf("Create and assemble the clouds...\n");
+	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr mergedClouds(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+	pcl::PointCloud<pcl::PointXYZINormal>::Ptr mergedCloudsI(new pcl::PointCloud<pcl::PointXYZINormal>);
+	std::map<int, rtabmap::Transform> robotPoses;
+	std::vector<std::map<int, rtabmap::Transform> > cameraPoses;
+	std::map<int, rtabmap::Transform> scanPoses;
+	std::map<int, double> cameraStamps;
+	std::map<int, std::vector<rtabmap::CameraModel> > cameraModels;
+	std::map<int, cv::Mat> cameraDepths;
+	int imagesExported = 0;
+	TSDFVolume * tsdfVolume = (mesh || texture) && tsdf?new TSDFVolume(tsdfVoxel, tsdfTrunc, maxRange, tsdfMaxBlocks):0;
+	for(std::map<int, Transform>::iterator iter=optimizedPoses.lower_bound(1); iter!=optimizedPoses.end(); ++iter)
+	{
+		Signature node = nodes.find(iter->first)->second;
+
+		// uncompress data
+		std::vector<CameraModel> models = node.sensorData().cameraModels();
+		cv::Mat rgb;
+		cv::Mat depth;
+		pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloudWithNormals;
+		pcl::PointCloud<pcl::PointXYZINormal>::Ptr cloudIWithNormals;
+		createNodeCloud(
+				node.sensorData(),
+				iter->second,
+				cloudFromScan,
+				exportImages,
+				texture||exportImages,
+				decimation,
+				maxRange,
+				voxelSize,
+				noiseRadius,
+				noiseMinNeighbors,
+				rgb,
+				depth,
+				cloudWithNormals,
+				cloudIWithNormals);
+
+		if(exportImages && exportNodeImages(
+				outputDirectory,
+				baseName,
+				exportImagesId?uNumber2Str(iter->first):uFormat("%f",node.getStamp()),
+				rgb,
+				depth,
+				models,
+				node.sensorData().stereoCameraModel()))
 		{
-			if(cloud.get() && !cloud->empty())
-				cloud = rtabmap::util3d::voxelize(cloud, indices, voxelSize);
-			else if(cloudI.get() && !cloudI->empty())
-				cloudI = rtabmap::util3d::voxelize(cloudI, indices, voxelSize);
+			++imagesExported;
 		}
-		if(cloud.get() && !cloud->empty())
-			cloud = rtabmap::util3d::transformPointCloud(cloud, iter->second);
-		else if(cloudI.get() && !cloudI->empty())
-			cloudI = rtabmap::util3d::transformPointCloud(cloudI, iter->second);
-
 
-		Eigen::Vector3f viewpoint(iter->second.x(), iter->second.y(), iter->second.z());
-		if(cloudFromScan)
+		if(tsdfVolume)
 		{
-			Transform lidarViewpoint = iter->second * node.sensorData().laserScanRaw().localTransform();
-			viewpoint = Eigen::Vector3f(iter->second.x(),  iter->second.y(),  iter->second.z());
+			tsdfVolume->integrate(node.sensorData(), iter->second);
 		}
-		if(cloud.get() && !cloud->empty())
+
+		if(cloudWithNormals.get() && !cloudWithNormals->empty())
 		{
-			pcl::PointCloud<pcl::Normal>::Ptr normals = rtabmap::util3d::computeNormals(cloud, 20, 0.0f, viewpoint);
-			pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloudWithNormals(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-			pcl::concatenateFields(*cloud, *normals, *cloudWithNormals);
 			if(mergedClouds->size() == 0)
 			{
 				*mergedClouds = *cloudWithNormals;
@@ -955,11 +1842,8 @@ int main(int argc, char * argv[])
 				*mergedClouds += *cloudWithNormals;
 			}
 		}
-		else if(cloudI.get() && !cloudI->empty())
+		else if(cloudIWithNormals.get() && !cloudIWithNormals->empty())
 		{
-			pcl::PointCloud<pcl::Normal>::Ptr normals = rtabmap::util3d::computeNormals(cloudI, 20, 0.0f, viewpoint);
-			pcl::PointCloud<pcl::PointXYZINormal>::Ptr cloudIWithNormals(new pcl::PointCloud<pcl::PointXYZINormal>);
-			pcl::concatenateFields(*cloudI, *normals, *cloudIWithNormals);
 			if(mergedCloudsI->size() == 0)
 			{
 				*mergedCloudsI = *cloudIWithNormals;
@@ -1021,32 +1905,18 @@ int main(int argc, char * argv[])
 		}
 		else
 		{
-			std::string posesExt = (exportPosesFormat==3?"toro":exportPosesFormat==4?"g2o":"txt");
-			if(exportPoses)
-			{
-				std::string outputPath=outputDirectory+"/"+baseName+"_poses." + posesExt;
-				rtabmap::graph::exportPoses(outputPath, exportPosesFormat, robotPoses, links, cameraStamps);
-				printf("Poses exported to \"%s\".\n", outputPath.c_str());
-			}
-			if(exportPosesCamera)
-			{
-				for(size_t i=0; i<cameraPoses.size(); ++i)
-				{
-					std::string outputPath;
-					if(cameraPoses.size()==1)
-						outputPath = outputDirectory+"/"+baseName+"_camera_poses." + posesExt;
-					else
-						outputPath = outputDirectory+"/"+baseName+"_camera_poses_"+uNumber2Str((int)i)+"." + posesExt;
-					rtabmap::graph::exportPoses(outputPath, exportPosesFormat, cameraPoses[i], std::multimap<int, Link>(), cameraStamps);
-					printf("Camera poses exported to \"%s\".\n", outputPath.c_str());
-				}
-			}
-			if(exportPosesScan)
-			{
-				std::string outputPath=outputDirectory+"/"+baseName+"_scan_poses." + posesExt;
-				rtabmap::graph::exportPoses(outputPath, exportPosesFormat, scanPoses, std::multimap<int, Link>(), cameraStamps);
-				printf("Scan poses exported to \"%s\".\n", outputPath.c_str());
-			}
+			exportPosesFiles(
+					outputDirectory,
+					baseName,
+					exportPosesFormat,
+					exportPoses,
+					exportPosesCamera,
+					exportPosesScan,
+					robotPoses,
+					cameraPoses,
+					scanPoses,
+					links,
+					cameraStamps);
 		}
 
 		pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloudToExport = mergedClouds;
@@ -1070,6 +1940,7 @@ int main(int argc, char * argv[])
 		if(camProjection && !robotPoses.empty())
 		{
 			printf("Camera projection...\n");
+			UTimer projectionTimer;
 			pointToCamId.resize(!cloudToExport->empty()?cloudToExport->size():cloudIToExport->size());
 			std::vector<std::pair< std::pair<int, int>, pcl::PointXY> > pointToPixel;
 			if(!cloudToExport->empty())
@@ -1096,6 +1967,20 @@ int main(int argc, char * argv[])
 				pointToCamIntensity.resize(pointToPixel.size());
 			}
 
+			printf("Projected %d points to %d poses (%fs)\n", (int)pointToPixel.size(), (int)robotPoses.size(), projectionTimer.ticks());
+
+			if(camProjectionBench > 0)
+			{
+				if(!cloudToExport->empty())
+				{
+					benchmarkCameraProjection(*cloudToExport, robotPoses, cameraModels, textureRange, distanceToCamPolicy, camProjectionBench, pointToPixel);
+				}
+				else if(!cloudIToExport->empty())
+				{
+					benchmarkCameraProjection(*cloudIToExport, robotPoses, cameraModels, textureRange, distanceToCamPolicy, camProjectionBench, pointToPixel);
+				}
+			}
+
 			// color the cloud
 			UASSERT(pointToPixel.empty() || pointToPixel.size() == pointToCamId.size());
 			std::map<int, cv::Mat> cachedImages;
@@ -1208,7 +2093,7 @@ int main(int argc, char * argv[])
 			}
 			else
 			{
-				std::string ext = las?"las":"ply";
+				std::string ext = las?"las":pcd?"pcd":"ply";
 				std::string outputPath=outputDirectory+"/"+baseName+"_cloud."+ext;
 				printf("Saving %s... (%d points)\n", outputPath.c_str(), !cloudToExport->empty()?(int)cloudToExport->size():(int)cloudIToExport->size());
 #ifdef RTABMAP_PDAL
@@ -1244,10 +2129,20 @@ int main(int argc, char * argv[])
 									"with PDAL support, so camera IDs won't be exported in the output cloud.\n");
 						}
 					}
-					if(!cloudToExport->empty())
-						pcl::io::savePLYFile(outputPath, *cloudToExport, binary);
-					else if(!cloudIToExport->empty())
-						pcl::io::savePLYFile(outputPath, *cloudIToExport, binary);
+					if(pcd)
+					{
+						if(!cloudToExport->empty())
+							pcl::io::savePCDFile(outputPath, *cloudToExport, binary);
+						else if(!cloudIToExport->empty())
+							pcl::io::savePCDFile(outputPath, *cloudIToExport, binary);
+					}
+					else
+					{
+						if(!cloudToExport->empty())
+							pcl::io::savePLYFile(outputPath, *cloudToExport, binary);
+						else if(!cloudIToExport->empty())
+							pcl::io::savePLYFile(outputPath, *cloudIToExport, binary);
+					}
 				}
 				printf("Saving %s... done!\n", outputPath.c_str());
 			}
@@ -1262,30 +2157,43 @@ int main(int argc, char * argv[])
 				mergedCloudsI->clear();
 			}
 
-			Eigen::Vector4f min,max;
-			pcl::getMinMax3D(*mergedClouds, min, max);
-			float mapLength = uMax3(max[0]-min[0], max[1]-min[1], max[2]-min[2]);
-			int optimizedDepth = 12;
-			for(int i=6; i<12; ++i)
+			// Mesh reconstruction
+			pcl::PolygonMesh::Ptr mesh(new pcl::PolygonMesh);
+			if(tsdfVolume)
 			{
-				if(mapLength/float(1<<i) < poissonSize)
-				{
-					optimizedDepth = i;
-					break;
-				}
+				printf("Mesh reconstruction with TSDF... (blocks=%d, released=%d, %lu MB)\n",
+						tsdfVolume->getBlocks(),
+						tsdfVolume->getReleasedBlocks(),
+						tsdfVolume->getMemoryUsed()/(1024*1024));
+				mesh = tsdfVolume->extractMesh();
+				delete tsdfVolume;
+				tsdfVolume = 0;
 			}
-			if(poissonDepth>0)
+			else
 			{
-				optimizedDepth = poissonDepth;
-			}
+				Eigen::Vector4f min,max;
+				pcl::getMinMax3D(*mergedClouds, min, max);
+				float mapLength = uMax3(max[0]-min[0], max[1]-min[1], max[2]-min[2]);
+				int optimizedDepth = 12;
+				for(int i=6; i<12; ++i)
+				{
+					if(mapLength/float(1<<i) < poissonSize)
+					{
+						optimizedDepth = i;
+						break;
+					}
+				}
+				if(poissonDepth>0)
+				{
+					optimizedDepth = poissonDepth;
+				}
 
-			// Mesh reconstruction
-			printf("Mesh reconstruction... depth=%d\n", optimizedDepth);
-			pcl::PolygonMesh::Ptr mesh(new pcl::PolygonMesh);
-			pcl::Poisson<pcl::PointXYZRGBNormal> poisson;
-			poisson.setDepth(optimizedDepth);
-			poisson.setInputCloud(mergedClouds);
-			poisson.reconstruct(*mesh);
+				printf("Mesh reconstruction... depth=%d\n", optimizedDepth);
+				pcl::Poisson<pcl::PointXYZRGBNormal> poisson;
+				poisson.setDepth(optimizedDepth);
+				poisson.setInputCloud(mergedClouds);
+				poisson.reconstruct(*mesh);
+			}
 			printf("Mesh reconstruction... done (%fs, %d polygons).\n", timer.ticks(), (int)mesh->polygons.size());
 
 			if(mesh->polygons.size())
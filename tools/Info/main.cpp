@@ -31,11 +31,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <signal.h>
 
 #include <rtabmap/core/DBDriver.h>
+#include <rtabmap/core/Signature.h>
 #include <rtabmap/core/VisualWord.h>
 #include <rtabmap/core/Graph.h>
 #include <rtabmap/utilite/UDirectory.h>
 #include "rtabmap/utilite/UFile.h"
 #include "rtabmap/utilite/UStl.h"
+#include "rtabmap/utilite/UMath.h"
+#include "rtabmap/utilite/UConversion.h"
+#include "rtabmap/utilite/UThread.h"
+#include "rtabmap/utilite/ULogger.h"
+#include "rtabmap/utilite/UTimer.h"
 
 using namespace rtabmap;
 
@@ -59,10 +65,241 @@ void showUsage()
 			"  Options:\n"
 			"     --diff                   Show only modified parameters.\n"
 			"     --diff  \"other_map.db\"   Compare parameters with other database.\n"
-			"\n");
+			"     --bench #                Stress read connections: on a copy of the database,\n"
+			"                              4 threads load # nodes each while nodes are saved,\n"
+			"                              without and with %s=4.\n"
+			"     --copy_bench #           Time # copies of the sensor data of each node with\n"
+			"                              features, with shared and with deep-copied keypoints.\n"
+			"\n", Parameters::kDbSqlite3ReadConnections().c_str());
 	exit(1);
 }
 
+// Reader of the read connections benchmark
+class BenchReader : public UThread
+{
+public:
+	BenchReader(DBDriver * driver, const std::vector<int> & ids, int offset, int iterations) :
+		driver_(driver),
+		ids_(ids),
+		offset_(offset),
+		iterations_(iterations)
+	{}
+	virtual ~BenchReader() {join(true);}
+	const std::vector<double> & times() const {return times_;}
+
+private:
+	virtual void mainLoop()
+	{
+		if((int)times_.size() >= iterations_)
+		{
+			kill();
+			return;
+		}
+		std::list<int> ids;
+		ids.push_back(ids_[(offset_ + times_.size()*7919) % ids_.size()]);
+		std::list<Signature *> signatures;
+		UTimer timer;
+		driver_->loadSignatures(ids, signatures);
+		driver_->loadNodeData(signatures);
+		times_.push_back(timer.ticks());
+		for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+		{
+			delete *iter;
+		}
+	}
+
+private:
+	DBDriver * driver_;
+	std::vector<int> ids_;
+	int offset_;
+	int iterations_;
+	std::vector<double> times_;
+};
+
+// Load nodes from reader threads while the main thread saves nodes
+// like the trash thread does, with and without read connections.
+int benchmarkReadConnections(const std::string & databasePath, int iterations, int readers)
+{
+	std::string benchPath = databasePath + ".bench.db";
+	UFile::copy(databasePath, benchPath);
+	if(UFile::exists(databasePath + ".data"))
+	{
+		UFile::copy(databasePath + ".data", benchPath + ".data");
+	}
+
+	for(int readConnections=0; readConnections<=readers; readConnections+=readers)
+	{
+		ParametersMap parameters;
+		parameters.insert(ParametersPair(Parameters::kDbSqlite3JournalMode(), "5"));
+		parameters.insert(ParametersPair(Parameters::kDbSqlite3ReadConnections(), uNumber2Str(readConnections)));
+		DBDriver * driver = DBDriver::create(parameters);
+		if(!driver->openConnection(benchPath))
+		{
+			printf("Cannot open database \"%s\".\n", benchPath.c_str());
+			delete driver;
+			break;
+		}
+
+		// readers and writer use different nodes
+		std::set<int> allIds;
+		driver->getAllNodeIds(allIds);
+		std::vector<int> readIds;
+		std::vector<int> writeIds;
+		for(std::set<int>::iterator iter=allIds.begin(); iter!=allIds.end(); ++iter)
+		{
+			(*iter % 2 == 0?writeIds:readIds).push_back(*iter);
+		}
+		if(readIds.empty() || writeIds.empty())
+		{
+			printf("Not enough nodes in the database for the benchmark.\n");
+			delete driver;
+			break;
+		}
+
+		std::vector<BenchReader*> threads;
+		for(int i=0; i<readers; ++i)
+		{
+			threads.push_back(new BenchReader(driver, readIds, i*(int)readIds.size()/readers, iterations));
+		}
+		UTimer totalTimer;
+		for(int i=0; i<readers; ++i)
+		{
+			threads[i]->start();
+		}
+
+		std::vector<double> writeTimes;
+		bool running = true;
+		for(size_t i=0; running; i+=10)
+		{
+			std::list<int> ids;
+			for(size_t j=i; j<i+10; ++j)
+			{
+				ids.push_back(writeIds[j % writeIds.size()]);
+			}
+			UTimer timer;
+			std::list<Signature *> signatures;
+			driver->loadSignatures(ids, signatures);
+			for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+			{
+				(*iter)->setWeight((*iter)->getWeight()+1);
+				driver->asyncSave(*iter);
+			}
+			driver->emptyTrashes();
+			writeTimes.push_back(timer.ticks());
+
+			running = false;
+			for(int j=0; j<readers; ++j)
+			{
+				running = running || threads[j]->isRunning();
+			}
+		}
+		double totalTime = totalTimer.ticks();
+
+		std::vector<double> readTimes;
+		for(int i=0; i<readers; ++i)
+		{
+			readTimes.insert(readTimes.end(), threads[i]->times().begin(), threads[i]->times().end());
+			delete threads[i];
+		}
+		printf("Read connections=%d: %d reads in %.2f s (%.1f reads/s), read avg=%.2f ms max=%.2f ms, %d writes avg=%.2f ms\n",
+				readConnections,
+				(int)readTimes.size(),
+				totalTime,
+				double(readTimes.size())/totalTime,
+				uMean(readTimes)*1000.0,
+				uMax(readTimes)*1000.0,
+				(int)writeTimes.size(),
+				uMean(writeTimes)*1000.0);
+
+		driver->closeConnection(false);
+		delete driver;
+	}
+
+	UFile::erase(benchPath);
+	if(UFile::exists(benchPath + ".data"))
+	{
+		UFile::erase(benchPath + ".data");
+	}
+	return 0;
+}
+
+// Copy cost of SensorData passed between threads (camera, odometry,
+// statistics events), with keypoints shared between copies and with
+// keypoints deep-copied on each copy.
+int benchmarkSensorDataCopy(const std::string & databasePath, int iterations)
+{
+	DBDriver * driver = DBDriver::create();
+	if(!driver->openConnection(databasePath))
+	{
+		printf("Cannot open database \"%s\".\n", databasePath.c_str());
+		delete driver;
+		return -1;
+	}
+
+	std::set<int> allIds;
+	driver->getAllNodeIds(allIds);
+	std::list<int> ids(allIds.begin(), allIds.end());
+	std::list<Signature *> signatures;
+	driver->loadSignatures(ids, signatures);
+	driver->loadNodeData(signatures);
+
+	std::vector<SensorData> frames;
+	size_t totalKeypoints = 0;
+	for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		const Signature & s = **iter;
+		if(!s.getWordsKpts().empty() &&
+		   (s.getWords3().empty() || s.getWords3().size() == s.getWordsKpts().size()) &&
+		   (s.getWordsDescriptors().empty() || s.getWordsDescriptors().rows == (int)s.getWordsKpts().size()))
+		{
+			SensorData data = s.sensorData();
+			data.setFeatures(s.getWordsKpts(), s.getWords3(), s.getWordsDescriptors());
+			totalKeypoints += s.getWordsKpts().size();
+			frames.push_back(data);
+		}
+		delete *iter;
+	}
+	driver->closeConnection(false);
+	delete driver;
+
+	if(frames.empty())
+	{
+		printf("No nodes with features in the database for the benchmark.\n");
+		return -1;
+	}
+
+	// 0=shared, 1=deep-copied
+	double times[2] = {0.0, 0.0};
+	size_t checksum = 0;
+	for(int mode=0; mode<2; ++mode)
+	{
+		UTimer timer;
+		for(int n=0; n<iterations; ++n)
+		{
+			for(size_t i=0; i<frames.size(); ++i)
+			{
+				SensorData copy = frames[i];
+				if(mode == 1)
+				{
+					copy.setFeatures(frames[i].keypoints(), frames[i].keypoints3D(), frames[i].descriptors());
+				}
+				checksum += copy.keypoints().size();
+			}
+		}
+		times[mode] = timer.ticks();
+	}
+	UASSERT(checksum == 2*totalKeypoints*iterations);
+
+	double copies = double(frames.size())*iterations;
+	printf("SensorData copy: %d frames, %.1f keypoints/frame, %d runs\n",
+			(int)frames.size(),
+			double(totalKeypoints)/frames.size(),
+			iterations);
+	printf("   shared keypoints:      %.3f us/copy\n", times[0]/copies*1000000.0);
+	printf("   deep-copied keypoints: %.3f us/copy\n", times[1]/copies*1000000.0);
+	return 0;
+}
+
 std::string pad(const std::string & title, int padding = 20)
 {
 	int emptySize = padding - (int)title.size();
@@ -82,8 +319,36 @@ int main(int argc, char * argv[])
 
 	std::string otherDatabasePath;
 	bool diff = false;
+	int benchIterations = 0;
+	int copyBenchIterations = 0;
 	for(int i=1; i<argc-1; ++i)
 	{
+		if(strcmp(argv[i], "--bench") == 0)
+		{
+			++i;
+			if(i<argc-1)
+			{
+				benchIterations = std::atoi(argv[i]);
+			}
+			if(benchIterations <= 0)
+			{
+				printf("--bench should be > 0\n");
+				showUsage();
+			}
+		}
+		if(strcmp(argv[i], "--copy_bench") == 0)
+		{
+			++i;
+			if(i<argc-1)
+			{
+				copyBenchIterations = std::atoi(argv[i]);
+			}
+			if(copyBenchIterations <= 0)
+			{
+				printf("--copy_bench should be > 0\n");
+				showUsage();
+			}
+		}
 		if(strcmp(argv[i], "--diff") == 0)
 		{
 			++i;
@@ -103,6 +368,15 @@ int main(int argc, char * argv[])
 		return -1;
 	}
 
+	if(benchIterations > 0)
+	{
+		return benchmarkReadConnections(databasePath, benchIterations, 4);
+	}
+	if(copyBenchIterations > 0)
+	{
+		return benchmarkSensorDataCopy(databasePath, copyBenchIterations);
+	}
+
 	DBDriver * driver = DBDriver::create();
 	if(!driver->openConnection(databasePath))
 	{
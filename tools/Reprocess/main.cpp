@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UFile.h>
 #include <rtabmap/utilite/UDirectory.h>
 #include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UTrace.h>
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/UMath.h>
 #include <stdio.h>
@@ -81,7 +82,19 @@ void showUsage()
 			"     -scan_range_max #.#   Filter input scans with maximum range (m).\n"
 			"     -scan_voxel_size #.#  Voxel filter input scans (m).\n"
 			"     -scan_normal_k #         Compute input scan normals (k-neighbors approach).\n"
-			"     -scan_normal_radius #.#  Compute input scan normals (radius(m)-neighbors approach).\n\n"
+			"     -scan_normal_radius #.#  Compute input scan normals (radius(m)-neighbors approach).\n"
+			"     -grid \"Name=v1,v2;Name2=v3\"  Batch mode: reprocess the input with all combinations\n"
+			"                       of the parameter values. Input data is read by blocks\n"
+			"                       shared by independent RTAB-Map instances running in\n"
+			"                       parallel. Each variant is saved to \"[output]_#.db\" and a\n"
+			"                       comparison report (timings, loop closures, ground truth\n"
+			"                       RMSE) to \"[output]_batch.txt\".\n"
+			"     -jobs #     Maximum variants processed in parallel with -grid (default 0=all).\n"
+			"                       Input is read again for each group of parallel variants.\n"
+			"     -grid_block #  Maximum frames kept in RAM with -grid (default 100). All\n"
+			"                       parallel variants process a block before the next is read.\n"
+			"     -trace \"path.json\"  Save timing spans in Chrome trace format (chrome://tracing,\n"
+			"                       ui.perfetto.dev). RTAB-Map should be built with WITH_TRACING.\n\n"
 			"%s\n"
 			"\n", Parameters::showUsage());
 	exit(1);
@@ -196,6 +209,345 @@ void showLocalizationStats(const std::string & outputDatabasePath)
 	++sessionCount;
 }
 
+// Batch mode (-grid): the input databases are streamed by blocks of frames,
+// each block is shared read-only by independent Rtabmap instances running in
+// parallel, then the next block is read.
+struct BatchFrame
+{
+	BatchFrame() : triggerNewMap(false) {}
+	SensorData data;
+	Transform odomPose;
+	cv::Mat odomCovariance;
+	std::vector<float> odomVelocity;
+	bool triggerNewMap;
+};
+
+class BatchJob : public UThread
+{
+public:
+	BatchJob(int index,
+			const ParametersMap & parameters,
+			const std::string & outputDatabasePath,
+			bool odometryIgnored) :
+		index_(index),
+		parameters_(parameters),
+		outputDatabasePath_(outputDatabasePath),
+		frames_(0),
+		odometryIgnored_(odometryIgnored),
+		rtabmap_(0),
+		processed_(0),
+		loopCount_(0),
+		proxCount_(0),
+		wallTime_(0.0)
+	{}
+	virtual ~BatchJob()
+	{
+		this->join(true);
+		close();
+	}
+
+	// Process the block of frames in the job's thread, call join() before changing it
+	void process(const std::vector<BatchFrame> * frames)
+	{
+		frames_ = frames;
+		this->start();
+	}
+	void close()
+	{
+		if(rtabmap_)
+		{
+			UTimer timer;
+			rtabmap_->close(true);
+			delete rtabmap_;
+			rtabmap_ = 0;
+			wallTime_ += timer.ticks();
+		}
+	}
+
+	int index() const {return index_;}
+	const ParametersMap & parameters() const {return parameters_;}
+	const std::string & outputDatabasePath() const {return outputDatabasePath_;}
+	int processed() const {return processed_;}
+	int loopCount() const {return loopCount_;}
+	int proxCount() const {return proxCount_;}
+	double wallTime() const {return wallTime_;}
+	const std::vector<float> & timings() const {return timings_;}
+	// Last value of each statistic (e.g., Gt/Translational_rmse/m)
+	const std::map<std::string, float> & lastStats() const {return lastStats_;}
+
+protected:
+	virtual void mainLoop()
+	{
+		UTimer timer;
+		if(rtabmap_ == 0)
+		{
+			rtabmap_ = new Rtabmap();
+			rtabmap_->init(parameters_, outputDatabasePath_);
+		}
+		for(size_t i=0; frames_ && i<frames_->size() && g_loopForever; ++i)
+		{
+			const BatchFrame & frame = frames_->at(i);
+			if(frame.triggerNewMap)
+			{
+				rtabmap_->triggerNewMap();
+			}
+			if(!odometryIgnored_ && frame.odomPose.isNull())
+			{
+				continue;
+			}
+			if(rtabmap_->process(frame.data, frame.odomPose, frame.odomCovariance, frame.odomVelocity))
+			{
+				const Statistics & stats = rtabmap_->getStatistics();
+				if(stats.loopClosureId()>0)
+				{
+					++loopCount_;
+				}
+				else if(stats.proximityDetectionId()>0)
+				{
+					++proxCount_;
+				}
+				timings_.push_back(uValue(stats.data(), Statistics::kTimingTotal(), 0.0f));
+				uInsert(lastStats_, stats.data());
+				++processed_;
+			}
+		}
+		wallTime_ += timer.ticks();
+		this->kill();
+	}
+
+private:
+	int index_;
+	ParametersMap parameters_;
+	std::string outputDatabasePath_;
+	const std::vector<BatchFrame> * frames_;
+	bool odometryIgnored_;
+	Rtabmap * rtabmap_;
+	int processed_;
+	int loopCount_;
+	int proxCount_;
+	double wallTime_;
+	std::vector<float> timings_;
+	std::map<std::string, float> lastStats_;
+};
+
+// "Name1=v1,v2;Name2=v3,v4" -> all combinations
+bool parseParameterGrid(const std::string & str, std::vector<ParametersMap> & variants)
+{
+	variants.clear();
+	variants.push_back(ParametersMap());
+	std::list<std::string> entries = uSplit(str, ';');
+	for(std::list<std::string>::iterator iter=entries.begin(); iter!=entries.end(); ++iter)
+	{
+		if(iter->empty())
+		{
+			continue;
+		}
+		std::list<std::string> keyValues = uSplit(*iter, '=');
+		if(keyValues.size() != 2)
+		{
+			printf("Wrong parameter grid format \"%s\", should be \"Name=value1,value2\".\n", iter->c_str());
+			return false;
+		}
+		std::string name = keyValues.front();
+		if(Parameters::getDefaultParameters().find(name) == Parameters::getDefaultParameters().end())
+		{
+			printf("Parameter \"%s\" of the grid doesn't exist!\n", name.c_str());
+			return false;
+		}
+		std::list<std::string> values = uSplit(keyValues.back(), ',');
+		std::vector<ParametersMap> combined;
+		for(size_t i=0; i<variants.size(); ++i)
+		{
+			for(std::list<std::string>::iterator jter=values.begin(); jter!=values.end(); ++jter)
+			{
+				ParametersMap variant = variants[i];
+				uInsert(variant, ParametersPair(name, *jter));
+				combined.push_back(variant);
+			}
+		}
+		variants = combined;
+	}
+	return !variants.empty() && !variants.front().empty();
+}
+
+int runBatch(
+		const std::vector<ParametersMap> & variants,
+		int jobs,
+		int blockSize,
+		const ParametersMap & parameters,
+		const std::string & inputDatabasePath,
+		const std::string & outputDatabasePath,
+		const std::string & initialDatabasePath, // to copy for localization mode
+		bool odometryIgnored,
+		bool intermediateNodes,
+		int startId,
+		int stopId,
+		int framesToSkip,
+		bool scanFromDepth,
+		int scanDecimation,
+		float scanRangeMin,
+		float scanRangeMax,
+		float scanVoxelSize,
+		int scanNormalK,
+		float scanNormalRadius)
+{
+	if(jobs <= 0)
+	{
+		jobs = (int)variants.size();
+	}
+	if(blockSize <= 0)
+	{
+		blockSize = 1;
+	}
+	printf("Reprocessing %d parameter variants (%d in parallel, blocks of %d frames)...\n", (int)variants.size(), jobs, blockSize);
+
+	std::vector<BatchJob*> batchJobs;
+	int totalFrames = 0;
+	// Variants are processed by waves of "jobs" variants, the input is streamed once per wave
+	for(size_t w=0; w<variants.size() && g_loopForever; w+=jobs)
+	{
+		std::vector<BatchJob*> wave;
+		for(size_t i=w; i<variants.size() && i<w+jobs; ++i)
+		{
+			std::string path = outputDatabasePath.substr(0, outputDatabasePath.size()-3) + uFormat("_%d.db", (int)i);
+			if(UFile::exists(path))
+			{
+				UFile::erase(path);
+			}
+			if(!initialDatabasePath.empty())
+			{
+				UFile::copy(initialDatabasePath, path);
+			}
+			ParametersMap variantParameters = parameters;
+			uInsert(variantParameters, variants[i]);
+			wave.push_back(new BatchJob((int)i, variantParameters, path, odometryIgnored));
+			batchJobs.push_back(wave.back());
+		}
+
+		UTimer timer;
+		DBReader * dbReader = new DBReader(inputDatabasePath, 0, odometryIgnored, false, false, startId, -1, stopId, !intermediateNodes);
+		dbReader->init();
+		CameraThread camThread(dbReader, parameters); // take ownership of dbReader
+		camThread.setScanParameters(scanFromDepth, scanDecimation, scanRangeMin, scanRangeMax, scanVoxelSize, scanNormalK, scanNormalRadius);
+
+		totalFrames = 0;
+		bool triggerNewMap = false;
+		CameraInfo info;
+		SensorData data = dbReader->takeImage(&info);
+		while(data.isValid() && g_loopForever)
+		{
+			// Read the next block
+			std::vector<BatchFrame> frames;
+			frames.reserve(blockSize);
+			while(data.isValid() && (int)frames.size() < blockSize)
+			{
+				if(scanFromDepth)
+				{
+					data.setLaserScan(LaserScan());
+				}
+				camThread.postUpdate(&data, &info);
+				BatchFrame frame;
+				frame.data = data;
+				frame.odomPose = info.odomPose;
+				frame.odomCovariance = info.odomCovariance;
+				frame.odomVelocity = info.odomVelocity;
+				frame.triggerNewMap = triggerNewMap ||
+						(!odometryIgnored && !info.odomCovariance.empty() && info.odomCovariance.at<double>(0,0)>=9999);
+				triggerNewMap = false;
+				frames.push_back(frame);
+
+				for(int skippedFrames = framesToSkip; skippedFrames>0; --skippedFrames)
+				{
+					data = dbReader->takeImage(&info);
+					if(!odometryIgnored && !info.odomCovariance.empty() && info.odomCovariance.at<double>(0,0)>=9999)
+					{
+						triggerNewMap = true;
+					}
+				}
+				data = dbReader->takeImage(&info);
+			}
+			totalFrames += (int)frames.size();
+
+			// Process it with all jobs of the wave
+			for(size_t i=0; i<wave.size(); ++i)
+			{
+				wave[i]->process(&frames);
+			}
+			for(size_t i=0; i<wave.size(); ++i)
+			{
+				wave[i]->join();
+			}
+		}
+		for(size_t i=0; i<wave.size(); ++i)
+		{
+			wave[i]->close();
+			printf("Variant %d done (%d/%d, %fs).\n", wave[i]->index(), wave[i]->processed(), totalFrames, wave[i]->wallTime());
+		}
+		printf("Wave of %d variants done (%fs)\n", (int)wave.size(), timer.ticks());
+	}
+
+	// Comparison report
+	std::string reportPath = outputDatabasePath.substr(0, outputDatabasePath.size()-3) + "_batch.txt";
+	FILE * report = fopen(reportPath.c_str(), "w");
+	std::string header = "Variant\tProcessed\tLoop\tProx\tTimingMean(ms)\tTimingMax(ms)\tWallTime(s)\tGtTranslationalRmse(m)\tGtRotationalRmse(deg)\tParameters\n";
+	printf("\n%s", header.c_str());
+	if(report)
+	{
+		fprintf(report, "%s", header.c_str());
+	}
+	for(size_t i=0; i<batchJobs.size(); ++i)
+	{
+		const BatchJob & job = *batchJobs[i];
+		std::string params;
+		for(ParametersMap::const_iterator iter=variants[job.index()].begin(); iter!=variants[job.index()].end(); ++iter)
+		{
+			params += (params.empty()?"":" ") + iter->first + "=" + iter->second;
+		}
+		std::string line = uFormat("%d\t%d\t%d\t%d\t%f\t%f\t%f\t%f\t%f\t%s\n",
+				job.index(),
+				job.processed(),
+				job.loopCount(),
+				job.proxCount(),
+				job.timings().empty()?0.0f:uMean(job.timings()),
+				job.timings().empty()?0.0f:uMax(job.timings()),
+				job.wallTime(),
+				uValue(job.lastStats(), Statistics::kGtTranslational_rmse(), -1.0f),
+				uValue(job.lastStats(), Statistics::kGtRotational_rmse(), -1.0f),
+				params.c_str());
+		printf("%s", line.c_str());
+		if(report)
+		{
+			fprintf(report, "%s", line.c_str());
+		}
+		delete batchJobs[i];
+	}
+	if(report)
+	{
+		fclose(report);
+		printf("\nReport saved to \"%s\".\n", reportPath.c_str());
+	}
+	return 0;
+}
+
+class TraceExporter
+{
+public:
+	TraceExporter(const std::string & path) : path_(path)
+	{
+		UTrace::setEnabled(!path_.empty());
+	}
+	~TraceExporter()
+	{
+		if(!path_.empty())
+		{
+			UTrace::setEnabled(false);
+			printf("Saving trace \"%s\"... %s\n", path_.c_str(), UTrace::exportChromeTrace(path_)?"done!":"failed!");
+		}
+	}
+private:
+	std::string path_;
+};
+
 int main(int argc, char * argv[])
 {
 	signal(SIGABRT, &sighandler);
@@ -228,6 +580,10 @@ int main(int argc, char * argv[])
 	float scanVoxelSize = 0;
 	int scanNormalK = 0;
 	float scanNormalRadius = 0.0f;
+	std::vector<ParametersMap> parameterGrid;
+	int batchJobs = 0;
+	int batchBlockSize = 100;
+	std::string tracePath;
 	ParametersMap configParameters;
 	for(int i=1; i<argc-2; ++i)
 	{
@@ -424,8 +780,75 @@ int main(int argc, char * argv[])
 				showUsage();
 			}
 		}
+		else if (strcmp(argv[i], "-grid") == 0 || strcmp(argv[i], "--grid") == 0)
+		{
+			++i;
+			if(i < argc - 2)
+			{
+				if(!parseParameterGrid(argv[i], parameterGrid))
+				{
+					showUsage();
+				}
+				printf("Batch mode: %d parameter variants.\n", (int)parameterGrid.size());
+			}
+			else
+			{
+				printf("-grid option requires 1 value\n");
+				showUsage();
+			}
+		}
+		else if (strcmp(argv[i], "-jobs") == 0 || strcmp(argv[i], "--jobs") == 0)
+		{
+			++i;
+			if(i < argc - 2)
+			{
+				batchJobs = atoi(argv[i]);
+				printf("Batch jobs = %d.\n", batchJobs);
+			}
+			else
+			{
+				printf("-jobs option requires 1 value\n");
+				showUsage();
+			}
+		}
+		else if (strcmp(argv[i], "-grid_block") == 0 || strcmp(argv[i], "--grid_block") == 0)
+		{
+			++i;
+			if(i < argc - 2)
+			{
+				batchBlockSize = atoi(argv[i]);
+				printf("Batch block size = %d frames.\n", batchBlockSize);
+			}
+			else
+			{
+				printf("-grid_block option requires 1 value\n");
+				showUsage();
+			}
+		}
+		else if (strcmp(argv[i], "-trace") == 0 || strcmp(argv[i], "--trace") == 0)
+		{
+			++i;
+			if(i < argc - 2)
+			{
+#ifdef UTILITE_TRACING
+				tracePath = uReplaceChar(argv[i], '~', UDirectory::homeDir());
+				printf("Trace = %s.\n", tracePath.c_str());
+#else
+				printf("WARNING: RTAB-Map is not built with WITH_TRACING, no spans are recorded. "
+						"-trace is ignored and \"%s\" won't be saved.\n", argv[i]);
+#endif
+			}
+			else
+			{
+				printf("-trace option requires 1 value\n");
+				showUsage();
+			}
+		}
 	}
 
+	// export on any return below
+	TraceExporter traceExporter(tracePath);
+
 	std::string inputDatabasePath = uReplaceChar(argv[argc-2], '~', UDirectory::homeDir());
 	std::string outputDatabasePath = uReplaceChar(argv[argc-1], '~', UDirectory::homeDir());
 
@@ -562,6 +985,46 @@ int main(int argc, char * argv[])
 	uInsert(parameters, ParametersPair(Parameters::kRtabmapWorkingDirectory(), workingDirectory));
 	uInsert(parameters, ParametersPair(Parameters::kRtabmapPublishStats(), "true")); // to log status below
 
+	bool rgbdEnabled = Parameters::defaultRGBDEnabled();
+	Parameters::parse(parameters, Parameters::kRGBDEnabled(), rgbdEnabled);
+	bool odometryIgnored = !rgbdEnabled;
+
+	if(!parameterGrid.empty())
+	{
+		if(assemble2dMap || assemble3dMap || assemble2dOctoMap || assemble3dOctoMap || exportPoses)
+		{
+			printf("Options -g2, -g3, -o2, -o3 and -p are ignored in batch mode (-grid).\n");
+		}
+		std::string initialDatabasePath;
+		if(!incrementalMemory && databases.size() > 1)
+		{
+			initialDatabasePath = databases.front();
+			printf("Parameter \"%s\" is set to false, initializing RTAB-Map with \"%s\" for localization...\n", Parameters::kMemIncrementalMemory().c_str(), databases.front().c_str());
+			databases.pop_front();
+			inputDatabasePath = uJoin(databases, ";");
+		}
+		return runBatch(
+				parameterGrid,
+				batchJobs,
+				batchBlockSize,
+				parameters,
+				inputDatabasePath,
+				outputDatabasePath,
+				initialDatabasePath,
+				odometryIgnored,
+				intermediateNodes,
+				startId,
+				stopId,
+				framesToSkip,
+				scanFromDepth,
+				scanDecimation,
+				scanRangeMin,
+				scanRangeMax,
+				scanVoxelSize,
+				scanNormalK,
+				scanNormalRadius);
+	}
+
 	if(!incrementalMemory && databases.size() > 1)
 	{
 		UFile::copy(databases.front(), outputDatabasePath);
@@ -573,9 +1036,6 @@ int main(int argc, char * argv[])
 	Rtabmap rtabmap;
 	rtabmap.init(parameters, outputDatabasePath);
 
-	bool rgbdEnabled = Parameters::defaultRGBDEnabled();
-	Parameters::parse(parameters, Parameters::kRGBDEnabled(), rgbdEnabled);
-	bool odometryIgnored = !rgbdEnabled;
 	DBReader * dbReader = new DBReader(inputDatabasePath, useDatabaseRate?-1:0, odometryIgnored, false, false, startId, -1, stopId, !intermediateNodes);
 	dbReader->init();
 
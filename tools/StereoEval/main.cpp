@@ -40,13 +40,53 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/imgproc/types_c.h>
 #include <fstream>
 #include <string>
+#include <cstring>
+#include <cstdlib>
 
 using namespace rtabmap;
 
+// Count accepted correspondences and those under 1 pixel from the ground truth (inliers),
+// avgError is the mean disparity error of the inliers
+static void evaluate(
+		const std::vector<cv::Point2f> & leftCorners,
+		const std::vector<cv::Point2f> & rightCorners,
+		const std::vector<unsigned char> & status,
+		const cv::Mat & disp,
+		int & accepted,
+		int & inliers,
+		float & avgError)
+{
+	accepted = 0;
+	inliers = 0;
+	avgError = 0.0f;
+	for(unsigned int i=0; i<leftCorners.size(); ++i)
+	{
+		if(status[i]!=0)
+		{
+			++accepted;
+			float gt = disp.at<float>(int(leftCorners[i].y), int(leftCorners[i].x));
+			float d = leftCorners[i].x - rightCorners[i].x;
+			if(uIsFinite(gt) && fabs(d-gt) < 1.0f)
+			{
+				++inliers;
+				avgError += fabs(d-gt);
+			}
+		}
+	}
+	if(inliers)
+	{
+		avgError /= float(inliers);
+	}
+}
+
 void showUsage()
 {
 	printf("Usage:\n"
-			"evalStereo.exe left.png right.png calib.txt disp.pfm mask.png [Parameters]\n"
+			"evalStereo.exe left.png right.png calib.txt disp.pfm mask.png [Options] [Parameters]\n"
+			"Options:\n"
+			"  --bench #    Time the sparse stereo approaches (pyramid block matching,\n"
+			"               full range block matching and optical flow) on the same\n"
+			"               keypoints # times and compare their accuracy.\n"
 			"Example (with http://vision.middlebury.edu/stereo datasets):\n"
 			"  $ ./rtabmap-stereoEval im0.png im1.png calib.txt disp0GT.pfm mask0nocc.png -Kp/DetectorStrategy 6 -Stereo/WinSize 5 -Stereo/MaxLevel 2 -Kp/WordsPerImage 1000 -Stereo/OpticalFlow false -Stereo/Iterations 5\n\n");
 	exit(1);
@@ -63,8 +103,27 @@ int main(int argc, char * argv[])
 	}
 
 	ParametersMap parameters = Parameters::getDefaultParameters();
+	int benchIterations = 0;
 	for(int i=6; i<argc; ++i)
 	{
+		if(strcmp(argv[i], "--bench") == 0)
+		{
+			++i;
+			if(i < argc)
+			{
+				benchIterations = std::atoi(argv[i]);
+				if(benchIterations <= 0)
+				{
+					showUsage();
+				}
+			}
+			else
+			{
+				showUsage();
+			}
+			continue;
+		}
+
 		// Check for RTAB-Map's parameters
 		std::string key = argv[i];
 		key = uSplit(key, '-').back();
@@ -415,6 +474,44 @@ int main(int argc, char * argv[])
 				(badRejected*100)/leftCorners.size());
 		UINFO("avg inliers =%f (subInliers=%f)", sumInliers/float(inliers), sumSubInliers/float(subInliers));
 
+		if(benchIterations > 0)
+		{
+			UINFO("Benchmark (%d iterations, %d keypoints)...", benchIterations, (int)leftCorners.size());
+			ULogger::Level level = ULogger::level();
+			const char * names[3] = {"pyramid block matching", "full range block matching", "optical flow"};
+			for(int approach=0; approach<3; ++approach)
+			{
+				ParametersMap benchParameters = parameters;
+				uInsert(benchParameters, ParametersPair(Parameters::kStereoOpticalFlow(), approach==2?"true":"false"));
+				uInsert(benchParameters, ParametersPair(Parameters::kStereoFullRange(), approach==1?"true":"false"));
+				Stereo * benchStereo = Stereo::create(benchParameters);
+
+				// don't time the debug logs
+				ULogger::setLevel(ULogger::kWarning);
+				std::vector<unsigned char> benchStatus;
+				std::vector<cv::Point2f> benchCorners;
+				UTimer benchTimer;
+				for(int j=0; j<benchIterations; ++j)
+				{
+					benchCorners = benchStereo->computeCorrespondences(leftMono, rightMono, leftCorners, benchStatus);
+				}
+				double benchTime = benchTimer.ticks()/double(benchIterations);
+				ULogger::setLevel(level);
+				delete benchStereo;
+
+				int accepted, benchInliers;
+				float avgError;
+				evaluate(leftCorners, benchCorners, benchStatus, disp, accepted, benchInliers, avgError);
+				UINFO("%s: %f ms, accepted=%d/%d inliers=%d (avg error=%f)",
+						names[approach],
+						benchTime*1000.0,
+						accepted,
+						(int)leftCorners.size(),
+						benchInliers,
+						avgError);
+			}
+		}
+
 
 		cv::namedWindow( "Right", cv::WINDOW_AUTOSIZE );
 		cv::imshow( "Right", right );
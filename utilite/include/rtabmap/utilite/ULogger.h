@@ -325,6 +325,54 @@ public:
     static void setBuffered(bool buffered);
     static bool isBuffered() {return buffered_;}
 
+    /**
+     * Overflow policies of the asynchronous logger:
+     * @code
+     * kOverflowDrop, kOverflowBlock
+     * @endcode
+     * @see setAsyncOverflowPolicy()
+     */
+    enum OverflowPolicy{kOverflowDrop, kOverflowBlock};
+
+    /**
+     * Set if messages are written asynchronously, default false. When true, the calling
+     * thread only formats the message (printf-like) in its own lock-free buffer.
+     * The time, level and location prefixes are added and the message is
+     * written to console/file by a background thread. Fatal messages and messages
+     * sent as ULogEvent (see setEventLevel()) are still written synchronously.
+     * @param asynchronous true to write messages in a background thread.
+     * @see setAsyncBufferSize(), setAsyncOverflowPolicy(), setAsyncRateLimit()
+     */
+    static void setAsynchronous(bool asynchronous);
+    static bool isAsynchronous() {return asynchronous_;}
+
+    /**
+     * Maximum messages buffered per thread in asynchronous mode: default 1024.
+     * The size is rounded up to a power of two.
+     * Only threads logging their first message after this call are affected.
+     * @param size the number of messages.
+     */
+    static void setAsyncBufferSize(int size);
+    static int asyncBufferSize() {return asyncBufferSize_;}
+
+    /**
+     * What to do when the buffer of a thread is full in asynchronous mode: default kOverflowDrop.
+     * Dropped messages are counted and reported by the writer thread. With
+     * kOverflowBlock, the calling thread waits for the writer thread.
+     * @param policy the overflow policy.
+     */
+    static void setAsyncOverflowPolicy(OverflowPolicy policy) {asyncOverflowPolicy_ = policy;}
+    static OverflowPolicy asyncOverflowPolicy() {return asyncOverflowPolicy_;}
+
+    /**
+     * In asynchronous mode, a message logged again from the same line of code within
+     * this period is skipped. The number of skipped messages is added to the next
+     * message written from that line. Default 0 ms (disabled).
+     * @param ms the minimum period between two messages of the same line of code.
+     */
+    static void setAsyncRateLimit(int ms) {asyncRateLimit_ = ms;}
+    static int asyncRateLimit() {return asyncRateLimit_;}
+
     /**
      * Set logger level: default kInfo. All messages over the severity set
      * are printed, other are ignored. The severity is from the lowest to
@@ -436,6 +484,36 @@ protected:
 	 */
 	void _flush();
 
+    /*
+     * Add the level, thread ID and location prefixes.
+     */
+    static void formatPrefix(ULogger::Level level,
+    		const char * file,
+    		int line,
+    		const char * function,
+    		unsigned long threadId,
+    		std::string & levelStr,
+    		std::string & pidStr,
+    		std::string & whereStr);
+
+    /*
+     * Write an already formatted message to the logger, with
+     * color if enabled. Must be called with loggerMutex_ locked.
+     */
+    static void writeFormatted(ULogger::Level level,
+    		const std::string & levelStr,
+    		const std::string & pidStr,
+    		const std::string & time,
+    		const std::string & whereStr,
+    		const std::string & msg);
+
+    /*
+     * Format the time (seconds and microseconds since epoch)
+     * in the format "2008-7-13 12:23:44.123". Set usec<0 to
+     * not show milliseconds.
+     */
+    static int formatTime(std::string &timeStr, long long sec, long usec);
+
     /*
      * A Destroyer is used to remove a dynamicaly created 
      * Singleton. It is friend here to have access to the 
@@ -444,6 +522,11 @@ protected:
      * @see Destroyer
      */
     friend class UDestroyer<ULogger>;
+
+    /*
+     * Background thread of the asynchronous mode.
+     */
+    friend class ULoggerAsyncWriter;
     
     /*
      * The log file name.
@@ -568,6 +651,14 @@ private:
 
 	static std::string bufferedMsgs_;
 
+	/*
+	 * Asynchronous mode, see setAsynchronous().
+	 */
+	static bool asynchronous_;
+	static int asyncBufferSize_;
+	static OverflowPolicy asyncOverflowPolicy_;
+	static int asyncRateLimit_;
+
 	static std::set<unsigned long> threadIdFilter_;
 	static std::map<std::string, unsigned long> registeredThreads_;
 };
@@ -0,0 +1,122 @@
+/*
+*  utilite is a cross-platform library with
+*  useful utilities for fast and small developing.
+*  Copyright (C) 2010  Mathieu Labbe
+*
+*  utilite is free library: you can redistribute it and/or modify
+*  it under the terms of the GNU Lesser General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  utilite is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UTRACE_H
+#define UTRACE_H
+
+#include "rtabmap/utilite/UtiLiteExp.h" // DLL export/import defines
+
+#include <string>
+#include <atomic>
+
+/**
+ * \file UTrace.h
+ * \brief UTrace class and UTRACE_SCOPE() macro
+ *
+ * Scoped spans are recorded only if the code is compiled with UTILITE_TRACING
+ * defined (CMake option WITH_TRACING), otherwise UTRACE_SCOPE() does nothing.
+ */
+#ifdef UTILITE_TRACING
+#define UTRACE_CONCAT_IMPL(a, b) a##b
+#define UTRACE_CONCAT(a, b) UTRACE_CONCAT_IMPL(a, b)
+#define UTRACE_SCOPE(name) UTraceScope UTRACE_CONCAT(uTraceScope, __LINE__)(name)
+#else
+#define UTRACE_SCOPE(name)
+#endif
+
+/**
+ * \def UTRACE_SCOPE(name)
+ * Record a span from this line to the end of the current scope. The name
+ * must be a string literal (only the pointer is kept):
+ * @code
+ * void Memory::update()
+ * {
+ *    UTRACE_SCOPE("Memory::update");
+ *    ...
+ * }
+ * @endcode
+ */
+
+/**
+ * Records spans of time per thread and exports them in the Chrome
+ * trace event format (JSON), which can be opened in chrome://tracing
+ * or https://ui.perfetto.dev. Each thread records in its own buffer,
+ * so threads don't wait on each other. Thread names registered with
+ * ULogger::registerCurrentThread() are used in the exported trace.
+ *
+ * Example:
+ * @code
+ * UTrace::setEnabled(true);
+ * ... // code with UTRACE_SCOPE()
+ * UTrace::exportChromeTrace("trace.json");
+ * @endcode
+ */
+class UTILITE_EXP UTrace
+{
+public:
+	/**
+	 * Start or stop recording spans, default false.
+	 */
+	static void setEnabled(bool enabled);
+	static bool isEnabled() {return enabled_.load(std::memory_order_relaxed);}
+
+	/**
+	 * Maximum spans kept per thread, default 1000000. When reached,
+	 * new spans are ignored.
+	 */
+	static void setMaxSpansPerThread(int max);
+
+	/**
+	 * Add a span, normally called by UTRACE_SCOPE().
+	 * @param name a string literal
+	 * @param start start time in seconds (see UTimer::now())
+	 * @param end end time in seconds (see UTimer::now())
+	 */
+	static void addSpan(const char * name, double start, double end);
+
+	/**
+	 * Remove all recorded spans.
+	 */
+	static void clear();
+
+	/**
+	 * Export recorded spans in Chrome trace event format.
+	 * @return false if the file cannot be written.
+	 */
+	static bool exportChromeTrace(const std::string & filePath);
+
+private:
+	static std::atomic<bool> enabled_;
+};
+
+/**
+ * Used by UTRACE_SCOPE(): records the span between
+ * its construction and its destruction.
+ */
+class UTILITE_EXP UTraceScope
+{
+public:
+	UTraceScope(const char * name);
+	~UTraceScope();
+private:
+	const char * name_;
+	double start_;
+};
+
+#endif // UTRACE_H
@@ -22,9 +22,13 @@
 #include "rtabmap/utilite/UFile.h"
 #include "rtabmap/utilite/UStl.h"
 #include "rtabmap/utilite/UEventsManager.h"
+#include "rtabmap/utilite/UThread.h"
+#include "rtabmap/utilite/USemaphore.h"
 #include <fstream>
 #include <string>
 #include <string.h>
+#include <list>
+#include <atomic>
 
 #ifndef _WIN32
 #include <sys/time.h>
@@ -65,6 +69,10 @@ std::string ULogger::logFileName_;
 std::string ULogger::bufferedMsgs_;
 std::set<unsigned long> ULogger::threadIdFilter_;
 std::map<std::string, unsigned long> ULogger::registeredThreads_;
+bool ULogger::asynchronous_ = false;
+int ULogger::asyncBufferSize_ = 1024;
+ULogger::OverflowPolicy ULogger::asyncOverflowPolicy_ = ULogger::kOverflowDrop;
+int ULogger::asyncRateLimit_ = 0;
 
 /**
  * This class is used to write logs in the console. This class cannot
@@ -173,6 +181,353 @@ private:
     std::string bufferedMsgs_;
 };
 
+/**
+ * Asynchronous logging (see ULogger::setAsynchronous()).
+ *
+ * Each thread logs in its own single-producer/single-consumer ring
+ * buffer, so the calling thread never waits on loggerMutex_: it only
+ * formats the user message. The ULoggerAsyncWriter thread is the only
+ * consumer, it adds the prefixes and writes the messages.
+ */
+#define ULOGGER_ASYNC_MSG_SIZE 256
+#define ULOGGER_ASYNC_RATE_SLOTS 64
+
+struct ULogEntry
+{
+	ULogEntry() :
+		level(ULogger::kInfo),
+		file(0),
+		line(0),
+		function(0),
+		threadId(0),
+		sec(0),
+		usec(0),
+		suppressed(0)
+	{
+		msg[0] = 0;
+	}
+	ULogger::Level level;
+	const char * file;
+	int line;
+	const char * function;
+	unsigned long threadId;
+	long long sec;
+	long usec;
+	int suppressed;
+	std::string longMsg; // used only if the message doesn't fit in msg
+	char msg[ULOGGER_ASYNC_MSG_SIZE];
+};
+
+class ULogRing
+{
+public:
+	ULogRing(int size) :
+		entries_(capacity(size)),
+		mask_((unsigned int)entries_.size()-1),
+		head_(0),
+		tail_(0),
+		dropped_(0),
+		orphan_(false)
+	{
+		memset(rateSlots_, 0, sizeof(rateSlots_));
+	}
+
+	// Producer
+	ULogEntry * reserve()
+	{
+		unsigned int head = head_.load(std::memory_order_relaxed);
+		if(head - tail_.load(std::memory_order_acquire) >= entries_.size())
+		{
+			return 0;
+		}
+		return &entries_[head & mask_];
+	}
+	void commit()
+	{
+		head_.store(head_.load(std::memory_order_relaxed)+1, std::memory_order_release);
+	}
+
+	// Consumer
+	ULogEntry * front()
+	{
+		unsigned int tail = tail_.load(std::memory_order_relaxed);
+		if(tail == head_.load(std::memory_order_acquire))
+		{
+			return 0;
+		}
+		return &entries_[tail & mask_];
+	}
+	void pop()
+	{
+		tail_.store(tail_.load(std::memory_order_relaxed)+1, std::memory_order_release);
+	}
+
+	// Counters wrap around, the capacity is a power of two
+	// so that the masked indexes stay contiguous on wrap.
+	static size_t capacity(int size)
+	{
+		size_t c = 1;
+		while(c < (size_t)size)
+		{
+			c <<= 1;
+		}
+		return c;
+	}
+
+	struct RateSlot
+	{
+		const char * file;
+		int line;
+		long long lastMs;
+		int suppressed;
+	};
+
+	std::vector<ULogEntry> entries_;
+	unsigned int mask_;
+	std::atomic<unsigned int> head_;
+	std::atomic<unsigned int> tail_;
+	std::atomic<unsigned int> dropped_;
+	std::atomic<bool> orphan_;
+	RateSlot rateSlots_[ULOGGER_ASYNC_RATE_SLOTS]; // producer only
+};
+
+// Rings of all threads, the ring of a thread that exited is deleted by the writer once empty
+static std::list<ULogRing*> g_asyncRings;
+static UMutex g_asyncRingsMutex;
+// Only one consumer at the same time (writer thread or flush())
+static UMutex g_asyncConsumerMutex;
+// The writer waits on g_asyncWake when all rings are empty, producers
+// release it only if g_asyncWriterWaiting is set.
+static USemaphore g_asyncWake;
+static std::atomic<bool> g_asyncWriterWaiting(false);
+
+struct ULogRingHolder
+{
+	ULogRingHolder() : ring(0) {}
+	~ULogRingHolder()
+	{
+		if(ring)
+		{
+			ring->orphan_ = true;
+		}
+	}
+	ULogRing * ring;
+};
+static thread_local ULogRingHolder t_asyncRing;
+
+static void captureTime(long long & sec, long & usec)
+{
+#ifdef _WIN32
+	time_t rawtime;
+	time(&rawtime);
+	sec = rawtime;
+	usec = -1;
+#else
+	struct timeval rawtime;
+	gettimeofday(&rawtime, NULL);
+	sec = rawtime.tv_sec;
+	usec = rawtime.tv_usec;
+#endif
+}
+
+class ULoggerAsyncWriter : public UThread
+{
+public:
+	ULoggerAsyncWriter() {}
+	virtual ~ULoggerAsyncWriter()
+	{
+		// Messages logged from now are written synchronously,
+		// the ones still buffered are written after the thread is joined
+		// (e.g., at exit when the destroyer deletes the writer).
+		ULogger::asynchronous_ = false;
+		this->join(true);
+		drain();
+	}
+
+	// Add a message in the buffer of the calling thread.
+	// Return false if the message should be written synchronously.
+	static bool push(ULogger::Level level,
+			const char * file,
+			int line,
+			const char * function,
+			const char * msg,
+			va_list args)
+	{
+		ULogRing * ring = t_asyncRing.ring;
+		if(ring == 0)
+		{
+			ring = new ULogRing(ULogger::asyncBufferSize_);
+			g_asyncRingsMutex.lock();
+			g_asyncRings.push_back(ring);
+			g_asyncRingsMutex.unlock();
+			t_asyncRing.ring = ring;
+		}
+
+		long long sec;
+		long usec;
+		captureTime(sec, usec);
+
+		int suppressed = 0;
+		if(ULogger::asyncRateLimit_ > 0)
+		{
+			long long ms = sec*1000 + (usec>0?usec/1000:0);
+			ULogRing::RateSlot & slot = ring->rateSlots_[((size_t)file/sizeof(void*) + line) % ULOGGER_ASYNC_RATE_SLOTS];
+			if(slot.file == file && slot.line == line)
+			{
+				if(ms - slot.lastMs < ULogger::asyncRateLimit_)
+				{
+					++slot.suppressed;
+					return true;
+				}
+				suppressed = slot.suppressed;
+			}
+			slot.file = file;
+			slot.line = line;
+			slot.lastMs = ms;
+			slot.suppressed = 0;
+		}
+
+		ULogEntry * entry = ring->reserve();
+		while(entry == 0)
+		{
+			if(ULogger::asyncOverflowPolicy_ == ULogger::kOverflowDrop)
+			{
+				++ring->dropped_;
+				return true;
+			}
+			if(!ULogger::asynchronous_)
+			{
+				return false;
+			}
+			uSleep(1);
+			entry = ring->reserve();
+		}
+
+		entry->level = level;
+		entry->file = file;
+		entry->line = line;
+		entry->function = function;
+		entry->threadId = UThread::currentThreadId();
+		entry->sec = sec;
+		entry->usec = usec;
+		entry->suppressed = suppressed;
+		va_list argsCopy;
+		va_copy(argsCopy, args);
+		int size = vsnprintf(entry->msg, ULOGGER_ASYNC_MSG_SIZE, msg, args);
+		if(size >= ULOGGER_ASYNC_MSG_SIZE)
+		{
+			entry->longMsg = uFormatv(msg, argsCopy);
+		}
+		else if(!entry->longMsg.empty())
+		{
+			entry->longMsg.clear();
+		}
+		va_end(argsCopy);
+		ring->commit();
+
+		// pairs with the fence of the writer before it waits
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(g_asyncWriterWaiting.load(std::memory_order_relaxed) && g_asyncWriterWaiting.exchange(false))
+		{
+			g_asyncWake.release();
+		}
+		return true;
+	}
+
+	// Write all buffered messages, return the number of messages written.
+	static int drain()
+	{
+		g_asyncConsumerMutex.lock();
+		g_asyncRingsMutex.lock();
+		std::list<ULogRing*> rings = g_asyncRings;
+		g_asyncRingsMutex.unlock();
+
+		int count = 0;
+		ULogger::loggerMutex_.lock();
+		for(std::list<ULogRing*>::iterator iter=rings.begin(); iter!=rings.end(); ++iter)
+		{
+			ULogRing * ring = *iter;
+			bool orphan = ring->orphan_;
+			ULogEntry * entry;
+			while((entry = ring->front()) != 0)
+			{
+				write(*entry);
+				ring->pop();
+				++count;
+			}
+			unsigned int dropped = ring->dropped_.exchange(0);
+			if(dropped && ULogger::instance_)
+			{
+				std::string levelStr, pidStr, whereStr, time;
+				ULogger::formatPrefix(ULogger::kWarning, __FILE__, __LINE__, __FUNCTION__, 0, levelStr, pidStr, whereStr);
+				ULogger::writeFormatted(ULogger::kWarning, levelStr, pidStr, time, whereStr,
+						uFormat("%u messages dropped, the asynchronous buffer was full (see ULogger::setAsyncBufferSize()).", dropped));
+			}
+			if(orphan)
+			{
+				// the thread has exited, nothing will be added anymore
+				g_asyncRingsMutex.lock();
+				g_asyncRings.remove(ring);
+				g_asyncRingsMutex.unlock();
+				delete ring;
+			}
+		}
+		ULogger::loggerMutex_.unlock();
+		g_asyncConsumerMutex.unlock();
+		return count;
+	}
+
+private:
+	static void write(const ULogEntry & entry)
+	{
+		if(!ULogger::instance_ ||
+			(ULogger::threadIdFilter_.size() &&
+			ULogger::threadIdFilter_.find(entry.threadId) == ULogger::threadIdFilter_.end()))
+		{
+			return;
+		}
+		std::string time = "";
+		if(ULogger::printTime_)
+		{
+			time.append("(");
+			ULogger::formatTime(time, entry.sec, entry.usec);
+			time.append(") ");
+		}
+		std::string levelStr, pidStr, whereStr;
+		ULogger::formatPrefix(entry.level, entry.file, entry.line, entry.function, entry.threadId, levelStr, pidStr, whereStr);
+		std::string msg = entry.longMsg.empty()?std::string(entry.msg):entry.longMsg;
+		if(entry.suppressed)
+		{
+			msg.append(uFormat(" (%d similar messages skipped)", entry.suppressed));
+		}
+		ULogger::writeFormatted(entry.level, levelStr, pidStr, time, whereStr, msg);
+	}
+
+protected:
+	virtual void mainLoopKill()
+	{
+		g_asyncWriterWaiting = false;
+		g_asyncWake.release();
+	}
+	virtual void mainLoop()
+	{
+		if(drain() == 0)
+		{
+			g_asyncWriterWaiting = true;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			// a message may have been committed before the flag was set
+			if(drain() == 0 && !this->isKilled())
+			{
+				g_asyncWake.acquire();
+			}
+			g_asyncWriterWaiting = false;
+		}
+	}
+};
+
+static ULoggerAsyncWriter * g_asyncWriter = 0;
+static UDestroyer<ULoggerAsyncWriter> g_asyncWriterDestroyer;
+
 void ULogger::setType(Type type, const std::string &fileName, bool append)
 {
 	ULogger::flush();
@@ -278,8 +633,41 @@ void ULogger::setBuffered(bool buffered)
 }
 
 
+void ULogger::setAsynchronous(bool asynchronous)
+{
+	loggerMutex_.lock();
+	if(asynchronous && !g_asyncWriter)
+	{
+		g_asyncWriter = new ULoggerAsyncWriter();
+		g_asyncWriterDestroyer.setDoomed(g_asyncWriter);
+		asynchronous_ = true;
+		g_asyncWriter->start();
+	}
+	else if(!asynchronous && g_asyncWriter)
+	{
+		asynchronous_ = false;
+		ULoggerAsyncWriter * writer = g_asyncWriter;
+		g_asyncWriter = 0;
+		g_asyncWriterDestroyer.setDoomed(0);
+		loggerMutex_.unlock();
+		delete writer; // joined and drained
+		return;
+	}
+	loggerMutex_.unlock();
+}
+
+void ULogger::setAsyncBufferSize(int size)
+{
+	UASSERT(size > 0);
+	asyncBufferSize_ = size;
+}
+
 void ULogger::flush()
 {
+	if(asynchronous_)
+	{
+		ULoggerAsyncWriter::drain();
+	}
 	loggerMutex_.lock();
 	if(!instance_ || bufferedMsgs_.size()==0)
 	{
@@ -364,6 +752,27 @@ void ULogger::write(ULogger::Level level,
 		const char* msg,
 		...)
 {
+	if(asynchronous_ && level < kFatal && level < eventLevel_)
+	{
+		if(type_ == kTypeNoLog || level < level_ || (strlen(msg) == 0 && !printWhere_))
+		{
+			return;
+		}
+		va_list args;
+		va_start(args, msg);
+		bool added = ULoggerAsyncWriter::push(level, file, line, function, msg, args);
+		va_end(args);
+		if(added)
+		{
+			return;
+		}
+	}
+	else if(asynchronous_ && level >= kFatal)
+	{
+		// keep messages in order before exiting
+		ULoggerAsyncWriter::drain();
+	}
+
 	loggerMutex_.lock();
 	if(type_ == kTypeNoLog && level < kFatal && level < eventLevel_)
 	{
@@ -386,35 +795,6 @@ void ULogger::write(ULogger::Level level,
 
     if(level >= level_ || level >= eventLevel_)
     {
-#ifdef _WIN32
-    	int color = 0;
-#else
-    	const char* color = NULL;
-#endif
-    	switch(level)
-    	{
-    	case kDebug:
-    		color = COLOR_GREEN;
-    		break;
-    	case kInfo:
-    		color = COLOR_NORMAL;
-    		break;
-    	case kWarning:
-    		color = COLOR_YELLOW;
-    		break;
-    	case kError:
-    	case kFatal:
-    		color = COLOR_RED;
-    		break;
-    	default:
-    		break;
-    	}
-
-		std::string endline = "";
-		if(printEndline_) {
-			endline = "\r\n";
-		}
-
 		std::string time = "";
 		if(printTime_ || level == kFatal)
 		{
@@ -423,138 +803,23 @@ void ULogger::write(ULogger::Level level,
 			time.append(") ");
 		}
 
-		std::string levelStr = "";
-		if(printLevel_ || level == kFatal)
-		{
-			const int bufSize = 30;
-			char buf[bufSize] = {0};
-
-#ifdef _MSC_VER
-			sprintf_s(buf, bufSize, "[%s]", levelName_[level]);
-#else
-			snprintf(buf, bufSize, "[%s]", levelName_[level]);
-#endif
-			levelStr = buf;
-			levelStr.append(" ");
-		}
-
-		std::string pidStr;
-		if(printThreadID_)
-		{
-			pidStr = uFormat("{%lu} ", UThread::currentThreadId());
-		}
-
-		std::string whereStr = "";
-		if(printWhere_ || level == kFatal)
-		{
-			whereStr.append("");
-			//File
-			if(printWhereFullPath_)
-			{
-				whereStr.append(file);
-			}
-			else
-			{
-				std::string fileName = UFile::getName(file);
-				if(limitWhereLength_ && fileName.size() > 8)
-				{
-					fileName.erase(8);
-					fileName.append("~");
-				}
-				whereStr.append(fileName);
-			}
-
-			//Line
-			whereStr.append(":");
-			std::string lineStr = uNumber2Str(line);
-			whereStr.append(lineStr);
-
-			//Function
-			whereStr.append("::");
-			std::string funcStr = function;
-			if(!printWhereFullPath_ && limitWhereLength_ && funcStr.size() > 8)
-			{
-				funcStr.erase(8);
-				funcStr.append("~");
-			}
-			funcStr.append("()");
-			whereStr.append(funcStr);
-
-			whereStr.append(" ");
-		}
+		std::string levelStr, pidStr, whereStr;
+		formatPrefix(level, file, line, function, UThread::currentThreadId(), levelStr, pidStr, whereStr);
 
 		va_list args;
+		va_start(args, msg);
+		std::string msgStr = uFormatv(msg, args);
+		va_end(args);
 
 		if(type_ != kTypeNoLog)
 		{
-			va_start(args, msg);
-#ifdef _WIN32
-			HANDLE H = GetStdHandle(STD_OUTPUT_HANDLE);
-#endif
-			if(type_ == ULogger::kTypeConsole && printColored_)
-			{
-#ifdef _WIN32
-				SetConsoleTextAttribute(H,color);
-#else
-				if(buffered_)
-				{
-					bufferedMsgs_.append(color);
-				}
-				else
-				{
-					ULogger::getInstance()->_writeStr(color);
-				}
-#endif
-			}
-
-			if(buffered_)
-			{
-				bufferedMsgs_.append(levelStr.c_str());
-				bufferedMsgs_.append(pidStr.c_str());
-				bufferedMsgs_.append(time.c_str());
-				bufferedMsgs_.append(whereStr.c_str());
-				bufferedMsgs_.append(uFormatv(msg, args));
-			}
-			else
-			{
-				ULogger::getInstance()->_writeStr(levelStr.c_str());
-				ULogger::getInstance()->_writeStr(pidStr.c_str());
-				ULogger::getInstance()->_writeStr(time.c_str());
-				ULogger::getInstance()->_writeStr(whereStr.c_str());
-				ULogger::getInstance()->_write(msg, args);
-			}
-			if(type_ == ULogger::kTypeConsole && printColored_)
-			{
-#ifdef _WIN32
-				SetConsoleTextAttribute(H,COLOR_NORMAL);
-#else
-				if(buffered_)
-				{
-					bufferedMsgs_.append(COLOR_NORMAL);
-				}
-				else
-				{
-					ULogger::getInstance()->_writeStr(COLOR_NORMAL);
-				}
-#endif
-			}
-			if(buffered_)
-			{
-				bufferedMsgs_.append(endline.c_str());
-			}
-			else
-			{
-				ULogger::getInstance()->_writeStr(endline.c_str());
-			}
-			va_end (args);
+			writeFormatted(level, levelStr, pidStr, time, whereStr, msgStr);
 		}
 
 		if(level >= eventLevel_)
 		{
 			std::string fullMsg = uFormat("%s%s%s%s", levelStr.c_str(), pidStr.c_str(), time.c_str(), whereStr.c_str());
-			va_start(args, msg);
-			fullMsg.append(uFormatv(msg, args));
-			va_end(args);
+			fullMsg.append(msgStr);
 			if(level >= kFatal)
 			{
 				// Send it synchronously, then receivers
@@ -570,9 +835,7 @@ void ULogger::write(ULogger::Level level,
 		if(level >= kFatal)
 		{
 			std::string fullMsg = uFormat("%s%s%s%s", levelStr.c_str(), pidStr.c_str(), time.c_str(), whereStr.c_str());
-			va_start(args, msg);
-			fullMsg.append(uFormatv(msg, args));
-			va_end(args);
+			fullMsg.append(msgStr);
 
 			if(instance_)
 			{
@@ -590,47 +853,224 @@ void ULogger::write(ULogger::Level level,
     loggerMutex_.unlock();
 }
 
+void ULogger::formatPrefix(ULogger::Level level,
+		const char * file,
+		int line,
+		const char * function,
+		unsigned long threadId,
+		std::string & levelStr,
+		std::string & pidStr,
+		std::string & whereStr)
+{
+	levelStr = "";
+	if(printLevel_ || level == kFatal)
+	{
+		const int bufSize = 30;
+		char buf[bufSize] = {0};
+
+#ifdef _MSC_VER
+		sprintf_s(buf, bufSize, "[%s]", levelName_[level]);
+#else
+		snprintf(buf, bufSize, "[%s]", levelName_[level]);
+#endif
+		levelStr = buf;
+		levelStr.append(" ");
+	}
+
+	pidStr = "";
+	if(printThreadID_)
+	{
+		pidStr = uFormat("{%lu} ", threadId);
+	}
+
+	whereStr = "";
+	if(printWhere_ || level == kFatal)
+	{
+		whereStr.append("");
+		//File
+		if(printWhereFullPath_)
+		{
+			whereStr.append(file);
+		}
+		else
+		{
+			std::string fileName = UFile::getName(file);
+			if(limitWhereLength_ && fileName.size() > 8)
+			{
+				fileName.erase(8);
+				fileName.append("~");
+			}
+			whereStr.append(fileName);
+		}
+
+		//Line
+		whereStr.append(":");
+		std::string lineStr = uNumber2Str(line);
+		whereStr.append(lineStr);
+
+		//Function
+		whereStr.append("::");
+		std::string funcStr = function;
+		if(!printWhereFullPath_ && limitWhereLength_ && funcStr.size() > 8)
+		{
+			funcStr.erase(8);
+			funcStr.append("~");
+		}
+		funcStr.append("()");
+		whereStr.append(funcStr);
+
+		whereStr.append(" ");
+	}
+}
+
+void ULogger::writeFormatted(ULogger::Level level,
+		const std::string & levelStr,
+		const std::string & pidStr,
+		const std::string & time,
+		const std::string & whereStr,
+		const std::string & msg)
+{
+#ifdef _WIN32
+	int color = 0;
+#else
+	const char* color = NULL;
+#endif
+	switch(level)
+	{
+	case kDebug:
+		color = COLOR_GREEN;
+		break;
+	case kInfo:
+		color = COLOR_NORMAL;
+		break;
+	case kWarning:
+		color = COLOR_YELLOW;
+		break;
+	case kError:
+	case kFatal:
+		color = COLOR_RED;
+		break;
+	default:
+		break;
+	}
+
+	std::string endline = "";
+	if(printEndline_) {
+		endline = "\r\n";
+	}
+
+#ifdef _WIN32
+	HANDLE H = GetStdHandle(STD_OUTPUT_HANDLE);
+#endif
+	if(type_ == ULogger::kTypeConsole && printColored_)
+	{
+#ifdef _WIN32
+		SetConsoleTextAttribute(H,color);
+#else
+		if(buffered_)
+		{
+			bufferedMsgs_.append(color);
+		}
+		else
+		{
+			ULogger::getInstance()->_writeStr(color);
+		}
+#endif
+	}
+
+	if(buffered_)
+	{
+		bufferedMsgs_.append(levelStr.c_str());
+		bufferedMsgs_.append(pidStr.c_str());
+		bufferedMsgs_.append(time.c_str());
+		bufferedMsgs_.append(whereStr.c_str());
+		bufferedMsgs_.append(msg);
+	}
+	else
+	{
+		ULogger::getInstance()->_writeStr(levelStr.c_str());
+		ULogger::getInstance()->_writeStr(pidStr.c_str());
+		ULogger::getInstance()->_writeStr(time.c_str());
+		ULogger::getInstance()->_writeStr(whereStr.c_str());
+		ULogger::getInstance()->_writeStr(msg.c_str());
+	}
+	if(type_ == ULogger::kTypeConsole && printColored_)
+	{
+#ifdef _WIN32
+		SetConsoleTextAttribute(H,COLOR_NORMAL);
+#else
+		if(buffered_)
+		{
+			bufferedMsgs_.append(COLOR_NORMAL);
+		}
+		else
+		{
+			ULogger::getInstance()->_writeStr(COLOR_NORMAL);
+		}
+#endif
+	}
+	if(buffered_)
+	{
+		bufferedMsgs_.append(endline.c_str());
+	}
+	else
+	{
+		ULogger::getInstance()->_writeStr(endline.c_str());
+	}
+}
+
 int ULogger::getTime(std::string &timeStr)
+{
+	long long sec;
+	long usec;
+	captureTime(sec, usec);
+	return formatTime(timeStr, sec, usec);
+}
+
+int ULogger::formatTime(std::string &timeStr, long long sec, long usec)
 {
     struct tm timeinfo;
     const int bufSize = 30;
     char buf[bufSize] = {0};
+    time_t rawtime = (time_t)sec;
 
 #if _MSC_VER
-    time_t rawtime;
-    time(&rawtime);
     localtime_s (&timeinfo, &rawtime );
-    int result = sprintf_s(buf, bufSize, "%d-%s%d-%s%d %s%d:%s%d:%s%d",
-        timeinfo.tm_year+1900,
-        (timeinfo.tm_mon+1) < 10 ? "0":"", timeinfo.tm_mon+1,
-        (timeinfo.tm_mday) < 10 ? "0":"", timeinfo.tm_mday,
-        (timeinfo.tm_hour) < 10 ? "0":"", timeinfo.tm_hour,
-        (timeinfo.tm_min) < 10 ? "0":"", timeinfo.tm_min,
-        (timeinfo.tm_sec) < 10 ? "0":"", timeinfo.tm_sec);
 #elif WIN32
-    time_t rawtime;
-    time(&rawtime);
     timeinfo = *localtime (&rawtime);
-    int result = snprintf(buf, bufSize, "%d-%s%d-%s%d %s%d:%s%d:%s%d",
-		timeinfo.tm_year+1900,
-		(timeinfo.tm_mon+1) < 10 ? "0":"", timeinfo.tm_mon+1,
-		(timeinfo.tm_mday) < 10 ? "0":"", timeinfo.tm_mday,
-		(timeinfo.tm_hour) < 10 ? "0":"", timeinfo.tm_hour,
-		(timeinfo.tm_min) < 10 ? "0":"", timeinfo.tm_min,
-		(timeinfo.tm_sec) < 10 ? "0":"", timeinfo.tm_sec);
- #else
-    struct timeval rawtime;
-    gettimeofday(&rawtime, NULL);
-    localtime_r (&rawtime.tv_sec, &timeinfo);
-	int result = snprintf(buf, bufSize, "%d-%s%d-%s%d %s%d:%s%d:%s%d.%s%d",
-		timeinfo.tm_year+1900,
-		(timeinfo.tm_mon+1) < 10 ? "0":"", timeinfo.tm_mon+1,
-		(timeinfo.tm_mday) < 10 ? "0":"", timeinfo.tm_mday,
-		(timeinfo.tm_hour) < 10 ? "0":"", timeinfo.tm_hour,
-		(timeinfo.tm_min) < 10 ? "0":"", timeinfo.tm_min,
-		(timeinfo.tm_sec) < 10 ? "0":"", timeinfo.tm_sec,
-	    (rawtime.tv_usec/1000) < 10 ? "00":(rawtime.tv_usec/1000) < 100?"0":"", int(rawtime.tv_usec/1000));
+#else
+    localtime_r (&rawtime, &timeinfo);
+#endif
+    int result;
+    if(usec < 0)
+    {
+#if _MSC_VER
+		result = sprintf_s(buf, bufSize, "%d-%s%d-%s%d %s%d:%s%d:%s%d",
+#else
+		result = snprintf(buf, bufSize, "%d-%s%d-%s%d %s%d:%s%d:%s%d",
 #endif
+			timeinfo.tm_year+1900,
+			(timeinfo.tm_mon+1) < 10 ? "0":"", timeinfo.tm_mon+1,
+			(timeinfo.tm_mday) < 10 ? "0":"", timeinfo.tm_mday,
+			(timeinfo.tm_hour) < 10 ? "0":"", timeinfo.tm_hour,
+			(timeinfo.tm_min) < 10 ? "0":"", timeinfo.tm_min,
+			(timeinfo.tm_sec) < 10 ? "0":"", timeinfo.tm_sec);
+    }
+    else
+    {
+#if _MSC_VER
+		result = sprintf_s(buf, bufSize, "%d-%s%d-%s%d %s%d:%s%d:%s%d.%s%d",
+#else
+		result = snprintf(buf, bufSize, "%d-%s%d-%s%d %s%d:%s%d:%s%d.%s%d",
+#endif
+			timeinfo.tm_year+1900,
+			(timeinfo.tm_mon+1) < 10 ? "0":"", timeinfo.tm_mon+1,
+			(timeinfo.tm_mday) < 10 ? "0":"", timeinfo.tm_mday,
+			(timeinfo.tm_hour) < 10 ? "0":"", timeinfo.tm_hour,
+			(timeinfo.tm_min) < 10 ? "0":"", timeinfo.tm_min,
+			(timeinfo.tm_sec) < 10 ? "0":"", timeinfo.tm_sec,
+			(usec/1000) < 10 ? "00":(usec/1000) < 100?"0":"", int(usec/1000));
+    }
     if(result)
     {
         timeStr.append(buf);
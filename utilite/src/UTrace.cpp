@@ -0,0 +1,202 @@
+/*
+*  utilite is a cross-platform library with
+*  useful utilities for fast and small developing.
+*  Copyright (C) 2010  Mathieu Labbe
+*
+*  utilite is free library: you can redistribute it and/or modify
+*  it under the terms of the GNU Lesser General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  utilite is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rtabmap/utilite/UTrace.h"
+#include "rtabmap/utilite/UTimer.h"
+#include "rtabmap/utilite/UThread.h"
+#include "rtabmap/utilite/UMutex.h"
+#include "rtabmap/utilite/ULogger.h"
+#include "rtabmap/utilite/UConversion.h"
+#include <stdio.h>
+#include <list>
+#include <vector>
+#include <map>
+
+std::atomic<bool> UTrace::enabled_(false);
+
+namespace {
+
+struct UTraceSpan
+{
+	const char * name;
+	double start;
+	double end;
+};
+
+// Spans of one thread. The mutex is only contended on export/clear.
+struct UTraceBuffer
+{
+	UTraceBuffer(unsigned long id) : threadId(id) {}
+	unsigned long threadId;
+	UMutex mutex;
+	std::vector<UTraceSpan> spans;
+};
+
+std::list<UTraceBuffer*> g_traceBuffers; // never deleted, threads may still reference them
+UMutex g_traceBuffersMutex;
+size_t g_traceMaxSpans = 1000000;
+double g_traceOrigin = 0.0;
+thread_local UTraceBuffer * t_traceBuffer = 0;
+
+// Escape a string to be written between quotes in JSON
+std::string jsonEscape(const std::string & str)
+{
+	std::string out;
+	out.reserve(str.size());
+	for(size_t i=0; i<str.size(); ++i)
+	{
+		char c = str[i];
+		if(c == '"' || c == '\\')
+		{
+			out.push_back('\\');
+			out.push_back(c);
+		}
+		else if((unsigned char)c < 0x20)
+		{
+			out.append(uFormat("\\u%04x", (int)c));
+		}
+		else
+		{
+			out.push_back(c);
+		}
+	}
+	return out;
+}
+
+}
+
+void UTrace::setEnabled(bool enabled)
+{
+	if(enabled && !enabled_.load() && g_traceOrigin == 0.0)
+	{
+		g_traceOrigin = UTimer::now();
+	}
+	enabled_ = enabled;
+}
+
+void UTrace::setMaxSpansPerThread(int max)
+{
+	UASSERT(max > 0);
+	g_traceMaxSpans = max;
+}
+
+void UTrace::addSpan(const char * name, double start, double end)
+{
+	if(!enabled_)
+	{
+		return;
+	}
+	if(t_traceBuffer == 0)
+	{
+		t_traceBuffer = new UTraceBuffer(UThread::currentThreadId());
+		g_traceBuffersMutex.lock();
+		g_traceBuffers.push_back(t_traceBuffer);
+		g_traceBuffersMutex.unlock();
+	}
+	t_traceBuffer->mutex.lock();
+	if(t_traceBuffer->spans.size() < g_traceMaxSpans)
+	{
+		UTraceSpan span = {name, start, end};
+		t_traceBuffer->spans.push_back(span);
+	}
+	t_traceBuffer->mutex.unlock();
+}
+
+void UTrace::clear()
+{
+	g_traceBuffersMutex.lock();
+	for(std::list<UTraceBuffer*>::iterator iter=g_traceBuffers.begin(); iter!=g_traceBuffers.end(); ++iter)
+	{
+		(*iter)->mutex.lock();
+		(*iter)->spans.clear();
+		(*iter)->mutex.unlock();
+	}
+	g_traceOrigin = UTimer::now();
+	g_traceBuffersMutex.unlock();
+}
+
+bool UTrace::exportChromeTrace(const std::string & filePath)
+{
+	FILE * file = 0;
+#ifdef _MSC_VER
+	fopen_s(&file, filePath.c_str(), "w");
+#else
+	file = fopen(filePath.c_str(), "w");
+#endif
+	if(!file)
+	{
+		UERROR("Cannot open file \"%s\"", filePath.c_str());
+		return false;
+	}
+
+	std::map<unsigned long, std::string> threadNames;
+	std::map<std::string, unsigned long> registeredThreads = ULogger::getRegisteredThreads();
+	for(std::map<std::string, unsigned long>::iterator iter=registeredThreads.begin(); iter!=registeredThreads.end(); ++iter)
+	{
+		threadNames.insert(std::make_pair(iter->second, iter->first));
+	}
+
+	// Chrome trace wants small thread ids
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	int tid = 0;
+	int spans = 0;
+	g_traceBuffersMutex.lock();
+	for(std::list<UTraceBuffer*>::iterator iter=g_traceBuffers.begin(); iter!=g_traceBuffers.end(); ++iter, ++tid)
+	{
+		UTraceBuffer * buffer = *iter;
+		std::map<unsigned long, std::string>::iterator nameIter = threadNames.find(buffer->threadId);
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				first?"":",\n",
+				tid,
+				jsonEscape(nameIter!=threadNames.end()?nameIter->second:uFormat("Thread %lu", buffer->threadId)).c_str());
+		first = false;
+		buffer->mutex.lock();
+		for(size_t i=0; i<buffer->spans.size(); ++i)
+		{
+			const UTraceSpan & span = buffer->spans[i];
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					jsonEscape(span.name).c_str(),
+					tid,
+					(span.start - g_traceOrigin)*1000000.0,
+					(span.end - span.start)*1000000.0);
+		}
+		spans += (int)buffer->spans.size();
+		buffer->mutex.unlock();
+	}
+	g_traceBuffersMutex.unlock();
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(file);
+	UINFO("Exported %d spans of %d threads to \"%s\"", spans, tid, filePath.c_str());
+	return true;
+}
+
+UTraceScope::UTraceScope(const char * name) :
+	name_(name),
+	start_(UTrace::isEnabled()?UTimer::now():0.0)
+{
+}
+
+UTraceScope::~UTraceScope()
+{
+	if(start_ > 0.0)
+	{
+		UTrace::addSpan(name_, start_, UTimer::now());
+	}
+}